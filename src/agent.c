@@ -0,0 +1,990 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Communication with the agent running inside the VM.
+ *
+ * Each VM has a virtio-vsock device, so the runtime can connect to the
+ * agent directly without any network configuration. A connection
+ * carries a single command: the runtime sends a request on the
+ * control stream, then the standard streams of the command are
+ * multiplexed over the connection as frames (see
+ * \ref CLR_OCI_AGENT_HEADER_SIZE) until the agent replies with the
+ * exit status of the command.
+ *
+ * The request is a JSON object:
+ *
+ *     {"args": [...], "env": [...], "cwd": "...", "terminal": false}
+ *
+ * and the reply is either {"exit-code": n} or {"error": "..."}.
+ *
+ * If the command has a terminal, the local terminal is put in raw
+ * mode for the duration of the command and its window size is sent
+ * (and sent again whenever it changes) on
+ * \ref CLR_OCI_AGENT_STREAM_RESIZE.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <linux/vhost.h>
+#include <linux/vm_sockets.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <json-glib/json-glib.h>
+
+#include "common.h"
+#include "oci.h"
+#include "util.h"
+#include "agent.h"
+
+/*! State of a command being run by the agent. */
+struct clr_oci_agent_session {
+	/** Connection to the agent. */
+	int          fd;
+
+	/** Data received from the agent not yet parsed. */
+	GByteArray  *buf;
+
+	GMainLoop   *loop;
+
+	/** Source watching standard input (\c 0 once closed). */
+	guint        stdin_source;
+
+	/** Source watching \ref fd (\c 0 once removed). */
+	guint        conn_source;
+
+	/** Frames waiting to be sent to the agent. Standard input is
+	 * not read while any are waiting.
+	 */
+	GByteArray  *out;
+
+	/** Source watching for \ref fd becoming writable while
+	 * \ref out is not empty.
+	 */
+	guint        out_source;
+
+	/** \c true once standard input has been closed. */
+	gboolean     stdin_closed;
+
+	/** Exit code of the command (\c -1 until known). */
+	gint         exit_code;
+
+	/** \c true if the connection failed. */
+	gboolean     failed;
+
+	/** \c true if \ref tty holds the settings of the local
+	 * terminal to restore.
+	 */
+	gboolean     tty_saved;
+
+	/** Settings of the local terminal before it was made raw. */
+	struct termios tty;
+
+	/** Signal mask to restore once \ref winch_fd is closed. */
+	sigset_t     sigmask;
+
+	/** signalfd reporting changes to the window size of the local
+	 * terminal (\c -1 if not used).
+	 */
+	int          winch_fd;
+
+	/** Source watching \ref winch_fd (\c 0 once removed). */
+	guint        winch_source;
+};
+
+/*!
+ * Choose a vsock context ID for a new VM.
+ *
+ * Context IDs must be unique on the host, so a random one is used
+ * (with 2^31 possibilities, a clash is very unlikely, and
+ * clr_oci_vsock_open() tries another if one occurs).
+ *
+ * \return Context ID.
+ */
+guint32
+clr_oci_vsock_cid_new (void)
+{
+	return (guint32)g_random_int_range (CLR_OCI_VSOCK_CID_MIN,
+			G_MAXINT32);
+}
+
+/*!
+ * Open the vhost-vsock device for a new VM, reserving a context ID.
+ *
+ * The device is passed to the hypervisor, so the context ID remains
+ * reserved until the VM exits. If the context ID is already in use,
+ * another is tried.
+ *
+ * \param[out] cid Context ID of the VM (\c 0 on failure).
+ *
+ * \return File descriptor on success, or \c -1 if the host does not
+ *   support vsock or no context ID could be reserved.
+ */
+int
+clr_oci_vsock_open (guint32 *cid)
+{
+	guint64  guest_cid;
+	int      fd;
+	int      i;
+
+	if (! cid) {
+		return -1;
+	}
+
+	*cid = 0;
+
+	fd = open (CLR_OCI_VHOST_VSOCK_DEVICE, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		g_debug ("cannot open %s: %s",
+				CLR_OCI_VHOST_VSOCK_DEVICE, strerror (errno));
+		return -1;
+	}
+
+	for (i = 0; i < CLR_OCI_VSOCK_CID_RETRIES; i++) {
+		guest_cid = clr_oci_vsock_cid_new ();
+
+		if (! ioctl (fd, VHOST_VSOCK_SET_GUEST_CID, &guest_cid)) {
+			*cid = (guint32)guest_cid;
+			return fd;
+		}
+
+		if (errno != EADDRINUSE) {
+			break;
+		}
+
+		g_debug ("vsock context ID %u in use",
+				(unsigned)guest_cid);
+	}
+
+	g_warning ("failed to reserve a vsock context ID: %s",
+			strerror (errno));
+
+	close (fd);
+
+	return -1;
+}
+
+/*!
+ * Write all of \p data to \p fd.
+ *
+ * \param fd File descriptor.
+ * \param data Data to write.
+ * \param len Length of \p data.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_agent_write_all (int fd, const guint8 *data, gsize len)
+{
+	ssize_t bytes;
+
+	while (len) {
+		bytes = write (fd, data, len);
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+
+		data += bytes;
+		len -= (gsize)bytes;
+	}
+
+	return true;
+}
+
+/*!
+ * Append an agent frame to a buffer.
+ *
+ * \param buf Buffer to append to.
+ * \param stream \ref clr_oci_agent_stream the frame belongs to.
+ * \param data Payload (may be \c NULL if \p len is \c 0).
+ * \param len Length of \p data (at most
+ *   \ref CLR_OCI_AGENT_MAX_PAYLOAD).
+ */
+private void
+clr_oci_agent_frame_append (GByteArray *buf, guint8 stream,
+		const guint8 *data, guint32 len)
+{
+	guint8 header[CLR_OCI_AGENT_HEADER_SIZE];
+
+	g_assert (buf);
+	g_assert (len <= CLR_OCI_AGENT_MAX_PAYLOAD);
+
+	header[0] = stream;
+	header[1] = (guint8)(len >> 24);
+	header[2] = (guint8)(len >> 16);
+	header[3] = (guint8)(len >> 8);
+	header[4] = (guint8)len;
+
+	g_byte_array_append (buf, header, sizeof (header));
+
+	if (len) {
+		g_byte_array_append (buf, data, len);
+	}
+}
+
+/*!
+ * Remove the first complete frame from a buffer.
+ *
+ * \param buf Buffer of received data.
+ * \param[out] stream \ref clr_oci_agent_stream of the frame.
+ * \param[out] payload Newly-allocated payload of the frame, or
+ *   \c NULL if \p buf does not yet contain a complete frame.
+ *
+ * \return \c true on success, or \c false if \p buf is invalid.
+ */
+private gboolean
+clr_oci_agent_frame_parse (GByteArray *buf, guint8 *stream,
+		GBytes **payload)
+{
+	guint32 len;
+
+	if (! (buf && stream && payload)) {
+		return false;
+	}
+
+	*payload = NULL;
+
+	if (buf->len < CLR_OCI_AGENT_HEADER_SIZE) {
+		return true;
+	}
+
+	len = (guint32)buf->data[1] << 24
+		| (guint32)buf->data[2] << 16
+		| (guint32)buf->data[3] << 8
+		| (guint32)buf->data[4];
+
+	if (len > CLR_OCI_AGENT_MAX_PAYLOAD) {
+		g_critical ("invalid agent frame length %u", len);
+		return false;
+	}
+
+	if (buf->len < CLR_OCI_AGENT_HEADER_SIZE + len) {
+		return true;
+	}
+
+	*stream = buf->data[0];
+	*payload = g_bytes_new (buf->data + CLR_OCI_AGENT_HEADER_SIZE, len);
+
+	g_byte_array_remove_range (buf, 0, CLR_OCI_AGENT_HEADER_SIZE + len);
+
+	return true;
+}
+
+/*!
+ * Create the request to run a command.
+ *
+ * \param config \ref clr_oci_config.
+ * \param argc Argument count.
+ * \param argv Argument vector.
+ * \param terminal If \c true, the command should be given a terminal.
+ *
+ * \return Newly-allocated JSON string on success, else \c NULL.
+ */
+private gchar *
+clr_oci_agent_request (const struct clr_oci_config *config,
+		int argc, char *const argv[], gboolean terminal)
+{
+	JsonObject  *request;
+	JsonArray   *args;
+	JsonArray   *env;
+	gchar      **e;
+	gchar       *str;
+	int          i;
+
+	if (! (config && argc > 0 && argv)) {
+		return NULL;
+	}
+
+	request = json_object_new ();
+
+	args = json_array_new ();
+	for (i = 0; i < argc; i++) {
+		json_array_add_string_element (args, argv[i]);
+	}
+	json_object_set_array_member (request, "args", args);
+
+	/* The command runs in the environment of the workload */
+	env = json_array_new ();
+	for (e = config->oci.process.env; e && *e; e++) {
+		json_array_add_string_element (env, *e);
+	}
+	json_object_set_array_member (request, "env", env);
+
+	json_object_set_string_member (request, "cwd",
+			config->oci.process.cwd[0]
+			? config->oci.process.cwd : "/");
+
+	json_object_set_boolean_member (request, "terminal", terminal);
+
+	str = clr_oci_json_obj_to_string (request, false, NULL);
+
+	json_object_unref (request);
+
+	return str;
+}
+
+/*!
+ * Handle a reply from the agent.
+ *
+ * \param session \ref clr_oci_agent_session.
+ * \param reply JSON reply.
+ * \param len Length of \p reply.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_agent_reply_handle (struct clr_oci_agent_session *session,
+		const gchar *reply, gsize len)
+{
+	JsonParser  *parser;
+	JsonNode    *root;
+	JsonObject  *obj;
+	GError      *error = NULL;
+	gboolean     ret = false;
+
+	parser = json_parser_new ();
+
+	if (! json_parser_load_from_data (parser, reply, (gssize)len,
+				&error)) {
+		g_critical ("invalid reply from agent: %s", error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	root = json_parser_get_root (parser);
+	if (! (root && JSON_NODE_HOLDS_OBJECT (root))) {
+		g_critical ("invalid reply from agent");
+		goto out;
+	}
+
+	obj = json_node_get_object (root);
+
+	if (json_object_has_member (obj, "error")) {
+		g_critical ("agent failed to run command: %s",
+				json_object_get_string_member (obj, "error"));
+		goto out;
+	}
+
+	if (! json_object_has_member (obj, "exit-code")) {
+		g_critical ("no exit code in reply from agent");
+		goto out;
+	}
+
+	session->exit_code = (gint)json_object_get_int_member (obj,
+			"exit-code");
+
+	ret = true;
+
+out:
+	g_object_unref (parser);
+
+	return ret;
+}
+
+static gboolean clr_oci_agent_out_ready (gint fd, GIOCondition cond,
+		struct clr_oci_agent_session *session);
+static gboolean clr_oci_agent_stdin_ready (gint fd, GIOCondition cond,
+		struct clr_oci_agent_session *session);
+
+/*!
+ * Send as much queued data to the agent as it will take without
+ * blocking.
+ *
+ * While data remains queued, standard input is not read and
+ * \ref clr_oci_agent_session.fd is watched for becoming writable;
+ * once the queue is empty, standard input is read again.
+ *
+ * \param session \ref clr_oci_agent_session.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_agent_flush (struct clr_oci_agent_session *session)
+{
+	ssize_t bytes;
+
+	while (session->out->len) {
+		bytes = write (session->fd, session->out->data,
+				session->out->len);
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno == EAGAIN) {
+				break;
+			}
+
+			g_critical ("failed to send data to agent: %s",
+					strerror (errno));
+			return false;
+		}
+
+		g_byte_array_remove_range (session->out, 0, (guint)bytes);
+	}
+
+	if (session->out->len) {
+		if (session->stdin_source) {
+			g_source_remove (session->stdin_source);
+			session->stdin_source = 0;
+		}
+
+		if (! session->out_source) {
+			session->out_source = g_unix_fd_add (session->fd,
+					G_IO_OUT | G_IO_HUP | G_IO_ERR,
+					(GUnixFDSourceFunc)clr_oci_agent_out_ready,
+					session);
+		}
+
+		return true;
+	}
+
+	if (session->out_source) {
+		g_source_remove (session->out_source);
+		session->out_source = 0;
+	}
+
+	if (! (session->stdin_source || session->stdin_closed)) {
+		session->stdin_source = g_unix_fd_add (STDIN_FILENO,
+				G_IO_IN | G_IO_HUP | G_IO_ERR,
+				(GUnixFDSourceFunc)clr_oci_agent_stdin_ready,
+				session);
+	}
+
+	return true;
+}
+
+/*!
+ * Queue a frame to be sent to the agent and send what can be sent
+ * now.
+ *
+ * \param session \ref clr_oci_agent_session.
+ * \param stream \ref clr_oci_agent_stream the frame belongs to.
+ * \param data Payload (may be \c NULL if \p len is \c 0).
+ * \param len Length of \p data.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_agent_send (struct clr_oci_agent_session *session,
+		guint8 stream, const guint8 *data, guint32 len)
+{
+	clr_oci_agent_frame_append (session->out, stream, data, len);
+
+	return clr_oci_agent_flush (session);
+}
+
+/*!
+ * Handle the connection to the agent becoming writable while data
+ * is queued for it.
+ *
+ * \param fd Connection to the agent.
+ * \param cond \c GIOCondition.
+ * \param session \ref clr_oci_agent_session.
+ *
+ * \return \c G_SOURCE_REMOVE (clr_oci_agent_flush() adds the source
+ *   again if data remains queued).
+ */
+static gboolean
+clr_oci_agent_out_ready (gint fd, GIOCondition cond,
+		struct clr_oci_agent_session *session)
+{
+	(void)fd;
+	(void)cond;
+
+	/* the source is removed by returning */
+	session->out_source = 0;
+
+	if (! clr_oci_agent_flush (session)) {
+		session->failed = true;
+		g_main_loop_quit (session->loop);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+/*!
+ * Forward standard input to the agent.
+ *
+ * \param fd Standard input.
+ * \param cond \c GIOCondition.
+ * \param session \ref clr_oci_agent_session.
+ *
+ * \return \c true while standard input should still be read, else
+ *   \c false.
+ */
+static gboolean
+clr_oci_agent_stdin_ready (gint fd, GIOCondition cond,
+		struct clr_oci_agent_session *session)
+{
+	guint8      data[CLR_OCI_AGENT_MAX_PAYLOAD];
+	ssize_t     bytes;
+
+	(void)cond;
+
+	bytes = read (fd, data, sizeof (data));
+	if (bytes < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return true;
+	}
+
+	/* An empty frame tells the agent standard input is closed */
+	if (bytes < 0) {
+		bytes = 0;
+	}
+
+	if (! bytes) {
+		session->stdin_closed = true;
+	}
+
+	/* The source is removed by returning, so the flush must not
+	 * remove it too.
+	 */
+	session->stdin_source = 0;
+
+	if (! clr_oci_agent_send (session, CLR_OCI_AGENT_STREAM_STDIN,
+				data, (guint32)bytes)) {
+		session->failed = true;
+		g_main_loop_quit (session->loop);
+		return false;
+	}
+
+	/* If everything was sent, the flush started reading again
+	 * using a new source.
+	 */
+	return false;
+}
+
+/*!
+ * Handle data from the agent.
+ *
+ * \param fd Connection to the agent.
+ * \param cond \c GIOCondition.
+ * \param session \ref clr_oci_agent_session.
+ *
+ * \return \c true until the command has finished, else \c false.
+ */
+static gboolean
+clr_oci_agent_conn_ready (gint fd, GIOCondition cond,
+		struct clr_oci_agent_session *session)
+{
+	guint8        data[CLR_OCI_AGENT_MAX_PAYLOAD];
+	GBytes       *payload = NULL;
+	gconstpointer bytes_data;
+	gsize         len;
+	guint8        stream = 0;
+	ssize_t       bytes;
+
+	(void)cond;
+
+	bytes = read (fd, data, sizeof (data));
+	if (bytes < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return true;
+	}
+
+	if (bytes <= 0) {
+		g_critical ("connection to agent closed unexpectedly");
+		goto fail;
+	}
+
+	g_byte_array_append (session->buf, data, (guint)bytes);
+
+	while (true) {
+		if (! clr_oci_agent_frame_parse (session->buf,
+					&stream, &payload)) {
+			goto fail;
+		}
+
+		if (! payload) {
+			break;
+		}
+
+		bytes_data = g_bytes_get_data (payload, &len);
+
+		switch (stream) {
+		case CLR_OCI_AGENT_STREAM_STDOUT:
+			(void)clr_oci_agent_write_all (STDOUT_FILENO,
+					bytes_data, len);
+			break;
+		case CLR_OCI_AGENT_STREAM_STDERR:
+			(void)clr_oci_agent_write_all (STDERR_FILENO,
+					bytes_data, len);
+			break;
+		case CLR_OCI_AGENT_STREAM_CONTROL:
+			if (! clr_oci_agent_reply_handle (session,
+						bytes_data, len)) {
+				goto fail;
+			}
+
+			g_bytes_unref (payload);
+			session->conn_source = 0;
+			g_main_loop_quit (session->loop);
+			return false;
+		default:
+			g_debug ("ignoring frame for unknown stream %u",
+					(unsigned)stream);
+			break;
+		}
+
+		g_bytes_unref (payload);
+		payload = NULL;
+	}
+
+	return true;
+
+fail:
+	if (payload) {
+		g_bytes_unref (payload);
+	}
+
+	session->failed = true;
+	session->conn_source = 0;
+	g_main_loop_quit (session->loop);
+
+	return false;
+}
+
+/*!
+ * Send the window size of the local terminal to the agent.
+ *
+ * \param session \ref clr_oci_agent_session.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_agent_winsize_send (struct clr_oci_agent_session *session)
+{
+	struct winsize  ws;
+	guint8          data[4];
+
+	if (ioctl (STDIN_FILENO, TIOCGWINSZ, &ws) < 0) {
+		/* the terminal has no size to forward */
+		return true;
+	}
+
+	data[0] = (guint8)(ws.ws_row >> 8);
+	data[1] = (guint8)ws.ws_row;
+	data[2] = (guint8)(ws.ws_col >> 8);
+	data[3] = (guint8)ws.ws_col;
+
+	return clr_oci_agent_send (session, CLR_OCI_AGENT_STREAM_RESIZE,
+			data, sizeof (data));
+}
+
+/*!
+ * Forward a change to the window size of the local terminal.
+ *
+ * \param fd signalfd reporting \c SIGWINCH.
+ * \param cond \c GIOCondition.
+ * \param session \ref clr_oci_agent_session.
+ *
+ * \return \c true until the connection fails, else \c false.
+ */
+static gboolean
+clr_oci_agent_winch_ready (gint fd, GIOCondition cond,
+		struct clr_oci_agent_session *session)
+{
+	struct signalfd_siginfo info;
+
+	(void)cond;
+
+	/* the size is read from the terminal, not the signal */
+	if (read (fd, &info, sizeof (info)) < 0 && errno != EAGAIN) {
+		g_debug ("failed to read signal: %s", strerror (errno));
+	}
+
+	if (! clr_oci_agent_winsize_send (session)) {
+		session->failed = true;
+		session->winch_source = 0;
+		g_main_loop_quit (session->loop);
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * Put the local terminal in raw mode, so that every key is sent to
+ * the command, and watch for changes to its window size.
+ *
+ * \param session \ref clr_oci_agent_session.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_agent_tty_setup (struct clr_oci_agent_session *session)
+{
+	struct termios  raw;
+	sigset_t        mask;
+
+	if (tcgetattr (STDIN_FILENO, &session->tty) < 0) {
+		g_critical ("failed to get terminal settings: %s",
+				strerror (errno));
+		return false;
+	}
+
+	raw = session->tty;
+	cfmakeraw (&raw);
+
+	if (tcsetattr (STDIN_FILENO, TCSANOW, &raw) < 0) {
+		g_critical ("failed to set terminal to raw mode: %s",
+				strerror (errno));
+		return false;
+	}
+
+	session->tty_saved = true;
+
+	/* SIGWINCH must be blocked to be read from a signalfd */
+	sigemptyset (&mask);
+	sigaddset (&mask, SIGWINCH);
+
+	if (sigprocmask (SIG_BLOCK, &mask, &session->sigmask) < 0) {
+		g_warning ("cannot forward window size changes: %s",
+				strerror (errno));
+		return true;
+	}
+
+	session->winch_fd = signalfd (-1, &mask,
+			SFD_NONBLOCK | SFD_CLOEXEC);
+	if (session->winch_fd < 0) {
+		g_warning ("cannot forward window size changes: %s",
+				strerror (errno));
+		(void)sigprocmask (SIG_SETMASK, &session->sigmask, NULL);
+		return true;
+	}
+
+	session->winch_source = g_unix_fd_add (session->winch_fd,
+			G_IO_IN,
+			(GUnixFDSourceFunc)clr_oci_agent_winch_ready,
+			session);
+
+	return true;
+}
+
+/*!
+ * Restore the local terminal changed by clr_oci_agent_tty_setup().
+ *
+ * \param session \ref clr_oci_agent_session.
+ */
+static void
+clr_oci_agent_tty_restore (struct clr_oci_agent_session *session)
+{
+	if (session->winch_source) {
+		g_source_remove (session->winch_source);
+		session->winch_source = 0;
+	}
+
+	if (session->winch_fd >= 0) {
+		close (session->winch_fd);
+		session->winch_fd = -1;
+		(void)sigprocmask (SIG_SETMASK, &session->sigmask, NULL);
+	}
+
+	if (session->tty_saved) {
+		(void)tcsetattr (STDIN_FILENO, TCSADRAIN, &session->tty);
+		session->tty_saved = false;
+	}
+}
+
+/*!
+ * Connect to the agent in a VM.
+ *
+ * \param cid vsock context ID of the VM.
+ *
+ * \return File descriptor on success, else \c -1.
+ */
+static int
+clr_oci_agent_connect (guint32 cid)
+{
+	struct sockaddr_vm  addr = { 0 };
+	int                 fd;
+
+	fd = socket (AF_VSOCK, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		g_critical ("failed to create vsock socket: %s",
+				strerror (errno));
+		return -1;
+	}
+
+	addr.svm_family = AF_VSOCK;
+	addr.svm_cid = cid;
+	addr.svm_port = CLR_OCI_AGENT_PORT;
+
+	if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+		g_critical ("failed to connect to agent "
+				"(cid %u, port %u): %s",
+				cid, CLR_OCI_AGENT_PORT, strerror (errno));
+		close (fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*!
+ * Run a command in a VM using its agent.
+ *
+ * Standard input is forwarded to the command, and its standard output
+ * and standard error are written to those of the runtime, until the
+ * command exits.
+ *
+ * \param config \ref clr_oci_config.
+ * \param cid vsock context ID of the VM.
+ * \param argc Argument count.
+ * \param argv Argument vector.
+ * \param terminal If \c true, the command should be given a terminal.
+ * \param[out] exit_code Exit code of the command.
+ *
+ * \return \c true if the command was run, else \c false.
+ */
+gboolean
+clr_oci_agent_exec (const struct clr_oci_config *config,
+		guint32 cid, int argc, char *const argv[],
+		gboolean terminal, gint *exit_code)
+{
+	struct clr_oci_agent_session  session = { 0 };
+	g_autofree gchar             *request = NULL;
+	GByteArray                   *frame = NULL;
+	gsize                         len;
+	int                           flags;
+	gboolean                      ret = false;
+
+	if (! (config && cid >= CLR_OCI_VSOCK_CID_MIN
+				&& argc > 0 && argv && exit_code)) {
+		return false;
+	}
+
+	request = clr_oci_agent_request (config, argc, argv, terminal);
+	if (! request) {
+		return false;
+	}
+
+	len = strlen (request);
+	if (len > CLR_OCI_AGENT_MAX_PAYLOAD) {
+		g_critical ("command too long");
+		return false;
+	}
+
+	session.fd = clr_oci_agent_connect (cid);
+	if (session.fd < 0) {
+		return false;
+	}
+
+	session.exit_code = -1;
+	session.winch_fd = -1;
+
+	frame = g_byte_array_new ();
+	clr_oci_agent_frame_append (frame, CLR_OCI_AGENT_STREAM_CONTROL,
+			(const guint8 *)request, (guint32)len);
+
+	if (! clr_oci_agent_write_all (session.fd, frame->data,
+				frame->len)) {
+		g_critical ("failed to send request to agent: %s",
+				strerror (errno));
+		goto out;
+	}
+
+	/* From now on, the agent is only written to when it is ready,
+	 * so that a command not reading its input cannot block the
+	 * runtime from relaying its output.
+	 */
+	flags = fcntl (session.fd, F_GETFL);
+	if (flags < 0 || fcntl (session.fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		g_critical ("failed to make agent connection "
+				"non-blocking: %s", strerror (errno));
+		goto out;
+	}
+
+	session.buf = g_byte_array_new ();
+	session.out = g_byte_array_new ();
+	session.loop = g_main_loop_new (NULL, 0);
+
+	if (terminal) {
+		if (! clr_oci_agent_tty_setup (&session)) {
+			goto out;
+		}
+
+		if (! clr_oci_agent_winsize_send (&session)) {
+			goto out;
+		}
+	}
+
+	/* starts reading standard input unless the window size is
+	 * still being sent
+	 */
+	if (! clr_oci_agent_flush (&session)) {
+		goto out;
+	}
+
+	session.conn_source = g_unix_fd_add (session.fd,
+			G_IO_IN | G_IO_HUP | G_IO_ERR,
+			(GUnixFDSourceFunc)clr_oci_agent_conn_ready,
+			&session);
+
+	g_main_loop_run (session.loop);
+
+	if (session.failed) {
+		goto out;
+	}
+
+	*exit_code = session.exit_code;
+
+	ret = true;
+
+out:
+	if (session.stdin_source) {
+		g_source_remove (session.stdin_source);
+	}
+	if (session.conn_source) {
+		g_source_remove (session.conn_source);
+	}
+	if (session.out_source) {
+		g_source_remove (session.out_source);
+	}
+
+	clr_oci_agent_tty_restore (&session);
+
+	if (session.loop) {
+		g_main_loop_unref (session.loop);
+	}
+	if (session.buf) {
+		g_byte_array_unref (session.buf);
+	}
+	if (session.out) {
+		g_byte_array_unref (session.out);
+	}
+	g_byte_array_unref (frame);
+	close (session.fd);
+
+	return ret;
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_AGENT_H
+#define _CLR_OCI_AGENT_H
+
+#include <glib.h>
+
+#include "oci.h"
+
+/** vsock port the agent in the VM listens on. */
+#define CLR_OCI_AGENT_PORT 1024
+
+/** Lowest vsock context ID that can be given to a VM
+ * (lower values are reserved).
+ */
+#define CLR_OCI_VSOCK_CID_MIN 3
+
+/** Device used to give a VM a vsock device. */
+#define CLR_OCI_VHOST_VSOCK_DEVICE "/dev/vhost-vsock"
+
+/** Number of context IDs to try before giving up if each is
+ * already in use.
+ */
+#define CLR_OCI_VSOCK_CID_RETRIES 8
+
+/** Size of the header of each agent frame: a one byte
+ * \ref clr_oci_agent_stream and a 4 byte big-endian payload length.
+ */
+#define CLR_OCI_AGENT_HEADER_SIZE 5
+
+/** Maximum payload of an agent frame. */
+#define CLR_OCI_AGENT_MAX_PAYLOAD (64 * 1024)
+
+/*! Streams multiplexed over an agent connection. */
+enum clr_oci_agent_stream {
+	/** JSON requests (from the runtime) and replies (from the
+	 * agent).
+	 */
+	CLR_OCI_AGENT_STREAM_CONTROL = 0,
+
+	/** Standard input of the command (an empty frame denotes
+	 * end-of-file).
+	 */
+	CLR_OCI_AGENT_STREAM_STDIN,
+
+	/** Standard output of the command. */
+	CLR_OCI_AGENT_STREAM_STDOUT,
+
+	/** Standard error of the command. */
+	CLR_OCI_AGENT_STREAM_STDERR,
+
+	/** Window size of the terminal of the command (a 2 byte
+	 * big-endian number of rows followed by the number of
+	 * columns).
+	 */
+	CLR_OCI_AGENT_STREAM_RESIZE,
+};
+
+guint32 clr_oci_vsock_cid_new (void);
+int clr_oci_vsock_open (guint32 *cid);
+gboolean clr_oci_agent_exec (const struct clr_oci_config *config,
+		guint32 cid, int argc, char *const argv[],
+		gboolean terminal, gint *exit_code);
+
+#endif /* _CLR_OCI_AGENT_H */
@@ -77,3 +77,94 @@ clr_oci_annotations_to_json (const struct clr_oci_config *config)
         return obj;
 }
 
+/*!
+ * Find the value of the specified annotation.
+ *
+ * \param annotations List of \ref oci_cfg_annotation.
+ * \param key Name of annotation to look up.
+ *
+ * \return Value of annotation on success, else \c NULL.
+ */
+const gchar *
+clr_oci_annotation_get (GSList *annotations, const gchar *key)
+{
+	GSList *l;
+
+	if (! key) {
+		return NULL;
+	}
+
+	for (l = annotations; l && l->data; l = g_slist_next (l)) {
+		struct oci_cfg_annotation *a = (struct oci_cfg_annotation *)l->data;
+
+		if (! g_strcmp0 (a->key, key)) {
+			return a->value;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * Determine the value of a boolean annotation.
+ *
+ * "true", "yes", "on" and "1" are true and "false", "no", "off" and
+ * "0" are false (ignoring case).
+ *
+ * \param annotations List of \ref oci_cfg_annotation.
+ * \param key Name of annotation to look up.
+ * \param[out] value Value of the annotation.
+ *
+ * \return \c true if the annotation exists and has one of the values
+ * above, else \c false (and \p value is not changed).
+ */
+gboolean
+clr_oci_annotation_bool_get (GSList *annotations, const gchar *key,
+		gboolean *value)
+{
+	const gchar *str;
+
+	if (! value) {
+		return false;
+	}
+
+	str = clr_oci_annotation_get (annotations, key);
+	if (! str) {
+		return false;
+	}
+
+	if (! (g_ascii_strcasecmp (str, "true")
+				&& g_ascii_strcasecmp (str, "yes")
+				&& g_ascii_strcasecmp (str, "on")
+				&& g_strcmp0 (str, "1"))) {
+		*value = true;
+	} else if (! (g_ascii_strcasecmp (str, "false")
+				&& g_ascii_strcasecmp (str, "no")
+				&& g_ascii_strcasecmp (str, "off")
+				&& g_strcmp0 (str, "0"))) {
+		*value = false;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * Determine if the specified annotation is set to a true value.
+ *
+ * \param annotations List of \ref oci_cfg_annotation.
+ * \param key Name of annotation to look up.
+ *
+ * \return \c true if the annotation exists and has a true value
+ * (see clr_oci_annotation_bool_get()), else \c false.
+ */
+gboolean
+clr_oci_annotation_is_true (GSList *annotations, const gchar *key)
+{
+	gboolean value = false;
+
+	(void)clr_oci_annotation_bool_get (annotations, key, &value);
+
+	return value;
+}
@@ -30,7 +30,14 @@
 #include "util.h"
 #include "oci.h"
 
+/** If set to "true", run poststart and poststop hooks concurrently. */
+#define CLR_OCI_ANNOTATION_PARALLEL_HOOKS "com.intel.clr.hooks.parallel"
+
 void clr_oci_annotations_free_all (GSList *annotations);
 JsonObject *clr_oci_annotations_to_json (const struct clr_oci_config *config);
+const gchar *clr_oci_annotation_get (GSList *annotations, const gchar *key);
+gboolean clr_oci_annotation_is_true (GSList *annotations, const gchar *key);
+gboolean clr_oci_annotation_bool_get (GSList *annotations, const gchar *key,
+		gboolean *value);
 
 #endif /* _CLR_OCI_ANNOTATION_H */
@@ -0,0 +1,543 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Pausing idle containers.
+ *
+ * When \ref CLR_OCI_ANNOTATION_AUTOPAUSE_IDLE is set, the console
+ * capture process (see clr_oci_console_capture_start()) pauses the
+ * VM once there has been no console input or output and (almost) no
+ * vCPU activity for the specified time, so an idle container uses
+ * no host CPU at all.
+ *
+ * The VM is resumed transparently on console input and by any
+ * command that needs the guest (for example "exec") via
+ * clr_oci_autopause_wake(). Since the container has not been paused
+ * by the user, its OCI state remains "running" throughout.
+ *
+ * \ref CLR_OCI_AUTOPAUSE_FILE is locked whenever the VM is paused or
+ * woken, so the capture process can never pause the VM between a
+ * command waking it and the command using the guest. Commands that
+ * use the guest for a long time (such as "exec") keep a shared lock
+ * on it, which prevents the VM from being paused until they finish.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "common.h"
+#include "oci.h"
+#include "annotation.h"
+#include "network.h"
+#include "state.h"
+#include "stats.h"
+#include "autopause.h"
+
+/*!
+ * Determine how long a container must be idle for before its VM is
+ * paused.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return Seconds, or \c 0 if the VM should never be paused
+ *   automatically.
+ */
+guint
+clr_oci_autopause_get (const struct clr_oci_config *config)
+{
+	const gchar  *str;
+	gchar        *end = NULL;
+	guint64       idle;
+
+	if (! config) {
+		return 0;
+	}
+
+	str = clr_oci_annotation_get (config->oci.annotations,
+			CLR_OCI_ANNOTATION_AUTOPAUSE_IDLE);
+	if (! (str && *str)) {
+		return 0;
+	}
+
+	idle = g_ascii_strtoull (str, &end, 10);
+	if (*end || idle > G_MAXUINT32) {
+		g_warning ("ignoring invalid value for %s: %s",
+				CLR_OCI_ANNOTATION_AUTOPAUSE_IDLE, str);
+		return 0;
+	}
+
+	return (guint)idle;
+}
+
+/*!
+ * Record the current modification time of \ref CLR_OCI_AUTOPAUSE_FILE.
+ *
+ * \param autopause \ref clr_oci_autopause.
+ * \param[out] paused If not \c NULL, set to \c true if the file
+ *   records that the VM was paused automatically.
+ *
+ * \return \c true if the file was modified by anything else since
+ *   it was last seen, else \c false.
+ */
+static gboolean
+clr_oci_autopause_stat (struct clr_oci_autopause *autopause,
+		gboolean *paused)
+{
+	struct stat  st;
+	gboolean     touched;
+
+	if (fstat (autopause->fd, &st) < 0) {
+		return false;
+	}
+
+	touched = st.st_mtim.tv_sec != autopause->stamp.tv_sec
+		|| st.st_mtim.tv_nsec != autopause->stamp.tv_nsec;
+
+	autopause->stamp = st.st_mtim;
+
+	if (paused) {
+		*paused = st.st_size > 0;
+	}
+
+	return touched;
+}
+
+/*!
+ * Record in \ref CLR_OCI_AUTOPAUSE_FILE whether the VM was paused
+ * automatically.
+ *
+ * \param autopause \ref clr_oci_autopause.
+ * \param paused \c true if the VM has been paused.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_autopause_mark (struct clr_oci_autopause *autopause,
+		gboolean paused)
+{
+	if (ftruncate (autopause->fd, 0) < 0
+			|| (paused && pwrite (autopause->fd, "1", 1, 0) != 1)) {
+		g_critical ("failed to update %s: %s",
+				CLR_OCI_AUTOPAUSE_FILE, strerror (errno));
+		return false;
+	}
+
+	autopause->paused = paused;
+
+	/* don't mistake our own update for a command */
+	(void)clr_oci_autopause_stat (autopause, NULL);
+
+	return true;
+}
+
+/*!
+ * Create the state used to pause the VM of a container when idle.
+ *
+ * \ref CLR_OCI_AUTOPAUSE_FILE is created in the runtime directory,
+ * which is also where the state of the container is read from.
+ *
+ * \param runtime_path Runtime directory of the container.
+ * \param comms_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param idle Seconds the VM must be idle for before it is paused
+ *   (see clr_oci_autopause_get()).
+ *
+ * \return Newly-allocated \ref clr_oci_autopause, or \c NULL if
+ *   the VM should not be paused automatically or on error.
+ */
+struct clr_oci_autopause *
+clr_oci_autopause_new (const gchar *runtime_path, const gchar *comms_path,
+		GPid pid, guint idle)
+{
+	struct clr_oci_autopause  *autopause;
+	g_autofree gchar          *path = NULL;
+
+	if (! (idle && runtime_path && comms_path)) {
+		return NULL;
+	}
+
+	path = g_build_path ("/", runtime_path,
+			CLR_OCI_AUTOPAUSE_FILE, NULL);
+
+	autopause = g_new0 (struct clr_oci_autopause, 1);
+
+	autopause->fd = open (path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+			0600);
+	if (autopause->fd < 0) {
+		g_critical ("failed to create %s: %s",
+				path, strerror (errno));
+		g_free (autopause);
+		return NULL;
+	}
+
+	autopause->pid = pid;
+	autopause->comms_path = g_strdup (comms_path);
+	autopause->state_file_path = g_build_path ("/", runtime_path,
+			CLR_OCI_STATE_FILE, NULL);
+	autopause->idle = idle;
+	autopause->last_activity = g_get_monotonic_time ();
+
+	(void)clr_oci_autopause_stat (autopause, NULL);
+
+	return autopause;
+}
+
+/*!
+ * Free the specified \ref clr_oci_autopause.
+ *
+ * \param autopause \ref clr_oci_autopause.
+ */
+void
+clr_oci_autopause_free (struct clr_oci_autopause *autopause)
+{
+	if (! autopause) {
+		return;
+	}
+
+	if (autopause->fd >= 0) {
+		close (autopause->fd);
+	}
+
+	clr_oci_stats_sampler_free (autopause->sampler);
+	g_free (autopause->comms_path);
+	g_free (autopause->state_file_path);
+	g_free (autopause);
+}
+
+/*!
+ * Decide if the VM has been idle for long enough to be paused.
+ *
+ * The VM is busy if its vCPUs ran for more than
+ * \ref CLR_OCI_AUTOPAUSE_IDLE_USAGE percent of the time since the
+ * previous call.
+ *
+ * \param autopause \ref clr_oci_autopause.
+ * \param vcpu_time Total time (in nanoseconds) spent running vCPUs.
+ * \param now Current monotonic time (in microseconds).
+ *
+ * \return \c true if the VM should be paused, else \c false.
+ */
+private gboolean
+clr_oci_autopause_idle (struct clr_oci_autopause *autopause,
+		guint64 vcpu_time, gint64 now)
+{
+	guint64 busy_time;
+
+	if (autopause->sample_time && now > autopause->sample_time
+			&& vcpu_time >= autopause->vcpu_time) {
+		/* microseconds of elapsed time to nanoseconds of vCPU
+		 * time
+		 */
+		busy_time = (guint64)(now - autopause->sample_time) * 1000
+			* CLR_OCI_AUTOPAUSE_IDLE_USAGE / 100;
+
+		if (vcpu_time - autopause->vcpu_time > busy_time) {
+			autopause->last_activity = now;
+		}
+	}
+
+	autopause->vcpu_time = vcpu_time;
+	autopause->sample_time = now;
+
+	return now - autopause->last_activity
+		>= (gint64)autopause->idle * G_USEC_PER_SEC;
+}
+
+/*!
+ * Record activity on the console of the VM, resuming the VM if it
+ * was paused automatically.
+ *
+ * \param autopause \ref clr_oci_autopause (may be \c NULL).
+ */
+void
+clr_oci_autopause_activity (struct clr_oci_autopause *autopause)
+{
+	if (! autopause) {
+		return;
+	}
+
+	autopause->last_activity = g_get_monotonic_time ();
+
+	if (! autopause->paused) {
+		return;
+	}
+
+	if (flock (autopause->fd, LOCK_EX | LOCK_NB) < 0) {
+		/* a command is already waking the VM */
+		if (errno == EWOULDBLOCK) {
+			autopause->paused = false;
+		}
+		return;
+	}
+
+	if (clr_oci_vm_resume (autopause->comms_path, autopause->pid)) {
+		g_debug ("resumed idle VM %d on console activity",
+				(int)autopause->pid);
+		(void)clr_oci_autopause_mark (autopause, false);
+	}
+
+	(void)flock (autopause->fd, LOCK_UN);
+}
+
+/*!
+ * Determine if the VM has started running for the first time.
+ *
+ * Until the container is started, the hypervisor is held stopped and
+ * cannot answer QMP, so it is only asked once the state of the
+ * container is no longer "created".
+ *
+ * \param autopause \ref clr_oci_autopause.
+ *
+ * \return \c true if the VM is running, else \c false.
+ */
+static gboolean
+clr_oci_autopause_started (struct clr_oci_autopause *autopause)
+{
+	struct oci_state  *state;
+	gboolean           created;
+	gboolean           running = false;
+
+	/* the capture process is started before the state is saved */
+	if (! g_file_test (autopause->state_file_path, G_FILE_TEST_EXISTS)) {
+		return false;
+	}
+
+	state = clr_oci_state_file_read (autopause->state_file_path);
+	if (! state) {
+		return false;
+	}
+
+	created = state->status == OCI_STATUS_CREATED;
+
+	clr_oci_state_free (state);
+
+	if (created) {
+		return false;
+	}
+
+	if (! clr_oci_vm_status (autopause->comms_path, autopause->pid,
+				&running)) {
+		return false;
+	}
+
+	return running;
+}
+
+/*!
+ * Pause the VM if it has been idle for long enough.
+ *
+ * Called every \ref CLR_OCI_AUTOPAUSE_INTERVAL seconds.
+ *
+ * \param autopause \ref clr_oci_autopause.
+ *
+ * \return \c true.
+ */
+gboolean
+clr_oci_autopause_check (struct clr_oci_autopause *autopause)
+{
+	gboolean  paused;
+	gboolean  running;
+	guint64   vcpu_time;
+	gint64    now;
+
+	if (! autopause) {
+		return true;
+	}
+
+	now = g_get_monotonic_time ();
+
+	if (! autopause->started) {
+		if (! clr_oci_autopause_started (autopause)) {
+			return true;
+		}
+
+		/* time spent waiting for "start" is not idle time */
+		autopause->started = true;
+		autopause->last_activity = now;
+		autopause->sample_time = 0;
+
+		return true;
+	}
+
+	if (autopause->paused) {
+		(void)clr_oci_autopause_stat (autopause, &paused);
+		if (! paused) {
+			/* woken by a command */
+			autopause->paused = false;
+			autopause->last_activity = now;
+			autopause->sample_time = 0;
+		}
+
+		return true;
+	}
+
+	if (! autopause->sampler) {
+		autopause->sampler = clr_oci_stats_sampler_new
+			(autopause->pid, autopause->comms_path, 0);
+		if (! autopause->sampler) {
+			return true;
+		}
+	}
+
+	if (! clr_oci_stats_vcpu_time (autopause->sampler, &vcpu_time)) {
+		return true;
+	}
+
+	if (! clr_oci_autopause_idle (autopause, vcpu_time, now)) {
+		return true;
+	}
+
+	if (flock (autopause->fd, LOCK_EX | LOCK_NB) < 0) {
+		/* a command is using the guest */
+		autopause->last_activity = now;
+		return true;
+	}
+
+	if (clr_oci_autopause_stat (autopause, NULL)) {
+		/* a command is using the guest */
+		autopause->last_activity = now;
+		goto out;
+	}
+
+	if (! clr_oci_vm_status (autopause->comms_path, autopause->pid,
+				&running)) {
+		goto out;
+	}
+
+	if (! running) {
+		/* not started yet or paused by the user: only start
+		 * counting once the VM runs again.
+		 */
+		autopause->last_activity = now;
+		goto out;
+	}
+
+	if (! clr_oci_vm_pause (autopause->comms_path, autopause->pid)) {
+		goto out;
+	}
+
+	g_debug ("paused VM %d after %u seconds idle",
+			(int)autopause->pid, autopause->idle);
+
+	if (! clr_oci_autopause_mark (autopause, true)) {
+		(void)clr_oci_vm_resume (autopause->comms_path,
+				autopause->pid);
+	}
+
+out:
+	(void)flock (autopause->fd, LOCK_UN);
+
+	return true;
+}
+
+/*!
+ * Resume the VM of a container if it was paused automatically.
+ *
+ * The VM will not be paused automatically again until it has been
+ * idle for the full period, so the caller can use the guest once
+ * this function returns.
+ *
+ * \param config \ref clr_oci_config.
+ * \param[out] hold If not \c NULL, set to a file descriptor which
+ *   prevents the VM from being paused automatically until it is
+ *   closed, or to \c -1 if the VM is never paused automatically.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_autopause_wake (const struct clr_oci_config *config, int *hold)
+{
+	g_autofree gchar  *path = NULL;
+	struct stat        st;
+	gboolean           ret = false;
+	int                fd;
+
+	if (! config) {
+		return false;
+	}
+
+	if (hold) {
+		*hold = -1;
+	}
+
+	path = g_build_path ("/", config->state.runtime_path,
+			CLR_OCI_AUTOPAUSE_FILE, NULL);
+
+	fd = open (path, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		/* VM is never paused automatically */
+		return errno == ENOENT;
+	}
+
+	if (flock (fd, LOCK_EX) < 0 || fstat (fd, &st) < 0) {
+		goto out;
+	}
+
+	if (st.st_size > 0) {
+		if (! clr_oci_vm_resume (config->state.comms_path,
+					config->state.workload_pid)) {
+			goto out;
+		}
+
+		g_debug ("resumed idle VM %d",
+				(int)config->state.workload_pid);
+
+		if (ftruncate (fd, 0) < 0) {
+			goto out;
+		}
+	}
+
+	/* tell the console capture the guest is in use */
+	if (futimens (fd, NULL) < 0) {
+		goto out;
+	}
+
+	if (hold) {
+		if (flock (fd, LOCK_SH) < 0) {
+			goto out;
+		}
+
+		*hold = fd;
+		fd = -1;
+	}
+
+	ret = true;
+
+out:
+	if (! ret) {
+		g_critical ("failed to wake container %s",
+				config->optarg_container_id);
+	}
+
+	if (fd >= 0) {
+		close (fd);
+	}
+
+	return ret;
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_AUTOPAUSE_H
+#define _CLR_OCI_AUTOPAUSE_H
+
+#include <time.h>
+
+#include <glib.h>
+
+#include "oci.h"
+#include "stats.h"
+
+/** Annotation specifying the number of seconds a container must be
+ * idle for before its VM is paused automatically.
+ */
+#define CLR_OCI_ANNOTATION_AUTOPAUSE_IDLE "com.intel.clr.autopause.idle"
+
+/** File below the runtime directory that records whether the VM was
+ * paused automatically. Its modification time is updated by every
+ * command that needs the guest, so that the VM is not paused under
+ * it.
+ */
+#define CLR_OCI_AUTOPAUSE_FILE "autopause"
+
+/** Seconds between checks of whether the VM is idle. */
+#define CLR_OCI_AUTOPAUSE_INTERVAL 5
+
+/** vCPU usage (as a percentage of one CPU) below which a VM is
+ * considered idle.
+ */
+#define CLR_OCI_AUTOPAUSE_IDLE_USAGE 2
+
+/** State of the console capture process used to pause an idle VM. */
+struct clr_oci_autopause {
+	/** \c GPid of hypervisor process. */
+	GPid                           pid;
+
+	/** Path to \ref CLR_OCI_HYPERVISOR_SOCKET. */
+	gchar                         *comms_path;
+
+	/** Path to \ref CLR_OCI_STATE_FILE of the container. */
+	gchar                         *state_file_path;
+
+	/** Open \ref CLR_OCI_AUTOPAUSE_FILE. */
+	int                            fd;
+
+	/** Seconds the VM must be idle for before it is paused. */
+	guint                          idle;
+
+	/** Used to determine the vCPU time of the VM (created on
+	 * the first check).
+	 */
+	struct clr_oci_stats_sampler  *sampler;
+
+	/** vCPU time (in nanoseconds) at the previous check. */
+	guint64                        vcpu_time;
+
+	/** Monotonic time (in microseconds) of the previous check,
+	 * or \c 0 before the first.
+	 */
+	gint64                         sample_time;
+
+	/** Monotonic time (in microseconds) the VM was last active. */
+	gint64                         last_activity;
+
+	/** Modification time of \ref fd when last seen. */
+	struct timespec                stamp;
+
+	/** \c true if the VM was paused automatically. */
+	gboolean                       paused;
+
+	/** \c true once the VM has been seen running (idle time is
+	 * only counted from then).
+	 */
+	gboolean                       started;
+};
+
+guint clr_oci_autopause_get (const struct clr_oci_config *config);
+struct clr_oci_autopause *clr_oci_autopause_new (const gchar *runtime_path,
+		const gchar *comms_path, GPid pid, guint idle);
+void clr_oci_autopause_free (struct clr_oci_autopause *autopause);
+void clr_oci_autopause_activity (struct clr_oci_autopause *autopause);
+gboolean clr_oci_autopause_check (struct clr_oci_autopause *autopause);
+gboolean clr_oci_autopause_wake (const struct clr_oci_config *config,
+		int *hold);
+
+#endif /* _CLR_OCI_AUTOPAUSE_H */
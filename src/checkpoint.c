@@ -0,0 +1,443 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Checkpoint files.
+ *
+ * A container is checkpointed by saving the state of its VM using a
+ * hypervisor migration to a file, and restored by starting a new
+ * hypervisor that loads that file (see clr_oci_checkpoint() and
+ * clr_oci_restore()). The file is accompanied by
+ * \ref CLR_OCI_CHECKPOINT_INFO_FILE, which records how it was written.
+ *
+ * Restoring a large guest is dominated by reading its RAM, so a
+ * "lazy" checkpoint saves guest RAM to a separate file which the
+ * restored hypervisor maps privately: the guest resumes as soon as
+ * the device state is loaded, and pages are faulted in from the file
+ * as they are touched.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include "common.h"
+#include "util.h"
+#include "annotation.h"
+#include "checkpoint.h"
+
+/** Size of buffer used to copy guest RAM. */
+#define CLR_OCI_CHECKPOINT_BUF_SIZE (1024 * 1024)
+
+/*!
+ * Determine if the VM of a container can be checkpointed lazily.
+ *
+ * Guest RAM must then be shared memory, which the hypervisor only
+ * uses if asked to, so this must be decided when the container is
+ * created. The annotation \ref CLR_OCI_ANNOTATION_CHECKPOINT_LAZY
+ * overrides the \c vm configuration.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true if lazy checkpoints are allowed, else \c false.
+ */
+gboolean
+clr_oci_checkpoint_lazy_get (const struct clr_oci_config *config)
+{
+	gboolean value;
+
+	if (! config) {
+		return false;
+	}
+
+	if (clr_oci_annotation_bool_get (config->oci.annotations,
+				CLR_OCI_ANNOTATION_CHECKPOINT_LAZY, &value)) {
+		return value;
+	}
+
+	return config->vm ? config->vm->lazy_checkpoint : false;
+}
+
+/*!
+ * Determine the path to the saved VM state.
+ *
+ * \param cp \ref clr_oci_checkpoint.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+gchar *
+clr_oci_checkpoint_path (const struct clr_oci_checkpoint *cp)
+{
+	if (! (cp && cp->image_path)) {
+		return NULL;
+	}
+
+	return g_build_path ("/", cp->image_path,
+			cp->compress
+			? CLR_OCI_CHECKPOINT_COMPRESSED_FILE
+			: CLR_OCI_CHECKPOINT_FILE,
+			NULL);
+}
+
+/*!
+ * Determine the migration URI the hypervisor should use to save or
+ * load the VM state.
+ *
+ * Compressed state is piped through gzip(1) by the hypervisor.
+ *
+ * \param cp \ref clr_oci_checkpoint.
+ * \param save If \c true, the URI is used to save the state,
+ *   else to load it.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+gchar *
+clr_oci_checkpoint_uri (const struct clr_oci_checkpoint *cp,
+		gboolean save)
+{
+	g_autofree gchar  *path = NULL;
+	g_autofree gchar  *quoted = NULL;
+
+	path = clr_oci_checkpoint_path (cp);
+	if (! path) {
+		return NULL;
+	}
+
+	if (! cp->compress) {
+		return g_strdup_printf ("file:%s", path);
+	}
+
+	quoted = g_shell_quote (path);
+
+	return g_strdup_printf (save
+			? "exec:gzip -c > %s"
+			: "exec:gzip -dc < %s",
+			quoted);
+}
+
+/*!
+ * Write \ref CLR_OCI_CHECKPOINT_INFO_FILE.
+ *
+ * \param cp \ref clr_oci_checkpoint.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_checkpoint_info_write (const struct clr_oci_checkpoint *cp)
+{
+	JsonObject        *obj = NULL;
+	GError            *error = NULL;
+	g_autofree gchar  *path = NULL;
+	g_autofree gchar  *str = NULL;
+	g_autofree gchar  *timestamp = NULL;
+	gsize              len = 0;
+	gboolean           ret = false;
+
+	if (! (cp && cp->image_path)) {
+		return false;
+	}
+
+	timestamp = clr_oci_get_iso8601_timestamp ();
+	if (! timestamp) {
+		return false;
+	}
+
+	obj = json_object_new ();
+
+	json_object_set_string_member (obj, "created", timestamp);
+	json_object_set_boolean_member (obj, "compressed", cp->compress);
+	json_object_set_boolean_member (obj, "lazy", cp->lazy);
+	json_object_set_boolean_member (obj, "paused", cp->paused);
+	json_object_set_int_member (obj, "multifd-channels",
+			(gint64)cp->channels);
+	json_object_set_int_member (obj, "size", (gint64)cp->size);
+	json_object_set_double_member (obj, "duration", cp->duration);
+
+	str = clr_oci_json_obj_to_string (obj, true, &len);
+	if (! str) {
+		goto out;
+	}
+
+	path = g_build_path ("/", cp->image_path,
+			CLR_OCI_CHECKPOINT_INFO_FILE, NULL);
+
+	if (! g_file_set_contents (path, str, (gssize)len, &error)) {
+		g_critical ("failed to write %s: %s", path, error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	ret = true;
+
+out:
+	json_object_unref (obj);
+
+	return ret;
+}
+
+/*!
+ * Read \ref CLR_OCI_CHECKPOINT_INFO_FILE.
+ *
+ * \param[in,out] cp \ref clr_oci_checkpoint whose \c image_path must
+ *   be set. The remaining members are set from the file.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_checkpoint_info_read (struct clr_oci_checkpoint *cp)
+{
+	JsonParser        *parser = NULL;
+	JsonNode          *root;
+	JsonObject        *obj;
+	GError            *error = NULL;
+	g_autofree gchar  *path = NULL;
+	gint64             channels;
+	gboolean           ret = false;
+
+	if (! (cp && cp->image_path)) {
+		return false;
+	}
+
+	path = g_build_path ("/", cp->image_path,
+			CLR_OCI_CHECKPOINT_INFO_FILE, NULL);
+
+	parser = json_parser_new ();
+
+	if (! json_parser_load_from_file (parser, path, &error)) {
+		g_critical ("failed to read checkpoint %s: %s",
+				path, error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	root = json_parser_get_root (parser);
+	if (! (root && JSON_NODE_HOLDS_OBJECT (root))) {
+		g_critical ("invalid checkpoint file %s", path);
+		goto out;
+	}
+
+	obj = json_node_get_object (root);
+
+	cp->compress = json_object_has_member (obj, "compressed")
+		&& json_object_get_boolean_member (obj, "compressed");
+
+	cp->lazy = json_object_has_member (obj, "lazy")
+		&& json_object_get_boolean_member (obj, "lazy");
+
+	cp->paused = json_object_has_member (obj, "paused")
+		&& json_object_get_boolean_member (obj, "paused");
+
+	channels = json_object_has_member (obj, "multifd-channels")
+		? json_object_get_int_member (obj, "multifd-channels") : 0;
+	if (channels < 0 || channels > G_MAXUINT) {
+		g_critical ("invalid multifd channels in %s", path);
+		goto out;
+	}
+
+	cp->channels = (guint)channels;
+
+	if (json_object_has_member (obj, "size")) {
+		cp->size = (guint64)json_object_get_int_member (obj, "size");
+	}
+
+	if (json_object_has_member (obj, "duration")) {
+		cp->duration = json_object_get_double_member (obj,
+				"duration");
+	}
+
+	ret = true;
+
+out:
+	g_object_unref (parser);
+
+	return ret;
+}
+
+/*!
+ * Open the memfd backing the RAM of a hypervisor.
+ *
+ * \param pid \c GPid of hypervisor process.
+ *
+ * \return File descriptor on success, else \c -1.
+ */
+private int
+clr_oci_checkpoint_ram_open (GPid pid)
+{
+	GDir               *dir = NULL;
+	GError             *error = NULL;
+	const gchar        *name = NULL;
+	g_autofree gchar   *fd_dir = NULL;
+	int                 fd = -1;
+
+	fd_dir = g_strdup_printf ("/proc/%d/fd", (int)pid);
+
+	dir = g_dir_open (fd_dir, 0, &error);
+	if (! dir) {
+		g_critical ("failed to open %s: %s", fd_dir, error->message);
+		g_error_free (error);
+		return -1;
+	}
+
+	while (fd < 0 && (name = g_dir_read_name (dir))) {
+		g_autofree gchar *path = NULL;
+		g_autofree gchar *target = NULL;
+
+		path = g_build_path ("/", fd_dir, name, NULL);
+		target = g_file_read_link (path, NULL);
+
+		if (! (target && g_str_has_prefix (target,
+					"/memfd:" CLR_OCI_RAM_MEMFD_NAME))) {
+			continue;
+		}
+
+		fd = open (path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			g_critical ("failed to open %s: %s",
+					path, strerror (errno));
+			break;
+		}
+	}
+
+	g_dir_close (dir);
+
+	if (fd < 0 && ! name) {
+		g_critical ("no guest RAM found for pid %d", (int)pid);
+	}
+
+	return fd;
+}
+
+/*!
+ * Save the RAM of a paused hypervisor to a file.
+ *
+ * Only the pages the guest has touched are copied, so the file is
+ * sparse.
+ *
+ * \param pid \c GPid of hypervisor process.
+ * \param path Path to save RAM to.
+ * \param[out] size Number of bytes copied.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_checkpoint_ram_save (GPid pid, const gchar *path, guint64 *size)
+{
+	struct stat         st;
+	g_autofree gchar   *buf = NULL;
+	off_t               data;
+	off_t               hole;
+	ssize_t             bytes;
+	int                 in = -1;
+	int                 out = -1;
+	gboolean            ret = false;
+
+	if (! (pid && path && size)) {
+		return false;
+	}
+
+	*size = 0;
+
+	in = clr_oci_checkpoint_ram_open (pid);
+	if (in < 0) {
+		return false;
+	}
+
+	if (fstat (in, &st) < 0) {
+		g_critical ("failed to stat guest RAM: %s", strerror (errno));
+		goto out;
+	}
+
+	out = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (out < 0) {
+		g_critical ("failed to create %s: %s", path, strerror (errno));
+		goto out;
+	}
+
+	if (ftruncate (out, st.st_size) < 0) {
+		g_critical ("failed to size %s: %s", path, strerror (errno));
+		goto out;
+	}
+
+	buf = g_malloc (CLR_OCI_CHECKPOINT_BUF_SIZE);
+
+	for (hole = 0; hole < st.st_size; ) {
+		data = lseek (in, hole, SEEK_DATA);
+		if (data < 0) {
+			/* no more data */
+			if (errno == ENXIO) {
+				break;
+			}
+			g_critical ("failed to seek guest RAM: %s",
+					strerror (errno));
+			goto out;
+		}
+
+		hole = lseek (in, data, SEEK_HOLE);
+		if (hole < 0) {
+			g_critical ("failed to seek guest RAM: %s",
+					strerror (errno));
+			goto out;
+		}
+
+		while (data < hole) {
+			bytes = pread (in, buf, (size_t)MIN (hole - data,
+						CLR_OCI_CHECKPOINT_BUF_SIZE),
+					data);
+			if (bytes <= 0) {
+				g_critical ("failed to read guest RAM: %s",
+						bytes ? strerror (errno)
+						: "unexpected end of file");
+				goto out;
+			}
+
+			if (pwrite (out, buf, (size_t)bytes, data) != bytes) {
+				g_critical ("failed to write %s: %s",
+						path, strerror (errno));
+				goto out;
+			}
+
+			data += bytes;
+			*size += (guint64)bytes;
+		}
+	}
+
+	ret = true;
+
+out:
+	if (in >= 0) {
+		close (in);
+	}
+	if (out >= 0 && close (out) < 0) {
+		g_critical ("failed to close %s: %s", path, strerror (errno));
+		ret = false;
+	}
+
+	return ret;
+}
@@ -0,0 +1,99 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_CHECKPOINT_H
+#define _CLR_OCI_CHECKPOINT_H
+
+#include <glib.h>
+
+#include "oci.h"
+
+/** Name of the directory below the bundle a checkpoint is written to
+ * by default.
+ */
+#define CLR_OCI_CHECKPOINT_DIR "checkpoint"
+
+/** Name of the file the VM state is saved to. */
+#define CLR_OCI_CHECKPOINT_FILE "vm.state"
+
+/** Name of the file the VM state is saved to when compressed. */
+#define CLR_OCI_CHECKPOINT_COMPRESSED_FILE "vm.state.gz"
+
+/** Name of the file guest RAM is saved to by a lazy checkpoint. */
+#define CLR_OCI_CHECKPOINT_RAM_FILE "vm.ram"
+
+/** Name of the memfd backing guest RAM of a VM that can be
+ * checkpointed lazily.
+ */
+#define CLR_OCI_RAM_MEMFD_NAME "memory-backend-memfd"
+
+/** Annotation used to allow a container to be checkpointed lazily
+ * ("true" or "false"), overriding the \c vm configuration.
+ */
+#define CLR_OCI_ANNOTATION_CHECKPOINT_LAZY "com.intel.clr.checkpoint.lazy"
+
+/** Name of the file describing a checkpoint. */
+#define CLR_OCI_CHECKPOINT_INFO_FILE "checkpoint.json"
+
+/*! Details of a container checkpoint. */
+struct clr_oci_checkpoint {
+	/** Directory containing the checkpoint files. */
+	gchar     *image_path;
+
+	/** If \c true, the container continues to run once
+	 * checkpointed.
+	 */
+	gboolean   leave_running;
+
+	/** If \c true, the VM state is compressed. */
+	gboolean   compress;
+
+	/** Number of multifd channels the VM state is saved with
+	 * (\c 0 if multifd is not used).
+	 */
+	guint      channels;
+
+	/** If \c true, guest RAM is saved separately from the VM state
+	 * so that it can be loaded on demand when restored.
+	 */
+	gboolean   lazy;
+
+	/** If \c true, the container was paused when checkpointed, so
+	 * remains paused when restored.
+	 */
+	gboolean   paused;
+
+	/** Size of the saved VM state in bytes. */
+	guint64    size;
+
+	/** Time taken to save the VM state in seconds. */
+	gdouble    duration;
+};
+
+gboolean clr_oci_checkpoint_lazy_get (const struct clr_oci_config *config);
+gchar *clr_oci_checkpoint_path (const struct clr_oci_checkpoint *cp);
+gchar *clr_oci_checkpoint_uri (const struct clr_oci_checkpoint *cp,
+		gboolean save);
+gboolean clr_oci_checkpoint_info_write (const struct clr_oci_checkpoint *cp);
+gboolean clr_oci_checkpoint_info_read (struct clr_oci_checkpoint *cp);
+gboolean clr_oci_checkpoint_ram_save (GPid pid, const gchar *path,
+		guint64 *size);
+
+#endif /* _CLR_OCI_CHECKPOINT_H */
@@ -32,6 +32,7 @@ struct subcommand *subcommands[] =
 {
 	&command_attach,
 	&command_checkpoint,
+	&command_console_capture,
 	&command_create,
 	&command_delete,
 	&command_events,
@@ -39,6 +40,7 @@ struct subcommand *subcommands[] =
 	&command_help,
 	&command_kill,
 	&command_list,
+	&command_logs,
 	&command_pause,
 	&command_ps,
 	&command_restore,
@@ -182,9 +184,13 @@ handle_command_stop (const struct subcommand *sub,
 
 	g_free_node(root);
 
-	/* move the mounts to the config object to allow unmounting */
-	config->oci.mounts = state->mounts;
-	state->mounts = NULL;
+	/* Transfer the state elements (including the mounts to allow
+	 * unmounting) to config so that the poststop hooks are given the
+	 * full details of the VM.
+	 */
+	if (! clr_oci_config_update (config, state)) {
+		goto out;
+	}
 
 	ret = clr_oci_stop (config, state);
 	if (! ret) {
@@ -95,6 +95,7 @@ gboolean handle_option_console (const gchar *option_name,
 
 extern struct subcommand command_attach;
 extern struct subcommand command_checkpoint;
+extern struct subcommand command_console_capture;
 extern struct subcommand command_create;
 extern struct subcommand command_delete;
 extern struct subcommand command_events;
@@ -102,6 +103,7 @@ extern struct subcommand command_exec;
 extern struct subcommand command_help;
 extern struct subcommand command_kill;
 extern struct subcommand command_list;
+extern struct subcommand command_logs;
 extern struct subcommand command_pause;
 extern struct subcommand command_ps;
 extern struct subcommand command_restore;
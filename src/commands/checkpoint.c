@@ -20,13 +20,55 @@
 
 #include "command.h"
 #include "state.h"
+#include "checkpoint.h"
+
+static struct clr_oci_checkpoint checkpoint_data;
+
+static GOptionEntry options_checkpoint[] =
+{
+	{
+		"image-path", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &checkpoint_data.image_path,
+		"path for saving the checkpoint (default: "
+			"<bundle>/" CLR_OCI_CHECKPOINT_DIR ")",
+		NULL
+	},
+	{
+		"leave-running", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &checkpoint_data.leave_running,
+		"leave the container running after checkpointing it",
+		NULL
+	},
+	{
+		"compress", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &checkpoint_data.compress,
+		"compress the checkpoint",
+		NULL
+	},
+	{
+		"lazy", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &checkpoint_data.lazy,
+		"save guest RAM separately so that restore loads it "
+			"on demand",
+		NULL
+	},
+	{
+		"multifd", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &checkpoint_data.channels,
+		"number of channels to save the checkpoint with in parallel",
+		NULL
+	},
+	{NULL}
+};
 
 static gboolean
 handler_checkpoint (const struct subcommand *sub,
 		struct clr_oci_config *config,
 		int argc, char *argv[])
 {
-	gboolean  ret = true;
+	struct oci_state  *state = NULL;
+	gchar             *config_file = NULL;
+	gboolean           ret;
 
 	g_assert (sub);
 	g_assert (config);
@@ -35,10 +77,42 @@ handler_checkpoint (const struct subcommand *sub,
 		return ret;
 	}
 
-	if (! clr_oci_state_file_exists(config)) {
-		g_warning ("state file does not exist for container %s",
+	/* Used to allow us to find the state file */
+	config->optarg_container_id = argv[0];
+
+	ret = clr_oci_get_config_and_state (&config_file, config, &state);
+	if (! ret) {
+		goto out;
+	}
+
+	/* Transfer certain state elements to config to allow the state *
+	 * file to be rewritten with full details.
+	 */
+	ret = clr_oci_config_update (config, state);
+	if (! ret) {
+		goto out;
+	}
+
+	ret = clr_oci_checkpoint (config, state, &checkpoint_data);
+	if (! ret) {
+		goto out;
+	}
+
+	g_print ("checkpointed container %s to %s "
+			"(%lu bytes in %.3fs)\n",
+			config->optarg_container_id,
+			checkpoint_data.image_path,
+			(unsigned long int)checkpoint_data.size,
+			checkpoint_data.duration);
+
+out:
+	g_free_if_set (config_file);
+	g_free_if_set (checkpoint_data.image_path);
+	clr_oci_state_free (state);
+
+	if (! ret) {
+		g_critical ("failed to checkpoint container %s",
 				config->optarg_container_id);
-		ret = false;
 	}
 
 	return ret;
@@ -46,7 +120,8 @@ handler_checkpoint (const struct subcommand *sub,
 
 struct subcommand command_checkpoint =
 {
-	.name    = "checkpoint",
-	.handler = handler_checkpoint,
+	.name        = "checkpoint",
+	.options     = options_checkpoint,
+	.handler     = handler_checkpoint,
 	.description = "checkpoint a running container",
 };
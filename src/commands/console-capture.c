@@ -0,0 +1,88 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "command.h"
+#include "console-log.h"
+
+static struct clr_oci_console_capture_args args = { .ready_fd = -1 };
+
+static GOptionEntry options_console_capture[] =
+{
+	{
+		"pid", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &args.vm_pid,
+		"pid of the hypervisor",
+		NULL
+	},
+	{
+		"comms", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_FILENAME, &args.comms_path,
+		"path to the hypervisor control socket",
+		NULL
+	},
+	{
+		"runtime-dir", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_FILENAME, &args.runtime_path,
+		"runtime directory of the container",
+		NULL
+	},
+	{
+		"socket", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_FILENAME, &args.client_path,
+		"path of the console socket clients connect to",
+		NULL
+	},
+	{
+		"autopause-idle", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &args.autopause_idle,
+		"seconds the VM must be idle for before it is paused",
+		NULL
+	},
+	{
+		"ready-fd", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &args.ready_fd,
+		"file descriptor to report readiness on",
+		NULL
+	},
+	{NULL}
+};
+
+static gboolean
+handler_console_capture (const struct subcommand *sub,
+		struct clr_oci_config *config,
+		int argc, char *argv[])
+{
+	(void)sub;
+	(void)config;
+	(void)argc;
+	(void)argv;
+
+	return clr_oci_console_capture (&args);
+}
+
+/** Internal command run by clr_oci_console_capture_start() (hidden
+ * since it has no description).
+ */
+struct subcommand command_console_capture =
+{
+	.name        = CLR_OCI_CONSOLE_CAPTURE_COMMAND,
+	.options     = options_console_capture,
+	.handler     = handler_console_capture,
+};
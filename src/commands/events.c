@@ -20,9 +20,13 @@
 
 #include "command.h"
 #include "events.h"
+#include "reclaim.h"
 #define DEFAULT_INTERVAL 5
 
 static gboolean run_once;
+static gboolean lifecycle;
+static gboolean all;
+static gboolean reclaim;
 static gint interval = DEFAULT_INTERVAL;
 
 
@@ -38,6 +42,21 @@ static GOptionEntry options_events[] =
 		G_OPTION_ARG_INT, &interval,
 		"set the interval to refresh stats", NULL
 	},
+	{
+		"reclaim", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &reclaim,
+		"reclaim memory from the container while it is idle", NULL
+	},
+	{
+		"lifecycle", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &lifecycle,
+		"stream VM lifecycle events as they happen", NULL
+	},
+	{
+		"all", 'a', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &all,
+		"stream lifecycle events for all containers", NULL
+	},
 	{NULL}
 };
 
@@ -55,10 +74,20 @@ handler_events (const struct subcommand *sub,
 		goto out;
 	}
 
+	if (all) {
+		ret = show_container_events (config->root_dir, NULL);
+		goto out;
+	}
+
 	if (handle_default_usage (argc, argv, sub->name, &ret)) {
 		goto out;
 	}
 
+	if (lifecycle) {
+		ret = show_container_events (config->root_dir, argv[0]);
+		goto out;
+	}
+
 	if (interval <= 0) {
 		g_critical ("Interval must be greater than 0");
 		return false;
@@ -75,7 +104,11 @@ handler_events (const struct subcommand *sub,
 		interval = 0;
 	}
 
-	ret = show_container_stats(config, state, interval);
+	if (! reclaim) {
+		reclaim = clr_oci_memory_reclaim_get (config);
+	}
+
+	ret = show_container_stats(config, state, interval, reclaim);
 
 out:
 	g_free_if_set (config_file);
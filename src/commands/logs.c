@@ -0,0 +1,82 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "command.h"
+#include "console-log.h"
+
+static gint tail = -1;
+static gboolean follow;
+
+static GOptionEntry options_logs[] =
+{
+	{
+		"tail", 'n', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &tail,
+		"only show the specified number of lines from the end of the output",
+		NULL
+	},
+	{
+		"follow", 'f', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &follow,
+		"continue to show output until the container exits",
+		NULL
+	},
+	{NULL}
+};
+
+static gboolean
+handler_logs (const struct subcommand *sub,
+		struct clr_oci_config *config,
+		int argc, char *argv[])
+{
+	struct oci_state  *state = NULL;
+	gchar             *config_file = NULL;
+	gboolean           ret;
+
+	g_assert (sub);
+	g_assert (config);
+
+	if (handle_default_usage (argc, argv, sub->name, &ret)) {
+		return ret;
+	}
+
+	config->optarg_container_id = argv[0];
+
+	ret = clr_oci_get_config_and_state (&config_file, config, &state);
+	if (! ret) {
+		goto out;
+	}
+
+	ret = clr_oci_console_logs (config, tail, follow);
+
+out:
+	g_free_if_set (config_file);
+	clr_oci_state_free (state);
+
+	return ret;
+}
+
+struct subcommand command_logs =
+{
+	.name        = "logs",
+	.options     = options_logs,
+	.handler     = handler_logs,
+	.description = "show the console output of a container",
+};
@@ -21,14 +21,30 @@
 #include "command.h"
 #include "state.h"
 
+static gchar *format;
+
+static GOptionEntry options_ps[] =
+{
+	{
+		"format", 'f', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &format,
+		"select one of: table or json (PIDs only)", NULL
+	},
+	{NULL}
+};
 
 static gboolean
 handler_ps (const struct subcommand *sub,
 		struct clr_oci_config *config,
 		int argc, char *argv[])
 {
-	// default ps options
-	gchar *ps_options = "-ef";
+	/* default ps options */
+	gchar             *default_options[] = { "-ef", NULL };
+	gchar            **ps_options = default_options;
+	struct oci_state  *state = NULL;
+	gchar             *config_file = NULL;
+	gboolean           json = false;
+	gboolean           ret;
 
 	g_assert (sub);
 	g_assert (config);
@@ -36,7 +52,7 @@ handler_ps (const struct subcommand *sub,
 	if ((argc && ((!g_strcmp0 (argv[0], "--help")) ||
 		     (!g_strcmp0 (argv[0], "-h")))) ||
 		     (!argc)) {
-		g_print ("Usage: %s [command options] <container-id> <ps options>\n",
+		g_print ("Usage: %s [command options] <container-id> [-- <ps options>]\n",
 		    sub->name);
 
 		return argc ? true : false;
@@ -45,25 +61,45 @@ handler_ps (const struct subcommand *sub,
 	config->optarg_container_id = argv[0];
 
 	if (argc > 1) {
-		ps_options = argv[1];
-	} else {
+		ps_options = argv + 1;
+	}
 
+	if (format && g_strcmp0 (format, "table")) {
+		if (g_strcmp0 (format, "json")) {
+			g_critical ("invalid format: %s", format);
+			ret = false;
+			goto out;
+		}
+
+		json = true;
 	}
 
 	if (! clr_oci_state_file_exists(config)) {
 		g_warning ("state file does not exist for container %s",
 				config->optarg_container_id);
-		return false;
+		ret = false;
+		goto out;
+	}
+
+	ret = clr_oci_get_config_and_state (&config_file, config, &state);
+	if (! ret) {
+		goto out;
 	}
 
-	//FIXME: implement ps, run ps inside the VM ?
+	ret = clr_oci_ps (config, state, ps_options, json);
+
+out:
+	g_free_if_set (format);
+	g_free_if_set (config_file);
+	clr_oci_state_free (state);
 
-	return true;
+	return ret;
 }
 
 struct subcommand command_ps =
 {
 	.name        = "ps",
+	.options     = options_ps,
 	.handler     = handler_ps,
 	.description = "display the processes running inside a container",
 };
@@ -19,34 +19,74 @@
  */
 
 #include "command.h"
-#include "state.h"
+#include "checkpoint.h"
+
+extern struct start_data start_data;
+
+static struct clr_oci_checkpoint restore_data;
+
+static GOptionEntry options_restore[] =
+{
+	{
+		"bundle", 'b', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &start_data.bundle,
+		"path to the bundle directory",
+		NULL
+	},
+	{
+		"console", 0, G_OPTION_FLAG_OPTIONAL_ARG,
+		G_OPTION_ARG_CALLBACK, handle_option_console,
+		"set pty console that will be used in the container",
+		NULL
+	},
+	{
+		"detach", 'd', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &start_data.detach,
+		"detach after restoring the container",
+		NULL
+	},
+	{
+		"image-path", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &restore_data.image_path,
+		"path to the checkpoint (default: "
+			"<bundle>/" CLR_OCI_CHECKPOINT_DIR ")",
+		NULL
+	},
+	{
+		"pid-file", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &start_data.pid_file,
+		"the file to write the process ID of the restored "
+		"container to",
+		NULL
+	},
+	{NULL}
+};
 
 static gboolean
 handler_restore (const struct subcommand *sub,
 		struct clr_oci_config *config,
 		int argc, char *argv[])
 {
-	gboolean  ret = true;
+	gboolean  ret;
 
 	g_assert (sub);
 	g_assert (config);
 
-	if (handle_default_usage (argc, argv, sub->name, &ret)) {
-		return ret;
+	if (! handle_command_setup (sub, config, argc, argv)) {
+		return false;
 	}
 
-	if (! clr_oci_state_file_exists(config)) {
-		g_warning ("state file does not exist for container %s",
-				config->optarg_container_id);
-		ret = false;
-	}
+	ret = clr_oci_restore (config, &restore_data);
+
+	g_free_if_set (restore_data.image_path);
 
 	return ret;
 }
 
 struct subcommand command_restore =
 {
-	.name    = "restore",
-	.handler = handler_restore,
+	.name        = "restore",
+	.options     = options_restore,
+	.handler     = handler_restore,
 	.description = "restore a container from a previous checkpoint",
 };
@@ -20,13 +20,97 @@
 
 #include "command.h"
 #include "state.h"
+#include "resources.h"
+
+static gchar *cpus;
+static gchar *memory;
+static gchar *resources_file;
+
+static GOptionEntry options_update[] =
+{
+	{
+		"cpus", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &cpus,
+		"number of CPUs (fractions are rounded up to whole vCPUs)",
+		NULL
+	},
+	{
+		"memory", 'm', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &memory,
+		"memory limit (for example \"512m\" or \"2g\")",
+		NULL
+	},
+	{
+		"resources", 'r', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &resources_file,
+		"path to a file containing the resources to update "
+			"(\"-\" for stdin)",
+		NULL
+	},
+	{NULL}
+};
+
+/*!
+ * Determine the resources requested on the command-line.
+ *
+ * Explicit options take precedence over those in the resources file.
+ *
+ * \param[out] resources \ref clr_oci_vm_resources.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+get_resources (struct clr_oci_vm_resources *resources)
+{
+	g_autofree gchar  *json = NULL;
+	gsize              len = 0;
+	GError            *error = NULL;
+	const gchar       *path;
+
+	if (resources_file) {
+		path = g_strcmp0 (resources_file, "-")
+			? resources_file : "/dev/stdin";
+
+		if (! g_file_get_contents (path, &json, &len, &error)) {
+			g_critical ("failed to read %s: %s",
+					resources_file, error->message);
+			g_error_free (error);
+			return false;
+		}
+
+		if (! clr_oci_resources_parse_json (json, (gssize)len,
+					resources)) {
+			return false;
+		}
+	}
+
+	if (cpus && ! clr_oci_resources_parse_cpus (cpus,
+				&resources->vcpus)) {
+		return false;
+	}
+
+	if (memory && ! clr_oci_resources_parse_memory (memory,
+				&resources->memory)) {
+		return false;
+	}
+
+	if (! (resources->vcpus || resources->memory)) {
+		g_critical ("no resources specified");
+		return false;
+	}
+
+	return true;
+}
 
 static gboolean
 handler_update (const struct subcommand *sub,
 		struct clr_oci_config *config,
 		int argc, char *argv[])
 {
-	gboolean  ret = true;
+	struct clr_oci_vm_resources  resources = { 0 };
+	struct oci_state            *state = NULL;
+	gchar                       *config_file = NULL;
+	gboolean                     ret;
 
 	g_assert (sub);
 	g_assert (config);
@@ -38,10 +122,38 @@ handler_update (const struct subcommand *sub,
 	/* Used to allow us to find the state file */
 	config->optarg_container_id = argv[0];
 
-	if (! clr_oci_state_file_exists(config)) {
-		g_warning ("state file does not exist for container %s",
+	ret = get_resources (&resources);
+	if (! ret) {
+		goto out;
+	}
+
+	ret = clr_oci_get_config_and_state (&config_file, config, &state);
+	if (! ret) {
+		goto out;
+	}
+
+	/* Transfer certain state elements to config to allow the state *
+	 * file to be rewritten with full details.
+	 */
+	ret = clr_oci_config_update (config, state);
+	if (! ret) {
+		goto out;
+	}
+
+	ret = clr_oci_resources_update (config, state, &resources);
+	if (! ret) {
+		goto out;
+	}
+
+	g_print ("updated container %s\n", config->optarg_container_id);
+
+out:
+	g_free_if_set (config_file);
+	clr_oci_state_free (state);
+
+	if (! ret) {
+		g_critical ("failed to update container %s",
 				config->optarg_container_id);
-		ret = false;
 	}
 
 	return ret;
@@ -49,7 +161,8 @@ handler_update (const struct subcommand *sub,
 
 struct subcommand command_update =
 {
-	.name    = "update",
-	.handler = handler_update,
+	.name        = "update",
+	.options     = options_update,
+	.handler     = handler_update,
 	.description = "update container resource constraints",
 };
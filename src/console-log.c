@@ -0,0 +1,1287 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Persistent console capture.
+ *
+ * When the hypervisor console is a socket, a capture process owns
+ * both the socket the hypervisor connects to
+ * (\ref CLR_OCI_CONSOLE_VM_SOCKET) and the socket clients such as
+ * "attach" connect to (\ref CLR_OCI_CONSOLE_SOCKET).
+ *
+ * All console output is written to a fixed-size ring buffer in a
+ * memory-mapped file (\ref CLR_OCI_CONSOLE_LOG_FILE) and attached
+ * clients are fed from that ring buffer, so a slow (or absent)
+ * client can never block the guest and the disk space used per
+ * container is bounded. Input from a client is only read once the
+ * hypervisor has accepted that client's previous input.
+ *
+ * The capture process also pauses the VM while the container is idle
+ * if requested (see \ref clr_oci_autopause).
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "oci.h"
+#include "util.h"
+#include "console.h"
+#include "console-log.h"
+#include "pidfd.h"
+#include "autopause.h"
+
+/** If \c true, enable \c g_debug() output (passed on to the capture
+ * helper).
+ */
+extern gboolean enable_debug;
+
+/** Maximum number of bytes written to the ring buffer in one go. */
+#define CLR_OCI_CONSOLE_LOG_CHUNK (64 * 1024)
+
+/** Interval (in milliseconds) at which "logs --follow" polls. */
+#define CLR_OCI_CONSOLE_LOG_POLL_MS 100
+
+/** A client connected to \ref CLR_OCI_CONSOLE_SOCKET. */
+struct clr_oci_console_client {
+	/** Capture the client is connected to. */
+	struct clr_oci_console_capture  *capture;
+
+	/** Connected socket. */
+	int                              fd;
+
+	/** Source watching for input from the client. */
+	guint                            in_source;
+
+	/** Source watching for the client becoming writable. */
+	guint                            out_source;
+
+	/** Source watching for the hypervisor accepting more input
+	 * (while set, no more input is read from the client).
+	 */
+	guint                            input_source;
+
+	/** Position in the ring buffer of the next byte to send. */
+	guint64                          pos;
+
+	/** Input read from the client but not yet sent. */
+	gchar                            input[CLR_OCI_CONSOLE_BUFFER_SIZE];
+
+	/** Offset into \ref input of the next byte to send. */
+	gsize                            input_offset;
+
+	/** Number of bytes of \ref input still to send. */
+	gsize                            input_pending;
+};
+
+/** State of the console capture process. */
+struct clr_oci_console_capture {
+	/** Ring buffer console output is written to. */
+	struct clr_oci_console_log  log;
+
+	/** Main loop of the capture process. */
+	GMainLoop                  *loop;
+
+	/** Pid of the hypervisor. */
+	GPid                        vm_pid;
+
+	/** Listening socket the hypervisor connects to. */
+	int                         vm_listen_fd;
+
+	/** Path to \ref vm_listen_fd. */
+	gchar                      *vm_path;
+
+	/** Connection from the hypervisor. */
+	int                         vm_fd;
+
+	/** Source watching \ref vm_fd. */
+	guint                       vm_source;
+
+	/** Listening socket clients connect to. */
+	int                         client_listen_fd;
+
+	/** Path to \ref client_listen_fd. */
+	gchar                      *client_path;
+
+	/** List of \ref clr_oci_console_client. */
+	GSList                     *clients;
+
+	/** Used to pause the VM while idle (or \c NULL). */
+	struct clr_oci_autopause   *autopause;
+};
+
+static gboolean clr_oci_console_client_write (gint fd, GIOCondition cond,
+		struct clr_oci_console_client *client);
+static gboolean clr_oci_console_client_read (gint fd, GIOCondition cond,
+		struct clr_oci_console_client *client);
+
+/*!
+ * Determine the largest single write made to a ring buffer.
+ *
+ * Readers never read data within this distance of being overwritten,
+ * so they cannot see a partially-written update.
+ *
+ * \param size Size of ring buffer.
+ *
+ * \return Size in bytes.
+ */
+static guint64
+clr_oci_console_log_guard (guint64 size)
+{
+	return MIN (CLR_OCI_CONSOLE_LOG_CHUNK, size / 4);
+}
+
+/*!
+ * Create a new, empty ring buffer file and map it.
+ *
+ * \param[out] log \ref clr_oci_console_log.
+ * \param path Full path to file to create.
+ * \param size Size of ring buffer (excluding header).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_console_log_create (struct clr_oci_console_log *log,
+		const gchar *path, gsize size)
+{
+	struct clr_oci_console_log_header *header;
+	gsize   map_size;
+	void   *map;
+	int     fd;
+
+	if (! (log && path && size >= 4)) {
+		return false;
+	}
+
+	map_size = sizeof (struct clr_oci_console_log_header) + size;
+
+	fd = open (path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+	if (fd < 0) {
+		g_critical ("failed to create console log %s: %s",
+				path, strerror (errno));
+		return false;
+	}
+
+	if (ftruncate (fd, (off_t)map_size) < 0) {
+		g_critical ("failed to size console log %s: %s",
+				path, strerror (errno));
+		goto err;
+	}
+
+	map = mmap (NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+	if (map == MAP_FAILED) {
+		g_critical ("failed to map console log %s: %s",
+				path, strerror (errno));
+		goto err;
+	}
+
+	close (fd);
+
+	header = map;
+	memcpy (header->magic, CLR_OCI_CONSOLE_LOG_MAGIC,
+			sizeof (header->magic));
+	header->version = CLR_OCI_CONSOLE_LOG_VERSION;
+	header->header_size = (guint32)sizeof (*header);
+	header->size = size;
+	header->head = 0;
+
+	log->header = header;
+	log->data = (gchar *)map + sizeof (*header);
+	log->map_size = map_size;
+
+	return true;
+
+err:
+	close (fd);
+	(void)unlink (path);
+
+	return false;
+}
+
+/*!
+ * Map an existing ring buffer file for reading.
+ *
+ * \param[out] log \ref clr_oci_console_log.
+ * \param path Full path to file.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_console_log_open (struct clr_oci_console_log *log,
+		const gchar *path)
+{
+	struct clr_oci_console_log_header *header;
+	struct stat  st;
+	void        *map;
+	int          fd;
+
+	if (! (log && path)) {
+		return false;
+	}
+
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		g_critical ("failed to open console log %s: %s",
+				path, strerror (errno));
+		return false;
+	}
+
+	if (fstat (fd, &st) < 0
+			|| (gsize)st.st_size < sizeof (*header)) {
+		g_critical ("invalid console log %s", path);
+		close (fd);
+		return false;
+	}
+
+	map = mmap (NULL, (gsize)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+
+	if (map == MAP_FAILED) {
+		g_critical ("failed to map console log %s: %s",
+				path, strerror (errno));
+		return false;
+	}
+
+	header = map;
+
+	if (memcmp (header->magic, CLR_OCI_CONSOLE_LOG_MAGIC,
+				sizeof (header->magic))
+			|| header->version != CLR_OCI_CONSOLE_LOG_VERSION
+			|| header->header_size != sizeof (*header)
+			|| header->size < 4
+			|| header->size + sizeof (*header)
+				> (guint64)st.st_size) {
+		g_critical ("invalid console log %s", path);
+		munmap (map, (gsize)st.st_size);
+		return false;
+	}
+
+	log->header = header;
+	log->data = (gchar *)map + sizeof (*header);
+	log->map_size = (gsize)st.st_size;
+
+	return true;
+}
+
+/*!
+ * Unmap the specified ring buffer.
+ *
+ * \param log \ref clr_oci_console_log.
+ */
+void
+clr_oci_console_log_close (struct clr_oci_console_log *log)
+{
+	if (! (log && log->header)) {
+		return;
+	}
+
+	munmap (log->header, log->map_size);
+
+	log->header = NULL;
+	log->data = NULL;
+	log->map_size = 0;
+}
+
+/*!
+ * Determine the total number of bytes ever written to the specified
+ * ring buffer.
+ *
+ * \param log \ref clr_oci_console_log.
+ *
+ * \return Number of bytes.
+ */
+guint64
+clr_oci_console_log_head (const struct clr_oci_console_log *log)
+{
+	g_assert (log);
+	g_assert (log->header);
+
+	return __atomic_load_n (&log->header->head, __ATOMIC_ACQUIRE);
+}
+
+/*!
+ * Determine the position of the oldest data that can safely be read
+ * from the specified ring buffer.
+ *
+ * \param log \ref clr_oci_console_log.
+ * \param head Current head of ring buffer.
+ *
+ * \return Position.
+ */
+static guint64
+clr_oci_console_log_oldest (const struct clr_oci_console_log *log,
+		guint64 head)
+{
+	guint64 size = log->header->size;
+	guint64 usable = size - clr_oci_console_log_guard (size);
+
+	return head > usable ? head - usable : 0;
+}
+
+/*!
+ * Append data to the specified ring buffer, overwriting the oldest
+ * data if the buffer is full.
+ *
+ * \param log \ref clr_oci_console_log.
+ * \param data Data to write.
+ * \param len Length of \p data.
+ */
+void
+clr_oci_console_log_write (struct clr_oci_console_log *log,
+		const gchar *data, gsize len)
+{
+	guint64 size;
+	guint64 guard;
+	guint64 head;
+
+	g_assert (log);
+	g_assert (log->header);
+
+	if (! (data && len)) {
+		return;
+	}
+
+	size = log->header->size;
+	guard = clr_oci_console_log_guard (size);
+	head = log->header->head;
+
+	/* Only the most recent data can be retained */
+	if (len > size) {
+		data += len - size;
+		head += len - size;
+		len = (gsize)size;
+	}
+
+	while (len) {
+		gsize chunk = (gsize)MIN (len, guard);
+		gsize offset = (gsize)(head % size);
+		gsize first = (gsize)MIN (chunk, size - offset);
+
+		memcpy (log->data + offset, data, first);
+		memcpy (log->data, data + first, chunk - first);
+
+		head += chunk;
+		data += chunk;
+		len -= chunk;
+
+		/* Publish the data only once it has been written */
+		__atomic_store_n (&log->header->head, head,
+				__ATOMIC_RELEASE);
+	}
+}
+
+/*!
+ * Read data from the specified ring buffer.
+ *
+ * \param log \ref clr_oci_console_log.
+ * \param[in,out] pos Position to read from, updated to the position
+ *   following the data read. If the data at \p pos has already been
+ *   overwritten, reading starts from the oldest available data.
+ * \param buf Buffer to read into.
+ * \param len Size of \p buf.
+ *
+ * \return Number of bytes read.
+ */
+gsize
+clr_oci_console_log_read (const struct clr_oci_console_log *log,
+		guint64 *pos, gchar *buf, gsize len)
+{
+	guint64  size;
+	guint64  head;
+	guint64  oldest;
+	gsize    count;
+	gsize    offset;
+	gsize    first;
+
+	g_assert (log);
+	g_assert (log->header);
+	g_assert (pos);
+	g_assert (buf);
+
+	size = log->header->size;
+
+	while (true) {
+		head = clr_oci_console_log_head (log);
+
+		oldest = clr_oci_console_log_oldest (log, head);
+		if (*pos < oldest || *pos > head) {
+			*pos = oldest;
+		}
+
+		count = (gsize)MIN (len, head - *pos);
+		if (! count) {
+			return 0;
+		}
+
+		offset = (gsize)(*pos % size);
+		first = (gsize)MIN (count, size - offset);
+
+		memcpy (buf, log->data + offset, first);
+		memcpy (buf + first, log->data, count - first);
+
+		/* Discard anything overwritten whilst copying */
+		oldest = clr_oci_console_log_oldest (log,
+				clr_oci_console_log_head (log));
+		if (*pos >= oldest) {
+			break;
+		}
+
+		if (*pos + count > oldest) {
+			gsize lost = (gsize)(oldest - *pos);
+
+			memmove (buf, buf + lost, count - lost);
+			count -= lost;
+			*pos = oldest;
+			break;
+		}
+
+		/* all overwritten, so try again */
+	}
+
+	*pos += count;
+
+	return count;
+}
+
+/*!
+ * Determine the position in the specified ring buffer from which the
+ * last \p lines lines of output start.
+ *
+ * \param log \ref clr_oci_console_log.
+ * \param lines Number of lines.
+ *
+ * \return Position.
+ */
+guint64
+clr_oci_console_log_tail (const struct clr_oci_console_log *log,
+		guint lines)
+{
+	guint64  size;
+	guint64  head;
+	guint64  oldest;
+	guint64  pos;
+
+	g_assert (log);
+	g_assert (log->header);
+
+	size = log->header->size;
+	head = clr_oci_console_log_head (log);
+	oldest = clr_oci_console_log_oldest (log, head);
+
+	if (! lines) {
+		return head;
+	}
+
+	pos = head;
+
+	/* Ignore the newline ending the final line */
+	if (pos > oldest && log->data[(pos - 1) % size] == '\n') {
+		pos--;
+	}
+
+	for (; pos > oldest; pos--) {
+		if (log->data[(pos - 1) % size] == '\n' && ! --lines) {
+			break;
+		}
+	}
+
+	return pos;
+}
+
+/*!
+ * Disconnect the specified client.
+ *
+ * \param client \ref clr_oci_console_client.
+ */
+static void
+clr_oci_console_client_free (struct clr_oci_console_client *client)
+{
+	struct clr_oci_console_capture *capture = client->capture;
+
+	capture->clients = g_slist_remove (capture->clients, client);
+
+	if (client->in_source) {
+		g_source_remove (client->in_source);
+	}
+
+	if (client->out_source) {
+		g_source_remove (client->out_source);
+	}
+
+	if (client->input_source) {
+		g_source_remove (client->input_source);
+	}
+
+	close (client->fd);
+	g_free (client);
+}
+
+/*!
+ * Start sending new console output to the specified client.
+ *
+ * \param client \ref clr_oci_console_client.
+ */
+static void
+clr_oci_console_client_wake (struct clr_oci_console_client *client)
+{
+	if (client->out_source) {
+		return;
+	}
+
+	client->out_source = g_unix_fd_add (client->fd, G_IO_OUT,
+			(GUnixFDSourceFunc)clr_oci_console_client_write,
+			client);
+}
+
+/*!
+ * Send console output to a client.
+ *
+ * \param fd File descriptor.
+ * \param cond \c GIOCondition.
+ * \param client \ref clr_oci_console_client.
+ *
+ * \return \c true if the source should remain, else \c false.
+ */
+static gboolean
+clr_oci_console_client_write (gint fd, GIOCondition cond,
+		struct clr_oci_console_client *client)
+{
+	gchar     buf[CLR_OCI_CONSOLE_LOG_CHUNK];
+	guint64   pos = client->pos;
+	gsize     count;
+	ssize_t   bytes;
+
+	(void)cond;
+
+	count = clr_oci_console_log_read (&client->capture->log,
+			&pos, buf, sizeof (buf));
+	if (! count) {
+		/* up to date */
+		client->pos = pos;
+		client->out_source = 0;
+		return false;
+	}
+
+	bytes = send (fd, buf, count, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (bytes < 0) {
+		if (errno == EAGAIN || errno == EINTR) {
+			return true;
+		}
+
+		client->out_source = 0;
+		clr_oci_console_client_free (client);
+		return false;
+	}
+
+	/* The client may have fallen behind, so position from where
+	 * the data was actually read.
+	 */
+	client->pos = pos - count + (gsize)bytes;
+
+	return true;
+}
+
+/*!
+ * Start reading input from a client again, discarding any input not
+ * yet sent.
+ *
+ * \param client \ref clr_oci_console_client.
+ */
+static void
+clr_oci_console_client_resume (struct clr_oci_console_client *client)
+{
+	if (client->input_source) {
+		g_source_remove (client->input_source);
+		client->input_source = 0;
+	}
+
+	client->input_offset = 0;
+	client->input_pending = 0;
+
+	if (client->in_source) {
+		return;
+	}
+
+	client->in_source = g_unix_fd_add (client->fd, G_IO_IN | G_IO_HUP,
+			(GUnixFDSourceFunc)clr_oci_console_client_read,
+			client);
+}
+
+/*!
+ * Send pending input from a client to the hypervisor.
+ *
+ * \param client \ref clr_oci_console_client.
+ *
+ * \return \c true if all input has been sent (or dropped), \c false
+ *   if the hypervisor is not accepting more yet.
+ */
+static gboolean
+clr_oci_console_client_send (struct clr_oci_console_client *client)
+{
+	struct clr_oci_console_capture *capture = client->capture;
+	ssize_t   bytes;
+
+	while (client->input_pending) {
+		/* Input is dropped if there is no hypervisor to take it */
+		if (capture->vm_fd < 0) {
+			break;
+		}
+
+		bytes = send (capture->vm_fd,
+				client->input + client->input_offset,
+				client->input_pending,
+				MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno == EAGAIN) {
+				return false;
+			}
+
+			/* the hypervisor disconnecting is handled by
+			 * clr_oci_console_vm_read()
+			 */
+			break;
+		}
+
+		client->input_offset += (gsize)bytes;
+		client->input_pending -= (gsize)bytes;
+	}
+
+	client->input_offset = 0;
+	client->input_pending = 0;
+
+	return true;
+}
+
+/*!
+ * Handle the hypervisor accepting more input from a client.
+ *
+ * \param fd File descriptor.
+ * \param cond \c GIOCondition.
+ * \param client \ref clr_oci_console_client.
+ *
+ * \return \c true if the source should remain, else \c false.
+ */
+static gboolean
+clr_oci_console_client_input_ready (gint fd, GIOCondition cond,
+		struct clr_oci_console_client *client)
+{
+	(void)fd;
+	(void)cond;
+
+	if (! clr_oci_console_client_send (client)) {
+		return true;
+	}
+
+	/* All input sent, so start reading again */
+	client->input_source = 0;
+	clr_oci_console_client_resume (client);
+
+	return false;
+}
+
+/*!
+ * Forward input from a client to the hypervisor.
+ *
+ * Like the console relay, no more input is read from a client until
+ * the hypervisor has accepted everything already read.
+ *
+ * \param fd File descriptor.
+ * \param cond \c GIOCondition.
+ * \param client \ref clr_oci_console_client.
+ *
+ * \return \c true if the source should remain, else \c false.
+ */
+static gboolean
+clr_oci_console_client_read (gint fd, GIOCondition cond,
+		struct clr_oci_console_client *client)
+{
+	struct clr_oci_console_capture *capture = client->capture;
+	ssize_t   bytes;
+
+	(void)cond;
+
+	bytes = read (fd, client->input, sizeof (client->input));
+	if (bytes < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return true;
+	}
+
+	if (bytes <= 0) {
+		client->in_source = 0;
+		clr_oci_console_client_free (client);
+		return false;
+	}
+
+	clr_oci_autopause_activity (capture->autopause);
+
+	client->input_offset = 0;
+	client->input_pending = (gsize)bytes;
+
+	if (clr_oci_console_client_send (client)) {
+		return true;
+	}
+
+	/* Stop reading until the hypervisor takes the rest */
+	client->in_source = 0;
+	client->input_source = g_unix_fd_add (capture->vm_fd,
+			G_IO_OUT | G_IO_HUP | G_IO_ERR,
+			(GUnixFDSourceFunc)clr_oci_console_client_input_ready,
+			client);
+
+	return false;
+}
+
+/*!
+ * Close the connection from the hypervisor.
+ *
+ * Clients waiting to send input over it are started reading again.
+ *
+ * \param capture \ref clr_oci_console_capture.
+ */
+static void
+clr_oci_console_vm_close (struct clr_oci_console_capture *capture)
+{
+	struct clr_oci_console_client *client;
+	GSList   *l;
+
+	for (l = capture->clients; l; l = g_slist_next (l)) {
+		client = l->data;
+
+		if (client->input_source) {
+			clr_oci_console_client_resume (client);
+		}
+	}
+
+	if (capture->vm_source) {
+		g_source_remove (capture->vm_source);
+		capture->vm_source = 0;
+	}
+
+	close (capture->vm_fd);
+	capture->vm_fd = -1;
+}
+
+/*!
+ * Accept a new client connection.
+ *
+ * \param fd File descriptor.
+ * \param cond \c GIOCondition.
+ * \param capture \ref clr_oci_console_capture.
+ *
+ * \return \c true.
+ */
+static gboolean
+clr_oci_console_client_accept (gint fd, GIOCondition cond,
+		struct clr_oci_console_capture *capture)
+{
+	struct clr_oci_console_client *client;
+	int client_fd;
+
+	(void)cond;
+
+	client_fd = accept4 (fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (client_fd < 0) {
+		return true;
+	}
+
+	client = g_new0 (struct clr_oci_console_client, 1);
+	client->capture = capture;
+	client->fd = client_fd;
+
+	/* Like a real console, clients only see new output */
+	client->pos = clr_oci_console_log_head (&capture->log);
+
+	client->in_source = g_unix_fd_add (client_fd, G_IO_IN | G_IO_HUP,
+			(GUnixFDSourceFunc)clr_oci_console_client_read,
+			client);
+
+	capture->clients = g_slist_prepend (capture->clients, client);
+
+	return true;
+}
+
+/*!
+ * Capture output from the hypervisor.
+ *
+ * \param fd File descriptor.
+ * \param cond \c GIOCondition.
+ * \param capture \ref clr_oci_console_capture.
+ *
+ * \return \c true if the source should remain, else \c false.
+ */
+static gboolean
+clr_oci_console_vm_read (gint fd, GIOCondition cond,
+		struct clr_oci_console_capture *capture)
+{
+	gchar     buf[CLR_OCI_CONSOLE_LOG_CHUNK];
+	ssize_t   bytes;
+	GSList   *l;
+
+	(void)cond;
+
+	bytes = read (fd, buf, sizeof (buf));
+	if (bytes < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return true;
+	}
+
+	if (bytes <= 0) {
+		/* hypervisor disconnected (the source is removed by
+		 * returning)
+		 */
+		capture->vm_source = 0;
+		clr_oci_console_vm_close (capture);
+		return false;
+	}
+
+	clr_oci_console_log_write (&capture->log, buf, (gsize)bytes);
+
+	clr_oci_autopause_activity (capture->autopause);
+
+	for (l = capture->clients; l; l = g_slist_next (l)) {
+		clr_oci_console_client_wake (l->data);
+	}
+
+	return true;
+}
+
+/*!
+ * Accept a connection from the hypervisor.
+ *
+ * \param fd File descriptor.
+ * \param cond \c GIOCondition.
+ * \param capture \ref clr_oci_console_capture.
+ *
+ * \return \c true.
+ */
+static gboolean
+clr_oci_console_vm_accept (gint fd, GIOCondition cond,
+		struct clr_oci_console_capture *capture)
+{
+	int vm_fd;
+
+	(void)cond;
+
+	vm_fd = accept4 (fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (vm_fd < 0) {
+		return true;
+	}
+
+	/* The hypervisor reconnected, so replace the old connection */
+	if (capture->vm_fd >= 0) {
+		clr_oci_console_vm_close (capture);
+	}
+
+	capture->vm_fd = vm_fd;
+	capture->vm_source = g_unix_fd_add (vm_fd, G_IO_IN | G_IO_HUP,
+			(GUnixFDSourceFunc)clr_oci_console_vm_read,
+			capture);
+
+	return true;
+}
+
+/*!
+ * Called when the hypervisor exits.
+ *
+ * \param capture \ref clr_oci_console_capture.
+ *
+ * \return \c false.
+ */
+static gboolean
+clr_oci_console_vm_exited (struct clr_oci_console_capture *capture)
+{
+	g_main_loop_quit (capture->loop);
+
+	return false;
+}
+
+/*!
+ * Capture the console of a VM until the hypervisor exits.
+ *
+ * This is the body of the console capture helper started by
+ * clr_oci_console_capture_start(). Once the sockets and log file
+ * have been created, a byte is written to \c args->ready_fd.
+ *
+ * \param args \ref clr_oci_console_capture_args.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_console_capture (const struct clr_oci_console_capture_args *args)
+{
+	struct clr_oci_console_capture  capture = { { 0 } };
+	g_autofree gchar               *log_path = NULL;
+	gboolean                        ret = false;
+
+	if (! (args && args->vm_pid > 0 && args->comms_path
+				&& args->runtime_path && args->client_path)) {
+		return false;
+	}
+
+	capture.vm_pid = (GPid)args->vm_pid;
+	capture.vm_fd = -1;
+	capture.vm_listen_fd = -1;
+	capture.client_listen_fd = -1;
+	capture.client_path = args->client_path;
+	capture.vm_path = g_build_path ("/", args->runtime_path,
+			CLR_OCI_CONSOLE_VM_SOCKET, NULL);
+	log_path = g_build_path ("/", args->runtime_path,
+			CLR_OCI_CONSOLE_LOG_FILE, NULL);
+
+	if (! clr_oci_console_log_create (&capture.log, log_path,
+				CLR_OCI_CONSOLE_LOG_SIZE)) {
+		goto out;
+	}
+
+	capture.vm_listen_fd = clr_oci_socket_listen (capture.vm_path,
+			SOCK_NONBLOCK);
+	if (capture.vm_listen_fd < 0) {
+		goto out;
+	}
+
+	capture.client_listen_fd = clr_oci_socket_listen (capture.client_path,
+			SOCK_NONBLOCK);
+	if (capture.client_listen_fd < 0) {
+		goto out;
+	}
+
+	if (args->autopause_idle > 0) {
+		capture.autopause = clr_oci_autopause_new (args->runtime_path,
+				args->comms_path, capture.vm_pid,
+				(guint)args->autopause_idle);
+		if (! capture.autopause) {
+			g_warning ("not pausing idle VM %d",
+					(int)capture.vm_pid);
+		}
+	}
+
+	capture.loop = g_main_loop_new (NULL, false);
+
+	g_unix_fd_add (capture.vm_listen_fd, G_IO_IN,
+			(GUnixFDSourceFunc)clr_oci_console_vm_accept,
+			&capture);
+
+	g_unix_fd_add (capture.client_listen_fd, G_IO_IN,
+			(GUnixFDSourceFunc)clr_oci_console_client_accept,
+			&capture);
+
+	if (capture.autopause) {
+		g_timeout_add_seconds (CLR_OCI_AUTOPAUSE_INTERVAL,
+				(GSourceFunc)clr_oci_autopause_check,
+				capture.autopause);
+	}
+
+	/* "create" waits for ready_fd while the VM is stopped, so
+	 * the pid cannot have been reused yet.
+	 */
+	if (! clr_oci_pid_watch (capture.vm_pid, 0,
+				(GSourceFunc)clr_oci_console_vm_exited,
+				&capture)) {
+		g_critical ("failed to watch hypervisor %d",
+				(int)capture.vm_pid);
+		goto out;
+	}
+
+	if (args->ready_fd >= 0) {
+		if (write (args->ready_fd, "", 1) != 1) {
+			g_critical ("failed to report console capture "
+					"ready: %s", strerror (errno));
+			goto out;
+		}
+
+		close (args->ready_fd);
+	}
+
+	g_debug ("capturing console of VM %d to %s",
+			(int)capture.vm_pid, log_path);
+
+	g_main_loop_run (capture.loop);
+
+	g_debug ("hypervisor %d exited, console capture finished",
+			(int)capture.vm_pid);
+
+	ret = true;
+
+out:
+	if (capture.vm_listen_fd >= 0) {
+		close (capture.vm_listen_fd);
+	}
+
+	if (capture.client_listen_fd >= 0) {
+		close (capture.client_listen_fd);
+	}
+
+	/* Remove the sockets (if the runtime directory still exists),
+	 * but leave the log for "logs" to read.
+	 */
+	(void)unlink (capture.vm_path);
+	(void)unlink (capture.client_path);
+
+	if (capture.loop) {
+		g_main_loop_unref (capture.loop);
+	}
+
+	clr_oci_console_log_close (&capture.log);
+	clr_oci_autopause_free (capture.autopause);
+	g_free (capture.vm_path);
+
+	return ret;
+}
+
+/*!
+ * Prepare the console capture helper to be exec'd.
+ *
+ * \param fd File descriptor the helper reports readiness on.
+ */
+static void
+clr_oci_console_capture_setup_child (gpointer fd)
+{
+	int ready_fd = GPOINTER_TO_INT (fd);
+
+	/* become session leader so the capture outlives the runtime
+	 * and does not hold the callers terminal.
+	 */
+	setsid ();
+
+	(void)fcntl (ready_fd, F_SETFD,
+			fcntl (ready_fd, F_GETFD) & ~FD_CLOEXEC);
+}
+
+/*!
+ * Start capturing the console of the specified VM.
+ *
+ * The capture runs in a separate helper process (the runtime itself,
+ * run as the hidden \ref CLR_OCI_CONSOLE_CAPTURE_COMMAND command)
+ * which exits once the hypervisor does. This function only returns
+ * once the helper has created the sockets and log file, so the
+ * hypervisor and clients can connect immediately.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_console_capture_start (struct clr_oci_config *config)
+{
+	g_autofree gchar  *pid_arg = NULL;
+	g_autofree gchar  *comms_arg = NULL;
+	g_autofree gchar  *runtime_arg = NULL;
+	g_autofree gchar  *socket_arg = NULL;
+	g_autofree gchar  *idle_arg = NULL;
+	g_autofree gchar  *ready_arg = NULL;
+	gchar             *args[16];
+	GError            *err = NULL;
+	gboolean           ret = false;
+	ssize_t            bytes;
+	gchar              c;
+	guint              i = 0;
+	int                fds[2];
+
+	if (! (config && config->console && config->use_socket_console)) {
+		return false;
+	}
+
+	if (pipe2 (fds, O_CLOEXEC) < 0) {
+		g_critical ("failed to create pipe: %s", strerror (errno));
+		return false;
+	}
+
+	pid_arg = g_strdup_printf ("--pid=%d",
+			(int)config->state.workload_pid);
+	comms_arg = g_strdup_printf ("--comms=%s",
+			config->state.comms_path);
+	runtime_arg = g_strdup_printf ("--runtime-dir=%s",
+			config->state.runtime_path);
+	socket_arg = g_strdup_printf ("--socket=%s", config->console);
+	idle_arg = g_strdup_printf ("--autopause-idle=%u",
+			clr_oci_autopause_get (config));
+	ready_arg = g_strdup_printf ("--ready-fd=%d", fds[1]);
+
+	args[i++] = "/proc/self/exe";
+	if (config->root_dir) {
+		args[i++] = "--root";
+		args[i++] = config->root_dir;
+	}
+	if (enable_debug) {
+		args[i++] = "--debug";
+	}
+	args[i++] = CLR_OCI_CONSOLE_CAPTURE_COMMAND;
+	args[i++] = pid_arg;
+	args[i++] = comms_arg;
+	args[i++] = runtime_arg;
+	args[i++] = socket_arg;
+	args[i++] = idle_arg;
+	args[i++] = ready_arg;
+	args[i] = NULL;
+
+	/* GLib double-forks, so the helper is not our child */
+	ret = g_spawn_async (NULL, args, NULL,
+			G_SPAWN_STDOUT_TO_DEV_NULL
+			| G_SPAWN_STDERR_TO_DEV_NULL,
+			clr_oci_console_capture_setup_child,
+			GINT_TO_POINTER (fds[1]),
+			NULL, &err);
+
+	close (fds[1]);
+
+	if (! ret) {
+		g_critical ("failed to spawn console capture: %s",
+				err->message);
+		g_error_free (err);
+		goto out;
+	}
+
+	/* The helper only reports it is ready once it is capturing,
+	 * so end of file means it failed.
+	 */
+	do {
+		bytes = read (fds[0], &c, 1);
+	} while (bytes < 0 && errno == EINTR);
+
+	if (bytes != 1) {
+		g_critical ("console capture of VM %d failed to start",
+				(int)config->state.workload_pid);
+		ret = false;
+		goto out;
+	}
+
+	g_debug ("console capture of VM %d started",
+			(int)config->state.workload_pid);
+
+out:
+	close (fds[0]);
+
+	return ret;
+}
+
+/*!
+ * Write all of \p len bytes of \p buf to stdout.
+ *
+ * \param buf Data to write.
+ * \param len Length of \p buf.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_console_logs_write (const gchar *buf, gsize len)
+{
+	ssize_t bytes;
+
+	while (len) {
+		bytes = write (STDOUT_FILENO, buf, len);
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (bytes <= 0) {
+			return false;
+		}
+
+		buf += bytes;
+		len -= (gsize)bytes;
+	}
+
+	return true;
+}
+
+/*!
+ * Display the captured console output of the specified VM.
+ *
+ * \param config \ref clr_oci_config.
+ * \param tail Number of lines to display from the end of the
+ *   output, or a negative value to display all output.
+ * \param follow If \c true, continue displaying new output until
+ *   the VM exits.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_console_logs (struct clr_oci_config *config,
+		gint tail, gboolean follow)
+{
+	struct clr_oci_console_log  log = { 0 };
+	g_autofree gchar           *log_path = NULL;
+	gchar                       buf[CLR_OCI_CONSOLE_LOG_CHUNK];
+	guint64                     pos = 0;
+	gsize                       count;
+	gboolean                    ret = true;
+
+	if (! config) {
+		return false;
+	}
+
+	log_path = g_build_path ("/", config->state.runtime_path,
+			CLR_OCI_CONSOLE_LOG_FILE, NULL);
+
+	if (! clr_oci_console_log_open (&log, log_path)) {
+		return false;
+	}
+
+	if (tail >= 0) {
+		pos = clr_oci_console_log_tail (&log, (guint)tail);
+	}
+
+	while (true) {
+		count = clr_oci_console_log_read (&log, &pos,
+				buf, sizeof (buf));
+		if (count) {
+			if (! clr_oci_console_logs_write (buf, count)) {
+				ret = false;
+				break;
+			}
+			continue;
+		}
+
+		if (! follow) {
+			break;
+		}
+
+		/* Once the VM has gone, no more output can appear */
+		if (! clr_oci_pid_running (config->state.workload_pid,
+					config->state.workload_start_time)) {
+			/* but display anything written since the
+			 * last read.
+			 */
+			follow = false;
+			continue;
+		}
+
+		g_usleep (CLR_OCI_CONSOLE_LOG_POLL_MS * 1000);
+	}
+
+	clr_oci_console_log_close (&log);
+
+	return ret;
+}
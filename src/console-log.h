@@ -0,0 +1,122 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_CONSOLE_LOG_H
+#define _CLR_OCI_CONSOLE_LOG_H
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "oci.h"
+
+/** Default number of bytes of console output retained per container. */
+#define CLR_OCI_CONSOLE_LOG_SIZE (1024 * 1024)
+
+/** Hidden command that runs the console capture helper. */
+#define CLR_OCI_CONSOLE_CAPTURE_COMMAND "console-capture"
+
+/** Identifies a \ref CLR_OCI_CONSOLE_LOG_FILE. */
+#define CLR_OCI_CONSOLE_LOG_MAGIC "CLRCLOG1"
+
+/** Version of the \ref CLR_OCI_CONSOLE_LOG_FILE format. */
+#define CLR_OCI_CONSOLE_LOG_VERSION 1
+
+/** Header at the start of a \ref CLR_OCI_CONSOLE_LOG_FILE.
+ *
+ * The header is followed by \ref size bytes of data used as a ring
+ * buffer.
+ */
+struct clr_oci_console_log_header {
+	/** \ref CLR_OCI_CONSOLE_LOG_MAGIC. */
+	gchar    magic[8];
+
+	/** \ref CLR_OCI_CONSOLE_LOG_VERSION. */
+	guint32  version;
+
+	/** Size of this header. */
+	guint32  header_size;
+
+	/** Size of the ring buffer. */
+	guint64  size;
+
+	/** Total number of bytes ever written (the next byte is
+	 * written at offset \c head % \ref size).
+	 */
+	guint64  head;
+};
+
+/** A mapped \ref CLR_OCI_CONSOLE_LOG_FILE. */
+struct clr_oci_console_log {
+	/** Mapped header. */
+	struct clr_oci_console_log_header  *header;
+
+	/** Mapped ring buffer. */
+	gchar                              *data;
+
+	/** Total size of mapping. */
+	gsize                               map_size;
+};
+
+/** Arguments of the console capture helper (see
+ * clr_oci_console_capture_start()).
+ */
+struct clr_oci_console_capture_args {
+	/** Pid of the hypervisor. */
+	gint    vm_pid;
+
+	/** Path to \ref CLR_OCI_HYPERVISOR_SOCKET. */
+	gchar  *comms_path;
+
+	/** Runtime directory of the container. */
+	gchar  *runtime_path;
+
+	/** Path of the socket clients connect to. */
+	gchar  *client_path;
+
+	/** Seconds the VM must be idle for before it is paused
+	 * (\c 0 to never pause it).
+	 */
+	gint    autopause_idle;
+
+	/** File descriptor to report readiness on (or \c -1). */
+	gint    ready_fd;
+};
+
+gboolean clr_oci_console_log_create (struct clr_oci_console_log *log,
+		const gchar *path, gsize size);
+gboolean clr_oci_console_log_open (struct clr_oci_console_log *log,
+		const gchar *path);
+void clr_oci_console_log_close (struct clr_oci_console_log *log);
+void clr_oci_console_log_write (struct clr_oci_console_log *log,
+		const gchar *data, gsize len);
+guint64 clr_oci_console_log_head (const struct clr_oci_console_log *log);
+gsize clr_oci_console_log_read (const struct clr_oci_console_log *log,
+		guint64 *pos, gchar *buf, gsize len);
+guint64 clr_oci_console_log_tail (const struct clr_oci_console_log *log,
+		guint lines);
+
+gboolean clr_oci_console_capture_start (struct clr_oci_config *config);
+gboolean clr_oci_console_capture
+	(const struct clr_oci_console_capture_args *args);
+gboolean clr_oci_console_logs (struct clr_oci_config *config,
+		gint tail, gboolean follow);
+
+#endif /* _CLR_OCI_CONSOLE_LOG_H */
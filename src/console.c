@@ -0,0 +1,398 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Relay data between a console socket and a terminal.
+ *
+ * Each direction is relayed by moving data from its input to a pipe
+ * and from the pipe to its output with \c splice(2), so the data is
+ * never copied into userspace. Where a file descriptor does not
+ * support \c splice(2) (for example some terminals), a fixed buffer
+ * is used instead.
+ *
+ * Input is only read once all previously read data has been written,
+ * so a slow reader simply stops the relay reading more data rather
+ * than causing unbounded buffering.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "console.h"
+#include "util.h"
+
+static gboolean clr_oci_console_in_ready (gint fd, GIOCondition cond,
+		struct clr_oci_console_stream *stream);
+static gboolean clr_oci_console_out_ready (gint fd, GIOCondition cond,
+		struct clr_oci_console_stream *stream);
+
+/*!
+ * Determine if \p err means \c splice(2) cannot be used for a file
+ * descriptor.
+ *
+ * \param err \c errno value.
+ *
+ * \return \c true if \c splice(2) is unsupported, else \c false.
+ */
+static gboolean
+clr_oci_console_splice_unsupported (int err)
+{
+	return err == EINVAL || err == ENOSYS || err == EOPNOTSUPP;
+}
+
+/*!
+ * Stop relaying the specified stream.
+ *
+ * \param stream \ref clr_oci_console_stream.
+ */
+static void
+clr_oci_console_stream_done (struct clr_oci_console_stream *stream)
+{
+	struct clr_oci_console_relay *relay = stream->relay;
+
+	if (stream->in_source) {
+		g_source_remove (stream->in_source);
+		stream->in_source = 0;
+	}
+
+	if (stream->out_source) {
+		g_source_remove (stream->out_source);
+		stream->out_source = 0;
+	}
+
+	stream->done = true;
+
+	/* Nothing more can be displayed once the console output has
+	 * finished (generally because the VM has shut down).
+	 */
+	if (stream == &relay->output && relay->loop) {
+		g_main_loop_quit (relay->loop);
+	}
+}
+
+/*!
+ * Switch the specified stream from using \c splice(2) to using a
+ * buffer, moving any data already in the pipe into the buffer.
+ *
+ * \param stream \ref clr_oci_console_stream.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_console_stream_unsplice (struct clr_oci_console_stream *stream)
+{
+	gsize    total = 0;
+	ssize_t  bytes;
+
+	if (! stream->buf) {
+		stream->buf = g_malloc (CLR_OCI_CONSOLE_BUFFER_SIZE);
+	}
+
+	while (total < stream->pending) {
+		bytes = read (stream->pipe[0], stream->buf + total,
+				stream->pending - total);
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (bytes <= 0) {
+			return false;
+		}
+
+		total += (gsize)bytes;
+	}
+
+	stream->offset = 0;
+	stream->use_splice = false;
+
+	return true;
+}
+
+/*!
+ * Handle data being available on the input side of a stream.
+ *
+ * \param fd File descriptor.
+ * \param cond \c GIOCondition.
+ * \param stream \ref clr_oci_console_stream.
+ *
+ * \return \c true if the source should remain, else \c false.
+ */
+static gboolean
+clr_oci_console_in_ready (gint fd, GIOCondition cond,
+		struct clr_oci_console_stream *stream)
+{
+	ssize_t bytes = -1;
+
+	(void)cond;
+
+	if (stream->use_splice) {
+		bytes = splice (fd, NULL, stream->pipe[1], NULL,
+				CLR_OCI_CONSOLE_BUFFER_SIZE,
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (bytes < 0 && clr_oci_console_splice_unsupported (errno)) {
+			g_debug ("cannot splice from fd %d, "
+					"using buffer", fd);
+
+			/* the pipe is empty so no data needs moving */
+			if (! stream->buf) {
+				stream->buf = g_malloc (CLR_OCI_CONSOLE_BUFFER_SIZE);
+			}
+			stream->use_splice = false;
+		}
+	}
+
+	if (! stream->use_splice) {
+		bytes = read (fd, stream->buf, CLR_OCI_CONSOLE_BUFFER_SIZE);
+	}
+
+	if (bytes < 0) {
+		if (errno == EAGAIN || errno == EINTR) {
+			return true;
+		}
+
+		g_debug ("failed to read from fd %d: %s",
+				fd, strerror (errno));
+	}
+
+	if (bytes <= 0) {
+		/* EOF or error */
+		stream->in_source = 0;
+		clr_oci_console_stream_done (stream);
+		return false;
+	}
+
+	stream->offset = 0;
+	stream->pending = (gsize)bytes;
+
+	/* Stop reading until the data has been written */
+	stream->in_source = 0;
+	stream->out_source = g_unix_fd_add (stream->out_fd,
+			G_IO_OUT | G_IO_HUP | G_IO_ERR,
+			(GUnixFDSourceFunc)clr_oci_console_out_ready,
+			stream);
+
+	return false;
+}
+
+/*!
+ * Handle the output side of a stream being writable.
+ *
+ * \param fd File descriptor.
+ * \param cond \c GIOCondition.
+ * \param stream \ref clr_oci_console_stream.
+ *
+ * \return \c true if the source should remain, else \c false.
+ */
+static gboolean
+clr_oci_console_out_ready (gint fd, GIOCondition cond,
+		struct clr_oci_console_stream *stream)
+{
+	ssize_t bytes = -1;
+
+	(void)cond;
+
+	if (stream->use_splice) {
+		bytes = splice (stream->pipe[0], NULL, fd, NULL,
+				stream->pending,
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (bytes < 0 && clr_oci_console_splice_unsupported (errno)) {
+			g_debug ("cannot splice to fd %d, "
+					"using buffer", fd);
+
+			if (! clr_oci_console_stream_unsplice (stream)) {
+				goto done;
+			}
+		}
+	}
+
+	if (! stream->use_splice) {
+		bytes = write (fd, stream->buf + stream->offset,
+				stream->pending);
+	}
+
+	if (bytes < 0) {
+		if (errno == EAGAIN || errno == EINTR) {
+			return true;
+		}
+
+		g_debug ("failed to write to fd %d: %s",
+				fd, strerror (errno));
+		goto done;
+	}
+
+	stream->offset += (gsize)bytes;
+	stream->pending -= (gsize)bytes;
+
+	if (stream->pending) {
+		return true;
+	}
+
+	/* All data written, so start reading again */
+	stream->out_source = 0;
+	stream->in_source = g_unix_fd_add (stream->in_fd,
+			G_IO_IN | G_IO_HUP | G_IO_ERR,
+			(GUnixFDSourceFunc)clr_oci_console_in_ready,
+			stream);
+
+	return false;
+
+done:
+	stream->out_source = 0;
+	clr_oci_console_stream_done (stream);
+
+	return false;
+}
+
+/*!
+ * Start relaying data from \p in_fd to \p out_fd.
+ *
+ * \param stream \ref clr_oci_console_stream.
+ * \param relay \ref clr_oci_console_relay \p stream belongs to.
+ * \param in_fd File descriptor to read from.
+ * \param out_fd File descriptor to write to.
+ */
+static void
+clr_oci_console_stream_init (struct clr_oci_console_stream *stream,
+		struct clr_oci_console_relay *relay,
+		int in_fd, int out_fd)
+{
+	stream->relay = relay;
+	stream->in_fd = in_fd;
+	stream->out_fd = out_fd;
+
+	if (pipe2 (stream->pipe, O_CLOEXEC | O_NONBLOCK) == 0) {
+		stream->use_splice = true;
+	} else {
+		g_debug ("failed to create pipe: %s", strerror (errno));
+		stream->buf = g_malloc (CLR_OCI_CONSOLE_BUFFER_SIZE);
+	}
+
+	stream->in_source = g_unix_fd_add (in_fd,
+			G_IO_IN | G_IO_HUP | G_IO_ERR,
+			(GUnixFDSourceFunc)clr_oci_console_in_ready,
+			stream);
+}
+
+/*!
+ * Free the resources used by the specified stream.
+ *
+ * \param stream \ref clr_oci_console_stream.
+ */
+static void
+clr_oci_console_stream_free (struct clr_oci_console_stream *stream)
+{
+	if (stream->in_source) {
+		g_source_remove (stream->in_source);
+	}
+
+	if (stream->out_source) {
+		g_source_remove (stream->out_source);
+	}
+
+	if (stream->pipe[0] >= 0) {
+		close (stream->pipe[0]);
+	}
+
+	if (stream->pipe[1] >= 0) {
+		close (stream->pipe[1]);
+	}
+
+	g_free_if_set (stream->buf);
+}
+
+/*!
+ * Start relaying data between a console and a terminal.
+ *
+ * Data read from \p in_fd is written to \p console_fd and data read
+ * from \p console_fd is written to \p out_fd. The relay runs from
+ * the default main context and \p loop is quit once the console
+ * closes.
+ *
+ * \param relay \ref clr_oci_console_relay.
+ * \param console_fd Connected console socket.
+ * \param in_fd File descriptor to read console input from.
+ * \param out_fd File descriptor to write console output to.
+ * \param loop Main loop to quit when the console closes (or \c NULL).
+ *
+ * \note None of the file descriptors are closed by the relay.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_console_relay_init (struct clr_oci_console_relay *relay,
+		int console_fd, int in_fd, int out_fd, GMainLoop *loop)
+{
+	int flags;
+
+	if (! relay || console_fd < 0 || in_fd < 0 || out_fd < 0) {
+		return false;
+	}
+
+	memset (relay, 0, sizeof (*relay));
+
+	relay->input.pipe[0] = relay->input.pipe[1] = -1;
+	relay->output.pipe[0] = relay->output.pipe[1] = -1;
+
+	relay->loop = loop;
+
+	flags = fcntl (console_fd, F_GETFL);
+	if (flags < 0 || fcntl (console_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		g_critical ("failed to make console non-blocking: %s",
+				strerror (errno));
+		return false;
+	}
+
+	/* A closed console or terminal is detected by the write
+	 * failing with EPIPE.
+	 */
+	(void)signal (SIGPIPE, SIG_IGN);
+
+	clr_oci_console_stream_init (&relay->input, relay,
+			in_fd, console_fd);
+	clr_oci_console_stream_init (&relay->output, relay,
+			console_fd, out_fd);
+
+	return true;
+}
+
+/*!
+ * Stop relaying and free the resources used by the specified relay.
+ *
+ * \param relay \ref clr_oci_console_relay.
+ */
+void
+clr_oci_console_relay_free (struct clr_oci_console_relay *relay)
+{
+	if (! relay) {
+		return;
+	}
+
+	clr_oci_console_stream_free (&relay->input);
+	clr_oci_console_stream_free (&relay->output);
+}
@@ -0,0 +1,85 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_CONSOLE_H
+#define _CLR_OCI_CONSOLE_H
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+/** Size of the buffer used to relay one direction of a console. */
+#define CLR_OCI_CONSOLE_BUFFER_SIZE (64 * 1024)
+
+struct clr_oci_console_relay;
+
+/** One direction of a console relay. */
+struct clr_oci_console_stream {
+	/** File descriptor data is read from. */
+	int        in_fd;
+
+	/** File descriptor data is written to. */
+	int        out_fd;
+
+	/** Pipe used to move data with \c splice(2). */
+	int        pipe[2];
+
+	/** If \c true, move data with \c splice(2), else use \ref buf. */
+	gboolean   use_splice;
+
+	/** Buffer used if \c splice(2) cannot be used. */
+	gchar     *buf;
+
+	/** Offset of the first unwritten byte in \ref buf. */
+	gsize      offset;
+
+	/** Number of bytes read but not yet written. */
+	gsize      pending;
+
+	/** Source watching \ref in_fd. */
+	guint      in_source;
+
+	/** Source watching \ref out_fd. */
+	guint      out_source;
+
+	/** \c true once no more data can be relayed. */
+	gboolean   done;
+
+	/** Relay this stream belongs to. */
+	struct clr_oci_console_relay *relay;
+};
+
+/** Bidirectional relay between a console socket and a terminal. */
+struct clr_oci_console_relay {
+	/** Terminal input to console. */
+	struct clr_oci_console_stream  input;
+
+	/** Console output to terminal. */
+	struct clr_oci_console_stream  output;
+
+	/** Main loop to quit once the console output finishes. */
+	GMainLoop                     *loop;
+};
+
+gboolean clr_oci_console_relay_init (struct clr_oci_console_relay *relay,
+		int console_fd, int in_fd, int out_fd, GMainLoop *loop);
+void clr_oci_console_relay_free (struct clr_oci_console_relay *relay);
+
+#endif /* _CLR_OCI_CONSOLE_H */
@@ -18,11 +18,41 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <signal.h>
+#include <stdio.h>
+#include <sys/types.h>
+
 #include <glib.h>
+#include <glib-unix.h>
 #include <json-glib/json-glib.h>
 #include <stdbool.h>
+#include "common.h"
 #include "oci.h"
 #include "util.h"
+#include "network.h"
+#include "stats.h"
+#include "pidfd.h"
+#include "reclaim.h"
+
+/** Seconds between checks for new containers when showing the
+ * events of all containers.
+ */
+#define CLR_OCI_EVENTS_SCAN_INTERVAL 1
+
+/** Hypervisor events reported by show_container_events(). */
+static const gchar *clr_oci_vm_events[] = {
+	"STOP",
+	"RESUME",
+	"SHUTDOWN",
+	"POWERDOWN",
+	"RESET",
+	"GUEST_PANICKED",
+	"BALLOON_CHANGE",
+
+	/* Not a QMP event: reported when the hypervisor goes away */
+	"EXIT",
+	NULL
+};
 
 /** used by watcher_destroyed_vm() */
 struct watcher_vm_data
@@ -30,64 +60,88 @@ struct watcher_vm_data
 	GMainLoop              *loop;
 	struct clr_oci_config *config;
 	struct oci_state *state;
+	struct clr_oci_stats_sampler *sampler;
+	struct clr_oci_reclaim *reclaim;
 	gboolean result;
 };
 
+/** used by show_container_events() */
+struct events_data
+{
+	GMainLoop   *loop;
+
+	/** Directory containing the container state directories. */
+	const gchar *root_dir;
+
+	/** Container to show events for (or \c NULL for all). */
+	const gchar *container_id;
+
+	/** Map of container id to \ref events_watch (or \c NULL if
+	 * the container cannot be watched).
+	 */
+	GHashTable  *watches;
+};
+
+/** A container whose events are being shown. */
+struct events_watch
+{
+	gchar                   *id;
+	struct clr_oci_vm_conn  *conn;
+	guint                    source;
+	struct events_data      *data;
+};
+
 
 /**
- * Stops show_container_stats main loop when the 
- * container VM is destroyed verifying 
- * if \ref CLR_OCI_PROCESS_SOCKET is removed.
- *
- * \param monitor \c GFileMonitor.
- * \param file \c GFile.
- * \param other_file \c GFile.
- * \param event_type \c GFileMonitorEvent.
- * \param data \ref watcher_destroyed_vm.
+ * Stops show_container_stats main loop when the
+ * container VM exits.
+ *
+ * \param data \ref watcher_vm_data.
+ *
+ * \return \c false.
  */
-static void
-watcher_destroyed_vm (GFileMonitor            *monitor,
-		GFile                        *file,
-		GFile                        *other_file,
-		GFileMonitorEvent             event_type,
-		struct watcher_vm_data *data)
+static gboolean
+watcher_destroyed_vm (struct watcher_vm_data *data)
 {
-	g_autofree gchar  *path = NULL;
-	g_autofree gchar  *name = NULL;
-
 	g_assert (data);
 
-	if (event_type != G_FILE_MONITOR_EVENT_DELETED) {
-		return;
-	}
-
-	path = g_file_get_path (file);
-	if (! path) {
-		return;
-	}
-
-	name = g_path_get_basename (path);
+	g_main_loop_quit (data->loop);
 
-	if (g_strcmp0 (CLR_OCI_PROCESS_SOCKET, name)) {
-		return;
-	}
+	return false;
+}
 
-	/* file was removed, remove monitor */
-	g_object_unref (monitor);
+/**
+ * Stops show_container_stats main loop when the
+ * runtime is interrupted, so that reclaimed memory can be given
+ * back.
+ *
+ * \param data \ref watcher_vm_data.
+ *
+ * \return \c true.
+ */
+static gboolean
+watcher_interrupted (struct watcher_vm_data *data)
+{
+	g_assert (data);
 
 	g_main_loop_quit (data->loop);
+
+	return true;
 }
 
 /*!
  * Get container stats (cpu, memory, etc) in json format.
  * \param config \ref clr_oci_config.
- * \param state \ref oci_state.
+ * \param sampler \ref clr_oci_stats_sampler.
+ * \param reclaim \ref clr_oci_reclaim, or \c NULL if memory should
+ *   not be reclaimed.
  *
  * \return json string on success, else NULL
  */
 static gchar*
 get_container_stats(struct clr_oci_config *config,
-	struct oci_state *state)
+	struct clr_oci_stats_sampler *sampler,
+	struct clr_oci_reclaim *reclaim)
 {
 	JsonObject  *root = NULL;
 	JsonObject  *data = NULL;
@@ -100,17 +154,22 @@ get_container_stats(struct clr_oci_config *config,
 		goto out;
 	}
 
-	root = json_object_new ();
-	data = json_object_new ();
-	resources = json_object_new ();
+	/* Get CPU and memory stats */
+	resources = clr_oci_stats_sample (sampler);
+	if (! resources) {
+		goto out;
+	}
 
-	/* Get CPU stats*/
-	//FIXME: Implment cpu usage
-	json_object_set_object_member (resources, "cpu_stats", json_object_new());
+	/* a failure to reclaim memory is not fatal to the stats */
+	if (reclaim && ! clr_oci_reclaim_sample (reclaim,
+				sampler->comms_path, sampler->pid,
+				resources)) {
+		g_warning ("failed to reclaim memory of container %s",
+				config->optarg_container_id);
+	}
 
-	/* Get Memory stats*/
-	//FIXME: Implment memory usage
-	json_object_set_object_member (resources, "memory_stats", json_object_new());
+	root = json_object_new ();
+	data = json_object_new ();
 
 	/* Add resoruces node to data node */
 	/* 
@@ -123,10 +182,11 @@ get_container_stats(struct clr_oci_config *config,
 	/* Add root elements */
 	json_object_set_string_member (root, "type", "stats");
 	json_object_set_string_member (root, "id", config->optarg_container_id);
-	json_object_set_string_member (root, "id", config->optarg_container_id);
 	json_object_set_object_member (root, "data", data);
 	stats_str = clr_oci_json_obj_to_string (root, false, &str_len);
 
+	json_object_unref (root);
+
 out:
 	return stats_str;
 }
@@ -135,11 +195,13 @@ static gboolean
 show_interval_stats(struct watcher_vm_data *data)
 {
 	gchar       *stats_str = NULL;
-	stats_str = get_container_stats(data->config, data->state);
+	stats_str = get_container_stats(data->config, data->sampler,
+			data->reclaim);
 	if (!stats_str){
 		return false;
 	}
-	g_print("%s", stats_str);
+	g_print("%s\n", stats_str);
+	g_free (stats_str);
 	return true;
 }
 
@@ -152,21 +214,30 @@ show_interval_stats(struct watcher_vm_data *data)
  * \param state \ref oci_state.
  * \param state \ref interval to show.
  * \param interval seconds to pause between displaying statistics.
+ * \param reclaim If \c true, reclaim memory from the VM while it is
+ *   idle (see reclaim.c); ignored unless \p interval is set. The
+ *   memory is given back when the VM stops being sampled (including
+ *   on \c SIGINT and \c SIGTERM).
  *
  * \return \c true on success, else \c false.
  */
 gboolean
 show_container_stats(struct clr_oci_config *config,
-	struct oci_state *state, int interval)
+	struct oci_state *state, int interval, gboolean reclaim)
 {
 
 	gchar       *stats_str = NULL;
 	gboolean     result = false;
 
-	GError        *error = NULL;
-	GFile         *file = NULL;
-	GFileMonitor  *monitor = NULL;
 	struct watcher_vm_data  data = {0};
+	guint                   sigint_source = 0;
+	guint                   sigterm_source = 0;
+
+	data.sampler = clr_oci_stats_sampler_new (state->pid,
+			state->comms_path, interval);
+	if (! data.sampler) {
+		goto out;
+	}
 
 	if (interval) {
 		data.loop = g_main_loop_new (NULL, 0);
@@ -177,45 +248,475 @@ show_container_stats(struct clr_oci_config *config,
 			goto out;
 		}
 
-		file = g_file_new_for_path (config->state.runtime_path);
-		if (! file) {
-			g_main_loop_unref (data.loop);
-			goto out;
+		if (reclaim) {
+			data.reclaim = clr_oci_reclaim_new
+				(config->state.runtime_path, interval);
+			if (! data.reclaim) {
+				g_main_loop_unref (data.loop);
+				goto out;
+			}
 		}
-		monitor = g_file_monitor_directory (file,
-				G_FILE_MONITOR_WATCH_MOVES,
-				NULL, &error);
-		if (! monitor) {
-			g_critical ("failed to monitor %s: %s",
-					g_file_get_path (file),
-					error->message);
-			g_error_free (error);
-			g_object_unref (file);
-			g_main_loop_unref (data.loop);
 
+		if (! clr_oci_pid_watch (state->pid, state->start_time,
+					(GSourceFunc)watcher_destroyed_vm,
+					&data)) {
+			g_main_loop_unref (data.loop);
 			goto out;
 		}
 
-		g_signal_connect (monitor, "changed",
-				G_CALLBACK (watcher_destroyed_vm),
-				&data);
-
 		g_timeout_add_seconds ((guint) interval,
 				       (GSourceFunc) show_interval_stats,
 				       (gpointer) &data);
 
+		/* reclaimed memory must be given back before exiting */
+		if (data.reclaim) {
+			sigint_source = g_unix_signal_add (SIGINT,
+					(GSourceFunc)watcher_interrupted,
+					&data);
+			sigterm_source = g_unix_signal_add (SIGTERM,
+					(GSourceFunc)watcher_interrupted,
+					&data);
+		}
+
 		/* Monitor when vm is destroyed */
 		g_main_loop_run (data.loop);
+
+		if (sigint_source) {
+			g_source_remove (sigint_source);
+			g_source_remove (sigterm_source);
+		}
+
+		/* give back any memory reclaimed from a VM that is
+		 * still running.
+		 */
+		if (data.reclaim
+				&& clr_oci_pid_running (state->pid,
+					state->start_time)
+				&& ! clr_oci_reclaim_stop (data.reclaim,
+					state->comms_path, state->pid)) {
+			g_warning ("failed to give back memory of "
+					"container %s",
+					config->optarg_container_id);
+		}
+
+		g_main_loop_unref (data.loop);
 	}else {
-		stats_str = get_container_stats(config, state);
+		stats_str = get_container_stats(config, data.sampler, NULL);
 		if (!stats_str){
 			goto out;
 		}
-		g_print("%s", stats_str);
+		g_print("%s\n", stats_str);
 	}
 
 	result = true;
 out:
 	g_free_if_set(stats_str);
+	clr_oci_reclaim_free (data.reclaim);
+	clr_oci_stats_sampler_free (data.sampler);
 	return result;
 }
+
+/*!
+ * Convert a QMP event into a line of the event stream.
+ *
+ * \param id Container id.
+ * \param event QMP event.
+ *
+ * \return json string, or \c NULL if \p event should not be shown.
+ */
+private gchar *
+clr_oci_vm_event_to_json (const gchar *id, JsonObject *event)
+{
+	JsonObject   *root = NULL;
+	JsonObject   *timestamp;
+	const gchar  *name;
+	const gchar **known;
+	gchar        *type = NULL;
+	gchar        *when = NULL;
+	gchar        *str = NULL;
+	gsize         str_len = 0;
+	GTimeVal      tv;
+
+	if (! (id && event)) {
+		return NULL;
+	}
+
+	if (! json_object_has_member (event, "event")) {
+		return NULL;
+	}
+
+	name = json_object_get_string_member (event, "event");
+
+	for (known = clr_oci_vm_events; *known; known++) {
+		if (! g_strcmp0 (name, *known)) {
+			break;
+		}
+	}
+
+	if (! *known) {
+		return NULL;
+	}
+
+	root = json_object_new ();
+
+	type = g_ascii_strdown (name, -1);
+	json_object_set_string_member (root, "type", type);
+	json_object_set_string_member (root, "id", id);
+
+	if (json_object_has_member (event, "timestamp")) {
+		timestamp = json_object_get_object_member (event,
+				"timestamp");
+
+		tv.tv_sec = (glong)json_object_get_int_member (timestamp,
+				"seconds");
+		tv.tv_usec = (glong)json_object_get_int_member (timestamp,
+				"microseconds");
+
+		when = g_time_val_to_iso8601 (&tv);
+		json_object_set_string_member (root, "timestamp", when);
+	}
+
+	if (json_object_has_member (event, "data")) {
+		json_object_set_object_member (root, "data",
+				json_object_ref (json_object_get_object_member
+					(event, "data")));
+	}
+
+	str = clr_oci_json_obj_to_string (root, false, &str_len);
+
+	json_object_unref (root);
+	g_free_if_set (type);
+	g_free_if_set (when);
+
+	return str;
+}
+
+/*!
+ * Display an event as a single line.
+ *
+ * \param id Container id.
+ * \param event QMP event.
+ */
+static void
+events_show (const gchar *id, JsonObject *event)
+{
+	gchar *str;
+
+	str = clr_oci_vm_event_to_json (id, event);
+	if (! str) {
+		return;
+	}
+
+	g_print ("%s\n", str);
+
+	/* consumers react to each event as it happens */
+	fflush (stdout);
+
+	g_free (str);
+}
+
+/*!
+ * Stop watching a container.
+ *
+ * \param watch \ref events_watch.
+ */
+static void
+events_watch_free (struct events_watch *watch)
+{
+	if (! watch) {
+		return;
+	}
+
+	if (watch->source) {
+		g_source_remove (watch->source);
+	}
+
+	if (watch->conn) {
+		clr_oci_vm_conn_free (watch->conn);
+	}
+
+	g_free_if_set (watch->id);
+	g_free (watch);
+}
+
+/*!
+ * Show events received from a hypervisor.
+ *
+ * \param fd Unused.
+ * \param condition Unused.
+ * \param watch \ref events_watch.
+ *
+ * \return \c G_SOURCE_CONTINUE while the hypervisor is running,
+ *   else \c G_SOURCE_REMOVE.
+ */
+static gboolean
+events_watcher (gint fd, GIOCondition condition, struct events_watch *watch)
+{
+	struct events_data  *data;
+	JsonObject          *exit_event;
+	GSList              *events = NULL;
+	GSList              *l;
+	gboolean             open;
+
+	g_assert (watch);
+
+	open = clr_oci_qmp_events_read (watch->conn, &events);
+
+	for (l = events; l; l = g_slist_next (l)) {
+		events_show (watch->id, l->data);
+	}
+
+	g_slist_free_full (events, (GDestroyNotify)json_object_unref);
+
+	if (open) {
+		return G_SOURCE_CONTINUE;
+	}
+
+	exit_event = json_object_new ();
+	json_object_set_string_member (exit_event, "event", "EXIT");
+	events_show (watch->id, exit_event);
+	json_object_unref (exit_event);
+
+	data = watch->data;
+
+	/* the source is removed by returning */
+	watch->source = 0;
+
+	if (data->container_id) {
+		g_main_loop_quit (data->loop);
+	}
+
+	/* Keep the entry to avoid watching the container again */
+	g_hash_table_insert (data->watches, g_strdup (watch->id), NULL);
+
+	return G_SOURCE_REMOVE;
+}
+
+/*!
+ * Start watching the events of a container.
+ *
+ * \param data \ref events_data.
+ * \param id Container id.
+ * \param[out] watch \ref events_watch, or \c NULL if the container
+ *   is not running or its hypervisor did not answer.
+ *
+ * \return \c true if the state of the container is known,
+ *   \c false if it should be checked again later.
+ */
+static gboolean
+events_watch_new (struct events_data *data, const gchar *id,
+		struct events_watch **watch)
+{
+	struct oci_state  *state;
+	g_autofree gchar  *path = NULL;
+
+	*watch = NULL;
+
+	/* A container which is still being created has no state yet */
+	state = clr_oci_vm_get_state (id, data->root_dir);
+	if (! state) {
+		return false;
+	}
+
+	/* The hypervisor is held stopped until the container is
+	 * started, so it cannot answer yet.
+	 */
+	if (state->status == OCI_STATUS_CREATED) {
+		clr_oci_state_free (state);
+		return false;
+	}
+
+	if (state->status == OCI_STATUS_STOPPED
+			|| ! state->pid
+			|| ! clr_oci_pid_running (state->pid,
+				state->start_time)) {
+		goto out;
+	}
+
+	path = g_build_path ("/", data->root_dir, id,
+			CLR_OCI_HYPERVISOR_EVENTS_SOCKET, NULL);
+
+	if (! g_file_test (path, G_FILE_TEST_EXISTS)) {
+		g_debug ("container %s has no events socket", id);
+		goto out;
+	}
+
+	*watch = g_new0 (struct events_watch, 1);
+	(*watch)->id = g_strdup (id);
+	(*watch)->data = data;
+
+	(*watch)->conn = clr_oci_qmp_events_connect (path, state->pid);
+	if (! (*watch)->conn) {
+		/* QMP only serves one client at a time */
+		g_critical ("cannot receive events for container %s "
+				"(already being watched?)", id);
+		events_watch_free (*watch);
+		*watch = NULL;
+		goto out;
+	}
+
+	(*watch)->source = g_unix_fd_add (clr_oci_vm_conn_fd ((*watch)->conn),
+			G_IO_IN | G_IO_HUP | G_IO_ERR,
+			(GUnixFDSourceFunc)events_watcher, *watch);
+
+out:
+	clr_oci_state_free (state);
+
+	return true;
+}
+
+/*!
+ * Determine if a container that cannot be watched has been deleted.
+ *
+ * \param id Container id.
+ * \param watch \ref events_watch.
+ * \param seen Set of containers that currently exist.
+ *
+ * \return \c true if the container should be forgotten.
+ */
+static gboolean
+events_forget (const gchar *id, struct events_watch *watch,
+		GHashTable *seen)
+{
+	return ! watch && ! g_hash_table_contains (seen, id);
+}
+
+/*!
+ * Start watching any containers which are not yet being watched.
+ *
+ * \param data \ref events_data.
+ *
+ * \return \c G_SOURCE_CONTINUE.
+ */
+static gboolean
+events_scan (struct events_data *data)
+{
+	GDir                *dir;
+	GHashTable          *seen;
+	const gchar         *name;
+	struct events_watch *watch;
+
+	g_assert (data);
+
+	seen = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, NULL);
+
+	dir = g_dir_open (data->root_dir, 0x0, NULL);
+
+	while (dir && (name = g_dir_read_name (dir)) != NULL) {
+		if (data->container_id
+				&& g_strcmp0 (name, data->container_id)) {
+			continue;
+		}
+
+		g_hash_table_add (seen, g_strdup (name));
+
+		if (g_hash_table_contains (data->watches, name)) {
+			continue;
+		}
+
+		if (! events_watch_new (data, name, &watch)) {
+			continue;
+		}
+
+		g_hash_table_insert (data->watches, g_strdup (name), watch);
+	}
+
+	if (dir) {
+		g_dir_close (dir);
+	}
+
+	/* A container may be recreated using the id of a deleted one */
+	g_hash_table_foreach_remove (data->watches,
+			(GHRFunc)events_forget, seen);
+
+	/* The container waited for was deleted before being started */
+	if (data->container_id
+			&& ! g_hash_table_contains (seen, data->container_id)) {
+		g_main_loop_quit (data->loop);
+	}
+
+	g_hash_table_destroy (seen);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * Show hypervisor events as they happen.
+ *
+ * Each event is displayed as a single line of JSON. If
+ * \p container_id is \c NULL, events are shown for all containers
+ * (including those created later) until interrupted, else until the
+ * specified container's hypervisor exits. A container which has been
+ * created but not started is watched once it starts.
+ *
+ * \param root_dir Directory containing container state directories
+ *   (or \c NULL for the default).
+ * \param container_id Container to show events for (or \c NULL).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+show_container_events (const gchar *root_dir, const gchar *container_id)
+{
+	struct events_data  data = { 0 };
+	struct oci_state   *state = NULL;
+	guint               scan_source = 0;
+	gboolean            ret = false;
+
+	data.root_dir = root_dir ? root_dir : CLR_OCI_RUNTIME_DIR_PREFIX;
+	data.container_id = container_id;
+	data.watches = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify)events_watch_free);
+
+	data.loop = g_main_loop_new (NULL, 0);
+	if (! data.loop) {
+		g_critical ("cannot create main loop");
+		goto out;
+	}
+
+	if (container_id) {
+		state = clr_oci_vm_get_state (container_id, data.root_dir);
+		if (! (state && state->pid
+				&& state->status != OCI_STATUS_STOPPED
+				&& clr_oci_pid_running (state->pid,
+					state->start_time))) {
+			g_critical ("container %s is not running",
+					container_id);
+			goto out;
+		}
+	}
+
+	(void)events_scan (&data);
+
+	if (container_id
+			&& g_hash_table_contains (data.watches, container_id)
+			&& ! g_hash_table_lookup (data.watches, container_id)) {
+		/* failure to connect has already been reported */
+		goto out;
+	}
+
+	/* Also used to wait for the container to be started */
+	scan_source = g_timeout_add_seconds (
+			CLR_OCI_EVENTS_SCAN_INTERVAL,
+			(GSourceFunc)events_scan, &data);
+
+	g_main_loop_run (data.loop);
+
+	ret = true;
+
+out:
+	if (scan_source) {
+		g_source_remove (scan_source);
+	}
+
+	g_hash_table_destroy (data.watches);
+
+	clr_oci_state_free (state);
+
+	if (data.loop) {
+		g_main_loop_unref (data.loop);
+	}
+
+	return ret;
+}
@@ -23,5 +23,7 @@
 
 gboolean
 show_container_stats(struct clr_oci_config *config,
-	struct oci_state *state, int interval);
+	struct oci_state *state, int interval, gboolean reclaim);
+gboolean
+show_container_events(const gchar *root_dir, const gchar *container_id);
 #endif /* _CLR_OCI_EVENTS_H */
@@ -0,0 +1,242 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Backing guest RAM with huge pages.
+ *
+ * Guest RAM normally comes from small anonymous pages, so a
+ * memory-intensive workload pays for TLB misses on both the guest
+ * and the host (EPT) page tables. Optionally, guest RAM can instead
+ * be a file on a hugetlbfs mount. Since the hypervisor cannot fall
+ * back to small pages, the runtime checks that enough huge pages
+ * are free before launching it.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+
+#include <glib.h>
+
+#include "common.h"
+#include "oci.h"
+#include "util.h"
+#include "annotation.h"
+#include "hugepages.h"
+
+/** Directory containing the huge page pools of the host. */
+private gchar *sysfs_hugepages_dir = "/sys/kernel/mm/hugepages";
+
+/*!
+ * Determine if guest RAM should be backed by huge pages.
+ *
+ * The annotation \ref CLR_OCI_ANNOTATION_HUGEPAGES overrides the
+ * \c vm configuration.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true if huge pages should be used, else \c false.
+ */
+gboolean
+clr_oci_hugepages_get (const struct clr_oci_config *config)
+{
+	gboolean value;
+
+	if (! config) {
+		return false;
+	}
+
+	if (clr_oci_annotation_bool_get (config->oci.annotations,
+				CLR_OCI_ANNOTATION_HUGEPAGES, &value)) {
+		return value;
+	}
+
+	return config->vm ? config->vm->hugepages : false;
+}
+
+/*!
+ * Determine the size of the huge pages of a hugetlbfs mount.
+ *
+ * \param path Mount point.
+ * \param[out] page_size Size of each page in bytes.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_hugepages_page_size (const gchar *path, guint64 *page_size)
+{
+	struct statfs fs;
+
+	if (! (path && page_size)) {
+		return false;
+	}
+
+	if (statfs (path, &fs) < 0) {
+		g_critical ("failed to stat %s: %s", path, strerror (errno));
+		return false;
+	}
+
+	if (fs.f_type != HUGETLBFS_MAGIC) {
+		g_critical ("%s is not a hugetlbfs mount", path);
+		return false;
+	}
+
+	*page_size = (guint64)fs.f_bsize;
+
+	return true;
+}
+
+/*!
+ * Read a counter of a huge page pool.
+ *
+ * \param dir Directory of the pool.
+ * \param name Name of the counter.
+ * \param[out] value Value of the counter.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_hugepages_read (const gchar *dir, const gchar *name,
+		guint64 *value)
+{
+	g_autofree gchar *path = NULL;
+	g_autofree gchar *contents = NULL;
+	gchar            *end;
+
+	path = g_build_path ("/", dir, name, NULL);
+
+	if (! g_file_get_contents (path, &contents, NULL, NULL)) {
+		g_critical ("failed to read %s", path);
+		return false;
+	}
+
+	*value = g_ascii_strtoull (g_strstrip (contents), &end, 10);
+	if (end == contents || *end) {
+		g_critical ("invalid value in %s: %s", path, contents);
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * Determine how many huge pages of the specified size are available.
+ *
+ * Pages reserved by other processes (which have mapped but not yet
+ * touched them) are not available.
+ *
+ * \param page_size Size of each page in bytes.
+ * \param[out] pages Number of available pages.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_hugepages_available (guint64 page_size, guint64 *pages)
+{
+	g_autofree gchar *dir = NULL;
+	g_autofree gchar *name = NULL;
+	guint64           free_pages;
+	guint64           reserved;
+
+	if (! (page_size && pages)) {
+		return false;
+	}
+
+	name = g_strdup_printf ("hugepages-%lukB",
+			(unsigned long int)(page_size / 1024));
+	dir = g_build_path ("/", sysfs_hugepages_dir, name, NULL);
+
+	if (! clr_oci_hugepages_read (dir, "free_hugepages",
+				&free_pages)) {
+		return false;
+	}
+
+	if (! clr_oci_hugepages_read (dir, "resv_hugepages", &reserved)) {
+		return false;
+	}
+
+	*pages = free_pages > reserved ? free_pages - reserved : 0;
+
+	return true;
+}
+
+/*!
+ * Generate the memory backend for guest RAM backed by huge pages.
+ *
+ * The guest memory size is rounded up to a whole number of pages,
+ * and the host must have enough free pages for all of it.
+ *
+ * \param config \ref clr_oci_config.
+ * \param[in,out] memory Guest memory size in MiB.
+ *
+ * \return Newly-allocated backend options on success, else \c NULL.
+ */
+gchar *
+clr_oci_hugepages_backend (const struct clr_oci_config *config,
+		guint64 *memory)
+{
+	const gchar *path = CLR_OCI_HUGEPAGES_PATH;
+	guint64      page_size;
+	guint64      pages;
+	guint64      needed;
+	guint64      bytes;
+
+	if (! (config && config->vm && memory)) {
+		return NULL;
+	}
+
+	if (config->vm->hugepages_path[0]) {
+		path = config->vm->hugepages_path;
+	}
+
+	if (! clr_oci_hugepages_page_size (path, &page_size)) {
+		return NULL;
+	}
+
+	bytes = *memory * 1024 * 1024;
+	needed = (bytes + page_size - 1) / page_size;
+
+	if (! clr_oci_hugepages_available (page_size, &pages)) {
+		return NULL;
+	}
+
+	if (pages < needed) {
+		g_critical ("not enough huge pages for guest RAM: "
+				"%lu pages of %lu bytes needed, "
+				"%lu available",
+				(unsigned long int)needed,
+				(unsigned long int)page_size,
+				(unsigned long int)pages);
+		return NULL;
+	}
+
+	*memory = (needed * page_size + (1024 * 1024) - 1) / (1024 * 1024);
+
+	return g_strdup_printf ("memory-backend-file,mem-path=%s,"
+			"share=%s,prealloc=%s",
+			path,
+			config->vm->hugepages_share ? "on" : "off",
+			config->vm->hugepages_prealloc ? "on" : "off");
+}
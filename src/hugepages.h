@@ -0,0 +1,44 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_HUGEPAGES_H
+#define _CLR_OCI_HUGEPAGES_H
+
+#include <glib.h>
+
+#include "oci.h"
+
+/** Annotation used to back guest RAM with huge pages ("true" or
+ * "false"), overriding the \c vm configuration.
+ */
+#define CLR_OCI_ANNOTATION_HUGEPAGES "com.intel.clr.memory.hugepages"
+
+/** Default hugetlbfs mount point. */
+#define CLR_OCI_HUGEPAGES_PATH "/dev/hugepages"
+
+gboolean clr_oci_hugepages_get (const struct clr_oci_config *config);
+gboolean clr_oci_hugepages_page_size (const gchar *path,
+		guint64 *page_size);
+gboolean clr_oci_hugepages_available (guint64 page_size,
+		guint64 *pages);
+gchar *clr_oci_hugepages_backend (const struct clr_oci_config *config,
+		guint64 *memory);
+
+#endif /* _CLR_OCI_HUGEPAGES_H */
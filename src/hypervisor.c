@@ -18,6 +18,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <string.h>
 #include <stdbool.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -31,6 +32,13 @@
 #include "util.h"
 #include "hypervisor.h"
 #include "common.h"
+#include "virtiofs.h"
+#include "resources.h"
+#include "placement.h"
+#include "hugepages.h"
+#include "annotation.h"
+#include "reclaim.h"
+#include "checkpoint.h"
 
 /** Length of an ASCII-formatted UUID */
 #define UUID_MAX 37
@@ -43,6 +51,200 @@
 private gchar *sysconfdir = SYSCONFDIR;
 private gchar *defaultsdir = DEFAULTSDIR;
 
+/*!
+ * Add a file descriptor to those the hypervisor inherits (which are
+ * closed by clr_oci_vm_fds_close()).
+ *
+ * \param config \ref clr_oci_config.
+ * \param fd File descriptor.
+ */
+static void
+clr_oci_vm_fd_add (struct clr_oci_config *config, int fd)
+{
+	if (! config->hypervisor_fds) {
+		config->hypervisor_fds = g_array_new (false, false,
+				sizeof (int));
+	}
+
+	g_array_append_val (config->hypervisor_fds, fd);
+}
+
+/*!
+ * Create a listening socket to be passed to the hypervisor.
+ *
+ * The socket is created by the runtime (rather than the hypervisor)
+ * so that it can be connected to as soon as the hypervisor has been
+ * launched. It is added to the \c hypervisor_fds of \p config so
+ * that the hypervisor inherits it.
+ *
+ * \param config \ref clr_oci_config.
+ * \param path Full path to socket.
+ * \param[in, out] fd Socket (created if \c -1).
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_vm_listen_fd (struct clr_oci_config *config, const gchar *path,
+		int *fd)
+{
+	if (*fd >= 0) {
+		return true;
+	}
+
+	*fd = clr_oci_socket_listen (path, 0);
+	if (*fd < 0) {
+		return false;
+	}
+
+	clr_oci_vm_fd_add (config, *fd);
+
+	return true;
+}
+
+/*!
+ * Replace \p tag in \p arg with the number of a listening socket
+ * (see clr_oci_vm_listen_fd()).
+ *
+ * \param config \ref clr_oci_config.
+ * \param[in, out] arg Argument to expand.
+ * \param tag Tag to replace.
+ * \param path Full path to socket.
+ * \param[in, out] fd Socket (created if \c -1 and \p tag is
+ *   found).
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_replace_fd (struct clr_oci_config *config, gchar **arg,
+		const gchar *tag, const gchar *path, int *fd)
+{
+	g_autofree gchar *str = NULL;
+
+	if (! strstr (*arg, tag)) {
+		return true;
+	}
+
+	if (! clr_oci_vm_listen_fd (config, path, fd)) {
+		return false;
+	}
+
+	str = g_strdup_printf ("%d", *fd);
+
+	return clr_oci_replace_string (arg, tag, str);
+}
+
+/*!
+ * Close the sockets created for the hypervisor by
+ * clr_oci_expand_cmdline(), once it has inherited them.
+ *
+ * \param config \ref clr_oci_config.
+ */
+void
+clr_oci_vm_fds_close (struct clr_oci_config *config)
+{
+	guint i;
+
+	if (! (config && config->hypervisor_fds)) {
+		return;
+	}
+
+	for (i = 0; i < config->hypervisor_fds->len; i++) {
+		(void)close (g_array_index (config->hypervisor_fds, int, i));
+	}
+
+	g_array_free (config->hypervisor_fds, true);
+	config->hypervisor_fds = NULL;
+}
+
+/*!
+ * Generate the workload specification passed to the hypervisor
+ * (\ref CLR_OCI_WORKLOAD_SPEC_NAME).
+ *
+ * The specification is a JSON object containing the command
+ * ("args"), its environment ("env") and working directory ("cwd").
+ * Commas are doubled since the value forms part of a hypervisor
+ * option.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+private gchar *
+clr_oci_workload_spec (const struct clr_oci_config *config)
+{
+	JsonObject        *spec = NULL;
+	JsonArray         *args = NULL;
+	JsonArray         *env = NULL;
+	gchar            **parts = NULL;
+	g_autofree gchar  *str = NULL;
+	gchar             *escaped = NULL;
+
+	if (! (config && config->oci.process.args)) {
+		return NULL;
+	}
+
+	spec = json_object_new ();
+	args = json_array_new ();
+	env = json_array_new ();
+
+	for (gchar **arg = config->oci.process.args; *arg; arg++) {
+		json_array_add_string_element (args, *arg);
+	}
+
+	if (config->oci.process.env) {
+		for (gchar **var = config->oci.process.env; *var; var++) {
+			json_array_add_string_element (env, *var);
+		}
+	}
+
+	json_object_set_array_member (spec, "args", args);
+	json_object_set_array_member (spec, "env", env);
+	json_object_set_string_member (spec, "cwd",
+			config->oci.process.cwd);
+
+	str = clr_oci_json_obj_to_string (spec, false, NULL);
+	json_object_unref (spec);
+
+	if (! str) {
+		return NULL;
+	}
+
+	parts = g_strsplit (str, ",", -1);
+	escaped = g_strjoinv (",,", parts);
+	g_strfreev (parts);
+
+	return escaped;
+}
+
+/*!
+ * Determine if the image should be shared with other VMs.
+ *
+ * A shared image is mapped read-only with \c share=on, so every VM
+ * using it maps the same host pages rather than its own private
+ * copy. The annotation \ref CLR_OCI_ANNOTATION_IMAGE_SHARED
+ * overrides the \c vm configuration.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true if the image is shared, else \c false.
+ */
+gboolean
+clr_oci_image_shared_get (const struct clr_oci_config *config)
+{
+	gboolean value;
+
+	if (! config) {
+		return false;
+	}
+
+	if (clr_oci_annotation_bool_get (config->oci.annotations,
+				CLR_OCI_ANNOTATION_IMAGE_SHARED, &value)) {
+		return value;
+	}
+
+	return config->vm ? config->vm->image_shared : false;
+}
+
 /*!
  * Replace any special tokens found in \p args with their expanded
  * values.
@@ -63,6 +265,28 @@ clr_oci_expand_cmdline (struct clr_oci_config *config,
 	gchar            *bytes = NULL;
 	gchar            *console_device = NULL;
 	g_autofree gchar *procsock_device = NULL;
+	g_autofree gchar *query_socket = NULL;
+	int               comms_fd = -1;
+	int               events_fd = -1;
+	int               procsock_fd = -1;
+	int               query_fd = -1;
+	g_autofree gchar *ram_backend = NULL;
+	g_autofree gchar *workload_spec = NULL;
+	g_autofree gchar *rootfs_device = NULL;
+	g_autofree gchar *rootfs_backend = NULL;
+	const gchar      *rootfs_backend_type = NULL;
+	struct clr_oci_vm_resources resources = { 0 };
+	guint64           memory;
+	guint             vcpus;
+	g_autofree gchar *memory_str = NULL;
+	g_autofree gchar *maxmem_str = NULL;
+	g_autofree gchar *smp = NULL;
+	g_autofree gchar *cpus = NULL;
+	g_autofree gchar *mems = NULL;
+	g_autofree gchar *memory_policy = NULL;
+	g_autofree gchar *image_backend = NULL;
+	const gchar      *image_device = NULL;
+	g_autofree gchar *kernel_params = NULL;
 
 	gboolean          ret = false;
 	gint              count;
@@ -97,6 +321,25 @@ clr_oci_expand_cmdline (struct clr_oci_config *config,
 		return false;
 	}
 
+	/* The guest overlays the root filesystem of a shared image
+	 * before mounting it (see
+	 * \ref CLR_OCI_IMAGE_SHARED_KERNEL_PARAMS), which needs an
+	 * initramfs.
+	 */
+	if (clr_oci_image_shared_get (config)
+			&& ! config->vm->initrd_path[0]) {
+		g_critical ("a shared image requires an initrd "
+				"(\"initrd\" in the vm kernel object)");
+		return false;
+	}
+
+	if (config->vm->initrd_path[0]
+		&& ! g_file_test (config->vm->initrd_path, G_FILE_TEST_EXISTS)) {
+		g_critical ("initrd: %s does not exist",
+			    config->vm->initrd_path);
+		return false;
+	}
+
 	if (!(config->oci.root.path[0]
 		&& g_file_test (config->oci.root.path, G_FILE_TEST_EXISTS|G_FILE_TEST_IS_DIR))) {
 		g_critical ("workload directory: %s does not exist",
@@ -120,6 +363,30 @@ clr_oci_expand_cmdline (struct clr_oci_config *config,
 
 	bytes = g_strdup_printf ("%lu", (unsigned long int)st.st_size);
 
+	/* A private mapping of the image is copied page by page as the
+	 * guest writes to it. A shared image cannot be written, so
+	 * that all VMs map the same pages, and the guest overlays
+	 * its root filesystem with a tmpfs instead.
+	 */
+	if (clr_oci_image_shared_get (config)) {
+		image_backend = g_strdup_printf ("memory-backend-file,"
+				"id=mem0,mem-path=%s,size=%s,"
+				"share=on,readonly=on",
+				config->vm->image_path, bytes);
+		image_device = "nvdimm,memdev=mem0,id=nv0,unarmed=on";
+		kernel_params = g_strdup_printf ("%s %s",
+				config->vm->kernel_params
+				? config->vm->kernel_params : "",
+				CLR_OCI_IMAGE_SHARED_KERNEL_PARAMS);
+		g_strstrip (kernel_params);
+	} else {
+		image_backend = g_strdup_printf ("memory-backend-file,"
+				"id=mem0,mem-path=%s,size=%s",
+				config->vm->image_path, bytes);
+		image_device = "nvdimm,memdev=mem0,id=nv0";
+		kernel_params = g_strdup (config->vm->kernel_params);
+	}
+
 	/* XXX: Note that "signal=off" ensures that the key sequence
 	 * CONTROL+c will not cause the VM to exit.
 	 */
@@ -134,18 +401,177 @@ clr_oci_expand_cmdline (struct clr_oci_config *config,
 
 		g_debug ("no console device provided, so using socket: %s", config->console);
 
-		/* Note that path is not quoted - attempting to do so
+		/* The hypervisor connects to the console capture
+		 * process (see console-log.c), which owns the socket
+		 * clients connect to.
+		 *
+		 * Note that path is not quoted - attempting to do so
 		 * results in qemu failing with the error:
 		 *
 		 *   Failed to bind socket to "/a/dir/console.sock": No such file or directory
 		 */
-		console_device = g_strdup_printf ("socket,path=%s,server,nowait,id=charconsole0,signal=off",
-				config->console);
+		console_device = g_strdup_printf ("socket,path=%s/%s,reconnect=1,id=charconsole0,signal=off",
+				config->state.runtime_path,
+				CLR_OCI_CONSOLE_VM_SOCKET);
 	} else {
 		console_device = g_strdup ("stdio,id=charconsole0,signal=off");
 	}
 
-	procsock_device = g_strdup_printf ("socket,id=procsock,path=%s,server,nowait", config->state.procsock_path);
+	query_socket = g_build_path ("/", config->state.runtime_path,
+			CLR_OCI_GUEST_QUERY_SOCKET, NULL);
+
+	/* Size the VM to the resource limits of the container, but
+	 * never give it more vCPUs than the host has.
+	 */
+	if (! clr_oci_resources_from_limits (&config->oci.oci_linux.resources,
+				&resources)) {
+		goto out;
+	}
+
+	memory = resources.memory
+		? (resources.memory + (1024 * 1024) - 1) / (1024 * 1024)
+		: CLR_OCI_VM_MEMORY_DEFAULT;
+	memory = MAX (memory, CLR_OCI_VM_MEMORY_MIN);
+
+	vcpus = resources.vcpus ? resources.vcpus : CLR_OCI_VM_VCPUS_DEFAULT;
+	vcpus = MIN (vcpus, g_get_num_processors ());
+
+	/* By default, guest RAM is allocated by the hypervisor and so
+	 * needs no backend. Otherwise, guest RAM is a memory backend
+	 * object (which requires a hypervisor machine supporting the
+	 * "memory-backend" property).
+	 *
+	 * If lazy checkpoints are enabled, guest RAM is shared so that
+	 * it can be saved directly, which virtio-fs also requires. When
+	 * restoring such a checkpoint, it is mapped privately from the
+	 * saved file so that pages are only read when touched and the
+	 * file is never modified.
+	 *
+	 * If huge pages are requested, guest RAM is a hugetlbfs file
+	 * instead (whose size is a whole number of pages). If pages
+	 * are to be merged, guest RAM must be private anonymous memory
+	 * since KSM ignores shared mappings.
+	 */
+	if ((config->incoming_ram || clr_oci_checkpoint_lazy_get (config))
+			&& (clr_oci_hugepages_get (config)
+				|| clr_oci_memory_merge_get (config))) {
+		g_critical ("huge pages and memory merging cannot "
+				"be used with lazy checkpoints");
+		goto out;
+	}
+
+	if (config->incoming_ram) {
+		ram_backend = g_strdup_printf ("memory-backend-file,"
+				"mem-path=%s,share=off",
+				config->incoming_ram);
+	} else if (clr_oci_hugepages_get (config)) {
+		if (clr_oci_memory_merge_get (config)) {
+			g_critical ("huge pages cannot be merged");
+			goto out;
+		}
+
+		ram_backend = clr_oci_hugepages_backend (config, &memory);
+		if (! ram_backend) {
+			goto out;
+		}
+	} else if (clr_oci_memory_merge_get (config)) {
+		ram_backend = g_strdup ("memory-backend-ram,merge=on");
+	} else if (clr_oci_checkpoint_lazy_get (config)
+			|| clr_oci_rootfs_transport_get (config)
+			== CLR_OCI_ROOTFS_VIRTIO_FS) {
+		ram_backend = g_strdup ("memory-backend-memfd,share=on");
+	}
+
+	/* Allocate guest memory from the NUMA nodes the VM is placed
+	 * on. Its threads are pinned to their CPUs once it is running
+	 * (see clr_oci_vm_pin()).
+	 */
+	if (! clr_oci_placement_get (config, &cpus, &mems)) {
+		goto out;
+	}
+
+	g_strlcpy (config->state.cpus, cpus ? cpus : "",
+			sizeof (config->state.cpus));
+
+	/* leave a CPU for the I/O and emulator threads */
+	vcpus = clr_oci_placement_vcpus (cpus, vcpus);
+
+	/* a memory policy can only be applied to a backend */
+	if (mems) {
+		gchar *backend = ram_backend;
+
+		memory_policy = clr_oci_placement_memory_policy (mems);
+		ram_backend = g_strdup_printf ("%s,%s",
+				backend ? backend : "memory-backend-ram",
+				memory_policy);
+		g_free_if_set (backend);
+	}
+
+	memory_str = g_strdup_printf ("%luM", (unsigned long int)memory);
+
+	g_free_if_set (config->ram_backend);
+
+	if (ram_backend) {
+		config->ram_backend = g_strdup_printf ("%s,id=%s,size=%s",
+				ram_backend, CLR_OCI_RAM_BACKEND_ID,
+				memory_str);
+	}
+	maxmem_str = g_strdup_printf ("%luM", (unsigned long int)
+			(memory + CLR_OCI_VM_MEMORY_HOTPLUG));
+
+	/* allow vCPUs to be hotplugged (as sockets) */
+	smp = g_strdup_printf ("%u,maxcpus=%u,sockets=%u,cores=1,threads=1",
+			vcpus,
+			MAX (vcpus, CLR_OCI_VM_VCPUS_MAX),
+			MAX (vcpus, CLR_OCI_VM_VCPUS_MAX));
+
+	/* The rootfs is shared using 9p unless virtio-fs is selected,
+	 * in which case the hypervisor connects to the virtio-fs
+	 * daemon (see virtiofs.c) and the guest maps file contents
+	 * through a DAX window.
+	 */
+	if (clr_oci_rootfs_transport_get (config)
+			== CLR_OCI_ROOTFS_VIRTIO_FS) {
+		const gchar *dax_size = config->vm->dax_size
+			? config->vm->dax_size : CLR_OCI_VIRTIOFS_DAX_SIZE;
+
+		if (config->incoming_ram) {
+			/* vhost-user requires guest RAM to be shared */
+			g_critical ("virtio-fs cannot be used when "
+					"restoring a lazy checkpoint");
+			goto out;
+		}
+
+		if ((clr_oci_hugepages_get (config)
+					&& ! config->vm->hugepages_share)
+				|| clr_oci_memory_merge_get (config)) {
+			g_critical ("virtio-fs requires guest RAM "
+					"to be shared");
+			goto out;
+		}
+
+		if (g_strcmp0 (dax_size, "0")) {
+			rootfs_device = g_strdup_printf ("vhost-user-fs-pci,"
+					"chardev=charfs0,tag=rootfs,"
+					"cache-size=%s", dax_size);
+		} else {
+			rootfs_device = g_strdup ("vhost-user-fs-pci,"
+					"chardev=charfs0,tag=rootfs");
+		}
+
+		rootfs_backend_type = "-chardev";
+		rootfs_backend = g_strdup_printf ("socket,id=charfs0,"
+				"path=%s/%s",
+				config->state.runtime_path,
+				CLR_OCI_VIRTIOFS_SOCKET);
+	} else {
+		rootfs_device = g_strdup ("virtio-9p-pci,"
+				"fsdev=workload9p,mount_tag=rootfs");
+		rootfs_backend_type = "-fsdev";
+		rootfs_backend = g_strdup_printf ("local,id=workload9p,"
+				"path=%s,security_model=none",
+				config->oci.root.path);
+	}
 
 	for (arg = args, count = 0; arg && *arg; arg++, count++) {
 		if (! count) {
@@ -166,6 +592,39 @@ clr_oci_expand_cmdline (struct clr_oci_config *config,
 			goto out;
 		}
 
+		ret = clr_oci_replace_string (arg, "@ROOTFS_DEVICE@",
+				rootfs_device);
+		if (! ret) {
+			goto out;
+		}
+
+		ret = clr_oci_replace_string (arg, "@ROOTFS_BACKEND_TYPE@",
+				rootfs_backend_type);
+		if (! ret) {
+			goto out;
+		}
+
+		ret = clr_oci_replace_string (arg, "@ROOTFS_BACKEND@",
+				rootfs_backend);
+		if (! ret) {
+			goto out;
+		}
+
+		ret = clr_oci_replace_string (arg, "@MAXMEM@", maxmem_str);
+		if (! ret) {
+			goto out;
+		}
+
+		ret = clr_oci_replace_string (arg, "@MEMORY@", memory_str);
+		if (! ret) {
+			goto out;
+		}
+
+		ret = clr_oci_replace_string (arg, "@SMP@", smp);
+		if (! ret) {
+			goto out;
+		}
+
 		ret = clr_oci_replace_string (arg, "@KERNEL@",
 				config->vm->kernel_path);
 		if (! ret) {
@@ -173,7 +632,19 @@ clr_oci_expand_cmdline (struct clr_oci_config *config,
 		}
 
 		ret = clr_oci_replace_string (arg, "@KERNEL_PARAMS@",
-				config->vm->kernel_params);
+				kernel_params);
+		if (! ret) {
+			goto out;
+		}
+
+		ret = clr_oci_replace_string (arg, "@IMAGE_BACKEND@",
+				image_backend);
+		if (! ret) {
+			goto out;
+		}
+
+		ret = clr_oci_replace_string (arg, "@IMAGE_DEVICE@",
+				image_device);
 		if (! ret) {
 			goto out;
 		}
@@ -195,6 +666,64 @@ clr_oci_expand_cmdline (struct clr_oci_config *config,
 			goto out;
 		}
 
+		ret = clr_oci_replace_string (arg, "@EVENTS_SOCKET@",
+				config->state.events_path);
+		if (! ret) {
+			goto out;
+		}
+
+		ret = clr_oci_replace_string (arg, "@QUERY_SOCKET@",
+				query_socket);
+		if (! ret) {
+			goto out;
+		}
+
+		ret = clr_oci_replace_fd (config, arg, "@COMMS_FD@",
+				config->state.comms_path, &comms_fd);
+		if (! ret) {
+			goto out;
+		}
+
+		ret = clr_oci_replace_fd (config, arg, "@EVENTS_FD@",
+				config->state.events_path, &events_fd);
+		if (! ret) {
+			goto out;
+		}
+
+		ret = clr_oci_replace_fd (config, arg, "@QUERY_FD@",
+				query_socket, &query_fd);
+		if (! ret) {
+			goto out;
+		}
+
+		if (strstr (*arg, "@WORKLOAD_SPEC@") && ! workload_spec) {
+			workload_spec = clr_oci_workload_spec (config);
+			if (! workload_spec) {
+				g_critical ("failed to create workload specification");
+				ret = false;
+				goto out;
+			}
+		}
+
+		ret = clr_oci_replace_string (arg, "@WORKLOAD_SPEC@",
+				workload_spec);
+		if (! ret) {
+			goto out;
+		}
+
+		if (strstr (*arg, "@PROCESS_SOCKET@") && ! procsock_device) {
+			ret = clr_oci_vm_listen_fd (config,
+					config->state.procsock_path,
+					&procsock_fd);
+			if (! ret) {
+				goto out;
+			}
+
+			procsock_device = g_strdup_printf ("socket,"
+					"id=procsock,fd=%d,server=on,wait=off",
+					procsock_fd);
+		}
+
 		ret = clr_oci_replace_string (arg, "@PROCESS_SOCKET@",
 				procsock_device);
 		if (! ret) {
@@ -290,6 +819,36 @@ out:
 	return args_file;
 }
 
+/*!
+ * Determine if the hypervisor arguments pass the workload
+ * specification to the VM (by using the \c @WORKLOAD_SPEC@ tag).
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true if the tag is used, else \c false.
+ */
+gboolean
+clr_oci_vm_args_use_workload_spec (const struct clr_oci_config *config)
+{
+	g_autofree gchar *args_file = NULL;
+	g_autofree gchar *contents = NULL;
+
+	if (! config) {
+		return false;
+	}
+
+	args_file = clr_oci_vm_args_file_path (config);
+	if (! args_file) {
+		return false;
+	}
+
+	if (! g_file_get_contents (args_file, &contents, NULL, NULL)) {
+		return false;
+	}
+
+	return strstr (contents, "@WORKLOAD_SPEC@") != NULL;
+}
+
 /*!
  * Generate the list of hypervisor arguments to use.
  *
@@ -304,6 +863,7 @@ clr_oci_vm_args_get (struct clr_oci_config *config,
 {
 	gboolean  ret;
 	gchar    *args_file = NULL;
+	guint     count;
 
 	if (! (config && args)) {
 		return false;
@@ -325,6 +885,67 @@ clr_oci_vm_args_get (struct clr_oci_config *config,
 		goto out;
 	}
 
+	if (config->vm->initrd_path[0]) {
+		count = g_strv_length (*args);
+		*args = g_renew (gchar *, *args, count + 3);
+		(*args)[count++] = g_strdup ("-initrd");
+		(*args)[count++] = g_strdup (config->vm->initrd_path);
+		(*args)[count] = NULL;
+	}
+
+	if (config->ram_backend) {
+		count = g_strv_length (*args);
+		*args = g_renew (gchar *, *args, count + 5);
+		(*args)[count++] = g_strdup ("-object");
+		(*args)[count++] = g_strdup (config->ram_backend);
+		(*args)[count++] = g_strdup ("-machine");
+		(*args)[count++] = g_strdup ("memory-backend="
+				CLR_OCI_RAM_BACKEND_ID);
+		(*args)[count] = NULL;
+	}
+
+	/* The hypervisor inherits the vhost-vsock device that
+	 * reserved the context ID of the VM.
+	 */
+	if (config->state.vsock_cid && config->vsock_fd >= 0) {
+		count = g_strv_length (*args);
+		*args = g_renew (gchar *, *args, count + 3);
+		(*args)[count++] = g_strdup ("-device");
+		(*args)[count++] = g_strdup_printf ("vhost-vsock-pci,"
+				"id=vsock0,guest-cid=%u,vhostfd=%d",
+				config->state.vsock_cid, config->vsock_fd);
+		(*args)[count] = NULL;
+
+		clr_oci_vm_fd_add (config, config->vsock_fd);
+		config->vsock_fd = -1;
+	}
+
+	/* A VM placed on host CPUs must not run until its vCPU
+	 * threads have been pinned (see clr_oci_vm_pin()).
+	 */
+	if (config->state.cpus[0]) {
+		count = g_strv_length (*args);
+		*args = g_renew (gchar *, *args, count + 2);
+		(*args)[count++] = g_strdup ("-S");
+		(*args)[count] = NULL;
+	}
+
+	if (config->incoming) {
+		/* Restore the VM rather than booting it */
+		count = g_strv_length (*args);
+		*args = g_renew (gchar *, *args, count + 5);
+		(*args)[count++] = g_strdup ("-incoming");
+		(*args)[count++] = g_strdup (config->incoming);
+
+		/* guest RAM is not part of the saved state */
+		if (config->incoming_ram) {
+			(*args)[count++] = g_strdup ("-global");
+			(*args)[count++] = g_strdup ("migration.x-ignore-shared=on");
+		}
+
+		(*args)[count] = NULL;
+	}
+
 	ret = true;
 out:
 	g_free_if_set (args_file);
@@ -24,7 +24,51 @@
 /** Name of file containing hypervisor arguments (one per line) */
 #define CLR_OCI_HYPERVISOR_CMDLINE_FILE "hypervisor.args"
 
+/** Guest memory (in MiB) if the container does not limit it. */
+#define CLR_OCI_VM_MEMORY_DEFAULT 2048
+
+/** Minimum guest memory (in MiB) required to boot the VM. */
+#define CLR_OCI_VM_MEMORY_MIN 256
+
+/** Memory (in MiB) that can be hotplugged by "update" above the
+ * memory the VM starts with.
+ */
+#define CLR_OCI_VM_MEMORY_HOTPLUG 1024
+
+/** Number of vCPUs if the container does not limit its CPU usage. */
+#define CLR_OCI_VM_VCPUS_DEFAULT 2
+
+/** Number of vCPUs a VM can have (including those hotplugged by
+ * "update") unless it starts with more.
+ */
+#define CLR_OCI_VM_VCPUS_MAX 4
+
+/** Name of the fw_cfg item the guest reads the workload
+ * specification from (see \c @WORKLOAD_SPEC@).
+ */
+#define CLR_OCI_WORKLOAD_SPEC_NAME "opt/org.clearlinux.clr-oci/workload"
+
+/** Annotation used to map the image read-only and shared with other
+ * VMs ("true" or "false"), overriding the \c vm configuration.
+ */
+#define CLR_OCI_ANNOTATION_IMAGE_SHARED "com.intel.clr.image.shared"
+
+/** Kernel parameters added when the image is shared: the root
+ * filesystem is mounted read-only and overlaid with a tmpfs inside
+ * the guest, so each VM can still write to it. The overlay is set up
+ * by the initrd (which a shared image therefore requires).
+ */
+#define CLR_OCI_IMAGE_SHARED_KERNEL_PARAMS "ro systemd.volatile=overlay"
+
+/** Id of the memory backend of guest RAM, if it has one (see
+ * clr_oci_vm_args_get()).
+ */
+#define CLR_OCI_RAM_BACKEND_ID "ram0"
+
+gboolean clr_oci_image_shared_get (const struct clr_oci_config *config);
 gboolean clr_oci_vm_args_get (struct clr_oci_config *config,
 		gchar ***args);
+gboolean clr_oci_vm_args_use_workload_spec (const struct clr_oci_config *config);
+void clr_oci_vm_fds_close (struct clr_oci_config *config);
 
 #endif /* _CLR_OCI_HYPERVISOR_H */
@@ -264,11 +264,12 @@ setup_logging (struct clr_log_options *options,
  *
  * \param argc Argument count.
  * \param argv Argument vector.
+ * \param[out] exit_code Exit status to use on success.
  *
  * \return \c true on success, else \c false.
  */
 static gboolean
-handle_arguments (int argc, char **argv)
+handle_arguments (int argc, char **argv, int *exit_code)
 {
 	gboolean               ret;
 	gint                   priv_level;
@@ -390,6 +391,8 @@ handle_arguments (int argc, char **argv)
 		goto out;
 	}
 
+	*exit_code = config.exit_code;
+
 	clr_oci_config_free (&config);
 
 out:
@@ -418,13 +421,14 @@ int
 main (int argc, char **argv)
 {
 	gboolean ret;
+	int      exit_code = EXIT_SUCCESS;
 
 	// FIXME: --debug currently forcibly enabled
 	enable_debug = true;
 
-	ret = handle_arguments (argc, argv);
+	ret = handle_arguments (argc, argv, &exit_code);
 
 	cleanup (&clr_log_options);
 
-	exit (ret ? EXIT_SUCCESS : EXIT_FAILURE);
+	exit (ret ? exit_code : EXIT_FAILURE);
 }
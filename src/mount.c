@@ -18,13 +18,65 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#define _GNU_SOURCE
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 
 #include "mount.h"
 #include "common.h"
 
+/* Definitions for the new mount API, which may be missing from the
+ * system headers.
+ */
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE 1
+#endif
+
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC O_CLOEXEC
+#endif
+
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+#define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
+
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY     0x00000001
+#define MOUNT_ATTR_NOSUID     0x00000002
+#define MOUNT_ATTR_NODEV      0x00000004
+#define MOUNT_ATTR_NOEXEC     0x00000008
+#define MOUNT_ATTR_NOATIME    0x00000010
+#define MOUNT_ATTR_NODIRATIME 0x00000080
+#endif
+
+#ifndef MOUNT_ATTR__ATIME
+#define MOUNT_ATTR__ATIME      0x00000070
+#define MOUNT_ATTR_RELATIME    0x00000000
+#define MOUNT_ATTR_STRICTATIME 0x00000020
+#endif
+
+/** Argument to \c mount_setattr(2). */
+struct clr_oci_mount_attr {
+	guint64 attr_set;
+	guint64 attr_clr;
+	guint64 propagation;
+	guint64 userns_fd;
+};
+
+/** Maximum number of threads used to unmount independent mounts. */
+#define CLR_OCI_UNMOUNT_THREADS 8
+
+/** Set to \c false if the running kernel lacks the new mount API. */
+static gboolean clr_oci_mount_tree_supported = true;
+
 /** Mounts that will be ignored.
  *
  * These are standard mounts that will be created within the VM
@@ -117,6 +169,168 @@ clr_oci_mounts_free_all (GSList *mounts)
 	g_slist_free_full (mounts, (GDestroyNotify)clr_oci_mount_free);
 }
 
+/*!
+ * Convert the \c mount(2) flags in \p flags to the equivalent
+ * \c mount_setattr(2) attributes.
+ *
+ * The atime mode is a value rather than a flag, so the kernel
+ * requires it to be cleared whenever one is set.
+ *
+ * \param flags \c mount(2) flags.
+ * \param[out] attr_clr \c MOUNT_ATTR_* attributes to clear.
+ *
+ * \return \c MOUNT_ATTR_* attributes to set.
+ */
+private guint64
+clr_oci_mount_flags_to_attr (unsigned long flags, guint64 *attr_clr)
+{
+	guint64 attr = 0;
+
+	*attr_clr = 0;
+
+	if (flags & MS_RDONLY) {
+		attr |= MOUNT_ATTR_RDONLY;
+	}
+
+	if (flags & MS_NOSUID) {
+		attr |= MOUNT_ATTR_NOSUID;
+	}
+
+	if (flags & MS_NODEV) {
+		attr |= MOUNT_ATTR_NODEV;
+	}
+
+	if (flags & MS_NOEXEC) {
+		attr |= MOUNT_ATTR_NOEXEC;
+	}
+
+	if (flags & MS_NOATIME) {
+		attr |= MOUNT_ATTR_NOATIME;
+		*attr_clr |= MOUNT_ATTR__ATIME;
+	} else if (flags & MS_STRICTATIME) {
+		attr |= MOUNT_ATTR_STRICTATIME;
+		*attr_clr |= MOUNT_ATTR__ATIME;
+	} else if (flags & MS_RELATIME) {
+		attr |= MOUNT_ATTR_RELATIME;
+		*attr_clr |= MOUNT_ATTR__ATIME;
+	}
+
+	if (flags & MS_NODIRATIME) {
+		attr |= MOUNT_ATTR_NODIRATIME;
+	}
+
+	return attr;
+}
+
+/*!
+ * Bind mount the resource specified by \p m using the new mount API,
+ * such that the mount only becomes visible at its destination once
+ * all its attributes have been applied.
+ *
+ * \param m \ref clr_oci_mount.
+ *
+ * \return \c 0 on success, else \c -1 with \c errno set
+ * (\c ENOSYS if the new mount API is not available).
+ */
+static int
+clr_oci_mount_tree (const struct clr_oci_mount *m)
+{
+#if defined (SYS_open_tree) && defined (SYS_move_mount) \
+	&& defined (SYS_mount_setattr)
+	struct clr_oci_mount_attr attr = { 0 };
+	unsigned int recursive;
+	int fd;
+	int saved;
+
+	recursive = (m->flags & MS_REC) ? AT_RECURSIVE : 0;
+
+	fd = (int)syscall (SYS_open_tree, AT_FDCWD, m->mnt.mnt_fsname,
+			OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | recursive);
+	if (fd < 0) {
+		return -1;
+	}
+
+	attr.attr_set = clr_oci_mount_flags_to_attr (m->flags,
+			&attr.attr_clr);
+	attr.propagation = m->flags &
+		(MS_PRIVATE | MS_SLAVE | MS_SHARED | MS_UNBINDABLE);
+
+	if (attr.attr_set || attr.attr_clr || attr.propagation) {
+		if (syscall (SYS_mount_setattr, fd, "",
+					AT_EMPTY_PATH | recursive,
+					&attr, sizeof (attr)) < 0) {
+			goto err;
+		}
+	}
+
+	if (syscall (SYS_move_mount, fd, "", AT_FDCWD, m->dest,
+				MOVE_MOUNT_F_EMPTY_PATH) < 0) {
+		goto err;
+	}
+
+	close (fd);
+
+	return 0;
+
+err:
+	saved = errno;
+	close (fd);
+	errno = saved;
+
+	return -1;
+#else
+	(void)m;
+
+	errno = ENOSYS;
+
+	return -1;
+#endif
+}
+
+/*!
+ * Mount the resource specified by \p m using \c mount(2).
+ *
+ * \param m \ref clr_oci_mount.
+ *
+ * \return \c 0 on success, else \c -1 with \c errno set.
+ */
+static int
+clr_oci_mount_legacy (const struct clr_oci_mount *m)
+{
+	unsigned long flags;
+	int ret;
+
+	ret = mount (m->mnt.mnt_fsname,
+			m->dest,
+			m->mnt.mnt_type,
+			m->flags,
+			m->mnt.mnt_opts);
+	if (ret || ! (m->flags & MS_BIND)) {
+		return ret;
+	}
+
+	/* The kernel ignores most flags when creating a bind mount, so
+	 * they must be applied with a separate remount.
+	 */
+	flags = m->flags & (MS_RDONLY | MS_NOSUID | MS_NODEV |
+			MS_NOEXEC | MS_NOATIME | MS_NODIRATIME |
+			MS_RELATIME | MS_STRICTATIME);
+	if (! flags) {
+		return 0;
+	}
+
+	ret = mount (NULL, m->dest, NULL,
+			MS_REMOUNT | MS_BIND | flags, NULL);
+	if (ret) {
+		int saved = errno;
+
+		(void)umount2 (m->dest, MNT_DETACH);
+		errno = saved;
+	}
+
+	return ret;
+}
+
 /*!
  * Mount the resource specified by \p m.
  *
@@ -153,11 +367,34 @@ clr_oci_perform_mount (const struct clr_oci_mount *m, gboolean dry_run)
 		return true;
 	}
 
-	ret = mount (m->mnt.mnt_fsname,
-			m->dest,
-			m->mnt.mnt_type,
-			m->flags,
-			m->mnt.mnt_opts);
+	ret = -1;
+	errno = ENOSYS;
+
+	/* Bind mounts are created detached and only attached once all
+	 * their attributes have been set.
+	 */
+	if ((m->flags & MS_BIND) && ! (m->flags & MS_REMOUNT)
+			&& clr_oci_mount_tree_supported) {
+		ret = clr_oci_mount_tree (m);
+		if (ret && errno == ENOSYS) {
+			g_debug ("new mount API not available");
+			clr_oci_mount_tree_supported = false;
+		} else if (ret) {
+			/* Nothing has been attached, so the mount can
+			 * still be attempted the old way (for example,
+			 * a seccomp policy may reject the new syscalls
+			 * with EPERM, or an older kernel may not support
+			 * an attribute).
+			 */
+			g_debug ("failed to mount %s using new mount API: %s",
+					m->dest, strerror (errno));
+		}
+	}
+
+	if (ret) {
+		ret = clr_oci_mount_legacy (m);
+	}
+
 	if (ret) {
 		int saved = errno;
 		gchar *msg;
@@ -181,23 +418,17 @@ clr_oci_perform_mount (const struct clr_oci_mount *m, gboolean dry_run)
 }
 
 /*!
- * Setup required mounts.
+ * Resolve the mounts specified in \p config, determining which
+ * should be honoured, their destinations and whether those
+ * destinations are files or directories.
  *
  * \param config \ref clr_oci_config.
- *
- * \return \c true on success, else \c false.
  */
-gboolean
-clr_oci_handle_mounts (struct clr_oci_config *config)
+static void
+clr_oci_mounts_resolve (struct clr_oci_config *config)
 {
-	GSList    *l;
-	gboolean   ret;
-	struct stat st;
-	gchar* dirname_dest = NULL;
-
-	if (! config) {
-		return false;
-	}
+	GSList      *l;
+	struct stat  st;
 
 	for (l = config->oci.mounts; l && l->data; l = g_slist_next (l)) {
 		struct clr_oci_mount *m = (struct clr_oci_mount *)l->data;
@@ -211,42 +442,275 @@ clr_oci_handle_mounts (struct clr_oci_config *config)
 				"%s%s",
 				config->oci.root.path, m->mnt.mnt_dir);
 
+		m->dest_is_file = false;
+
 		if (m->mnt.mnt_fsname[0] == '/') {
 			if (stat (m->mnt.mnt_fsname, &st)) {
-				g_debug ("ignoring mount, %s does not exist", m->mnt.mnt_fsname);
+				g_debug ("ignoring mount, %s does not exist",
+						m->mnt.mnt_fsname);
+				m->ignore_mount = true;
 				continue;
 			}
-			if (! S_ISDIR(st.st_mode)) {
-				dirname_dest = g_path_get_dirname(m->dest);
+
+			m->dest_is_file = ! S_ISDIR (st.st_mode);
+		}
+	}
+}
+
+/*!
+ * Compare two directory paths.
+ *
+ * \param a Pointer to first path.
+ * \param b Pointer to second path.
+ *
+ * \return Negative, zero or positive value (see \c strcmp(3)).
+ */
+static gint
+clr_oci_mount_dir_cmp (const gchar **a, const gchar **b)
+{
+	return g_strcmp0 (*a, *b);
+}
+
+/*!
+ * Determine the full set of directories (relative to the rootfs)
+ * that must exist before the specified mounts can be performed.
+ *
+ * Every parent directory is included, each directory is only listed
+ * once and parents always appear before their children.
+ *
+ * \param mounts List of \ref clr_oci_mount.
+ *
+ * \return Newly-allocated sorted list of directories.
+ */
+private gchar **
+clr_oci_mount_dirs_get (GSList *mounts)
+{
+	GHashTable  *dirs;
+	GPtrArray   *sorted;
+	GSList      *l;
+	GHashTableIter iter;
+	gpointer     key;
+
+	dirs = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, NULL);
+
+	for (l = mounts; l && l->data; l = g_slist_next (l)) {
+		struct clr_oci_mount *m = (struct clr_oci_mount *)l->data;
+		g_autofree gchar *dir = NULL;
+		GString  *path;
+		gchar   **parts;
+		gchar   **p;
+
+		if (m->ignore_mount || ! m->mnt.mnt_dir) {
+			continue;
+		}
+
+		dir = m->dest_is_file
+			? g_path_get_dirname (m->mnt.mnt_dir)
+			: g_strdup (m->mnt.mnt_dir);
+
+		path = g_string_new ("");
+		parts = g_strsplit (dir, "/", -1);
+
+		for (p = parts; *p; p++) {
+			if (! (*p)[0] || ! g_strcmp0 (*p, ".")) {
+				continue;
+			}
+
+			if (path->len) {
+				g_string_append_c (path, '/');
 			}
+
+			g_string_append (path, *p);
+
+			if (! g_hash_table_contains (dirs, path->str)) {
+				g_hash_table_add (dirs, g_strdup (path->str));
+			}
+		}
+
+		g_strfreev (parts);
+		g_string_free (path, true);
+	}
+
+	sorted = g_ptr_array_new ();
+
+	g_hash_table_iter_init (&iter, dirs);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		g_ptr_array_add (sorted, g_strdup (key));
+	}
+
+	/* A parent is a prefix of its children so sorts first */
+	g_ptr_array_sort (sorted, (GCompareFunc)clr_oci_mount_dir_cmp);
+	g_ptr_array_add (sorted, NULL);
+
+	g_hash_table_destroy (dirs);
+
+	return (gchar **)g_ptr_array_free (sorted, false);
+}
+
+/*!
+ * Create the directories and files that the mounts in \p config
+ * will be mounted onto.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_mount_targets_create (const struct clr_oci_config *config)
+{
+	const gchar  *root;
+	gchar       **dirs = NULL;
+	gchar       **d;
+	GSList       *l;
+	gboolean      ret = false;
+	int           root_fd;
+
+	root = config->oci.root.path[0] ? config->oci.root.path : "/";
+
+	root_fd = open (root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (root_fd < 0) {
+		g_critical ("failed to open rootfs %s: %s",
+				root, strerror (errno));
+		return false;
+	}
+
+	dirs = clr_oci_mount_dirs_get (config->oci.mounts);
+
+	for (d = dirs; d && *d; d++) {
+		if (mkdirat (root_fd, *d, CLR_OCI_DIR_MODE) < 0
+				&& errno != EEXIST) {
+			g_critical ("failed to create mount directory: "
+					"%s/%s (%s)",
+					root, *d, strerror (errno));
+			goto out;
+		}
+	}
+
+	if (config->dry_run_mode) {
+		ret = true;
+		goto out;
+	}
+
+	/* A file can only be bind mounted onto a file */
+	for (l = config->oci.mounts; l && l->data; l = g_slist_next (l)) {
+		struct clr_oci_mount *m = (struct clr_oci_mount *)l->data;
+		const gchar *rel;
+		int fd;
+
+		if (m->ignore_mount || ! m->dest_is_file) {
+			continue;
 		}
 
-		if (! dirname_dest) {
-			dirname_dest = g_strdup(m->dest);
+		for (rel = m->mnt.mnt_dir; *rel == '/'; rel++)
+			;
+
+		fd = openat (root_fd, rel,
+				O_WRONLY | O_CREAT | O_NOCTTY | O_CLOEXEC,
+				0644);
+		if (fd < 0) {
+			g_critical ("failed to create mount file: "
+					"%s/%s (%s)",
+					root, rel, strerror (errno));
+			goto out;
 		}
 
-		ret = g_mkdir_with_parents (dirname_dest, CLR_OCI_DIR_MODE);
-		if (ret < 0) {
-			g_critical ("failed to create mount directory: %s (%s)",
+		close (fd);
+	}
+
+	ret = true;
+
+out:
+	g_strfreev (dirs);
+	close (root_fd);
+
+	return ret;
+}
+
+/*!
+ * Undo the specified mounts.
+ *
+ * \param mounted List of \ref clr_oci_mount that have been mounted,
+ * most recent first.
+ */
+static void
+clr_oci_mounts_rollback (GSList *mounted)
+{
+	GSList *l;
+
+	for (l = mounted; l; l = g_slist_next (l)) {
+		struct clr_oci_mount *m = (struct clr_oci_mount *)l->data;
+
+		g_debug ("rolling back mount %s", m->dest);
+
+		if (umount2 (m->dest, MNT_DETACH) < 0) {
+			g_warning ("failed to unmount %s: %s",
 					m->dest, strerror (errno));
-			g_free(dirname_dest);
-			return false;
 		}
+	}
+}
 
-		g_free(dirname_dest);
-		dirname_dest = NULL;
+/*!
+ * Setup required mounts.
+ *
+ * All required directories are created before any mounts are
+ * performed. If any mount fails, those already performed are undone.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_handle_mounts (struct clr_oci_config *config)
+{
+	GSList    *l;
+	GSList    *mounted = NULL;
+	gboolean   ret = false;
+
+	if (! config) {
+		return false;
+	}
+
+	clr_oci_mounts_resolve (config);
+
+	if (! clr_oci_mount_targets_create (config)) {
+		return false;
+	}
+
+	for (l = config->oci.mounts; l && l->data; l = g_slist_next (l)) {
+		struct clr_oci_mount *m = (struct clr_oci_mount *)l->data;
+
+		if (m->ignore_mount) {
+			continue;
+		}
 
 		if (! clr_oci_perform_mount (m, config->dry_run_mode)) {
-			return false;
+			goto out;
+		}
+
+		if (! config->dry_run_mode) {
+			mounted = g_slist_prepend (mounted, m);
 		}
 	}
 
-	return true;
+	ret = true;
+
+out:
+	if (! ret) {
+		clr_oci_mounts_rollback (mounted);
+	}
+
+	g_slist_free (mounted);
+
+	return ret;
 }
 
 /*!
  * Unmount the mount specified by \p m.
  *
+ * If the mount is busy, it is lazily detached so that teardown is
+ * not held up by processes still using it.
+ *
  * \param m \ref clr_oci_mount.
  *
  * \return \c true on success, else \c false.
@@ -260,12 +724,176 @@ clr_oci_perform_unmount (const struct clr_oci_mount *m)
 
 	g_debug ("unmounting %s", m->dest);
 
-	return umount (m->dest) == 0;
+	if (! umount (m->dest)) {
+		return true;
+	}
+
+	if (errno != EBUSY) {
+		g_warning ("failed to unmount %s: %s",
+				m->dest, strerror (errno));
+		return false;
+	}
+
+	g_debug ("%s is busy, detaching", m->dest);
+
+	if (umount2 (m->dest, MNT_DETACH)) {
+		g_warning ("failed to detach %s: %s",
+				m->dest, strerror (errno));
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * Compare two mount destinations such that a directory sorts
+ * immediately before everything below it.
+ *
+ * \param a Pointer to first \ref clr_oci_mount.
+ * \param b Pointer to second \ref clr_oci_mount.
+ *
+ * \return Negative, zero or positive value (see \c strcmp(3)).
+ */
+static gint
+clr_oci_mount_dest_cmp (const struct clr_oci_mount **a,
+		const struct clr_oci_mount **b)
+{
+	const guchar *p = (const guchar *)(*a)->dest;
+	const guchar *q = (const guchar *)(*b)->dest;
+
+	while (*p && *p == *q) {
+		p++;
+		q++;
+	}
+
+	/* '/' sorts before any other character (other than the
+	 * terminator) to keep subtrees together.
+	 */
+	return (*p == '/' ? 1 : *p ? *p + 1 : 0)
+		- (*q == '/' ? 1 : *q ? *q + 1 : 0);
+}
+
+/*!
+ * Determine if \p path is \p dir or is below \p dir.
+ *
+ * \param dir Directory.
+ * \param path Path to check.
+ *
+ * \return \c true if \p path is within \p dir, else \c false.
+ */
+static gboolean
+clr_oci_path_is_within (const gchar *dir, const gchar *path)
+{
+	size_t len = strlen (dir);
+
+	if (strncmp (dir, path, len)) {
+		return false;
+	}
+
+	return path[len] == '\0' || path[len] == '/'
+		|| (len && dir[len-1] == '/');
+}
+
+/*!
+ * Split the mounts into independent groups such that no mount in a
+ * group is below a mount in any other group.
+ *
+ * Each group is ordered such that it can be unmounted from last to
+ * first (mounts below a directory are unmounted before the directory
+ * itself and mounts stacked on the same directory are unmounted in
+ * the reverse of the order they were mounted in).
+ *
+ * \param mounts List of \ref clr_oci_mount.
+ *
+ * \return Array of \c GPtrArray groups of \ref clr_oci_mount.
+ */
+private GPtrArray *
+clr_oci_unmount_groups_get (GSList *mounts)
+{
+	GPtrArray  *sorted;
+	GPtrArray  *groups;
+	GPtrArray  *group = NULL;
+	const struct clr_oci_mount *root = NULL;
+	GSList     *l;
+	guint       i;
+
+	groups = g_ptr_array_new_with_free_func
+		((GDestroyNotify)g_ptr_array_unref);
+
+	sorted = g_ptr_array_new ();
+
+	for (l = mounts; l && l->data; l = g_slist_next (l)) {
+		struct clr_oci_mount *m = (struct clr_oci_mount *)l->data;
+
+		if (m->ignore_mount) {
+			/* was never mounted */
+			continue;
+		}
+
+		g_ptr_array_add (sorted, m);
+	}
+
+	/* stable, so stacked mounts remain in mount order */
+	g_ptr_array_sort (sorted, (GCompareFunc)clr_oci_mount_dest_cmp);
+
+	for (i = 0; i < sorted->len; i++) {
+		struct clr_oci_mount *m = g_ptr_array_index (sorted, i);
+
+		if (! root || ! clr_oci_path_is_within (root->dest, m->dest)) {
+			root = m;
+			group = g_ptr_array_new ();
+			g_ptr_array_add (groups, group);
+		}
+
+		g_ptr_array_add (group, m);
+	}
+
+	g_ptr_array_free (sorted, true);
+
+	return groups;
+}
+
+/** A group of mounts to be unmounted by one thread. */
+struct clr_oci_unmount_group {
+	/** Mounts, in mount order. */
+	GPtrArray  *mounts;
+
+	/** Mounts that could not be unmounted. */
+	GSList     *leaked;
+};
+
+/*!
+ * Unmount a group of mounts in reverse order.
+ *
+ * \param group \ref clr_oci_unmount_group.
+ * \param user_data Unused.
+ */
+static void
+clr_oci_unmount_group (struct clr_oci_unmount_group *group,
+		gpointer user_data)
+{
+	guint i;
+
+	(void)user_data;
+
+	for (i = group->mounts->len; i > 0; i--) {
+		struct clr_oci_mount *m;
+
+		m = g_ptr_array_index (group->mounts, i - 1);
+
+		if (! clr_oci_perform_unmount (m)) {
+			group->leaked = g_slist_prepend (group->leaked, m);
+		}
+	}
 }
 
 /*!
  * Unmount all mounts.
  *
+ * Mounts are unmounted in reverse dependency order. Independent
+ * subtrees are unmounted concurrently and a failure to unmount one
+ * mount does not stop the remaining mounts from being unmounted.
+ *
  * \param config \ref clr_oci_config.
  *
  * \return \c true on success, else \c false.
@@ -273,26 +901,61 @@ clr_oci_perform_unmount (const struct clr_oci_mount *m)
 gboolean
 clr_oci_handle_unmounts (const struct clr_oci_config *config)
 {
-	GSList  *l;
+	struct clr_oci_unmount_group *groups = NULL;
+	GPtrArray    *sets;
+	GThreadPool  *pool = NULL;
+	guint         leaked = 0;
+	guint         i;
 
 	if (! config) {
 		return false;
 	}
 
-	for (l = config->oci.mounts; l && l->data; l = g_slist_next (l)) {
-		struct clr_oci_mount *m = (struct clr_oci_mount *)l->data;
+	sets = clr_oci_unmount_groups_get (config->oci.mounts);
+	if (! sets->len) {
+		goto out;
+	}
 
-		if (m->ignore_mount) {
-			/* was never mounted */
-			continue;
+	groups = g_new0 (struct clr_oci_unmount_group, sets->len);
+
+	if (sets->len > 1) {
+		pool = g_thread_pool_new ((GFunc)clr_oci_unmount_group,
+				NULL,
+				(gint)MIN (sets->len, CLR_OCI_UNMOUNT_THREADS),
+				false, NULL);
+	}
+
+	for (i = 0; i < sets->len; i++) {
+		groups[i].mounts = g_ptr_array_index (sets, i);
+
+		if (! (pool && g_thread_pool_push (pool, &groups[i], NULL))) {
+			clr_oci_unmount_group (&groups[i], NULL);
 		}
+	}
 
-		if (! clr_oci_perform_unmount (m)) {
-			return false;
+	if (pool) {
+		/* wait for all groups to be unmounted */
+		g_thread_pool_free (pool, false, true);
+	}
+
+	for (i = 0; i < sets->len; i++) {
+		GSList *l;
+
+		for (l = groups[i].leaked; l; l = g_slist_next (l)) {
+			struct clr_oci_mount *m = l->data;
+
+			g_critical ("leaked mount %s", m->dest);
+			leaked++;
 		}
+
+		g_slist_free (groups[i].leaked);
 	}
 
-	return true;
+out:
+	g_free_if_set (groups);
+	g_ptr_array_free (sets, true);
+
+	return leaked == 0;
 }
 
 /*!
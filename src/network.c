@@ -38,9 +38,11 @@
 #include <gio/gio.h>
 #include <gio/gunixsocketaddress.h>
 
+#include "common.h"
 #include "oci.h"
 #include "util.h"
 #include "network.h"
+#include "hypervisor.h"
 
 /** Size of buffer to use to receive network data */
 #define CLR_OCI_NET_BUF_SIZE 2048
@@ -48,6 +50,39 @@
 /** String that separates messages returned from the hypervisor */
 #define CLR_OCI_MSG_SEPARATOR "\r\n"
 
+/** QOM path below which devices added with an id live. */
+#define CLR_OCI_QOM_PERIPHERAL "/machine/peripheral/"
+
+/** Prefix of the id of hotplugged vCPUs. */
+#define CLR_OCI_VCPU_ID_PREFIX "vcpu"
+
+/** Prefix of the id of hotplugged memory devices. */
+#define CLR_OCI_DIMM_ID_PREFIX "dimm"
+
+/** Prefix of the id of the backends of hotplugged memory devices. */
+#define CLR_OCI_DIMM_BACKEND_PREFIX "mem-" CLR_OCI_DIMM_ID_PREFIX
+
+/** QOM path below which objects created with an id live. */
+#define CLR_OCI_QOM_OBJECTS "/objects"
+
+/** Granularity of memory hotplug (the Linux memory block size). */
+#define CLR_OCI_MEMORY_BLOCK_SIZE (128 * 1024 * 1024ULL)
+
+/** Time to wait for the guest to release an unplugged memory device. */
+#define CLR_OCI_MEMORY_UNPLUG_TIMEOUT_MS 5000
+
+/** Interval between checks on whether a memory device was unplugged. */
+#define CLR_OCI_MEMORY_UNPLUG_POLL_MS 50
+
+/** Time to wait for the guest to release unplugged vCPUs. */
+#define CLR_OCI_VCPU_UNPLUG_TIMEOUT_MS 5000
+
+/** Interval between checks on whether vCPUs were unplugged. */
+#define CLR_OCI_VCPU_UNPLUG_POLL_MS 50
+
+/** Interval between checks on the progress of a migration. */
+#define CLR_OCI_MIGRATE_POLL_MS 10
+
 /*! VM connection object. */
 struct clr_oci_vm_conn
 {
@@ -59,6 +94,12 @@ struct clr_oci_vm_conn
 
 	/*! The socket. */
 	GSocket *socket;
+
+	/*! \c true once QMP capabilities negotiation has completed. */
+	gboolean initialised;
+
+	/*! Data received but not yet parsed. */
+	GString *pending;
 };
 
 /*!
@@ -90,9 +131,13 @@ clr_oci_net_msgs_free_all (GSList *msgs)
 }
 
 /*!
- * Read a QMP message.
+ * Read QMP messages.
+ *
+ * Data received after the last message asked for (for example an
+ * event following a command response) is kept in
+ * \ref clr_oci_vm_conn.pending for the next call.
  *
- * \param socket \c GSocket to use.
+ * \param conn \ref clr_oci_vm_conn to use.
  * \param expected_count Number of messages to try to receive.
  * \param[out] msgs List of received messages (which are of
  *   type \c GString).
@@ -100,79 +145,53 @@ clr_oci_net_msgs_free_all (GSList *msgs)
  * \return \c true on success, else \c false.
  */
 static gboolean
-clr_oci_qmp_msg_recv (GSocket *socket,
+clr_oci_qmp_msg_recv (struct clr_oci_vm_conn *conn,
 		gsize expected_count,
 		GSList **msgs,
 		gsize *count)
 {
-	gboolean     ret = false;
 	gchar        buffer[CLR_OCI_NET_BUF_SIZE];
 	gsize        total = 0;
 	gssize       bytes;
 	gssize       msg_len;
 	GError      *error = NULL;
 	GString     *msg = NULL;
-	GString     *received = NULL;
+	GString     *pending;
 	gchar       *p;
 
-	g_assert (socket);
+	g_assert (conn);
 	g_assert (expected_count);
 	g_assert (msgs);
 	g_assert (count);
 
+	pending = conn->pending;
+
 	g_debug ("client expects %lu message%s",
 			expected_count,
 			expected_count == 1 ? "" : "s");
 
-	do {
-		/* reset */
-		memset (buffer, '\0', CLR_OCI_NET_BUF_SIZE);
-
-		/* read a chunk */
-		bytes = g_socket_receive (socket, buffer, CLR_OCI_NET_BUF_SIZE,
-				NULL, &error);
-
-		if (bytes <= 0) {
-			g_critical ("client failed to receive: %s",
-					error->message);
-			g_error_free (error);
-			goto out;
-		}
-
-		/* save the chunk */
-		if (! received) {
-			received = g_string_new_len (buffer, bytes);
-		} else {
-			g_string_append_len (received, buffer, bytes);
-		}
-
-		total += (gsize)bytes;
-
-		while (true) {
-			if (! received->len) {
-				/* All the data read so far has been consumed */
-				break;
-			}
-
-			/* Check for end of message marker to determine if a
-			 * complete message has been received yet.
+	while (true) {
+		/* Handle the complete messages received so far, but
+		 * no more than were asked for.
+		 */
+		while (*count < expected_count) {
+			/* Check for end of message marker to determine
+			 * if a complete message has been received yet.
 			 */
-			p = g_strstr_len (received->str, (gssize)total,
+			p = g_strstr_len (pending->str, (gssize)pending->len,
 					CLR_OCI_MSG_SEPARATOR);
 			if (! p) {
 				/* No complete message to operate on */
 				break;
 			}
 
-			/* We now have (*atleast* !!) one complete message to handle */
-
 			/* Calculate the length of the message */
-			msg_len = p - received->str;
-
-			/* Save the message */
-			msg = g_string_new_len (received->str, msg_len);
+			msg_len = p - pending->str;
 
-			/* Add the the complete message to the list */
+			/* Save the message (caller is responsible for
+			 * freeing the list).
+			 */
+			msg = g_string_new_len (pending->str, msg_len);
 			*msgs = g_slist_append (*msgs, msg);
 			(*count)++;
 
@@ -184,31 +203,32 @@ clr_oci_qmp_msg_recv (GSocket *socket,
 			/* Remove the handled data
 			 * (including the message separator).
 			 */
-			g_string_erase (received, 0,
+			g_string_erase (pending, 0,
 					(gssize)
 					((gsize)msg_len + sizeof (CLR_OCI_MSG_SEPARATOR)-1));
-
-			/* Get ready to potentially receive a new
-			 * message (caller is responsible for freeing the list).
-			 */
-			msg = NULL;
 		}
 
-		if (*count == expected_count) {
+		if (*count >= expected_count) {
 			g_debug ("found expected number of messages (%lu)",
 					(unsigned long int)expected_count);
 			break;
 		}
-	} while (true);
 
-	/* All complete messages should have been added to the list */
-	g_assert (! msg);
+		/* read a chunk */
+		bytes = g_socket_receive (conn->socket, buffer,
+				CLR_OCI_NET_BUF_SIZE, NULL, &error);
 
-	/* All received data should have been handled */
-	g_assert (! received->len);
+		if (bytes <= 0) {
+			g_critical ("client failed to receive: %s",
+					error ? error->message
+					: "connection closed");
+			g_clear_error (&error);
+			return false;
+		}
 
-	/* clean up */
-	g_string_free (received, true);
+		g_string_append_len (pending, buffer, bytes);
+		total += (gsize)bytes;
+	}
 
 	g_debug ("client received %lu message%s "
 			"(expected %lu) in %lu bytes",
@@ -217,10 +237,7 @@ clr_oci_qmp_msg_recv (GSocket *socket,
 			(unsigned long int)expected_count,
 			(unsigned long int)total);
 
-	ret = *count == expected_count;
-
-out:
-	return ret;
+	return true;
 }
 
 /*!
@@ -294,6 +311,75 @@ out:
 	return ret;
 }
 
+/*!
+ * Perform the QMP capabilities negotiation required before any
+ * other command may be sent on a connection.
+ *
+ * \param conn \ref clr_oci_vm_conn to use.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_qmp_negotiate (struct clr_oci_vm_conn *conn)
+{
+	const  gchar      capabilities[] = "{ \"execute\": \"qmp_capabilities\" }";
+	GError           *error = NULL;
+	gssize            size;
+	gboolean          ret = false;
+	GSList           *msgs = NULL;
+	GString          *recv_msg = NULL;
+	gsize             msg_count = 0;
+
+	g_assert (conn);
+
+	if (conn->initialised) {
+		return true;
+	}
+
+	g_debug ("sending required initial capabilities "
+			"message (%s)", capabilities);
+
+	size = g_socket_send (conn->socket, capabilities,
+			sizeof (capabilities)-1, NULL, &error);
+	if (size < 0) {
+		g_critical ("failed to send json: %s", capabilities);
+		if (error) {
+			g_critical ("error: %s", error->message);
+			g_error_free (error);
+		}
+		goto out;
+	}
+
+	/* Get the response */
+	ret = clr_oci_qmp_msg_recv (conn,
+			1, &msgs, &msg_count);
+	if (! ret) {
+		goto out;
+	}
+
+	recv_msg = g_slist_nth_data (msgs, 0);
+	if (! recv_msg) {
+		ret = false;
+		goto out;
+	}
+
+	/* Check it */
+	ret = clr_oci_qmp_check_result (recv_msg->str,
+			recv_msg->len, true);
+	if (! ret) {
+		goto out;
+	}
+
+	conn->initialised = true;
+
+out:
+	if (msgs) {
+		clr_oci_net_msgs_free_all (msgs);
+	}
+
+	return ret;
+}
+
 /*!
  * Send a QMP message to the hypervisor.
  *
@@ -313,8 +399,6 @@ clr_oci_qmp_msg_send (struct clr_oci_vm_conn *conn,
 		gsize expected_resp_count,
 		gboolean expect_empty)
 {
-	static gboolean   initialised = false;
-	const  gchar      capabilities[] = "{ \"execute\": \"qmp_capabilities\" }";
 	GError           *error = NULL;
 	gssize            size;
 	gboolean          ret = false;
@@ -325,53 +409,8 @@ clr_oci_qmp_msg_send (struct clr_oci_vm_conn *conn,
 	g_assert (conn);
 	g_assert (msg);
 
-	if (! initialised) {
-		/* The QMP protocol requires we query its capabilities
-		 * before sending any further messages.
-		 */
-
-		g_debug ("sending required initial capabilities "
-				"message (%s)", capabilities);
-
-		size = g_socket_send (conn->socket, capabilities,
-				sizeof (capabilities)-1, NULL, &error);
-		if (size < 0) {
-			g_critical ("failed to send json: %s", capabilities);
-			if (error) {
-				g_critical ("error: %s", error->message);
-				g_error_free (error);
-			}
-			goto out;
-		}
-
-		/* Get the response */
-		ret = clr_oci_qmp_msg_recv (conn->socket,
-				1, &msgs, &msg_count);
-		if (! ret) {
-			goto out;
-		}
-
-		recv_msg = g_slist_nth_data (msgs, 0);
-		if (! recv_msg) {
-			ret = false;
-			goto out;
-		}
-
-		/* Check it */
-		ret = clr_oci_qmp_check_result (recv_msg->str,
-				recv_msg->len, true);
-		if (! ret) {
-			goto out;
-		}
-
-		clr_oci_net_msgs_free_all (msgs);
-
-		initialised = true;
-
-		/* reset */
-		recv_msg = NULL;
-		msgs = NULL;
-		msg_count = 0;
+	if (! clr_oci_qmp_negotiate (conn)) {
+		goto out;
 	}
 
 	g_debug ("sending message '%s'", msg);
@@ -393,7 +432,7 @@ clr_oci_qmp_msg_send (struct clr_oci_vm_conn *conn,
 	}
 
 	/* Get the response */
-	ret = clr_oci_qmp_msg_recv (conn->socket,
+	ret = clr_oci_qmp_msg_recv (conn,
 			expected_resp_count,
 			&msgs, &msg_count);
 	if (! ret) {
@@ -451,6 +490,206 @@ out:
 	return ret;
 }
 
+/*!
+ * Examine a message received in response to a QMP command.
+ *
+ * \param msg Message received from the hypervisor.
+ * \param command Name of command the response is expected for.
+ * \param[out] result Copy of the "return" member (may be \c NULL).
+ * \param[out] done Set to \c true if \p msg is the command
+ *   response, or left unchanged if it was an asynchronous event.
+ *
+ * \return \c true if \p msg is a successful response or an event,
+ *   \c false if it is an error response or could not be parsed.
+ */
+static gboolean
+clr_oci_qmp_response_parse (const GString *msg,
+		const gchar *command,
+		JsonNode **result,
+		gboolean *done)
+{
+	JsonParser  *parser = NULL;
+	JsonNode    *root;
+	JsonObject  *obj;
+	JsonObject  *error_obj;
+	GError      *error = NULL;
+	gboolean     ret = false;
+
+	g_assert (msg);
+	g_assert (command);
+	g_assert (done);
+
+	parser = json_parser_new ();
+
+	if (! json_parser_load_from_data (parser, msg->str,
+				(gssize)msg->len, &error)) {
+		g_critical ("failed to parse qmp response: %s",
+				error->message);
+		g_error_free (error);
+		*done = true;
+		goto out;
+	}
+
+	root = json_parser_get_root (parser);
+	if (! (root && JSON_NODE_HOLDS_OBJECT (root))) {
+		g_critical ("unexpected qmp response: %s", msg->str);
+		*done = true;
+		goto out;
+	}
+
+	obj = json_node_get_object (root);
+
+	if (json_object_has_member (obj, "event")) {
+		g_debug ("ignoring qmp event '%s' while waiting for '%s'",
+				json_object_get_string_member (obj, "event"),
+				command);
+		ret = true;
+		goto out;
+	}
+
+	*done = true;
+
+	if (json_object_has_member (obj, "error")) {
+		error_obj = json_object_get_object_member (obj, "error");
+		g_debug ("qmp command '%s' failed: %s", command,
+				error_obj && json_object_has_member (error_obj, "desc")
+				? json_object_get_string_member (error_obj, "desc")
+				: msg->str);
+		goto out;
+	}
+
+	if (! json_object_has_member (obj, "return")) {
+		g_critical ("unexpected qmp response: %s", msg->str);
+		goto out;
+	}
+
+	if (result) {
+		*result = json_node_copy (json_object_get_member (obj,
+					"return"));
+	}
+
+	ret = true;
+
+out:
+	g_object_unref (parser);
+
+	return ret;
+}
+
+/*!
+ * Run a QMP command and return its result.
+ *
+ * Asynchronous events sent by the hypervisor whilst the command is
+ * in flight are skipped.
+ *
+ * \param conn \ref clr_oci_vm_conn to use.
+ * \param command QMP command name.
+ * \param arguments Command arguments (may be \c NULL).
+ * \param[out] result Copy of the "return" member of the response,
+ *   to be freed with \c json_node_free() (may be \c NULL if the
+ *   caller is not interested in the result).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_qmp_execute (struct clr_oci_vm_conn *conn,
+		const gchar *command,
+		JsonObject *arguments,
+		JsonNode **result)
+{
+	JsonObject  *request = NULL;
+	gchar       *msg = NULL;
+	gsize        msg_len = 0;
+	GError      *error = NULL;
+	GSList      *msgs = NULL;
+	GSList      *l;
+	gsize        msg_count;
+	gssize       size;
+	gboolean     done = false;
+	gboolean     ret = false;
+
+	if (! (conn && command)) {
+		return false;
+	}
+
+	if (result) {
+		*result = NULL;
+	}
+
+	if (! clr_oci_qmp_negotiate (conn)) {
+		goto out;
+	}
+
+	request = json_object_new ();
+	json_object_set_string_member (request, "execute", command);
+	if (arguments) {
+		json_object_set_object_member (request, "arguments",
+				json_object_ref (arguments));
+	}
+
+	msg = clr_oci_json_obj_to_string (request, false, &msg_len);
+	if (! msg) {
+		goto out;
+	}
+
+	g_debug ("sending message '%s'", msg);
+
+	size = g_socket_send (conn->socket, msg, msg_len,
+			NULL, &error);
+	if (size < 0) {
+		g_critical ("failed to send json: %s", msg);
+		if (error) {
+			g_critical ("error: %s", error->message);
+			g_error_free (error);
+		}
+		goto out;
+	}
+
+	while (! done) {
+		msg_count = 0;
+
+		/* Skipped events are not a response, so success is
+		 * only reported once the response itself arrives.
+		 */
+		ret = false;
+
+		/* Only one message is taken at a time, so anything
+		 * received after the response is left in
+		 * conn->pending.
+		 */
+		if (! clr_oci_qmp_msg_recv (conn, 1,
+					&msgs, &msg_count)) {
+			goto out;
+		}
+
+		for (l = msgs; l && ! done; l = g_slist_next (l)) {
+			ret = clr_oci_qmp_response_parse (l->data,
+					command, result, &done);
+		}
+
+		clr_oci_net_msgs_free_all (msgs);
+		msgs = NULL;
+	}
+
+	/* never report success without the result asked for */
+	if (ret && result && ! *result) {
+		g_critical ("no result for qmp command '%s'", command);
+		ret = false;
+	}
+
+out:
+	if (! ret && result && *result) {
+		json_node_free (*result);
+		*result = NULL;
+	}
+	if (request) {
+		json_object_unref (request);
+	}
+	g_free_if_set (msg);
+
+	return ret;
+}
+
 /*!
  * Send a QMP shutdown message to the hypervisor.
  *
@@ -523,12 +762,12 @@ clr_oci_qmp_resume (struct clr_oci_vm_conn *conn, GPid pid)
 /*!
  * Read the expected QMP welcome message.
  *
- * \param socket \c GSocket to use.
+ * \param conn \ref clr_oci_vm_conn to use.
  *
  * \return \c true on success, else \c false.
  */
 static gboolean
-clr_oci_qmp_check_welcome (GSocket *socket)
+clr_oci_qmp_check_welcome (struct clr_oci_vm_conn *conn)
 {
 	GError      *error = NULL;
 	JsonParser  *parser = NULL;
@@ -538,9 +777,9 @@ clr_oci_qmp_check_welcome (GSocket *socket)
 	gboolean     ret;
 	GString     *msg = NULL;
 
-	g_assert (socket);
+	g_assert (conn);
 
-	ret = clr_oci_qmp_msg_recv (socket, 1, &msgs, &msg_count);
+	ret = clr_oci_qmp_msg_recv (conn, 1, &msgs, &msg_count);
 	if (! ret) {
 		goto out;
 	}
@@ -581,18 +820,32 @@ out:
 		clr_oci_net_msgs_free_all (msgs);
 	}
 
-	g_debug ("handled qmp welcome");
+	if (ret) {
+		g_debug ("handled qmp welcome");
+	}
 
-	return true;
+	return ret;
 }
 
-static void
+/*!
+ * Close the connection to the hypervisor and free \p conn.
+ *
+ * \param conn \ref clr_oci_vm_conn.
+ */
+void
 clr_oci_vm_conn_free (struct clr_oci_vm_conn *conn)
 {
 	g_assert (conn);
 
-	g_object_unref (conn->socket_addr);
-	g_object_unref (conn->socket);
+	if (conn->socket_addr) {
+		g_object_unref (conn->socket_addr);
+	}
+	if (conn->socket) {
+		g_object_unref (conn->socket);
+	}
+	if (conn->pending) {
+		g_string_free (conn->pending, true);
+	}
 	g_free_if_set (conn);
 }
 
@@ -605,7 +858,7 @@ clr_oci_vm_conn_free (struct clr_oci_vm_conn *conn)
  *
  * \return \ref clr_oci_vm_conn on success, else \c NULL.
  */
-static struct clr_oci_vm_conn *
+struct clr_oci_vm_conn *
 clr_oci_vm_conn_new (const gchar *socket_path, GPid pid)
 {
 	struct clr_oci_vm_conn  *conn = NULL;
@@ -623,6 +876,8 @@ clr_oci_vm_conn_new (const gchar *socket_path, GPid pid)
 	g_strlcpy (conn->socket_path, socket_path,
 			sizeof (conn->socket_path));
 
+	conn->pending = g_string_new ("");
+
 	conn->socket_addr = g_unix_socket_address_new (socket_path);
 	if (! conn->socket_addr) {
 		g_critical ("socket path does not exist: %s", socket_path);
@@ -640,6 +895,12 @@ clr_oci_vm_conn_new (const gchar *socket_path, GPid pid)
 		goto err;
 	}
 
+	/* A hypervisor that is not serving QMP (for example one still
+	 * held stopped, or already talking to another client) must
+	 * not block the caller forever.
+	 */
+	g_socket_set_timeout (conn->socket, CLR_OCI_QMP_TIMEOUT);
+
 	ret = g_socket_connect (conn->socket, conn->socket_addr,
 			NULL, &error);
 	if (! ret) {
@@ -651,7 +912,7 @@ clr_oci_vm_conn_new (const gchar *socket_path, GPid pid)
 
 	g_debug ("connected to socket path %s", socket_path);
 
-	ret = clr_oci_qmp_check_welcome (conn->socket);
+	ret = clr_oci_qmp_check_welcome (conn);
 	if (! ret) {
 		goto err;
 	}
@@ -664,6 +925,1580 @@ err:
 	return NULL;
 }
 
+/*!
+ * Remove all complete QMP event messages from \p pending.
+ *
+ * Messages that are not events (such as command responses) are
+ * discarded.
+ *
+ * \param pending Data received from the hypervisor. Any trailing
+ *   partial message is left in the buffer.
+ * \param[out] events List that parsed events (of type
+ *   \c JsonObject) are appended to.
+ */
+private void
+clr_oci_qmp_events_parse (GString *pending, GSList **events)
+{
+	JsonParser  *parser;
+	JsonNode    *root;
+	GError      *error = NULL;
+	gchar       *p;
+	gsize        len;
+
+	g_assert (pending);
+	g_assert (events);
+
+	parser = json_parser_new ();
+
+	while ((p = g_strstr_len (pending->str, (gssize)pending->len,
+					CLR_OCI_MSG_SEPARATOR))) {
+		len = (gsize)(p - pending->str);
+
+		if (! len) {
+			goto next;
+		}
+
+		if (! json_parser_load_from_data (parser, pending->str,
+					(gssize)len, &error)) {
+			g_warning ("ignoring invalid qmp message: %s",
+					error->message);
+			g_clear_error (&error);
+			goto next;
+		}
+
+		root = json_parser_get_root (parser);
+		if (! (root && JSON_NODE_HOLDS_OBJECT (root))) {
+			goto next;
+		}
+
+		if (! json_object_has_member (json_node_get_object (root),
+					"event")) {
+			goto next;
+		}
+
+		*events = g_slist_append (*events,
+				json_object_ref (json_node_get_object (root)));
+
+next:
+		g_string_erase (pending, 0, (gssize)
+				(len + sizeof (CLR_OCI_MSG_SEPARATOR) - 1));
+	}
+
+	g_object_unref (parser);
+}
+
+/*!
+ * Connect to a hypervisor QMP socket to receive asynchronous events.
+ *
+ * The returned connection is non-blocking and should only be used
+ * with \ref clr_oci_qmp_events_read().
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_EVENTS_SOCKET.
+ * \param pid Process ID of running hypervisor.
+ *
+ * \return \ref clr_oci_vm_conn on success, else \c NULL.
+ */
+struct clr_oci_vm_conn *
+clr_oci_qmp_events_connect (const gchar *socket_path, GPid pid)
+{
+	struct clr_oci_vm_conn  *conn;
+
+	if (! (socket_path && pid)) {
+		return NULL;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return NULL;
+	}
+
+	/* Events are only sent once capabilities have been
+	 * negotiated.
+	 */
+	if (! clr_oci_qmp_negotiate (conn)) {
+		clr_oci_vm_conn_free (conn);
+		return NULL;
+	}
+
+	g_socket_set_blocking (conn->socket, false);
+
+	return conn;
+}
+
+/*!
+ * Get the file descriptor of a hypervisor connection, to allow it to
+ * be watched by a main loop.
+ *
+ * \param conn \ref clr_oci_vm_conn.
+ *
+ * \return file descriptor on success, else -1.
+ */
+int
+clr_oci_vm_conn_fd (const struct clr_oci_vm_conn *conn)
+{
+	if (! conn) {
+		return -1;
+	}
+
+	return g_socket_get_fd (conn->socket);
+}
+
+/*!
+ * Read all QMP events currently available from the hypervisor.
+ *
+ * \param conn \ref clr_oci_vm_conn created by
+ *   \ref clr_oci_qmp_events_connect().
+ * \param[out] events List that received events (of type
+ *   \c JsonObject) are appended to.
+ *
+ * \return \c true if the connection is still open, \c false if the
+ *   hypervisor has gone away.
+ */
+gboolean
+clr_oci_qmp_events_read (struct clr_oci_vm_conn *conn, GSList **events)
+{
+	gchar     buffer[CLR_OCI_NET_BUF_SIZE];
+	GError   *error = NULL;
+	gssize    bytes;
+	gboolean  ret = true;
+
+	if (! (conn && events)) {
+		return false;
+	}
+
+	while (true) {
+		bytes = g_socket_receive (conn->socket, buffer,
+				sizeof (buffer), NULL, &error);
+		if (bytes < 0) {
+			if (! g_error_matches (error, G_IO_ERROR,
+						G_IO_ERROR_WOULD_BLOCK)) {
+				g_debug ("failed to receive qmp event: %s",
+						error->message);
+				ret = false;
+			}
+			g_error_free (error);
+			break;
+		}
+
+		if (! bytes) {
+			/* hypervisor exited */
+			ret = false;
+			break;
+		}
+
+		g_string_append_len (conn->pending, buffer, bytes);
+	}
+
+	clr_oci_qmp_events_parse (conn->pending, events);
+
+	return ret;
+}
+
+/*!
+ * Build the device id used when hotplugging a vCPU.
+ *
+ * The id is derived from the topology properties of the CPU slot,
+ * so is stable and unique.
+ *
+ * \param props "props" member of a "query-hotpluggable-cpus" entry.
+ *
+ * \return Newly-allocated string.
+ */
+private gchar *
+clr_oci_vcpu_id (JsonObject *props)
+{
+	GString  *id;
+	GList    *members;
+	GList    *l;
+
+	id = g_string_new (CLR_OCI_VCPU_ID_PREFIX);
+
+	members = props ? json_object_get_members (props) : NULL;
+
+	for (l = members; l; l = g_list_next (l)) {
+		g_string_append_printf (id, "-%ld", (long int)
+				json_object_get_int_member (props, l->data));
+	}
+
+	g_list_free (members);
+
+	return g_string_free (id, false);
+}
+
+/*!
+ * Wait for the guest to release vCPUs which are being unplugged.
+ *
+ * \param conn \ref clr_oci_vm_conn.
+ * \param qom_paths QOM paths of the vCPUs being unplugged (those
+ *   released are removed).
+ *
+ * \return \c true once all of the vCPUs have been released, else
+ *   \c false.
+ */
+static gboolean
+clr_oci_vm_vcpus_wait_unplugged (struct clr_oci_vm_conn *conn,
+		GPtrArray *qom_paths)
+{
+	JsonNode    *result;
+	JsonArray   *slots;
+	JsonObject  *slot;
+	const gchar *path;
+	gboolean     found;
+	gint64       end_time;
+	guint        i;
+	guint        j;
+
+	end_time = g_get_monotonic_time ()
+		+ CLR_OCI_VCPU_UNPLUG_TIMEOUT_MS * 1000;
+
+	/* A vCPU slot only loses its QOM path once the guest has
+	 * offlined the vCPU.
+	 */
+	while (qom_paths->len) {
+		result = NULL;
+		if (! clr_oci_qmp_execute (conn, "query-hotpluggable-cpus",
+					NULL, &result)) {
+			return false;
+		}
+
+		if (! JSON_NODE_HOLDS_ARRAY (result)) {
+			json_node_free (result);
+			return false;
+		}
+
+		slots = json_node_get_array (result);
+
+		for (i = qom_paths->len; i > 0; i--) {
+			found = false;
+
+			for (j = 0; j < json_array_get_length (slots) && ! found;
+					j++) {
+				slot = json_array_get_object_element (slots, j);
+				if (! json_object_has_member (slot, "qom-path")) {
+					continue;
+				}
+
+				path = json_object_get_string_member (slot,
+						"qom-path");
+				found = ! g_strcmp0 (path,
+						g_ptr_array_index (qom_paths, i - 1));
+			}
+
+			if (! found) {
+				g_ptr_array_remove_index (qom_paths, i - 1);
+			}
+		}
+
+		json_node_free (result);
+
+		if (! qom_paths->len) {
+			break;
+		}
+
+		if (g_get_monotonic_time () >= end_time) {
+			g_critical ("guest did not release vCPU %s",
+					(gchar *)g_ptr_array_index (qom_paths, 0));
+			return false;
+		}
+
+		g_usleep (CLR_OCI_VCPU_UNPLUG_POLL_MS * 1000);
+	}
+
+	return true;
+}
+
+/*!
+ * Hotplug or unplug vCPUs so that the VM has \p vcpus of them.
+ *
+ * Only vCPUs which were hotplugged can be unplugged, and this only
+ * succeeds once the guest has released them.
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param vcpus Number of vCPUs required.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_set_vcpus (const gchar *socket_path, GPid pid, guint vcpus)
+{
+	struct clr_oci_vm_conn  *conn = NULL;
+	JsonNode                *result = NULL;
+	JsonArray               *slots;
+	JsonObject              *slot;
+	JsonObject              *props;
+	JsonObject              *args;
+	const gchar             *qom_path;
+	GPtrArray               *unplugged = NULL;
+	gchar                   *id;
+	GList                   *members;
+	GList                   *l;
+	guint                    max;
+	guint                    online = 0;
+	guint                    i;
+	gboolean                 ret = false;
+
+	if (! (socket_path && pid && vcpus)) {
+		return false;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return false;
+	}
+
+	if (! clr_oci_qmp_execute (conn, "query-hotpluggable-cpus",
+				NULL, &result)) {
+		g_critical ("hypervisor does not support vCPU hotplug");
+		goto out;
+	}
+
+	if (! JSON_NODE_HOLDS_ARRAY (result)) {
+		goto out;
+	}
+
+	slots = json_node_get_array (result);
+	max = json_array_get_length (slots);
+
+	for (i = 0; i < max; i++) {
+		slot = json_array_get_object_element (slots, i);
+		if (json_object_has_member (slot, "qom-path")) {
+			online++;
+		}
+	}
+
+	if (vcpus > max) {
+		g_critical ("cannot use %u vCPUs: maximum is %u",
+				vcpus, max);
+		goto out;
+	}
+
+	/* Slots are listed highest first, so plug from the end of the
+	 * list and unplug from the start.
+	 */
+	for (i = max; i > 0 && online < vcpus; i--) {
+		slot = json_array_get_object_element (slots, i - 1);
+		if (json_object_has_member (slot, "qom-path")) {
+			continue;
+		}
+
+		props = json_object_get_object_member (slot, "props");
+		id = clr_oci_vcpu_id (props);
+
+		args = json_object_new ();
+		json_object_set_string_member (args, "driver",
+				json_object_get_string_member (slot, "type"));
+		json_object_set_string_member (args, "id", id);
+
+		/* the slot is identified by its topology properties */
+		members = props ? json_object_get_members (props) : NULL;
+		for (l = members; l; l = g_list_next (l)) {
+			json_object_set_member (args, l->data,
+					json_node_copy (json_object_get_member
+						(props, l->data)));
+		}
+		g_list_free (members);
+
+		ret = clr_oci_qmp_execute (conn, "device_add", args, NULL);
+
+		json_object_unref (args);
+
+		if (! ret) {
+			g_critical ("failed to add vCPU %s", id);
+			g_free (id);
+			goto out;
+		}
+
+		g_debug ("added vCPU %s", id);
+		g_free (id);
+
+		online++;
+	}
+
+	for (i = 0; i < max && online > vcpus; i++) {
+		slot = json_array_get_object_element (slots, i);
+		if (! json_object_has_member (slot, "qom-path")) {
+			continue;
+		}
+
+		/* Only devices added with an id can be removed */
+		qom_path = json_object_get_string_member (slot, "qom-path");
+		if (! g_str_has_prefix (qom_path, CLR_OCI_QOM_PERIPHERAL)) {
+			continue;
+		}
+
+		args = json_object_new ();
+		json_object_set_string_member (args, "id",
+				qom_path + sizeof (CLR_OCI_QOM_PERIPHERAL) - 1);
+
+		ret = clr_oci_qmp_execute (conn, "device_del", args, NULL);
+
+		json_object_unref (args);
+
+		if (! ret) {
+			g_critical ("failed to remove vCPU %s", qom_path);
+			goto out;
+		}
+
+		g_debug ("removed vCPU %s", qom_path);
+
+		if (! unplugged) {
+			unplugged = g_ptr_array_new_with_free_func (g_free);
+		}
+		g_ptr_array_add (unplugged, g_strdup (qom_path));
+
+		online--;
+	}
+
+	if (online != vcpus) {
+		g_critical ("cannot use %u vCPUs: only hotplugged vCPUs "
+				"can be removed", vcpus);
+		ret = false;
+		goto out;
+	}
+
+	if (unplugged && ! clr_oci_vm_vcpus_wait_unplugged (conn, unplugged)) {
+		ret = false;
+		goto out;
+	}
+
+	ret = true;
+
+out:
+	if (result) {
+		json_node_free (result);
+	}
+	if (unplugged) {
+		g_ptr_array_unref (unplugged);
+	}
+	clr_oci_vm_conn_free (conn);
+
+	return ret;
+}
+
+/*!
+ * Determine the host threads running the vCPUs of a VM.
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param[out] threads Newly-allocated array of \c GPid thread IDs,
+ *   indexed by vCPU index.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_vcpu_threads (const gchar *socket_path, GPid pid,
+		GArray **threads)
+{
+	struct clr_oci_vm_conn  *conn = NULL;
+	JsonNode                *result = NULL;
+	JsonArray               *cpus;
+	JsonObject              *cpu;
+	gint64                   index;
+	guint                    i;
+	gboolean                 ret = false;
+
+	if (! (socket_path && pid && threads)) {
+		return false;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return false;
+	}
+
+	if (! clr_oci_qmp_execute (conn, "query-cpus-fast", NULL, &result)) {
+		goto out;
+	}
+
+	if (! JSON_NODE_HOLDS_ARRAY (result)) {
+		goto out;
+	}
+
+	cpus = json_node_get_array (result);
+
+	*threads = g_array_new (false, true, sizeof (GPid));
+
+	for (i = 0; i < json_array_get_length (cpus); i++) {
+		cpu = json_array_get_object_element (cpus, i);
+
+		if (! (json_object_has_member (cpu, "cpu-index")
+				&& json_object_has_member (cpu, "thread-id"))) {
+			continue;
+		}
+
+		index = json_object_get_int_member (cpu, "cpu-index");
+		if (index < 0 || index > G_MAXUINT16) {
+			continue;
+		}
+
+		if ((guint)index >= (*threads)->len) {
+			g_array_set_size (*threads, (guint)index + 1);
+		}
+
+		g_array_index (*threads, GPid, index) = (GPid)
+			json_object_get_int_member (cpu, "thread-id");
+	}
+
+	ret = true;
+
+out:
+	if (result) {
+		json_node_free (result);
+	}
+	clr_oci_vm_conn_free (conn);
+
+	return ret;
+}
+
+/*!
+ * Determine if a memory device exists.
+ *
+ * \param devices "query-memory-devices" result.
+ * \param id Id of memory device.
+ *
+ * \return \c true if the device exists, else \c false.
+ */
+static gboolean
+clr_oci_vm_memory_device_exists (JsonArray *devices, const gchar *id)
+{
+	JsonObject  *device;
+	JsonObject  *data;
+	guint        i;
+
+	for (i = 0; devices && i < json_array_get_length (devices); i++) {
+		device = json_array_get_object_element (devices, i);
+		if (! json_object_has_member (device, "data")) {
+			continue;
+		}
+
+		data = json_object_get_object_member (device, "data");
+		if (data && json_object_has_member (data, "id")
+				&& ! g_strcmp0 (id,
+					json_object_get_string_member (data,
+						"id"))) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*!
+ * Find a QOM object.
+ *
+ * \param objects "qom-list" result for \ref CLR_OCI_QOM_OBJECTS.
+ * \param name Name of object.
+ *
+ * \return "qom-list" entry for the object, or \c NULL if it does
+ *   not exist.
+ */
+static JsonObject *
+clr_oci_qom_object_find (JsonArray *objects, const gchar *name)
+{
+	JsonObject  *object;
+	guint        i;
+
+	for (i = 0; objects && i < json_array_get_length (objects); i++) {
+		object = json_array_get_object_element (objects, i);
+		if (json_object_has_member (object, "name")
+				&& ! g_strcmp0 (name,
+					json_object_get_string_member (object,
+						"name"))) {
+			return object;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * Read a property of a QOM object.
+ *
+ * \param conn \ref clr_oci_vm_conn.
+ * \param path QOM path of object.
+ * \param property Name of property.
+ *
+ * \return Value of the property, to be freed with \c json_node_free(),
+ *   or \c NULL on error.
+ */
+static JsonNode *
+clr_oci_qom_get (struct clr_oci_vm_conn *conn, const gchar *path,
+		const gchar *property)
+{
+	JsonObject  *args;
+	JsonNode    *result = NULL;
+
+	args = json_object_new ();
+	json_object_set_string_member (args, "path", path);
+	json_object_set_string_member (args, "property", property);
+
+	(void)clr_oci_qmp_execute (conn, "qom-get", args, &result);
+	json_object_unref (args);
+
+	return result;
+}
+
+/*!
+ * Delete the backend of a memory device, freeing its host memory.
+ *
+ * \param conn \ref clr_oci_vm_conn.
+ * \param memdev Id of backend.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_vm_memory_backend_del (struct clr_oci_vm_conn *conn,
+		const gchar *memdev)
+{
+	JsonObject  *args;
+	gboolean     ret;
+
+	args = json_object_new ();
+	json_object_set_string_member (args, "id", memdev);
+	ret = clr_oci_qmp_execute (conn, "object-del", args, NULL);
+	json_object_unref (args);
+
+	if (ret) {
+		g_debug ("deleted memory backend %s", memdev);
+	}
+
+	return ret;
+}
+
+/*!
+ * Delete the backends of memory devices that have been unplugged.
+ *
+ * A backend can only be deleted once the guest has released its
+ * device, which may happen long after the device was unplugged.
+ *
+ * \param conn \ref clr_oci_vm_conn.
+ * \param devices "query-memory-devices" result.
+ * \param objects "qom-list" result for \ref CLR_OCI_QOM_OBJECTS.
+ */
+static void
+clr_oci_vm_memory_backends_free (struct clr_oci_vm_conn *conn,
+		JsonArray *devices, JsonArray *objects)
+{
+	JsonObject   *object;
+	const gchar  *name;
+	guint         i;
+
+	for (i = 0; objects && i < json_array_get_length (objects); i++) {
+		object = json_array_get_object_element (objects, i);
+		if (! json_object_has_member (object, "name")) {
+			continue;
+		}
+
+		name = json_object_get_string_member (object, "name");
+		if (! g_str_has_prefix (name, CLR_OCI_DIMM_BACKEND_PREFIX)) {
+			continue;
+		}
+
+		/* skip "mem-" to get the device id */
+		if (clr_oci_vm_memory_device_exists (devices,
+					name + strlen ("mem-"))) {
+			continue;
+		}
+
+		(void)clr_oci_vm_memory_backend_del (conn, name);
+	}
+}
+
+/*!
+ * Set the "object-add" arguments that back hotplugged memory the
+ * same way as boot RAM.
+ *
+ * Boot RAM may be shared (for example with a vhost-user device or
+ * for a lazy checkpoint), so hotplugged memory must be too.
+ *
+ * \param conn \ref clr_oci_vm_conn.
+ * \param objects "qom-list" result for \ref CLR_OCI_QOM_OBJECTS.
+ * \param args "object-add" arguments.
+ * \param props Properties of the backend.
+ */
+static void
+clr_oci_vm_memory_backend_args (struct clr_oci_vm_conn *conn,
+		JsonArray *objects, JsonObject *args, JsonObject *props)
+{
+	g_autofree gchar  *qom_type = NULL;
+	g_autofree gchar  *path = NULL;
+	JsonObject        *object;
+	JsonNode          *value;
+	const gchar       *type = NULL;
+	const gchar       *start;
+	const gchar       *end;
+
+	object = clr_oci_qom_object_find (objects, CLR_OCI_RAM_BACKEND_ID);
+	if (object && json_object_has_member (object, "type")) {
+		/* of the form "child<TYPE>" */
+		type = json_object_get_string_member (object, "type");
+	}
+
+	start = type ? strchr (type, '<') : NULL;
+	end = start ? strchr (start, '>') : NULL;
+
+	if (! end) {
+		/* boot RAM is private anonymous memory */
+		json_object_set_string_member (args, "qom-type",
+				"memory-backend-ram");
+		return;
+	}
+
+	qom_type = g_strndup (start + 1, (gsize)(end - start - 1));
+	json_object_set_string_member (args, "qom-type", qom_type);
+
+	path = g_strdup_printf ("%s/%s", CLR_OCI_QOM_OBJECTS,
+			CLR_OCI_RAM_BACKEND_ID);
+
+	value = clr_oci_qom_get (conn, path, "share");
+	if (value) {
+		json_object_set_boolean_member (props, "share",
+				json_node_get_boolean (value));
+		json_node_free (value);
+	}
+
+	if (! g_strcmp0 (qom_type, "memory-backend-file")) {
+		value = clr_oci_qom_get (conn, path, "mem-path");
+		if (value) {
+			json_object_set_string_member (props, "mem-path",
+					json_node_get_string (value));
+			json_node_free (value);
+		}
+	} else if (! g_strcmp0 (qom_type, "memory-backend-ram")) {
+		value = clr_oci_qom_get (conn, path, "merge");
+		if (value) {
+			json_object_set_boolean_member (props, "merge",
+					json_node_get_boolean (value));
+			json_node_free (value);
+		}
+	}
+}
+
+/*!
+ * Hotplug a memory device.
+ *
+ * \param conn \ref clr_oci_vm_conn.
+ * \param devices "query-memory-devices" result, used to find an
+ *   unused device id.
+ * \param objects "qom-list" result for \ref CLR_OCI_QOM_OBJECTS,
+ *   used to find an unused backend id.
+ * \param size Size of the memory device in bytes.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_vm_memory_add (struct clr_oci_vm_conn *conn, JsonArray *devices,
+		JsonArray *objects, guint64 size)
+{
+	g_autofree gchar  *id = NULL;
+	g_autofree gchar  *memdev = NULL;
+	JsonObject        *args;
+	JsonObject        *props;
+	guint              index;
+	gboolean           ret;
+
+	/* find an unused id (the backend of an unplugged device may
+	 * not have been deleted yet)
+	 */
+	for (index = 0; ; index++) {
+		g_free_if_set (id);
+		g_free_if_set (memdev);
+		id = g_strdup_printf ("%s%u", CLR_OCI_DIMM_ID_PREFIX, index);
+		memdev = g_strdup_printf ("mem-%s", id);
+
+		if (! (clr_oci_vm_memory_device_exists (devices, id)
+					|| clr_oci_qom_object_find (objects,
+						memdev))) {
+			break;
+		}
+	}
+
+	props = json_object_new ();
+	json_object_set_int_member (props, "size", (gint64)size);
+
+	args = json_object_new ();
+	clr_oci_vm_memory_backend_args (conn, objects, args, props);
+	json_object_set_string_member (args, "id", memdev);
+	json_object_set_object_member (args, "props", props);
+
+	ret = clr_oci_qmp_execute (conn, "object-add", args, NULL);
+	json_object_unref (args);
+
+	if (! ret) {
+		g_critical ("failed to create %lu bytes of memory",
+				(unsigned long int)size);
+		return false;
+	}
+
+	args = json_object_new ();
+	json_object_set_string_member (args, "driver", "pc-dimm");
+	json_object_set_string_member (args, "id", id);
+	json_object_set_string_member (args, "memdev", memdev);
+
+	ret = clr_oci_qmp_execute (conn, "device_add", args, NULL);
+	json_object_unref (args);
+
+	if (! ret) {
+		g_critical ("failed to add %lu bytes of memory",
+				(unsigned long int)size);
+
+		(void)clr_oci_vm_memory_backend_del (conn, memdev);
+
+		return false;
+	}
+
+	g_debug ("added memory device %s (%lu bytes)", id,
+			(unsigned long int)size);
+
+	return true;
+}
+
+/*!
+ * Unplug a memory device and free its host memory.
+ *
+ * The backend can only be deleted once the guest has released the
+ * device (signalled by the DEVICE_DELETED event). If that takes too
+ * long, the backend is deleted by a later call to
+ * clr_oci_vm_set_memory() instead.
+ *
+ * \param conn \ref clr_oci_vm_conn.
+ * \param id Id of memory device.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_vm_memory_del (struct clr_oci_vm_conn *conn, const gchar *id)
+{
+	g_autofree gchar  *memdev = NULL;
+	JsonObject        *args;
+	JsonNode          *result;
+	gboolean           removed = false;
+	gboolean           ret;
+	gint64             end_time;
+
+	args = json_object_new ();
+	json_object_set_string_member (args, "id", id);
+	ret = clr_oci_qmp_execute (conn, "device_del", args, NULL);
+	json_object_unref (args);
+
+	if (! ret) {
+		g_critical ("failed to remove memory device %s", id);
+		return false;
+	}
+
+	g_debug ("removed memory device %s", id);
+
+	memdev = g_strdup_printf ("mem-%s", id);
+
+	end_time = g_get_monotonic_time ()
+		+ CLR_OCI_MEMORY_UNPLUG_TIMEOUT_MS * 1000;
+
+	/* The device is only deleted once the guest has offlined its
+	 * memory.
+	 */
+	while (! removed && g_get_monotonic_time () < end_time) {
+		result = NULL;
+		if (! clr_oci_qmp_execute (conn, "query-memory-devices",
+					NULL, &result)) {
+			break;
+		}
+
+		removed = JSON_NODE_HOLDS_ARRAY (result)
+			&& ! clr_oci_vm_memory_device_exists
+				(json_node_get_array (result), id);
+		json_node_free (result);
+
+		if (! removed) {
+			g_usleep (CLR_OCI_MEMORY_UNPLUG_POLL_MS * 1000);
+		}
+	}
+
+	if (! (removed && clr_oci_vm_memory_backend_del (conn, memdev))) {
+		g_debug ("memory backend %s will be deleted later", memdev);
+	}
+
+	return true;
+}
+
+/*!
+ * Change the amount of memory available to the guest.
+ *
+ * Memory is added by hotplugging a memory device. Memory is removed
+ * by unplugging previously hotplugged memory devices and, for any
+ * remainder, by inflating the balloon (if the VM has a
+ * virtio-balloon device).
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param bytes Amount of memory required.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_set_memory (const gchar *socket_path, GPid pid, guint64 bytes)
+{
+	struct clr_oci_vm_conn  *conn = NULL;
+	JsonNode                *summary = NULL;
+	JsonNode                *result = NULL;
+	JsonNode                *qom_result = NULL;
+	JsonArray               *devices = NULL;
+	JsonArray               *objects = NULL;
+	JsonObject              *obj;
+	JsonObject              *data;
+	JsonObject              *args;
+	const gchar             *id;
+	guint64                  current;
+	guint64                  size;
+	guint                    i;
+	gboolean                 ret = false;
+
+	if (! (socket_path && pid && bytes)) {
+		return false;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return false;
+	}
+
+	if (! clr_oci_qmp_execute (conn, "query-memory-size-summary",
+				NULL, &summary)
+			|| ! JSON_NODE_HOLDS_OBJECT (summary)) {
+		g_critical ("failed to query memory size");
+		goto out;
+	}
+
+	obj = json_node_get_object (summary);
+	current = (guint64)json_object_get_int_member (obj, "base-memory");
+	if (json_object_has_member (obj, "plugged-memory")) {
+		current += (guint64)json_object_get_int_member (obj,
+				"plugged-memory");
+	}
+
+	if (! clr_oci_qmp_execute (conn, "query-memory-devices",
+				NULL, &result)
+			|| ! JSON_NODE_HOLDS_ARRAY (result)) {
+		g_critical ("failed to query memory devices");
+		goto out;
+	}
+
+	devices = json_node_get_array (result);
+
+	args = json_object_new ();
+	json_object_set_string_member (args, "path", CLR_OCI_QOM_OBJECTS);
+	ret = clr_oci_qmp_execute (conn, "qom-list", args, &qom_result);
+	json_object_unref (args);
+
+	if (! (ret && JSON_NODE_HOLDS_ARRAY (qom_result))) {
+		g_critical ("failed to list objects");
+		ret = false;
+		goto out;
+	}
+
+	objects = json_node_get_array (qom_result);
+
+	clr_oci_vm_memory_backends_free (conn, devices, objects);
+
+	if (bytes > current) {
+		/* The guest can only online whole memory blocks */
+		size = bytes - current;
+		size = (size + CLR_OCI_MEMORY_BLOCK_SIZE - 1)
+			/ CLR_OCI_MEMORY_BLOCK_SIZE * CLR_OCI_MEMORY_BLOCK_SIZE;
+
+		if (! clr_oci_vm_memory_add (conn, devices, objects,
+					size)) {
+			goto out;
+		}
+
+		current += size;
+	}
+
+	/* Remove the most recently added devices first */
+	for (i = json_array_get_length (devices); i > 0 && current > bytes; i--) {
+		obj = json_array_get_object_element (devices, i - 1);
+		data = json_object_get_object_member (obj, "data");
+		if (! (data && json_object_has_member (data, "id"))) {
+			continue;
+		}
+
+		id = json_object_get_string_member (data, "id");
+		if (! g_str_has_prefix (id, CLR_OCI_DIMM_ID_PREFIX)) {
+			continue;
+		}
+
+		size = (guint64)json_object_get_int_member (data, "size");
+		if (current - size < bytes) {
+			continue;
+		}
+
+		if (! clr_oci_vm_memory_del (conn, id)) {
+			ret = false;
+			goto out;
+		}
+
+		current -= size;
+	}
+
+	/* Inflate the balloon to reclaim the rest, or deflate it to
+	 * give back memory previously reclaimed.
+	 */
+	args = json_object_new ();
+	json_object_set_int_member (args, "value", (gint64)bytes);
+	ret = clr_oci_qmp_execute (conn, "balloon", args, NULL);
+	json_object_unref (args);
+
+	/* Without a balloon, memory can only be removed in whole
+	 * blocks.
+	 */
+	if (! ret && current - bytes >= CLR_OCI_MEMORY_BLOCK_SIZE) {
+		g_critical ("cannot reduce memory to %lu bytes "
+				"without a balloon device",
+				(unsigned long int)bytes);
+		goto out;
+	}
+
+	ret = true;
+
+out:
+	if (summary) {
+		json_node_free (summary);
+	}
+	if (result) {
+		json_node_free (result);
+	}
+	if (qom_result) {
+		json_node_free (qom_result);
+	}
+	clr_oci_vm_conn_free (conn);
+
+	return ret;
+}
+
+/*!
+ * Set the target size of the balloon of a running hypervisor.
+ *
+ * Unlike clr_oci_vm_set_memory(), memory devices are not added or
+ * removed: the guest returns pages to (or takes them back from) the
+ * host as the balloon is inflated (or deflated).
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param bytes Amount of memory the guest should be left with.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_balloon (const gchar *socket_path, GPid pid, guint64 bytes)
+{
+	struct clr_oci_vm_conn  *conn;
+	JsonObject              *args;
+	gboolean                 ret;
+
+	if (! (socket_path && pid && bytes)) {
+		return false;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return false;
+	}
+
+	args = json_object_new ();
+	json_object_set_int_member (args, "value", (gint64)bytes);
+	ret = clr_oci_qmp_execute (conn, "balloon", args, NULL);
+	json_object_unref (args);
+
+	if (! ret) {
+		g_critical ("failed to set balloon target to %lu bytes",
+				(unsigned long int)bytes);
+	}
+
+	clr_oci_vm_conn_free (conn);
+
+	return ret;
+}
+
+/*!
+ * Determine how many memory devices have been hotplugged into a
+ * running hypervisor.
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param[out] count Number of memory devices.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_memory_devices (const gchar *socket_path, GPid pid,
+		guint *count)
+{
+	struct clr_oci_vm_conn  *conn;
+	JsonNode                *result = NULL;
+	gboolean                 ret = false;
+
+	if (! (socket_path && pid && count)) {
+		return false;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return false;
+	}
+
+	if (! clr_oci_qmp_execute (conn, "query-memory-devices",
+				NULL, &result)) {
+		goto out;
+	}
+
+	if (! JSON_NODE_HOLDS_ARRAY (result)) {
+		goto out;
+	}
+
+	*count = json_array_get_length (json_node_get_array (result));
+
+	ret = true;
+
+out:
+	if (result) {
+		json_node_free (result);
+	}
+
+	clr_oci_vm_conn_free (conn);
+
+	return ret;
+}
+
+/*!
+ * Determine the memory currently left to the guest by the balloon of
+ * a running hypervisor.
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param[out] bytes Amount of memory available to the guest.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_balloon_get (const gchar *socket_path, GPid pid,
+		guint64 *bytes)
+{
+	struct clr_oci_vm_conn  *conn;
+	JsonNode                *result = NULL;
+	JsonObject              *obj;
+	gboolean                 ret = false;
+
+	if (! (socket_path && pid && bytes)) {
+		return false;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return false;
+	}
+
+	if (! clr_oci_qmp_execute (conn, "query-balloon", NULL, &result)) {
+		goto out;
+	}
+
+	if (! JSON_NODE_HOLDS_OBJECT (result)) {
+		goto out;
+	}
+
+	obj = json_node_get_object (result);
+	if (! json_object_has_member (obj, "actual")) {
+		goto out;
+	}
+
+	*bytes = (guint64)json_object_get_int_member (obj, "actual");
+
+	ret = true;
+
+out:
+	if (result) {
+		json_node_free (result);
+	}
+
+	clr_oci_vm_conn_free (conn);
+
+	return ret;
+}
+
+/*!
+ * Determine if the vCPUs of the hypervisor are running.
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param[out] running \c true if the VM is running, \c false if it
+ *   is paused (or stopped for any other reason).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_status (const gchar *socket_path, GPid pid,
+		gboolean *running)
+{
+	struct clr_oci_vm_conn  *conn;
+	JsonNode                *result = NULL;
+	JsonObject              *status;
+	gboolean                 ret = false;
+
+	if (! (socket_path && pid && running)) {
+		return false;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return false;
+	}
+
+	if (! clr_oci_qmp_execute (conn, "query-status", NULL, &result)) {
+		goto out;
+	}
+
+	if (! JSON_NODE_HOLDS_OBJECT (result)) {
+		goto out;
+	}
+
+	status = json_node_get_object (result);
+	if (! json_object_has_member (status, "running")) {
+		goto out;
+	}
+
+	*running = json_object_get_boolean_member (status, "running");
+
+	ret = true;
+
+out:
+	if (result) {
+		json_node_free (result);
+	}
+	clr_oci_vm_conn_free (conn);
+
+	return ret;
+}
+
+/*!
+ * Enable a migration capability.
+ *
+ * \param caps Array of capabilities to add to.
+ * \param name Name of capability.
+ */
+static void
+clr_oci_qmp_migrate_cap_add (JsonArray *caps, const gchar *name)
+{
+	JsonObject *cap;
+
+	cap = json_object_new ();
+	json_object_set_string_member (cap, "capability", name);
+	json_object_set_boolean_member (cap, "state", true);
+	json_array_add_object_element (caps, cap);
+}
+
+/*!
+ * Configure the hypervisor for a migration.
+ *
+ * The default bandwidth limit is intended to avoid starving a
+ * running guest, which is pointless when saving to or loading from a
+ * file, so it is lifted.
+ *
+ * \param conn \ref clr_oci_vm_conn to use.
+ * \param channels Number of multifd channels (\c 0 to disable
+ *   multifd).
+ * \param ignore_shared If \c true, do not migrate guest RAM that is
+ *   shared with other processes.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_qmp_migrate_setup (struct clr_oci_vm_conn *conn, guint channels,
+		gboolean ignore_shared)
+{
+	JsonObject  *args;
+	JsonArray   *caps;
+	gboolean     ret;
+
+	if (channels || ignore_shared) {
+		caps = json_array_new ();
+
+		if (channels) {
+			clr_oci_qmp_migrate_cap_add (caps, "multifd");
+
+			/* multifd can only write to a file if each page
+			 * has a fixed location within it.
+			 */
+			clr_oci_qmp_migrate_cap_add (caps, "mapped-ram");
+		}
+
+		if (ignore_shared) {
+			clr_oci_qmp_migrate_cap_add (caps,
+					"x-ignore-shared");
+		}
+
+		args = json_object_new ();
+		json_object_set_array_member (args, "capabilities", caps);
+
+		ret = clr_oci_qmp_execute (conn, "migrate-set-capabilities",
+				args, NULL);
+		json_object_unref (args);
+
+		if (! ret) {
+			g_critical ("failed to set migration capabilities");
+			return false;
+		}
+	}
+
+	args = json_object_new ();
+
+	if (channels) {
+		json_object_set_int_member (args, "multifd-channels",
+				(gint64)channels);
+	}
+
+	json_object_set_int_member (args, "max-bandwidth", G_MAXINT64);
+
+	ret = clr_oci_qmp_execute (conn, "migrate-set-parameters",
+			args, NULL);
+	json_object_unref (args);
+
+	if (! ret) {
+		g_critical ("failed to set migration parameters");
+	}
+
+	return ret;
+}
+
+/*!
+ * Wait for a migration to finish.
+ *
+ * \param conn \ref clr_oci_vm_conn to use.
+ *
+ * \return \c true if the migration completed, else \c false.
+ */
+static gboolean
+clr_oci_qmp_migrate_wait (struct clr_oci_vm_conn *conn)
+{
+	JsonNode    *result = NULL;
+	JsonObject  *obj;
+	const gchar *status;
+	gboolean     ret = false;
+
+	while (true) {
+		if (! clr_oci_qmp_execute (conn, "query-migrate",
+					NULL, &result)
+				|| ! JSON_NODE_HOLDS_OBJECT (result)) {
+			g_critical ("failed to query migration status");
+			break;
+		}
+
+		obj = json_node_get_object (result);
+
+		/* no status until an incoming migration has started */
+		status = json_object_has_member (obj, "status")
+			? json_object_get_string_member (obj, "status")
+			: NULL;
+
+		if (! g_strcmp0 (status, "completed")) {
+			ret = true;
+			break;
+		}
+
+		if (! g_strcmp0 (status, "failed")
+				|| ! g_strcmp0 (status, "cancelled")) {
+			g_critical ("migration %s: %s", status,
+					json_object_has_member (obj, "error-desc")
+					? json_object_get_string_member (obj,
+						"error-desc")
+					: "unknown error");
+			break;
+		}
+
+		json_node_free (result);
+		result = NULL;
+
+		g_usleep (CLR_OCI_MIGRATE_POLL_MS * 1000);
+	}
+
+	if (result) {
+		json_node_free (result);
+	}
+
+	return ret;
+}
+
+/*!
+ * Save the state of the VM.
+ *
+ * The VM should be paused first so that the saved state is
+ * consistent. It remains paused afterwards.
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param uri Migration URI to save the state to (for example
+ *   "file:/path/to/file").
+ * \param channels Number of multifd channels to save with (\c 0 to
+ *   disable multifd).
+ * \param ignore_shared If \c true, do not save guest RAM that is
+ *   shared with other processes (the caller saves it instead).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_migrate (const gchar *socket_path, GPid pid,
+		const gchar *uri, guint channels, gboolean ignore_shared)
+{
+	struct clr_oci_vm_conn  *conn = NULL;
+	JsonObject              *args;
+	gboolean                 ret = false;
+
+	if (! (socket_path && pid && uri)) {
+		return false;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return false;
+	}
+
+	if (! clr_oci_qmp_migrate_setup (conn, channels,
+				ignore_shared)) {
+		goto out;
+	}
+
+	args = json_object_new ();
+	json_object_set_string_member (args, "uri", uri);
+	ret = clr_oci_qmp_execute (conn, "migrate", args, NULL);
+	json_object_unref (args);
+
+	if (! ret) {
+		g_critical ("failed to start migration to %s", uri);
+		goto out;
+	}
+
+	ret = clr_oci_qmp_migrate_wait (conn);
+
+out:
+	clr_oci_vm_conn_free (conn);
+
+	return ret;
+}
+
+/*!
+ * Load the state of a VM started with "-incoming defer".
+ *
+ * This is only required to load state saved with multifd, since the
+ * capabilities must be set before the migration starts. Otherwise,
+ * the hypervisor can be started with "-incoming <uri>".
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param uri Migration URI to load the state from.
+ * \param channels Number of multifd channels the state was saved with.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_migrate_incoming (const gchar *socket_path, GPid pid,
+		const gchar *uri, guint channels)
+{
+	struct clr_oci_vm_conn  *conn = NULL;
+	JsonObject              *args;
+	gboolean                 ret = false;
+
+	if (! (socket_path && pid && uri)) {
+		return false;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return false;
+	}
+
+	if (! clr_oci_qmp_migrate_setup (conn, channels, false)) {
+		goto out;
+	}
+
+	args = json_object_new ();
+	json_object_set_string_member (args, "uri", uri);
+	ret = clr_oci_qmp_execute (conn, "migrate-incoming", args, NULL);
+	json_object_unref (args);
+
+	if (! ret) {
+		g_critical ("failed to start migration from %s", uri);
+		goto out;
+	}
+
+	ret = clr_oci_qmp_migrate_wait (conn);
+
+out:
+	clr_oci_vm_conn_free (conn);
+
+	return ret;
+}
+
+/*!
+ * Wait for the state of a VM started with "-incoming <uri>" to load.
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_migrate_incoming_wait (const gchar *socket_path, GPid pid)
+{
+	struct clr_oci_vm_conn  *conn = NULL;
+	gboolean                 ret;
+
+	if (! (socket_path && pid)) {
+		return false;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return false;
+	}
+
+	ret = clr_oci_qmp_migrate_wait (conn);
+
+	clr_oci_vm_conn_free (conn);
+
+	return ret;
+}
+
+/*!
+ * Request the hypervisor exit immediately.
+ *
+ * Unlike clr_oci_vm_shutdown(), the guest is given no chance to shut
+ * down (which also works when the VM is paused).
+ *
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_quit (const gchar *socket_path, GPid pid)
+{
+	struct clr_oci_vm_conn  *conn = NULL;
+	gboolean                 ret;
+
+	if (! (socket_path && pid)) {
+		return false;
+	}
+
+	conn = clr_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		return false;
+	}
+
+	ret = clr_oci_qmp_execute (conn, "quit", NULL, NULL);
+
+	clr_oci_vm_conn_free (conn);
+
+	return ret;
+}
+
 /*!
  * Request the running hypervisor shutdown.
  *
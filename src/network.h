@@ -21,8 +21,51 @@
 #ifndef _CLR_OCI_NETWORK_H
 #define _CLR_OCI_NETWORK_H
 
+#include <json-glib/json-glib.h>
+
+/** Number of seconds to wait for the hypervisor to accept a QMP
+ * connection, answer it, or send an awaited event.
+ */
+#define CLR_OCI_QMP_TIMEOUT 30
+
+struct clr_oci_vm_conn;
+
+struct clr_oci_vm_conn *clr_oci_vm_conn_new (const gchar *socket_path,
+		GPid pid);
+void clr_oci_vm_conn_free (struct clr_oci_vm_conn *conn);
+int clr_oci_vm_conn_fd (const struct clr_oci_vm_conn *conn);
+gboolean clr_oci_qmp_negotiate (struct clr_oci_vm_conn *conn);
+gboolean clr_oci_qmp_execute (struct clr_oci_vm_conn *conn,
+		const gchar *command, JsonObject *arguments,
+		JsonNode **result);
+struct clr_oci_vm_conn *clr_oci_qmp_events_connect (
+		const gchar *socket_path, GPid pid);
+gboolean clr_oci_qmp_events_read (struct clr_oci_vm_conn *conn,
+		GSList **events);
+
 gboolean clr_oci_vm_pause (const gchar *socket_path, GPid pid);
 gboolean clr_oci_vm_resume (const gchar *socket_path, GPid pid);
 gboolean clr_oci_vm_shutdown (const gchar *socket_path, GPid pid);
+gboolean clr_oci_vm_quit (const gchar *socket_path, GPid pid);
+gboolean clr_oci_vm_set_vcpus (const gchar *socket_path, GPid pid,
+		guint vcpus);
+gboolean clr_oci_vm_vcpu_threads (const gchar *socket_path, GPid pid,
+		GArray **threads);
+gboolean clr_oci_vm_set_memory (const gchar *socket_path, GPid pid,
+		guint64 bytes);
+gboolean clr_oci_vm_memory_devices (const gchar *socket_path, GPid pid,
+		guint *count);
+gboolean clr_oci_vm_balloon (const gchar *socket_path, GPid pid,
+		guint64 bytes);
+gboolean clr_oci_vm_balloon_get (const gchar *socket_path, GPid pid,
+		guint64 *bytes);
+gboolean clr_oci_vm_status (const gchar *socket_path, GPid pid,
+		gboolean *running);
+gboolean clr_oci_vm_migrate (const gchar *socket_path, GPid pid,
+		const gchar *uri, guint channels, gboolean ignore_shared);
+gboolean clr_oci_vm_migrate_incoming (const gchar *socket_path, GPid pid,
+		const gchar *uri, guint channels);
+gboolean clr_oci_vm_migrate_incoming_wait (const gchar *socket_path,
+		GPid pid);
 
 #endif /* _CLR_OCI_NETWORK_H */
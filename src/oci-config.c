@@ -31,6 +31,7 @@
 #include "namespace.h"
 #include "oci.h"
 #include "semver.h"
+#include "hypervisor.h"
 #include "oci-config.h"
 
 /*!
@@ -122,9 +123,14 @@ clr_oci_config_free (struct clr_oci_config *config)
 	g_free_if_set (config->bundle_path);
 	g_free_if_set (config->root_dir);
 	g_free_if_set (config->pid_file);
+	g_free_if_set (config->incoming);
+	g_free_if_set (config->incoming_ram);
+	g_free_if_set (config->ram_backend);
+	clr_oci_vm_fds_close (config);
 
 	if (config->vm) {
 		g_free_if_set (config->vm->kernel_params);
+		g_free_if_set (config->vm->dax_size);
 		g_free (config->vm);
 	}
 
@@ -158,4 +164,7 @@ clr_oci_config_free (struct clr_oci_config *config)
 		g_slist_free_full(config->oci.oci_linux.namespaces,
                 (GDestroyNotify)clr_oci_ns_free);
 	}
+
+	g_free_if_set (config->oci.oci_linux.resources.cpu_cpus);
+	g_free_if_set (config->oci.oci_linux.resources.cpu_mems);
 }
@@ -30,6 +30,8 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -47,9 +49,22 @@
 #include "mount.h"
 #include "state.h"
 #include "oci-config.h"
+#include "annotation.h"
 #include "runtime.h"
 #include "spec_handler.h"
 #include "command.h"
+#include "console.h"
+#include "console-log.h"
+#include "checkpoint.h"
+#include "agent.h"
+#include "query.h"
+#include "pidfd.h"
+#include "hypervisor.h"
+#include "virtiofs.h"
+#include "placement.h"
+#include "hugepages.h"
+#include "reclaim.h"
+#include "autopause.h"
 
 extern struct start_data start_data;
 
@@ -76,28 +91,26 @@ struct format_options
 	int         kernel_width;
 };
 
-/** used by stdin and stdout socket watchers */
-struct socket_watcher_data
+/** Used by clr_oci_attach(). */
+struct attach_data
 {
-	GMainLoop* loop;
-	GIOChannel* socket_io;
-	struct oci_state *state;
-	gboolean setup_success;
+	/** Relay between the console and the terminal. */
+	struct clr_oci_console_relay  relay;
+
+	/** State of VM being attached to. */
+	struct oci_state             *state;
+
+	/** Source watching for the VM to exit. */
+	guint                         exit_source;
 };
 
-/**
- * Used by watcher_runtime_dir(), handle_process_socket() and
- * handle_socket_close() to determine when the VM has finished starting
- * and also when it has shutdown.
- */
+/** Used by clr_oci_start() to determine when the VM has shut down. */
 struct process_watcher_data
 {
-	struct clr_oci_config  *config;
-	GMainLoop              *loop;
-	GSocket                *socket;
-	GSocketAddress         *src_address;
-	GIOChannel             *channel;
-	gboolean                failed;
+	GMainLoop  *loop;
+
+	/** Source watching the VM process (\c 0 once it has exited). */
+	guint       source;
 };
 
 /*!
@@ -160,6 +173,7 @@ clr_oci_get_config_and_state (gchar **config_file,
 	/* Fill in further details to make the config valid */
 	config->bundle_path = g_strdup ((*state)->bundle_path);
 	config->state.workload_pid = (*state)->pid;
+	config->state.workload_start_time = (*state)->start_time;
 	config->state.status= (*state)->status;
 
 	g_strlcpy (config->state.comms_path, (*state)->comms_path,
@@ -209,7 +223,7 @@ clr_oci_kill (struct clr_oci_config *config,
 		return false;
 	}
 
-	if (kill (state->pid, signum) < 0) {
+	if (! clr_oci_pid_signal (state->pid, state->start_time, signum)) {
 		g_critical ("failed to stop container %s "
 				"running with pid %u: %s",
 				config->optarg_container_id,
@@ -249,138 +263,25 @@ clr_oci_vm_running (const struct oci_state *state)
 		return false;
 	}
 
-	return kill (state->pid, 0) == 0;
+	return clr_oci_pid_running (state->pid, state->start_time);
 }
 
 /*!
- * Watcher for socket stdin.
+ * Called when the VM being attached to exits.
  *
- * \param  source GIOChannel.
- * \param  condition GIOCondition.
- * \param  buffer GString.
+ * \param data \ref attach_data.
  *
- * \return \c false to ignore event.
+ * \return \c false.
  */
 static gboolean
-watcher_socket_stdin(GIOChannel* source, GIOCondition condition,
-    GString* buffer)
+clr_oci_attach_exited (struct attach_data *data)
 {
-	gsize bytes_written;
-	GIOStatus status;
+	data->exit_source = 0;
+	g_main_loop_quit (data->relay.loop);
 
-	if (condition == G_IO_HUP) {
-		g_io_channel_unref(source);
-		goto out;
-	}
-	do {
-		status = g_io_channel_write_chars(source, buffer->str,
-				(gssize)buffer->len, &bytes_written, NULL);
-	}while(status == G_IO_STATUS_NORMAL && buffer->len != bytes_written );
-
-	g_io_channel_flush(source, NULL);
-
-out:
-	g_string_free(buffer, true);
-
-	/* unregister this watcher */
 	return false;
 }
 
-/*!
- * Watcher for socket stdout.
- *
- * \param  source GIOChannel.
- * \param  condition GIOCondition.
- * \param  data \ref socket_watcher_data.
- *
- * \return \c false to ignore event.
- */
-static gboolean
-watcher_socket_stdout(GIOChannel* source, GIOCondition condition,
-    struct socket_watcher_data *data)
-{
-	GIOStatus status;
-	gchar buffer[LINE_MAX];
-	gsize bytes_read;
-	gboolean ret = true;
-
-	if (condition == G_IO_HUP) {
-		g_io_channel_unref(source);
-		ret = false;
-		goto out;
-	}
-
-	/* read and print all chars */
-	while(true) {
-		status = g_io_channel_read_chars(source, buffer, sizeof(buffer),
-				&bytes_read, NULL);
-		if (status != G_IO_STATUS_NORMAL) {
-			break;
-		}
-		if (bytes_read < sizeof(buffer)) {
-			g_strlcpy(buffer+bytes_read, "", 1);
-		}
-		g_print("%s", buffer);
-	}
-out:
-	/* if vm is not running exit */
-	if (! clr_oci_vm_running(data->state)) {
-		if (data->loop) {
-			g_main_loop_quit(data->loop);
-			return false;
-		}
-	}
-
-	return ret;
-}
-
-/*!
- * Watcher for stdin.
- *
- * \param  source GIOChannel.
- * \param  condition GIOCondition.
- * \param  data \ref socket_watcher_data.
- *
- * \return \c false to ignore event.
- */
-static gboolean
-watcher_stdin(GIOChannel* source, GIOCondition condition,
-    struct socket_watcher_data *data)
-{
-	GIOStatus status;
-	GString* buffer;
-	gboolean ret = true;
-
-	if (condition == G_IO_HUP) {
-		g_io_channel_unref(source);
-		ret = false;
-		goto out;
-	}
-
-	buffer = g_string_new("");
-	status = g_io_channel_read_line_string(source, buffer, NULL, NULL);
-	if (status != G_IO_STATUS_NORMAL) {
-		if (buffer) {
-			g_string_free(buffer, true);
-		}
-		goto out;
-	}
-
-	/* buffer will be freed by watcher_socket_stdin */
-	g_io_add_watch(data->socket_io, G_IO_OUT | G_IO_HUP,
-		(GIOFunc)watcher_socket_stdin, buffer);
-out:
-	/* if vm is not running exit */
-	if (! clr_oci_vm_running(data->state)) {
-		if (data->loop) {
-			g_main_loop_quit(data->loop);
-			return false;
-		}
-	}
-
-	return ret;
-}
-
 /*!
  * Attach to the Hypervisor.
  *
@@ -397,11 +298,8 @@ clr_oci_attach (struct clr_oci_config *config,
 	GSocket* socket;
 	GSocketAddress* src_address;
 	GError *error = NULL;
-	int socket_fd;
-	GIOChannel* socket_io;
-	GIOChannel* std_in;
 	GMainLoop* loop;
-	struct socket_watcher_data data = { 0 };
+	struct attach_data data = { { { 0 } } };
 
 	loop = g_main_loop_new (NULL, false);
 	if (! loop) {
@@ -435,54 +333,31 @@ clr_oci_attach (struct clr_oci_config *config,
 		goto fail3;
 	}
 
-	/* ensure non-blocking mode */
-	g_socket_set_blocking(socket, false);
-
-	/* get socket fd to create GIOChannel */
-	socket_fd = g_socket_get_fd(socket);
-
-	/* add watcher to socket stdout */
-	socket_io = g_io_channel_unix_new(socket_fd);
-	if (! socket_io) {
-		g_critical("failed to create io channel");
+	if (! clr_oci_console_relay_init (&data.relay,
+				g_socket_get_fd (socket),
+				STDIN_FILENO, STDOUT_FILENO, loop)) {
 		goto fail3;
 	}
 
-	std_in = g_io_channel_unix_new(STDIN_FILENO);
-	if (! std_in) {
-		g_critical("failed to create io channel");
-		goto fail4;
-	}
-
-	data.loop = loop;
 	data.state = state;
-	data.socket_io = socket_io;
-
-	/* add stdin watcher */
-	g_io_add_watch(std_in, G_IO_IN | G_IO_HUP,
-	    (GIOFunc)watcher_stdin, &data);
 
-	/* add socket stdout watcher */
-	g_io_add_watch(socket_io, G_IO_IN | G_IO_HUP,
-	    (GIOFunc)watcher_socket_stdout, &data);
-
-	data.setup_success = true;
+	/* The console is closed when the VM shuts down, but also stop
+	 * if the VM disappears without closing it.
+	 */
+	data.exit_source = clr_oci_pid_watch (state->pid, state->start_time,
+			(GSourceFunc)clr_oci_attach_exited, &data);
 
 	/* run main loop */
 	g_main_loop_run(loop);
 
 	result = true;
 
-	/* Free memory.
-	 *
-	 * Note that watcher_* functions handle freeing the channels
-	 * normally.
-	 */
-fail4:
-	g_io_channel_shutdown(socket_io, true, NULL);
-	if (! data.setup_success) {
-		 g_io_channel_unref (socket_io);
+	if (data.exit_source) {
+		g_source_remove (data.exit_source);
 	}
+
+	clr_oci_console_relay_free (&data.relay);
+
 fail3:
 	g_object_unref(src_address);
 fail2:
@@ -497,6 +372,10 @@ fail1:
  * Create the containers Clear Linux workload file
  * (\ref CLR_OCI_WORKLOAD_FILE).
  *
+ * If the hypervisor arguments pass the workload specification
+ * directly to the VM (\c @WORKLOAD_SPEC@), nothing is written to
+ * the rootfs, allowing it to be read-only or shared.
+ *
  * \param config \ref clr_oci_config.
  *
  * \warning FIXME: Need to support running the workload as a different user/group.
@@ -525,6 +404,12 @@ clr_oci_create_container_workload (struct clr_oci_config *config)
 		goto out;
 	}
 
+	if (clr_oci_vm_args_use_workload_spec (config)) {
+		g_debug ("workload passed to hypervisor, "
+				"not writing to rootfs");
+		return true;
+	}
+
 	if (config->oci.process.env) {
 		g_autofree gchar  *envpath = NULL;
 		g_autofree gchar  *env = NULL;
@@ -626,10 +511,22 @@ out:
 static gboolean
 clr_oci_cleanup (struct clr_oci_config *config)
 {
+	gboolean ret = true;
+
 	g_assert (config);
 
+	/* Leaked mounts are reported but must not stop the remaining
+	 * resources from being cleaned up.
+	 *
+	 * The virtio-fs daemon is stopped first since it holds the
+	 * mounts below the rootfs open.
+	 */
+	if (! clr_oci_virtiofsd_stop (config)) {
+		ret = false;
+	}
+
 	if (! clr_oci_handle_unmounts (config)) {
-		return false;
+		ret = false;
 	}
 
 	if (! clr_oci_state_file_delete (config)) {
@@ -640,7 +537,52 @@ clr_oci_cleanup (struct clr_oci_config *config)
 		return false;
 	}
 
-	return true;
+	return ret;
+}
+
+/*!
+ * Run the specified hooks, passing them the current state of the VM.
+ *
+ * The state is rendered once, in memory, and the same buffer is
+ * given to every hook so that it is not re-read from the state file
+ * (which may no longer exist) for each one.
+ *
+ * \param config \ref clr_oci_config.
+ * \param hooks List of \ref oci_cfg_hook to run.
+ * \param created_timestamp ISO 8601 timestamp for when VM Was created.
+ * \param stop_on_failure If \c true, a failing hook stops the
+ *   remaining hooks from running and is considered fatal.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_run_hooks (const struct clr_oci_config *config,
+		GSList *hooks,
+		const gchar *created_timestamp,
+		gboolean stop_on_failure)
+{
+	g_autofree gchar  *state = NULL;
+	gsize              state_length = 0;
+	gboolean           parallel;
+
+	g_assert (config);
+
+	if (! hooks) {
+		return true;
+	}
+
+	state = clr_oci_state_to_string (config, created_timestamp,
+			false, &state_length);
+	if (! state) {
+		g_critical ("failed to determine state for hooks");
+		return false;
+	}
+
+	parallel = clr_oci_annotation_is_true (config->oci.annotations,
+			CLR_OCI_ANNOTATION_PARALLEL_HOOKS);
+
+	return clr_run_hooks (hooks, state, state_length,
+			stop_on_failure, parallel);
 }
 
 /*!
@@ -781,11 +723,44 @@ clr_oci_create (struct clr_oci_config *config)
 		goto out;
 	}
 
+	/* The hypervisor connects to the virtio-fs daemon (if used)
+	 * as soon as it is launched.
+	 */
+	if (! clr_oci_virtiofsd_start (config)) {
+		g_critical ("failed to start virtio-fs daemon");
+		goto out;
+	}
+
+	/* "exec" reaches the agent in the VM using vsock, which the
+	 * host may not support.
+	 */
+	config->vsock_fd = clr_oci_vsock_open (&config->state.vsock_cid);
+	if (config->vsock_fd < 0) {
+		g_warning ("vsock unavailable, so commands cannot be "
+				"run in container %s",
+				config->optarg_container_id);
+	}
+
 	/* start VM is a stopped state (containerd requires a
 	 * valid pid in the pidfile after a successful "create").
 	 */
 	if (! clr_oci_vm_launch (config)) {
 		g_critical ("failed to launch VM");
+		(void)clr_oci_virtiofsd_stop (config);
+		goto out;
+	}
+
+	/* Capture console output so that it is available even when
+	 * nothing is attached. Without the capture, the console would
+	 * be unusable, so the container is not created.
+	 */
+	if (config->use_socket_console
+			&& ! clr_oci_console_capture_start (config)) {
+		g_critical ("failed to start console capture");
+		(void)clr_oci_pid_signal (config->state.workload_pid,
+				config->state.workload_start_time,
+				SIGKILL);
+		(void)clr_oci_virtiofsd_stop (config);
 		goto out;
 	}
 
@@ -799,8 +774,8 @@ clr_oci_create (struct clr_oci_config *config)
 	 * including the exit code and the stderr is returned to the
 	 * caller and the container is torn down.
 	 */
-	if (! clr_run_hooks (config->oci.hooks.prestart,
-	                    config->state.state_file_path, true)) {
+	if (! clr_oci_run_hooks (config, config->oci.hooks.prestart,
+				timestamp, true)) {
 		g_critical ("failed to run prestart hooks");
 	}
 
@@ -813,169 +788,24 @@ out:
 }
 
 /*!
- * Called when the \ref CLR_OCI_PROCESS_SOCKET file is closed by the VM,
- * denoting process shutdown.
+ * Called when the VM process exits.
  *
- * \param source \c GIOChannel.
- * \param condition \c GIOCondition.
  * \param data \ref process_watcher_data.
  *
- * \return \c false on success, else \c true.
+ * \return \c false.
  */
 static gboolean
-handle_socket_close (GIOChannel              *source,
-		GIOCondition                  condition,
-		struct process_watcher_data  *data)
+clr_oci_vm_exited (struct process_watcher_data *data)
 {
-	(void)source;
-	(void)condition;
-
 	g_assert (data);
 	g_assert (data->loop);
 
+	data->source = 0;
 	g_main_loop_quit (data->loop);
 
-	/* signify success */
-	return false;
-}
-
-/**
- * Connect to \ref CLR_OCI_PROCESS_SOCKET and set a watch to trigger
- * when the socket is closed (denoting the VM has shutdown).
- *
- * \param data \ref process_watcher_data.
- *
- * \return \c true on success, else \c false.
- */
-static gboolean
-handle_process_socket (struct process_watcher_data *data)
-{
-	gboolean         ret = false;
-	int              socket_fd;
-	GError          *error = NULL;
-	const gchar     *path;
-
-	if (! data || ! data->loop || ! data->config) {
-		return false;
-	}
-
-	if (! data->config->state.procsock_path[0]) {
-		return false;
-	}
-
-	path = data->config->state.procsock_path;
-
-	data->socket = g_socket_new (G_SOCKET_FAMILY_UNIX,
-			G_SOCKET_TYPE_STREAM, 0, &error);
-	if (! data->socket) {
-		g_critical("failed to create unix socket: %s",
-				error->message);
-		g_error_free (error);
-		goto fail1;
-	}
-
-	data->src_address = g_unix_socket_address_new_with_type (path,
-			-1,
-			G_UNIX_SOCKET_ADDRESS_PATH);
-	if (! data->src_address) {
-		g_critical("failed to create socket address: %s",
-				data->config->state.procsock_path);
-		goto fail2;
-	}
-
-	ret = g_socket_connect(data->socket, data->src_address,
-			NULL, &error);
-	if (! ret) {
-		g_critical("failed to connect to socket: %s",
-				error->message);
-		g_error_free (error);
-		goto fail3;
-	}
-
-	/* ensure non-blocking mode */
-	g_socket_set_blocking (data->socket, false);
-
-	/* get socket fd to create GIOChannel */
-	socket_fd = g_socket_get_fd (data->socket);
-
-	data->channel = g_io_channel_unix_new (socket_fd);
-	if (! data->channel) {
-		g_critical ("failed to create io channel");
-		goto fail4;
-	}
-
-	g_io_add_watch (data->channel,
-			G_IO_HUP|G_IO_ERR,
-			(GIOFunc)handle_socket_close,
-			data);
-
-	return true;
-
-fail4:
-	g_io_channel_shutdown (data->channel, true, NULL);
-	g_io_channel_unref (data->channel);
-fail3:
-	g_object_unref (data->src_address);
-fail2:
-	g_object_unref (data->socket);
-fail1:
-	g_main_loop_unref (data->loop);
-	data->loop = NULL;
-
 	return false;
 }
 
-/**
- * Determine when \ref CLR_OCI_PROCESS_SOCKET is created.
- *
- * \param monitor \c GFileMonitor.
- * \param file \c GFile.
- * \param other_file \c GFile (unused).
- * \param event_type \c GFileMonitorEvent.
- * \param data \ref process_watcher_data.
- */
-static void
-watcher_runtime_dir (GFileMonitor            *monitor,
-		GFile                        *file,
-		GFile                        *other_file,
-		GFileMonitorEvent             event_type,
-		struct process_watcher_data  *data)
-{
-	g_autofree gchar  *path = NULL;
-	g_autofree gchar  *name = NULL;
-
-	(void)other_file;
-
-	g_assert (data);
-
-	if (event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
-		return;
-	}
-
-	path = g_file_get_path (file);
-	if (! path) {
-		return;
-	}
-
-	name = g_path_get_basename (path);
-
-	/* ignore non-matching files */
-	if (g_strcmp0 (CLR_OCI_PROCESS_SOCKET, name)) {
-		return;
-	}
-
-	/* CLR_OCI_PROCESS_SOCKET has now been created, so delete the
-	 * monitor.
-	 */
-	g_object_unref (monitor);
-
-	/* Now that the socket has been created, connect to it */
-	if (! handle_process_socket (data)) {
-		data->failed = true;
-		g_critical ("failed to handle process socket");
-	}
-}
-
 /*!
  * Start a VM previously setup by a call to clr_oci_create().
  *
@@ -990,9 +820,6 @@ clr_oci_start (struct clr_oci_config *config,
 {
 	gboolean       ret = false;
 	GPid           pid;
-	GFileMonitor  *monitor = NULL;
-	GFile         *file = NULL;
-	GError        *error = NULL;
 	gboolean       wait = false;
 	struct process_watcher_data data = { 0 };
 	gchar         *config_file = NULL;
@@ -1046,61 +873,59 @@ clr_oci_start (struct clr_oci_config *config,
 	}
 
 	if (wait) {
-		data.config = config;
 		data.loop = g_main_loop_new (NULL, 0);
 		if (! data.loop) {
 			g_critical ("cannot create main loop for client");
 			return false;
 		}
 
-		file = g_file_new_for_path (config->state.runtime_path);
-		if (! file) {
-			g_main_loop_unref (data.loop);
-			return false;
-		}
-
-		/* create inotify watch on runtime directory
-		 * (crucially before the VM is resumed).
+		/* Watch for the VM exiting (crucially before it is
+		 * resumed).
 		 */
-		monitor = g_file_monitor_directory (file,
-				G_FILE_MONITOR_WATCH_MOVES,
-				NULL, &error);
-		if (! monitor) {
-			g_critical ("failed to monitor %s: %s",
-					g_file_get_path (file),
-					error->message);
-			g_error_free (error);
-			g_object_unref (file);
+		data.source = clr_oci_pid_watch (pid, state->start_time,
+				(GSourceFunc)clr_oci_vm_exited, &data);
+		if (! data.source) {
+			g_critical ("failed to watch VM %s",
+					config->optarg_container_id);
 			g_main_loop_unref (data.loop);
-
 			return false;
 		}
-
-		g_signal_connect (monitor, "changed",
-				G_CALLBACK (watcher_runtime_dir),
-				&data);
 	}
 
 	/* "create" left the VM in a stopped state, so now let it
 	 * continue.
-	 *
-	 * This will result in \ref CLR_OCI_PROCESS_SOCKET being
-	 * created, however there will be a delay. Since we wish to
-	 * connect to this socket, the approach is to use an inotify
-	 * watch to wait for the socket file to exist, then connect to
-	 * it.
 	 */
-	if (kill (pid, SIGCONT) < 0) {
+	if (! clr_oci_pid_signal (pid, state->start_time, SIGCONT)) {
 		g_critical ("failed to start VM %s: %s",
 				config->optarg_container_id,
 				strerror (errno));
-		return false;
+		ret = false;
+		goto out;
 	}
 
 	g_debug ("activated VM %s (pid %d)",
 			config->optarg_container_id,
 			(int)pid);
 
+	/* The vCPU threads only exist once the hypervisor is running,
+	 * but a placed VM waits for them to be pinned before it runs
+	 * (a restored VM is pinned by clr_oci_restore()).
+	 */
+	if (config->state.cpus[0] && ! config->incoming) {
+		if (! clr_oci_vm_pin (config)) {
+			g_warning ("failed to pin VM %s to cpus %s",
+					config->optarg_container_id,
+					config->state.cpus);
+		}
+
+		if (! clr_oci_vm_resume (config->state.comms_path, pid)) {
+			g_critical ("failed to run VM %s",
+					config->optarg_container_id);
+			ret = false;
+			goto out;
+		}
+	}
+
 	/* Now the VM is running */
 	config->state.status = OCI_STATUS_RUNNING;
 
@@ -1113,8 +938,8 @@ clr_oci_start (struct clr_oci_config *config,
 
 	/* If a hook returns a non-zero exit code, then an error is
 	logged and the remaining hooks are executed. */
-	clr_run_hooks (config->oci.hooks.poststart,
-	              config->state.state_file_path, false);
+	(void)clr_oci_run_hooks (config, config->oci.hooks.poststart,
+			state->create_time, false);
 
 	if (wait) {
 		g_main_loop_run (data.loop);
@@ -1130,9 +955,6 @@ clr_oci_start (struct clr_oci_config *config,
 		if (config->state.status != OCI_STATUS_STOPPED &&
 			config->state.status != OCI_STATUS_STOPPING) {
 			ret = clr_oci_cleanup (config);
-			if (data.failed) {
-				ret = false;
-			}
 		}
 	} else {
 		ret = true;
@@ -1140,18 +962,8 @@ clr_oci_start (struct clr_oci_config *config,
 
 out:
 	if (wait) {
-		if (file) {
-			g_object_unref (file);
-		}
-		if (data.channel) {
-			g_io_channel_shutdown (data.channel, true, NULL);
-			g_io_channel_unref (data.channel);
-		}
-		if (data.src_address) {
-			g_object_unref (data.src_address);
-		}
-		if (data.socket) {
-			g_object_unref (data.socket);
+		if (data.source) {
+			g_source_remove (data.source);
 		}
 		if (data.loop) {
 			g_main_loop_unref (data.loop);
@@ -1222,7 +1034,22 @@ clr_oci_stop (struct clr_oci_config *config,
 	g_assert (config);
 	g_assert (state);
 
-	if (clr_oci_vm_running (state)) {
+	if (state->status == OCI_STATUS_CREATED
+			&& clr_oci_vm_running (state)) {
+		/* The hypervisor is still held stopped waiting for
+		 * "start", so it cannot answer QMP; there is no guest
+		 * state worth shutting down cleanly either.
+		 */
+		if (! clr_oci_pid_signal (state->pid, state->start_time,
+					SIGKILL)) {
+			return false;
+		}
+	} else if (clr_oci_vm_running (state)) {
+		/* the guest must be running to shut down cleanly */
+		if (! clr_oci_autopause_wake (config, NULL)) {
+			return false;
+		}
+
 		ret = clr_oci_vm_shutdown (state->comms_path, state->pid);
 		if (! ret) {
 			return false;
@@ -1239,15 +1066,20 @@ clr_oci_stop (struct clr_oci_config *config,
 				state->id, state->pid);
 	}
 
+	config->state.status = OCI_STATUS_STOPPED;
+
 	ret = clr_oci_cleanup (config);
 
 	/* The post-stop hooks are called after the container process is
 	 * stopped. Cleanup or debugging could be performed in such a
 	 * hook. If a hook returns a non-zero exit code, then an error
 	 * is logged and the remaining hooks are executed.
+	 *
+	 * Note that the state file has been removed by now, so the
+	 * hooks are given the state from config.
 	 */
-	clr_run_hooks (config->oci.hooks.poststop,
-	              config->state.state_file_path, false);
+	(void)clr_oci_run_hooks (config, config->oci.hooks.poststop,
+			state->create_time, false);
 
 	return ret;
 }
@@ -1275,6 +1107,19 @@ clr_oci_toggle (struct clr_oci_config *config,
 
 	dest_status = pause ? OCI_STATUS_PAUSED : OCI_STATUS_RUNNING;
 
+	if (state->status == OCI_STATUS_CREATED) {
+		g_critical ("container %s has not been started",
+				config->optarg_container_id);
+		return false;
+	}
+
+	/* A VM paused while idle is still "running", so this also
+	 * allows "resume" to wake it explicitly.
+	 */
+	if (! clr_oci_autopause_wake (config, NULL)) {
+		return false;
+	}
+
 	if (state->status == dest_status) {
 		g_warning ("already %s",
 				clr_oci_status_to_str (state->status));
@@ -1293,16 +1138,363 @@ clr_oci_toggle (struct clr_oci_config *config,
 	return clr_oci_state_file_create (config, state->create_time);
 }
 
+/*!
+ * Checkpoint a container by saving the state of its VM.
+ *
+ * The VM is paused while its state is saved. Once checkpointed, the
+ * container is destroyed (as runc does) unless \c leave_running is
+ * set in \p cp. For a lazy checkpoint, guest RAM is saved to its own
+ * file.
+ *
+ * \param config \ref clr_oci_config.
+ * \param state \ref oci_state.
+ * \param[in,out] cp \ref clr_oci_checkpoint. \c image_path defaults
+ *   to \ref CLR_OCI_CHECKPOINT_DIR below the bundle, and \c size and
+ *   \c duration are set on success.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_checkpoint (struct clr_oci_config *config,
+		struct oci_state *state,
+		struct clr_oci_checkpoint *cp)
+{
+	struct stat        st;
+	g_autofree gchar  *path = NULL;
+	g_autofree gchar  *uri = NULL;
+	g_autofree gchar  *ram_path = NULL;
+	guint64            ram_size = 0;
+	guint              dimms = 0;
+	gint64             start_time;
+	gboolean           paused = false;
+	gboolean           ret = false;
+
+	g_assert (config);
+	g_assert (state);
+	g_assert (cp);
+
+	if (state->status != OCI_STATUS_RUNNING
+			&& state->status != OCI_STATUS_PAUSED) {
+		g_critical ("unexpected state for container %s: %s",
+				config->optarg_container_id,
+				clr_oci_status_to_str (state->status));
+		return false;
+	}
+
+	if (cp->compress && cp->channels) {
+		g_critical ("compression cannot be used with multifd");
+		return false;
+	}
+
+	if (! clr_oci_autopause_wake (config, NULL)) {
+		return false;
+	}
+
+	if (cp->lazy && (cp->compress || cp->channels)) {
+		g_critical ("lazy checkpoints cannot be compressed "
+				"or use multifd");
+		return false;
+	}
+
+	if (! cp->lazy && clr_oci_image_shared_get (config)) {
+		/* a read-only image cannot be loaded into, so it must
+		 * be skipped along with any other shared memory
+		 */
+		g_critical ("checkpoints of VMs using a shared image "
+				"must be lazy");
+		return false;
+	}
+
+	if (cp->lazy && ! clr_oci_checkpoint_lazy_get (config)) {
+		/* guest RAM is not a memfd that can be saved directly */
+		g_critical ("lazy checkpoints of container %s "
+				"were not enabled when it was created",
+				config->optarg_container_id);
+		return false;
+	}
+
+	if (cp->lazy) {
+		/* Only the boot RAM is saved to its own file, and the
+		 * memfd of a hotplugged DIMM could be mistaken for it.
+		 */
+		if (! clr_oci_vm_memory_devices (state->comms_path,
+					state->pid, &dimms)) {
+			g_critical ("failed to query memory devices");
+			return false;
+		}
+
+		if (dimms) {
+			g_critical ("lazy checkpoints of container %s "
+					"are not possible after memory "
+					"has been added by \"update\"",
+					config->optarg_container_id);
+			return false;
+		}
+	}
+
+	if (! cp->image_path) {
+		cp->image_path = g_build_path ("/", config->bundle_path,
+				CLR_OCI_CHECKPOINT_DIR, NULL);
+	}
+
+	if (g_mkdir_with_parents (cp->image_path, 0700) < 0) {
+		g_critical ("failed to create directory %s: %s",
+				cp->image_path, strerror (errno));
+		return false;
+	}
+
+	path = clr_oci_checkpoint_path (cp);
+	uri = clr_oci_checkpoint_uri (cp, true);
+	if (! (path && uri)) {
+		return false;
+	}
+
+	/* restore must leave a paused container paused */
+	cp->paused = state->status == OCI_STATUS_PAUSED;
+
+	start_time = g_get_monotonic_time ();
+
+	/* Ensure the saved state is consistent */
+	if (state->status == OCI_STATUS_RUNNING) {
+		if (! clr_oci_vm_pause (state->comms_path, state->pid)) {
+			return false;
+		}
+
+		paused = true;
+	}
+
+	if (! clr_oci_vm_migrate (state->comms_path, state->pid,
+				uri, cp->channels, cp->lazy)) {
+		g_critical ("failed to save state of container %s",
+				config->optarg_container_id);
+		goto resume;
+	}
+
+	if (stat (path, &st) < 0) {
+		g_critical ("failed to stat %s: %s", path, strerror (errno));
+		goto resume;
+	}
+
+	cp->size = (guint64)st.st_size;
+
+	if (cp->lazy) {
+		ram_path = g_build_path ("/", cp->image_path,
+				CLR_OCI_CHECKPOINT_RAM_FILE, NULL);
+
+		if (! clr_oci_checkpoint_ram_save (state->pid, ram_path,
+					&ram_size)) {
+			g_critical ("failed to save RAM of container %s",
+					config->optarg_container_id);
+			goto resume;
+		}
+
+		cp->size += ram_size;
+	}
+
+	cp->duration = (gdouble)(g_get_monotonic_time () - start_time)
+		/ G_USEC_PER_SEC;
+
+	if (! clr_oci_checkpoint_info_write (cp)) {
+		goto resume;
+	}
+
+	g_debug ("saved %lu bytes of state for container %s in %.3fs",
+			(unsigned long int)cp->size,
+			config->optarg_container_id,
+			cp->duration);
+
+	if (cp->leave_running) {
+		ret = true;
+		goto resume;
+	}
+
+	/* The guest must not run again once its state has been saved,
+	 * so stop the hypervisor without shutting the guest down.
+	 */
+	if (! clr_oci_vm_quit (state->comms_path, state->pid)) {
+		g_critical ("failed to stop container %s",
+				config->optarg_container_id);
+		return false;
+	}
+
+	config->state.status = OCI_STATUS_STOPPED;
+
+	ret = clr_oci_cleanup (config);
+
+	(void)clr_oci_run_hooks (config, config->oci.hooks.poststop,
+			state->create_time, false);
+
+	return ret;
+
+resume:
+	if (paused && ! clr_oci_vm_resume (state->comms_path, state->pid)) {
+		g_critical ("failed to resume container %s",
+				config->optarg_container_id);
+		ret = false;
+	}
+
+	return ret;
+}
+
+/*!
+ * Create and start a container from a checkpoint.
+ *
+ * The container is created as clr_oci_run() would, but the hypervisor
+ * loads the saved VM state rather than booting. If the checkpoint is
+ * lazy, guest RAM is mapped from the checkpoint rather than loaded.
+ *
+ * Once loaded, the VM is resumed unless the container was paused
+ * when checkpointed. If the restore fails, the container is removed.
+ *
+ * \param config \ref clr_oci_config.
+ * \param cp \ref clr_oci_checkpoint. \c image_path defaults to
+ *   \ref CLR_OCI_CHECKPOINT_DIR below the bundle.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_restore (struct clr_oci_config *config,
+		struct clr_oci_checkpoint *cp)
+{
+	struct oci_state  *state = NULL;
+	g_autofree gchar  *uri = NULL;
+	gboolean           loaded;
+	gboolean           ret = false;
+
+	g_assert (config);
+	g_assert (cp);
+
+	if (! cp->image_path) {
+		cp->image_path = g_build_path ("/", config->bundle_path,
+				CLR_OCI_CHECKPOINT_DIR, NULL);
+	}
+
+	if (! clr_oci_checkpoint_info_read (cp)) {
+		return false;
+	}
+
+	uri = clr_oci_checkpoint_uri (cp, false);
+	if (! uri) {
+		return false;
+	}
+
+	/* multifd must be enabled before the state is loaded, so the
+	 * hypervisor waits to be told where to load it from.
+	 */
+	config->incoming = g_strdup (cp->channels ? "defer" : uri);
+
+	if (cp->lazy) {
+		config->incoming_ram = g_build_path ("/", cp->image_path,
+				CLR_OCI_CHECKPOINT_RAM_FILE, NULL);
+	}
+
+	if (! clr_oci_create (config)) {
+		return false;
+	}
+
+	/* The hypervisor must run to be able to load the state, and
+	 * the state must be loaded before the VM can be resumed, so
+	 * clr_oci_start() cannot be left to continue it.
+	 */
+	if (! clr_oci_pid_signal (config->state.workload_pid,
+				config->state.workload_start_time, SIGCONT)) {
+		g_critical ("failed to continue VM %s: %s",
+				config->optarg_container_id,
+				strerror (errno));
+		goto fail;
+	}
+
+	if (cp->channels) {
+		loaded = clr_oci_vm_migrate_incoming (config->state.comms_path,
+				config->state.workload_pid,
+				uri, cp->channels);
+	} else {
+		loaded = clr_oci_vm_migrate_incoming_wait
+			(config->state.comms_path,
+			 config->state.workload_pid);
+	}
+
+	if (! loaded) {
+		g_critical ("failed to load state of container %s",
+				config->optarg_container_id);
+		goto fail;
+	}
+
+	if (! clr_oci_vm_pin (config)) {
+		g_warning ("failed to pin VM %s to cpus %s",
+				config->optarg_container_id,
+				config->state.cpus);
+	}
+
+	/* The saved state is always paused (see clr_oci_checkpoint()) */
+	if (cp->paused) {
+		/* nothing would run to wait for */
+		config->detached_mode = true;
+	} else if (! clr_oci_vm_resume (config->state.comms_path,
+				config->state.workload_pid)) {
+		g_critical ("failed to resume container %s",
+				config->optarg_container_id);
+		goto fail;
+	}
+
+	state = clr_oci_state_file_read (config->state.state_file_path);
+	if (! state) {
+		g_critical ("failed to read state file "
+				"for container %s",
+				config->optarg_container_id);
+		goto fail;
+	}
+
+	ret = clr_oci_start (config, state);
+	if (! ret) {
+		goto fail;
+	}
+
+	if (cp->paused) {
+		config->state.status = OCI_STATUS_PAUSED;
+
+		ret = clr_oci_state_file_create (config, state->create_time);
+		if (! ret) {
+			goto fail;
+		}
+	}
+
+	clr_oci_state_free (state);
+
+	return ret;
+
+fail:
+	/* A container that was started and then waited for has
+	 * already been cleaned up.
+	 */
+	if (g_file_test (config->state.state_file_path,
+				G_FILE_TEST_EXISTS)) {
+		(void)clr_oci_pid_signal (config->state.workload_pid,
+				config->state.workload_start_time,
+				SIGKILL);
+		(void)clr_oci_cleanup (config);
+	}
+
+	if (state) {
+		clr_oci_state_free (state);
+	}
+
+	return false;
+}
+
 /*!
  * Run the command specified by \p argv in the hypervisor
  * and wait for it to finish.
  *
+ * The exit status of the command is saved in
+ * \ref clr_oci_config.exit_code.
+ *
  * \param config \ref clr_oci_config.
  * \param state \ref oci_state.
  * \param argc Argument count.
  * \param argv Argument vector.
  *
- * \return \c true on success, else \c false.
+ * \return \c true if the command was run, else \c false.
  */
 gboolean
 clr_oci_exec (struct clr_oci_config *config,
@@ -1310,16 +1502,114 @@ clr_oci_exec (struct clr_oci_config *config,
 		int argc,
 		char *const argv[])
 {
+	gboolean  ret;
+	gint      exit_code = EXIT_FAILURE;
+	int       hold;
+
 	g_assert (config);
 	g_assert (state);
 	g_assert (argc);
 	g_assert (argv);
 
-	if (! clr_oci_vm_connect (config, argc, argv)) {
-		g_critical ("failed to connect to VM");
+	/* The VM has no vsock device if the host did not support
+	 * vsock when the container was created (or it was created by
+	 * an older version).
+	 */
+	if (! state->vsock_cid) {
+		g_critical ("cannot exec in container %s: it has no vsock "
+				"device (is %s available?)",
+				config->optarg_container_id,
+				CLR_OCI_VHOST_VSOCK_DEVICE);
 		return false;
 	}
 
+	/* keep the VM running until the command finishes */
+	if (! clr_oci_autopause_wake (config, &hold)) {
+		return false;
+	}
+
+	ret = clr_oci_vm_connect (config, state->vsock_cid, argc, argv,
+			&exit_code);
+
+	if (hold >= 0) {
+		close (hold);
+	}
+
+	if (ret) {
+		config->exit_code = exit_code;
+	}
+
+	return ret;
+}
+
+/*!
+ * Display the processes running inside the VM of a container.
+ *
+ * \param config \ref clr_oci_config.
+ * \param state \ref oci_state.
+ * \param options Options for \c ps(1) in the guest (may be \c NULL).
+ * \param json If \c true, display a JSON array of process IDs
+ *   rather than a table.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_ps (struct clr_oci_config *config,
+		struct oci_state *state,
+		gchar *const options[],
+		gboolean json)
+{
+	g_autofree gchar  *socket_path = NULL;
+	g_autofree gchar  *output = NULL;
+	JsonObject        *arguments;
+	JsonArray         *array;
+	JsonNode          *result = NULL;
+	gchar *const      *option;
+	gboolean           ret;
+
+	g_assert (config);
+	g_assert (state);
+
+	/* The guest cannot answer while its vCPUs are stopped */
+	if (state->status == OCI_STATUS_PAUSED) {
+		g_critical ("container %s is paused",
+				config->optarg_container_id);
+		return false;
+	}
+
+	if (! clr_oci_autopause_wake (config, NULL)) {
+		return false;
+	}
+
+	socket_path = g_build_path ("/", config->state.runtime_path,
+			CLR_OCI_GUEST_QUERY_SOCKET, NULL);
+
+	arguments = json_object_new ();
+
+	array = json_array_new ();
+	for (option = options; option && *option; option++) {
+		json_array_add_string_element (array, *option);
+	}
+	json_object_set_array_member (arguments, "options", array);
+
+	ret = clr_oci_query (socket_path, "ps", arguments, &result);
+
+	json_object_unref (arguments);
+
+	if (! ret) {
+		return false;
+	}
+
+	output = clr_oci_ps_format (result, json);
+
+	json_node_free (result);
+
+	if (! output) {
+		return false;
+	}
+
+	g_print ("%s%s", output, json ? "\n" : "");
+
 	return true;
 }
 
@@ -1433,7 +1723,7 @@ clr_oci_list_vm (const struct oci_state *state,
  *
  * \return \ref oci_state on success, else \c NULL.
  */
-static struct oci_state *
+struct oci_state *
 clr_oci_vm_get_state (const gchar *name, const char *root_dir)
 {
 	struct clr_oci_config  config = { { 0 } };
@@ -1717,6 +2007,16 @@ clr_oci_config_update (struct clr_oci_config *config,
 		state->vm = NULL;
 	}
 
+	config->state.resources = state->resources;
+	config->state.vsock_cid = state->vsock_cid;
+	config->state.virtiofsd_pid = state->virtiofsd_pid;
+	config->state.virtiofsd_start_time = state->virtiofsd_start_time;
+
+	if (state->cpus) {
+		g_strlcpy (config->state.cpus, state->cpus,
+				sizeof (config->state.cpus));
+	}
+
 	if (state->procsock_path) {
 		/* No need to do a full transfer */
 		g_strlcpy (config->state.procsock_path,
@@ -56,12 +56,35 @@
 /** Name of hypervisor socket used to control an already running VM */
 #define CLR_OCI_HYPERVISOR_SOCKET	"hypervisor.sock"
 
+/** Name of hypervisor socket used to receive asynchronous events
+ * from a running VM.
+ */
+#define CLR_OCI_HYPERVISOR_EVENTS_SOCKET "hypervisor-events.sock"
+
 /** Name of hypervisor socket used to determine if VM is running */
 #define CLR_OCI_PROCESS_SOCKET		"process.sock"
 
-/** Name of hypervisor socket used as a console device. */
+/** Name of socket used to connect to the console. */
 #define CLR_OCI_CONSOLE_SOCKET		"console.sock"
 
+/** Name of socket the hypervisor console device connects to
+ * (see console-log.c).
+ */
+#define CLR_OCI_CONSOLE_VM_SOCKET	"vm-console.sock"
+
+/** Name of socket connected to the virtio-serial port the guest
+ * answers queries on (see query.c).
+ */
+#define CLR_OCI_GUEST_QUERY_SOCKET	"guest-query.sock"
+
+/** Name of socket the virtio-fs daemon serves the rootfs on
+ * (see virtiofs.c).
+ */
+#define CLR_OCI_VIRTIOFS_SOCKET		"virtiofs.sock"
+
+/** Name of file containing the captured console output. */
+#define CLR_OCI_CONSOLE_LOG_FILE	"console.log"
+
 /** File generated below \ref CLR_OCI_RUNTIME_DIR_PREFIX at runtime that
  * contains metadata about the running instance.
  */
@@ -98,9 +121,6 @@
 /** Shell to use for \ref CLR_OCI_WORKLOAD_FILE. */
 #define CLR_OCI_WORKLOAD_SHELL		"/bin/sh"
 
-/** Command to use to allow "exec" to connect to the container. */
-#define CLR_OCI_EXEC_CMD               "ssh"
-
 /** File that contains vm spec configuration, used if vm node
  * in CLR_OCI_CONFIG_FILE bundle file
 */
@@ -191,17 +211,45 @@ struct oci_cfg_process {
 	struct oci_cfg_user  user;
 };
 
+/**
+ * Representation of the OCI resource limits used to size the VM.
+ *
+ * Members are \c 0 (or \c NULL) if not specified.
+ */
+struct oci_cfg_resources {
+	/** Hard memory limit in bytes. */
+	gint64   memory_limit;
+
+	/** Soft memory limit in bytes. */
+	gint64   memory_reservation;
+
+	/** CPU time (in microseconds) allowed per \ref cpu_period. */
+	gint64   cpu_quota;
+
+	/** CPU scheduling period in microseconds. */
+	gint64   cpu_period;
+
+	/** List of CPUs the container may use (for example "0-3"). */
+	gchar   *cpu_cpus;
+
+	/** List of NUMA nodes the container may use memory from. */
+	gchar   *cpu_mems;
+};
+
 /**
  * Representation of OCI linux-specific configuration.
  *
  * \see
  * https://github.com/opencontainers/runtime-spec/blob/master/config-linux.md
  *
- * \note For now, we only care about namespaces.
+ * \note For now, we only care about namespaces and resources.
  */
 struct oci_cfg_linux {
 	/** List of \ref oci_cfg_namespace namespaces */
 	GSList          *namespaces;
+
+	/** Resource limits ("linux.resources"). */
+	struct oci_cfg_resources  resources;
 };
 
 /** Representation of the OCI runtime schema embodied by
@@ -235,6 +283,12 @@ struct oci_cfg {
 	struct oci_cfg_linux         oci_linux;
 };
 
+/** Transport used to share the container rootfs with the VM. */
+enum clr_oci_rootfs_transport {
+	CLR_OCI_ROOTFS_9P = 0,
+	CLR_OCI_ROOTFS_VIRTIO_FS,
+};
+
 /** clr-specific VM configuration data. */
 struct clr_oci_vm_cfg {
 	/** Full path to the hypervisor. */
@@ -246,6 +300,11 @@ struct clr_oci_vm_cfg {
 	/** Full path to kernel to use for VM. */
 	gchar kernel_path[PATH_MAX];
 
+	/** Full path to initial ramdisk of the kernel (optional, but
+	 * required if \ref image_shared is set).
+	 */
+	gchar initrd_path[PATH_MAX];
+
 	/** Full path to CLR_OCI_WORKLOAD_FILE
 	 * (which exists below "root_path").
 	 */
@@ -253,6 +312,46 @@ struct clr_oci_vm_cfg {
 
 	/** Kernel parameters (optional). */
 	gchar *kernel_params;
+
+	/** Map the image read-only and share it with other VMs
+	 * (optional).
+	 */
+	gboolean image_shared;
+
+	/** Transport used to share the rootfs (optional). */
+	enum clr_oci_rootfs_transport rootfs_transport;
+
+	/** Full path to the virtio-fs daemon (optional). */
+	gchar virtiofsd_path[PATH_MAX];
+
+	/** Size of the virtio-fs DAX window, "0" to disable
+	 * (optional).
+	 */
+	gchar *dax_size;
+
+	/** Back guest RAM with huge pages (optional). */
+	gboolean hugepages;
+
+	/** hugetlbfs mount point for guest RAM (optional). */
+	gchar hugepages_path[PATH_MAX];
+
+	/** Allocate all of the huge pages for guest RAM when the VM
+	 * is launched (optional).
+	 */
+	gboolean hugepages_prealloc;
+
+	/** Share guest RAM backed by huge pages (optional). */
+	gboolean hugepages_share;
+
+	/** Allow identical pages of guest RAM to be merged
+	 * (optional).
+	 */
+	gboolean memory_merge;
+
+	/** Back guest RAM with shared memory so that the VM can be
+	 * checkpointed lazily (optional).
+	 */
+	gboolean lazy_checkpoint;
 };
 
 /**
@@ -264,6 +363,17 @@ struct clr_oci_map {
 	const gchar  *name;
 };
 
+/** Resources assigned to a running VM by "update". */
+struct clr_oci_vm_resources {
+	/** Number of vCPUs (\c 0 if not changed since the VM started). */
+	guint    vcpus;
+
+	/** Guest memory in bytes (\c 0 if not changed since the VM
+	 * started).
+	 */
+	guint64  memory;
+};
+
 /** OCI State, read from \ref CLR_OCI_STATE_FILE.
  *
  * \see https://github.com/opencontainers/runtime-spec/blob/master/runtime.md#state
@@ -278,6 +388,11 @@ struct oci_state {
 	/** Process ID of VM. */
 	GPid             pid;
 
+	/** Start time of \ref pid (\c 0 if unknown, see
+	 * clr_oci_pid_start_time()).
+	 */
+	guint64          start_time;
+
 	gchar           *bundle_path;
 	gchar           *comms_path;
 
@@ -307,6 +422,21 @@ struct oci_state {
 	gboolean         use_socket_console;
 
 	struct clr_oci_vm_cfg *vm;
+
+	/* See member of same name in \ref clr_oci_container_state. */
+	struct clr_oci_vm_resources resources;
+
+	/* See member of same name in \ref clr_oci_container_state. */
+	guint32          vsock_cid;
+
+	/* See member of same name in \ref clr_oci_container_state. */
+	GPid             virtiofsd_pid;
+
+	/* See member of same name in \ref clr_oci_container_state. */
+	guint64          virtiofsd_start_time;
+
+	/* See member of same name in \ref clr_oci_container_state. */
+	gchar           *cpus;
 };
 
 /** clr-specific state fields. */
@@ -326,6 +456,11 @@ struct clr_oci_container_state {
 	 */
 	gchar comms_path[PATH_MAX];
 
+	/** Full path to socket used to receive asynchronous events
+	 * from the hypervisor (see \ref CLR_OCI_HYPERVISOR_EVENTS_SOCKET).
+	 */
+	gchar events_path[PATH_MAX];
+
 	/** Full path to socket used to determine when the hypervisor
 	 * has been shut down.
 	 * Created below \ref CLR_OCI_RUNTIME_DIR_PREFIX
@@ -336,8 +471,33 @@ struct clr_oci_container_state {
 	/* Process ID of hypervisor. */
 	GPid workload_pid;
 
+	/** Start time of \ref workload_pid, used to detect the pid
+	 * being reused (see clr_oci_pid_start_time()).
+	 */
+	guint64 workload_start_time;
+
 	/** OCI status of container. */
 	enum oci_status status;
+
+	/** Resources assigned to the VM since it started. */
+	struct clr_oci_vm_resources resources;
+	/** vsock context ID of the VM, used to reach the agent
+	 * (see agent.c).
+	 */
+	guint32 vsock_cid;
+
+	/** Process ID of the virtio-fs daemon (\c 0 if the rootfs is
+	 * shared using 9p).
+	 */
+	GPid virtiofsd_pid;
+
+	/** Start time of \ref virtiofsd_pid. */
+	guint64 virtiofsd_start_time;
+
+	/** Host CPUs the VM is pinned to (see placement.c), or "" if
+	 * it is not pinned.
+	 */
+	gchar cpus[LINE_MAX];
 };
 
 /** clr-specific mount details. */
@@ -354,6 +514,9 @@ struct clr_oci_mount {
 
 	/** \c true if mount should not be honoured. */
 	gboolean       ignore_mount;
+
+	/** \c true if \ref dest is a file rather than a directory. */
+	gboolean       dest_is_file;
 };
 
 /** The main object holding all configuration data.
@@ -402,6 +565,36 @@ struct clr_oci_config {
 
 	/** If \c true, don't wait for hypervisor process to finish. */
 	gboolean detached_mode;
+
+	/** If set, migration URI the hypervisor should load the VM
+	 * state from, rather than booting (see checkpoint.c).
+	 */
+	gchar *incoming;
+
+	/** If set, file guest RAM is mapped from when restoring from
+	 * \ref incoming (see lazy checkpoints in checkpoint.c).
+	 */
+	gchar *incoming_ram;
+
+	/** If set, memory backend object of guest RAM (set when the
+	 * hypervisor arguments are expanded).
+	 */
+	gchar *ram_backend;
+
+	/** Listening sockets (of type \c int) created by the runtime
+	 * for the hypervisor to inherit (see clr_oci_vm_fds_close()).
+	 */
+	GArray *hypervisor_fds;
+
+	/** vhost-vsock device reserving the vsock context ID of the VM
+	 * until the hypervisor inherits it (see clr_oci_vsock_open()).
+	 */
+	int vsock_fd;
+
+	/** Exit status of the runtime if the command succeeds
+	 * (set by "exec" to that of the command it ran).
+	 */
+	gint exit_code;
 };
 
 gboolean clr_oci_attach(struct clr_oci_config *config,
@@ -425,8 +618,13 @@ gboolean clr_oci_toggle (struct clr_oci_config *config,
 gboolean clr_oci_exec (struct clr_oci_config *config,
 		struct oci_state *state,
 		int argc, char *const args[]);
+gboolean clr_oci_ps (struct clr_oci_config *config,
+		struct oci_state *state,
+		gchar *const options[], gboolean json);
 gboolean clr_oci_list (struct clr_oci_config *config,
 		const gchar *format, gboolean show_all);
+struct oci_state *clr_oci_vm_get_state (const gchar *name,
+		const char *root_dir);
 gboolean clr_oci_delete (struct clr_oci_config *config,
 		struct oci_state *state);
 gboolean clr_oci_kill (struct clr_oci_config *config,
@@ -435,4 +633,11 @@ gboolean clr_oci_kill (struct clr_oci_config *config,
 gboolean clr_oci_config_update (struct clr_oci_config *config,
 		struct oci_state *state);
 
+struct clr_oci_checkpoint;
+
+gboolean clr_oci_checkpoint (struct clr_oci_config *config,
+		struct oci_state *state, struct clr_oci_checkpoint *cp);
+gboolean clr_oci_restore (struct clr_oci_config *config,
+		struct clr_oci_checkpoint *cp);
+
 #endif /* _CLR_OCI_H */
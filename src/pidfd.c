@@ -0,0 +1,415 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Monitoring and signalling processes (such as the hypervisor) which
+ * are not children of the runtime.
+ *
+ * A pidfd refers to one particular process, so unlike a pid it cannot
+ * be confused with an unrelated process which has reused the pid once
+ * it has been opened. It becomes readable when the process exits,
+ * allowing exit to be waited for without polling. On kernels without
+ * pidfd support (before 5.3), the pid is used directly and polled.
+ *
+ * A pid stored in the state file may have been reused before the
+ * pidfd is opened, so the start time of the process is stored with it
+ * and compared once the pidfd has been opened (see
+ * clr_oci_pid_start_time()).
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "common.h"
+#include "pidfd.h"
+
+/* The system call numbers are the same on all architectures */
+#ifndef __NR_pidfd_send_signal
+#define __NR_pidfd_send_signal 424
+#endif
+
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+
+/** A process being waited for by clr_oci_pid_watch(). */
+struct clr_oci_pid_watch {
+	GPid         pid;
+
+	/** Start time of \ref pid (\c 0 if unknown). */
+	guint64      start_time;
+
+	/** pidfd of \ref pid (\c -1 if it is being polled). */
+	int          fd;
+
+	GSourceFunc  func;
+	gpointer     data;
+};
+
+/*!
+ * Determine when a process started.
+ *
+ * \param pid Process ID.
+ * \param[out] start_time Start time of the process in clock ticks
+ *   since boot (field 22 of \c /proc/<pid>/stat).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_pid_start_time (GPid pid, guint64 *start_time)
+{
+	g_autofree gchar  *path = NULL;
+	g_autofree gchar  *contents = NULL;
+	gchar            **fields = NULL;
+	gchar             *p;
+	gchar             *endptr = NULL;
+	gboolean           ret = false;
+
+	if (pid <= 0 || ! start_time) {
+		return false;
+	}
+
+	path = g_strdup_printf ("/proc/%d/stat", (int)pid);
+
+	if (! g_file_get_contents (path, &contents, NULL, NULL)) {
+		return false;
+	}
+
+	/* The command name (field 2) may contain spaces and
+	 * parentheses, so the fields after it are found from the last
+	 * parenthesis.
+	 */
+	p = strrchr (contents, ')');
+	if (! p) {
+		goto out;
+	}
+
+	/* fields[0] is field 3 */
+	fields = g_strsplit (g_strchug (p + 1), " ", 21);
+	if (g_strv_length (fields) < 20) {
+		goto out;
+	}
+
+	*start_time = g_ascii_strtoull (fields[19], &endptr, 10);
+	if (endptr == fields[19]) {
+		goto out;
+	}
+
+	ret = true;
+
+out:
+	if (! ret) {
+		g_debug ("invalid %s", path);
+	}
+
+	g_strfreev (fields);
+
+	return ret;
+}
+
+/*!
+ * Determine if a pid still refers to the process it was stored for.
+ *
+ * \param pid Process ID.
+ * \param start_time Start time of the process, or \c 0 if unknown.
+ *
+ * \return \c true if the process is the same (or \p start_time is
+ *   \c 0), else \c false with \c errno set to \c ESRCH.
+ */
+static gboolean
+clr_oci_pid_same (GPid pid, guint64 start_time)
+{
+	guint64 current;
+
+	if (! start_time) {
+		return true;
+	}
+
+	if (clr_oci_pid_start_time (pid, &current)
+			&& current == start_time) {
+		return true;
+	}
+
+	errno = ESRCH;
+
+	return false;
+}
+
+/*!
+ * Obtain a pidfd for a process.
+ *
+ * If \p start_time is given, the pidfd is only returned if it refers
+ * to the process which started then. Since the pidfd is opened
+ * first, the pid cannot be reused once it has been checked.
+ *
+ * \param pid Process ID.
+ * \param start_time Start time of the process (see
+ *   clr_oci_pid_start_time()), or \c 0 if unknown.
+ *
+ * \return File descriptor on success, else \c -1 with \c errno set
+ * (to \c ENOSYS if the kernel does not support pidfds, or \c ESRCH
+ * if the process has gone).
+ */
+int
+clr_oci_pidfd_open (GPid pid, guint64 start_time)
+{
+	int fd;
+
+	if (pid <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fd = (int)syscall (__NR_pidfd_open, (pid_t)pid, 0);
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (! clr_oci_pid_same (pid, start_time)) {
+		close (fd);
+		errno = ESRCH;
+		return -1;
+	}
+
+	return fd;
+}
+
+/*!
+ * Determine if the process using a pid is still running
+ * (without using a pidfd).
+ *
+ * \param pid Process ID.
+ * \param start_time Start time of the process, or \c 0 if unknown.
+ *
+ * \return \c true if the process exists, else \c false.
+ */
+static gboolean
+clr_oci_pid_exists (GPid pid, guint64 start_time)
+{
+	/* EPERM means the process exists but cannot be signalled */
+	return (kill (pid, 0) == 0 || errno == EPERM)
+		&& clr_oci_pid_same (pid, start_time);
+}
+
+/*!
+ * Determine if a process is running.
+ *
+ * Unlike \c kill(pid, 0), a process which has exited but has not yet
+ * been reaped is not considered to be running.
+ *
+ * \param pid Process ID.
+ * \param start_time Start time of the process (see
+ *   clr_oci_pid_start_time()), or \c 0 if unknown.
+ *
+ * \return \c true if the process is running, else \c false.
+ */
+gboolean
+clr_oci_pid_running (GPid pid, guint64 start_time)
+{
+	struct pollfd  pfd = { 0 };
+	int            ret;
+
+	if (pid <= 0) {
+		return false;
+	}
+
+	pfd.fd = clr_oci_pidfd_open (pid, start_time);
+	if (pfd.fd < 0) {
+		if (errno == ENOSYS) {
+			return clr_oci_pid_exists (pid, start_time);
+		}
+
+		return false;
+	}
+
+	pfd.events = POLLIN;
+
+	ret = poll (&pfd, 1, 0);
+
+	close (pfd.fd);
+
+	return ret == 0;
+}
+
+/*!
+ * Send a signal to a process.
+ *
+ * \param pid Process ID.
+ * \param start_time Start time of the process (see
+ *   clr_oci_pid_start_time()), or \c 0 if unknown.
+ * \param signum Signal number.
+ *
+ * \return \c true on success, else \c false with \c errno set.
+ */
+gboolean
+clr_oci_pid_signal (GPid pid, guint64 start_time, int signum)
+{
+	int  fd;
+	int  ret;
+	int  saved;
+
+	if (pid <= 0) {
+		errno = EINVAL;
+		return false;
+	}
+
+	fd = clr_oci_pidfd_open (pid, start_time);
+	if (fd < 0) {
+		if (errno == ENOSYS) {
+			return clr_oci_pid_same (pid, start_time)
+				&& kill (pid, signum) == 0;
+		}
+
+		return false;
+	}
+
+	ret = (int)syscall (__NR_pidfd_send_signal, fd, signum, NULL, 0);
+
+	saved = errno;
+	close (fd);
+	errno = saved;
+
+	return ret == 0;
+}
+
+/*!
+ * Free a \ref clr_oci_pid_watch once its source has been removed.
+ *
+ * \param watch \ref clr_oci_pid_watch.
+ */
+static void
+clr_oci_pid_watch_free (struct clr_oci_pid_watch *watch)
+{
+	if (watch->fd >= 0) {
+		close (watch->fd);
+	}
+
+	g_free (watch);
+}
+
+/*!
+ * Called when the pidfd of a watched process becomes readable.
+ *
+ * \param fd pidfd.
+ * \param condition \c GIOCondition.
+ * \param watch \ref clr_oci_pid_watch.
+ *
+ * \return \c false (the process has exited).
+ */
+static gboolean
+clr_oci_pid_watch_exited (gint fd, GIOCondition condition,
+		struct clr_oci_pid_watch *watch)
+{
+	(void)fd;
+	(void)condition;
+
+	(void)watch->func (watch->data);
+
+	return false;
+}
+
+/*!
+ * Check whether a watched process without a pidfd has exited.
+ *
+ * \param watch \ref clr_oci_pid_watch.
+ *
+ * \return \c true while the process is running, else \c false.
+ */
+static gboolean
+clr_oci_pid_watch_poll (struct clr_oci_pid_watch *watch)
+{
+	/* If the process is a child of the runtime (as when using
+	 * "run"), it continues to exist until it is reaped.
+	 */
+	if (waitpid (watch->pid, NULL, WNOHANG) != watch->pid
+			&& clr_oci_pid_exists (watch->pid,
+				watch->start_time)) {
+		return true;
+	}
+
+	(void)watch->func (watch->data);
+
+	return false;
+}
+
+/*!
+ * Call a function (once) when a process exits.
+ *
+ * \param pid Process ID.
+ * \param start_time Start time of the process (see
+ *   clr_oci_pid_start_time()), or \c 0 if unknown.
+ * \param func Function to call (its return value is ignored).
+ * \param data Data to pass to \p func.
+ *
+ * \return ID of the source in the default main context (which is
+ * removed after calling \p func), or \c 0 on error.
+ */
+guint
+clr_oci_pid_watch (GPid pid, guint64 start_time, GSourceFunc func,
+		gpointer data)
+{
+	struct clr_oci_pid_watch *watch;
+
+	if (pid <= 0 || ! func) {
+		return 0;
+	}
+
+	watch = g_new0 (struct clr_oci_pid_watch, 1);
+
+	watch->pid = pid;
+	watch->start_time = start_time;
+	watch->func = func;
+	watch->data = data;
+
+	watch->fd = clr_oci_pidfd_open (pid, start_time);
+	if (watch->fd >= 0) {
+		return g_unix_fd_add_full (G_PRIORITY_DEFAULT, watch->fd,
+				G_IO_IN,
+				(GUnixFDSourceFunc)clr_oci_pid_watch_exited,
+				watch,
+				(GDestroyNotify)clr_oci_pid_watch_free);
+	}
+
+	if (errno != ENOSYS) {
+		/* The process has already gone, so the first poll
+		 * will report it.
+		 */
+		g_debug ("cannot open pidfd for pid %d: %s",
+				(int)pid, strerror (errno));
+	}
+
+	return g_timeout_add_seconds_full (G_PRIORITY_DEFAULT,
+			CLR_OCI_PID_POLL_SECS,
+			(GSourceFunc)clr_oci_pid_watch_poll,
+			watch,
+			(GDestroyNotify)clr_oci_pid_watch_free);
+}
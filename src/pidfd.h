@@ -0,0 +1,38 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_PIDFD_H
+#define _CLR_OCI_PIDFD_H
+
+#include <glib.h>
+
+/** Interval (in seconds) at which processes are polled on kernels
+ * that do not support pidfds.
+ */
+#define CLR_OCI_PID_POLL_SECS 1
+
+gboolean clr_oci_pid_start_time (GPid pid, guint64 *start_time);
+int clr_oci_pidfd_open (GPid pid, guint64 start_time);
+gboolean clr_oci_pid_running (GPid pid, guint64 start_time);
+gboolean clr_oci_pid_signal (GPid pid, guint64 start_time, int signum);
+guint clr_oci_pid_watch (GPid pid, guint64 start_time, GSourceFunc func,
+		gpointer data);
+
+#endif /* _CLR_OCI_PIDFD_H */
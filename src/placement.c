@@ -0,0 +1,502 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Placement of VMs on host CPUs and NUMA nodes.
+ *
+ * If a container is limited to a set of host CPUs, each vCPU thread
+ * of its VM is pinned to one of them and the remaining hypervisor
+ * threads (the main loop and I/O threads) to the CPUs left over, so
+ * that they do not compete with the vCPUs. Guest memory is bound to
+ * the NUMA nodes specified, or else to the nodes of those CPUs, so
+ * that it is never allocated remotely.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "common.h"
+#include "oci.h"
+#include "util.h"
+#include "annotation.h"
+#include "network.h"
+#include "resources.h"
+#include "placement.h"
+
+/* XXX: assigned to a variable to allow the tests to modify it */
+private gchar *sysfs_node_dir = "/sys/devices/system/node";
+
+/*!
+ * Compare two \c guint values (for sorting).
+ *
+ * \param a First value.
+ * \param b Second value.
+ *
+ * \return Negative, zero or positive as \p a is less than, equal to,
+ * or greater than \p b.
+ */
+static gint
+clr_oci_placement_cmp (gconstpointer a, gconstpointer b)
+{
+	guint x = *(const guint *)a;
+	guint y = *(const guint *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*!
+ * Determine the NUMA nodes of the specified host CPUs.
+ *
+ * \param cpus List of CPUs (for example "0-3,6").
+ *
+ * \return Newly-allocated list of NUMA nodes on success, else \c NULL.
+ */
+gchar *
+clr_oci_placement_nodes (const gchar *cpus)
+{
+	GArray       *wanted = NULL;
+	GArray       *node_cpus;
+	GArray       *found_nodes = NULL;
+	GDir         *dir = NULL;
+	const gchar  *name;
+	GString      *nodes = NULL;
+	gchar        *end;
+	guint         node;
+	guint         i;
+	guint         j;
+	gboolean      found;
+
+	wanted = clr_oci_cpuset_parse (cpus);
+	if (! wanted) {
+		return NULL;
+	}
+
+	dir = g_dir_open (sysfs_node_dir, 0, NULL);
+	if (! dir) {
+		/* not a NUMA system */
+		goto out;
+	}
+
+	found_nodes = g_array_new (false, false, sizeof (guint));
+
+	while ((name = g_dir_read_name (dir))) {
+		g_autofree gchar *path = NULL;
+		g_autofree gchar *contents = NULL;
+
+		if (! (g_str_has_prefix (name, "node")
+				&& g_ascii_isdigit (name[4]))) {
+			continue;
+		}
+
+		node = (guint)g_ascii_strtoull (name + 4, &end, 10);
+		if (*end) {
+			continue;
+		}
+
+		path = g_build_path ("/", sysfs_node_dir, name, "cpulist",
+				NULL);
+		if (! g_file_get_contents (path, &contents, NULL, NULL)) {
+			continue;
+		}
+
+		node_cpus = clr_oci_cpuset_parse (g_strstrip (contents));
+		if (! node_cpus) {
+			continue;
+		}
+
+		found = false;
+		for (i = 0; i < node_cpus->len && ! found; i++) {
+			for (j = 0; j < wanted->len && ! found; j++) {
+				found = g_array_index (node_cpus, guint, i)
+					== g_array_index (wanted, guint, j);
+			}
+		}
+
+		g_array_free (node_cpus, true);
+
+		if (found) {
+			g_array_append_val (found_nodes, node);
+		}
+	}
+
+	if (! found_nodes->len) {
+		goto out;
+	}
+
+	/* directory entries are not ordered */
+	g_array_sort (found_nodes, clr_oci_placement_cmp);
+
+	nodes = g_string_new ("");
+
+	for (i = 0; i < found_nodes->len; i++) {
+		g_string_append_printf (nodes, "%s%u", i ? "," : "",
+				g_array_index (found_nodes, guint, i));
+	}
+
+out:
+	if (dir) {
+		g_dir_close (dir);
+	}
+
+	if (found_nodes) {
+		g_array_free (found_nodes, true);
+	}
+
+	g_array_free (wanted, true);
+
+	return nodes ? g_string_free (nodes, false) : NULL;
+}
+
+/*!
+ * Determine where to place the VM of a container.
+ *
+ * The annotations \ref CLR_OCI_ANNOTATION_CPUS and
+ * \ref CLR_OCI_ANNOTATION_MEMS override the "cpus" and "mems"
+ * limits of the container. If CPUs are specified but NUMA nodes are
+ * not, the nodes of the CPUs are used.
+ *
+ * \param config \ref clr_oci_config.
+ * \param[out] cpus Newly-allocated list of host CPUs (or \c NULL if
+ *   the VM is not limited to particular CPUs).
+ * \param[out] mems Newly-allocated list of NUMA nodes (or \c NULL if
+ *   guest memory is not bound to particular nodes).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_placement_get (const struct clr_oci_config *config,
+		gchar **cpus, gchar **mems)
+{
+	const struct oci_cfg_resources *resources;
+	const gchar                    *value;
+	GArray                         *list;
+
+	if (! (config && cpus && mems)) {
+		return false;
+	}
+
+	resources = &config->oci.oci_linux.resources;
+
+	value = clr_oci_annotation_get (config->oci.annotations,
+			CLR_OCI_ANNOTATION_CPUS);
+	*cpus = g_strdup (value ? value : resources->cpu_cpus);
+
+	value = clr_oci_annotation_get (config->oci.annotations,
+			CLR_OCI_ANNOTATION_MEMS);
+	*mems = g_strdup (value ? value : resources->cpu_mems);
+
+	if (*cpus) {
+		list = clr_oci_cpuset_parse (*cpus);
+		if (! list) {
+			g_critical ("invalid cpus: %s", *cpus);
+			goto err;
+		}
+		g_array_free (list, true);
+
+		if (! *mems) {
+			*mems = clr_oci_placement_nodes (*cpus);
+		}
+	}
+
+	if (*mems) {
+		list = clr_oci_cpuset_parse (*mems);
+		if (! list) {
+			g_critical ("invalid mems: %s", *mems);
+			goto err;
+		}
+		g_array_free (list, true);
+	}
+
+	return true;
+
+err:
+	g_free_if_set (*cpus);
+	g_free_if_set (*mems);
+	*cpus = *mems = NULL;
+
+	return false;
+}
+
+/*!
+ * Determine the number of vCPUs to give a VM placed on host CPUs.
+ *
+ * One of the CPUs is left for the I/O and emulator threads of the
+ * hypervisor (see clr_oci_placement_pin()) unless there is only one,
+ * or fewer vCPUs than CPUs were asked for anyway.
+ *
+ * \param cpus List of CPUs (for example "0-3,6"), or \c NULL.
+ * \param vcpus Number of vCPUs requested.
+ *
+ * \return Number of vCPUs to use.
+ */
+guint
+clr_oci_placement_vcpus (const gchar *cpus, guint vcpus)
+{
+	GArray *list;
+	guint   count;
+
+	if (! cpus) {
+		return vcpus;
+	}
+
+	list = clr_oci_cpuset_parse (cpus);
+	if (! list) {
+		return vcpus;
+	}
+
+	count = list->len;
+	g_array_free (list, true);
+
+	if (count > 1 && vcpus >= count) {
+		return count - 1;
+	}
+
+	return vcpus;
+}
+
+/*!
+ * Generate the memory backend options which bind guest memory to the
+ * specified NUMA nodes.
+ *
+ * \param mems List of NUMA nodes (for example "0-1,3").
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+gchar *
+clr_oci_placement_memory_policy (const gchar *mems)
+{
+	GString  *policy;
+	gchar   **ranges;
+	gchar   **range;
+
+	if (! (mems && *mems)) {
+		return NULL;
+	}
+
+	policy = g_string_new ("");
+	ranges = g_strsplit (mems, ",", -1);
+
+	/* each range is a separate element of the list */
+	for (range = ranges; *range; range++) {
+		g_string_append_printf (policy, "host-nodes=%s,", *range);
+	}
+
+	g_string_append (policy, "policy=bind");
+
+	g_strfreev (ranges);
+
+	return g_string_free (policy, false);
+}
+
+/*!
+ * Set the CPU affinity of a thread.
+ *
+ * \param tid Thread ID.
+ * \param cpus Array of \c guint CPUs.
+ * \param first Index of first CPU in \p cpus to use.
+ * \param count Number of CPUs to use.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_placement_set_affinity (GPid tid, GArray *cpus, guint first,
+		guint count)
+{
+	cpu_set_t  *set;
+	size_t      size;
+	guint       max = 0;
+	guint       i;
+	int         ret;
+	int         saved;
+
+	for (i = first; i < first + count; i++) {
+		max = MAX (max, g_array_index (cpus, guint, i));
+	}
+
+	set = CPU_ALLOC (max + 1);
+	if (! set) {
+		return false;
+	}
+
+	size = CPU_ALLOC_SIZE (max + 1);
+	CPU_ZERO_S (size, set);
+
+	for (i = first; i < first + count; i++) {
+		CPU_SET_S (g_array_index (cpus, guint, i), size, set);
+	}
+
+	ret = sched_setaffinity (tid, size, set);
+
+	saved = errno;
+	CPU_FREE (set);
+	errno = saved;
+
+	return ret == 0;
+}
+
+/*!
+ * Pin the threads of a hypervisor to host CPUs.
+ *
+ * vCPU \c N is pinned to the \c Nth CPU of \p cpus (wrapping around
+ * if there are more vCPUs than CPUs). All other threads are pinned to
+ * the CPUs not used by a vCPU, or to all of \p cpus if there are none.
+ *
+ * \param pid \c GPid of hypervisor process.
+ * \param vcpu_threads Array of \c GPid vCPU thread IDs (indexed by
+ *   vCPU).
+ * \param cpus List of CPUs (for example "0-3,6").
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_placement_pin (GPid pid, GArray *vcpu_threads, const gchar *cpus)
+{
+	g_autofree gchar  *task_dir = NULL;
+	GArray            *list = NULL;
+	GDir              *dir = NULL;
+	const gchar       *name;
+	gchar             *end;
+	GPid               tid;
+	guint              vcpus;
+	guint              i;
+	gboolean           vcpu;
+	gboolean           ok;
+	gboolean           ret = false;
+
+	if (! (pid > 0 && vcpu_threads)) {
+		return false;
+	}
+
+	list = clr_oci_cpuset_parse (cpus);
+	if (! list) {
+		return false;
+	}
+
+	task_dir = g_strdup_printf ("/proc/%d/task", (int)pid);
+
+	dir = g_dir_open (task_dir, 0, NULL);
+	if (! dir) {
+		g_critical ("failed to list threads of process %d",
+				(int)pid);
+		goto out;
+	}
+
+	vcpus = MIN (vcpu_threads->len, list->len);
+
+	while ((name = g_dir_read_name (dir))) {
+		tid = (GPid)g_ascii_strtoll (name, &end, 10);
+		if (*end || tid <= 0) {
+			continue;
+		}
+
+		vcpu = false;
+		ok = true;
+
+		for (i = 0; i < vcpu_threads->len; i++) {
+			if (g_array_index (vcpu_threads, GPid, i) != tid) {
+				continue;
+			}
+
+			vcpu = true;
+			ok = clr_oci_placement_set_affinity (tid, list,
+					i % list->len, 1);
+			break;
+		}
+
+		if (! vcpu) {
+			if (list->len > vcpus) {
+				ok = clr_oci_placement_set_affinity (tid, list,
+						vcpus, list->len - vcpus);
+			} else {
+				ok = clr_oci_placement_set_affinity (tid, list,
+						0, list->len);
+			}
+		}
+
+		/* the thread may have exited */
+		if (! ok && errno != ESRCH) {
+			g_critical ("failed to pin thread %d to cpus %s: %s",
+					(int)tid, cpus, strerror (errno));
+			goto out;
+		}
+	}
+
+	g_debug ("pinned %u vCPUs of process %d to cpus %s",
+			vcpu_threads->len, (int)pid, cpus);
+
+	ret = true;
+
+out:
+	if (dir) {
+		g_dir_close (dir);
+	}
+
+	g_array_free (list, true);
+
+	return ret;
+}
+
+/*!
+ * Pin the threads of the hypervisor of a running container to the
+ * CPUs chosen for it when it was created.
+ *
+ * The hypervisor of a placed VM starts with its vCPUs stopped (see
+ * clr_oci_vm_args_get()), so this is called before they first run.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_vm_pin (const struct clr_oci_config *config)
+{
+	GArray    *threads = NULL;
+	gboolean   ret;
+
+	if (! config) {
+		return false;
+	}
+
+	if (! config->state.cpus[0]) {
+		/* not placed */
+		return true;
+	}
+
+	if (! clr_oci_vm_vcpu_threads (config->state.comms_path,
+				config->state.workload_pid, &threads)) {
+		g_critical ("failed to find vCPU threads");
+		return false;
+	}
+
+	ret = clr_oci_placement_pin (config->state.workload_pid, threads,
+			config->state.cpus);
+
+	g_array_free (threads, true);
+
+	return ret;
+}
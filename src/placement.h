@@ -0,0 +1,47 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_PLACEMENT_H
+#define _CLR_OCI_PLACEMENT_H
+
+#include <glib.h>
+
+#include "oci.h"
+
+/** Annotation specifying the host CPUs to place the VM on, overriding
+ * "linux.resources.cpu.cpus".
+ */
+#define CLR_OCI_ANNOTATION_CPUS "com.intel.clr.placement.cpus"
+
+/** Annotation specifying the host NUMA nodes to allocate guest memory
+ * from, overriding "linux.resources.cpu.mems".
+ */
+#define CLR_OCI_ANNOTATION_MEMS "com.intel.clr.placement.mems"
+
+gboolean clr_oci_placement_get (const struct clr_oci_config *config,
+		gchar **cpus, gchar **mems);
+gchar *clr_oci_placement_nodes (const gchar *cpus);
+guint clr_oci_placement_vcpus (const gchar *cpus, guint vcpus);
+gchar *clr_oci_placement_memory_policy (const gchar *mems);
+gboolean clr_oci_placement_pin (GPid pid, GArray *vcpu_threads,
+		const gchar *cpus);
+gboolean clr_oci_vm_pin (const struct clr_oci_config *config);
+
+#endif /* _CLR_OCI_PLACEMENT_H */
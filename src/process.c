@@ -43,8 +43,10 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/ptrace.h>
+#include <sys/uio.h>
 
 #include <glib.h>
+#include <glib-unix.h>
 #include <glib/gprintf.h>
 #include <gio/gio.h>
 #include <gio/gunixsocketaddress.h>
@@ -54,10 +56,73 @@
 #include "hypervisor.h"
 #include "process.h"
 #include "namespace.h"
+#include "agent.h"
+#include "pidfd.h"
 #include "common.h"
 
-static GMainLoop* main_loop = NULL;
-static GMainLoop* hook_loop = NULL;
+/** Maximum number of bytes of output captured from each hook stream. */
+#define CLR_OCI_HOOK_OUTPUT_MAX (64 * 1024)
+
+/** Size of buffer used to read hook output. */
+#define CLR_OCI_HOOK_READ_SIZE 4096
+
+/** Output captured from a hook stream. */
+struct clr_oci_hook_output {
+	/** Read end of pipe connected to the hook stream. */
+	int       fd;
+
+	/** Source watching \ref fd. */
+	guint     source;
+
+	/** Captured output (at most \ref CLR_OCI_HOOK_OUTPUT_MAX bytes). */
+	GString  *data;
+
+	/** Number of bytes of output discarded. */
+	gsize     dropped;
+};
+
+/** State of a single hook run by clr_run_hooks(). */
+struct clr_oci_hook_run {
+	/** Hook to run. */
+	struct oci_cfg_hook  *hook;
+
+	/** Loop shared by all hooks, quit when \ref pending hits zero. */
+	GMainLoop            *loop;
+
+	/** Number of hooks still running (shared by all hooks). */
+	guint                *pending;
+
+	GPid                  pid;
+	gint                  exit_code;
+
+	/** Source used to kill the hook if it runs for too long. */
+	guint                 timeout_source;
+
+	/** \c true if the hook was killed by \ref timeout_source. */
+	gboolean              timed_out;
+
+	/** Time hook was started (monotonic, in microseconds). */
+	gint64                start_time;
+
+	/** Time hook ran for (in microseconds). */
+	gint64                wall_time;
+
+	/** Output captured from the hooks stdout. */
+	struct clr_oci_hook_output  out;
+
+	/** Output captured from the hooks stderr. */
+	struct clr_oci_hook_output  err;
+};
+
+/** Buffer reused to format hook output for logging. */
+static GString *hook_log = NULL;
+
+static gboolean clr_oci_hook_output_watcher (gint fd,
+		GIOCondition cond,
+		struct clr_oci_hook_output *output);
+static void clr_oci_hook_output_flush (struct clr_oci_hook_output *output,
+		const struct clr_oci_hook_run *run,
+		gint stream);
 
 /** List of shells that are recognised by "exec", ordered by likelihood. */
 static const gchar *recognised_shells[] =
@@ -110,12 +175,39 @@ clr_oci_cmd_is_shell (const char *cmd)
 }
 
 /*!
- * Close file descriptors, excluding standard streams.
+ * Determine if \p fd is one of the sockets to be passed to the
+ * hypervisor.
+ *
+ * \param config \ref clr_oci_config.
+ * \param fd File descriptor.
+ *
+ * \return \c true if \p fd must be inherited, else \c false.
+ */
+static gboolean
+clr_oci_hypervisor_fd (const struct clr_oci_config *config, int fd)
+{
+	guint i;
+
+	for (i = 0; config->hypervisor_fds
+			&& i < config->hypervisor_fds->len; i++) {
+		if (g_array_index (config->hypervisor_fds, int, i) == fd) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*!
+ * Close file descriptors, excluding standard streams and those to be
+ * passed to the hypervisor.
+ *
+ * \param config \ref clr_oci_config.
  *
  * \return \c true on success, else \c false.
  */
 static gboolean
-clr_oci_close_fds (void) {
+clr_oci_close_fds (const struct clr_oci_config *config) {
 	char           *fd_dir = "/proc/self/fd";
 	DIR            *dir;
 	struct dirent  *ent;
@@ -144,6 +236,10 @@ clr_oci_close_fds (void) {
 			continue;
 		}
 
+		if (clr_oci_hypervisor_fd (config, fd)) {
+			continue;
+		}
+
 		(void)close (fd);
 	}
 
@@ -198,6 +294,9 @@ clr_oci_set_child_std_fds (const char *tty) {
 static void
 clr_oci_setup_child (struct clr_oci_config *config)
 {
+	guint  i;
+	int    fd;
+
 	/* become session leader */
 	setsid ();
 
@@ -220,7 +319,16 @@ clr_oci_setup_child (struct clr_oci_config *config)
 
 	/* Do not close fds when VM runs in detached mode*/
 	if (! config->detached_mode) {
-		clr_oci_close_fds ();
+		clr_oci_close_fds (config);
+	}
+
+	/* Allow the hypervisor to inherit the sockets created for it */
+	for (i = 0; config->hypervisor_fds
+			&& i < config->hypervisor_fds->len; i++) {
+		fd = g_array_index (config->hypervisor_fds, int, i);
+
+		(void)fcntl (fd, F_SETFD,
+				fcntl (fd, F_GETFD) & ~FD_CLOEXEC);
 	}
 
 	if (! config->use_socket_console) {
@@ -234,110 +342,370 @@ clr_oci_setup_child (struct clr_oci_config *config)
 }
 
 /*!
- * Close spawned container and stop the main loop.
+ * Handle a hook process exiting.
  *
  * \param pid Process ID.
  * \param status status of child process.
- * \param[out] exit_code exit code of child process.
- *
- * \note \p exit_code may be \c NULL to avoid returning the
- * child exit code.
+ * \param run \ref clr_oci_hook_run.
  */
 static void
-clr_oci_child_watcher (GPid pid, gint status,
-		gpointer exit_code) {
-	g_debug ("pid %u ended with exit status %d", pid, status);
+clr_oci_hook_watcher (GPid pid, gint status, struct clr_oci_hook_run *run)
+{
+	g_assert (run);
 
-	if (exit_code) {
-		*((gint*)exit_code) = status;
+	run->exit_code = status;
+	run->wall_time = g_get_monotonic_time () - run->start_time;
+
+	g_debug ("Hook pid %u ended with exit status %d", pid, status);
+
+	if (run->timeout_source) {
+		g_source_remove (run->timeout_source);
+		run->timeout_source = 0;
 	}
 
 	g_spawn_close_pid (pid);
 
-	g_main_loop_quit (main_loop);
+	clr_oci_hook_output_flush (&run->out, run, STDOUT_FILENO);
+	clr_oci_hook_output_flush (&run->err, run, STDERR_FILENO);
+
+	if (! --(*run->pending)) {
+		g_main_loop_quit (run->loop);
+	}
 }
 
 /*!
- * Close spawned hook and stop the hook loop.
+ * Kill a hook that has exceeded its timeout.
  *
- * \param pid Process ID.
- * \param status status of child process.
- * \param[out] exit_code exit code of child process.
- * */
+ * \param run \ref clr_oci_hook_run.
+ *
+ * \return \c false (to remove the timeout source).
+ */
+static gboolean
+clr_oci_hook_timeout (struct clr_oci_hook_run *run)
+{
+	g_assert (run);
+
+	run->timeout_source = 0;
+	run->timed_out = true;
+
+	g_critical ("hook process %d ('%s') timed out after %d "
+			"second%s - killing it",
+			(int)run->pid,
+			run->hook->path,
+			run->hook->timeout,
+			run->hook->timeout == 1 ? "" : "s");
+
+	/* The hook runs in its own process group so that any children
+	 * it has spawned are killed too.
+	 */
+	if (kill (-run->pid, SIGKILL) < 0) {
+		(void)kill (run->pid, SIGKILL);
+	}
+
+	/* clr_oci_hook_watcher() will be called once the hook has been
+	 * reaped.
+	 */
+	return false;
+}
+
+/*!
+ * Perform setup in the spawned hook process.
+ *
+ * \param user_data Unused.
+ */
 static void
-clr_oci_hook_watcher(GPid pid, gint status, gpointer exit_code) {
-	g_debug ("Hook pid %u ended with exit status %d", pid, status);
+clr_oci_hook_setup_child (gpointer user_data)
+{
+	(void)user_data;
 
-	*((gint*)exit_code) = status;
+	/* create a new process group to allow the hook (and its
+	 * children) to be killed on timeout.
+	 */
+	(void)setpgid (0, 0);
+}
 
-	g_spawn_close_pid (pid);
+/*!
+ * Save hook output, discarding anything beyond \p max bytes.
+ *
+ * \param buf Buffer to save output to.
+ * \param max Maximum size of \p buf.
+ * \param data Output to save.
+ * \param len Length of \p data.
+ *
+ * \return Number of bytes of \p data that were discarded.
+ */
+private gsize
+clr_oci_hook_output_append (GString *buf, gsize max,
+		const gchar *data, gsize len)
+{
+	gsize space;
 
-	g_main_loop_quit(hook_loop);
+	g_assert (buf);
+
+	if (! data || ! len) {
+		return 0;
+	}
+
+	space = buf->len < max ? max - buf->len : 0;
+
+	if (len <= space) {
+		g_string_append_len (buf, data, (gssize)len);
+		return 0;
+	}
+
+	g_string_append_len (buf, data, (gssize)space);
+
+	return len - space;
 }
 
 /*!
- * Handle processes output streams
- * \param channel GIOChannel
- * \param cond GIOCondition
- * \param stream STDOUT_FILENO or STDERR_FILENO
+ * Split hook output into lines, appending each (with a prefix) to
+ * \p log.
  *
- * \return \c true on success, else \c false.
- * */
+ * \param log Buffer to append formatted output to.
+ * \param prefix String to prefix each line with.
+ * \param data Output to format.
+ * \param len Length of \p data.
+ *
+ * \note Empty lines and carriage returns are dropped and a final
+ * partial line is treated as a complete line.
+ */
+private void
+clr_oci_hook_output_format (GString *log, const gchar *prefix,
+		const gchar *data, gsize len)
+{
+	const gchar *p = data;
+	const gchar *end = data + len;
+
+	g_assert (log);
+	g_assert (prefix);
+
+	if (! data) {
+		return;
+	}
+
+	while (p < end) {
+		const gchar *nl = memchr (p, '\n', (size_t)(end - p));
+		const gchar *eol = nl ? nl : end;
+		const gchar *next = nl ? nl + 1 : end;
+
+		if (eol > p && eol[-1] == '\r') {
+			eol--;
+		}
+
+		if (eol > p) {
+			g_string_append (log, prefix);
+			g_string_append_len (log, p, eol - p);
+			g_string_append_c (log, '\n');
+		}
+
+		p = next;
+	}
+}
+
+/*!
+ * Start capturing output from a hook stream.
+ *
+ * \param output \ref clr_oci_hook_output.
+ * \param fd Read end of pipe connected to the hooks output stream.
+ */
+static void
+clr_oci_hook_output_init (struct clr_oci_hook_output *output, int fd)
+{
+	g_assert (output);
+
+	output->fd = fd;
+	output->data = g_string_new ("");
+	output->dropped = 0;
+
+	if (fd < 0) {
+		return;
+	}
+
+	/* Allow all available data to be read in one go */
+	(void)fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+
+	output->source = g_unix_fd_add (fd,
+			G_IO_IN | G_IO_HUP | G_IO_ERR,
+			(GUnixFDSourceFunc)clr_oci_hook_output_watcher,
+			output);
+}
+
+/*!
+ * Read all available output from a hook stream.
+ *
+ * \param output \ref clr_oci_hook_output.
+ *
+ * \return \c true if the stream is still open, else \c false.
+ */
 static gboolean
-clr_oci_output_watcher(GIOChannel* channel, GIOCondition cond,
-                            gint stream)
+clr_oci_hook_output_read (struct clr_oci_hook_output *output)
 {
-	gchar* string;
-	gsize size;
+	gchar    buffer[CLR_OCI_HOOK_READ_SIZE];
+	ssize_t  bytes;
 
-	if (cond == G_IO_HUP) {
-		g_io_channel_unref(channel);
+	g_assert (output);
+
+	if (output->fd < 0) {
 		return false;
 	}
 
-	g_io_channel_read_line(channel, &string, &size, NULL, NULL);
-	if (STDOUT_FILENO == stream) {
-		g_message("%s", string);
-	} else {
-		g_warning("%s", string);
+	while (true) {
+		bytes = read (output->fd, buffer, sizeof (buffer));
+
+		if (bytes > 0) {
+			output->dropped += clr_oci_hook_output_append (
+					output->data,
+					CLR_OCI_HOOK_OUTPUT_MAX,
+					buffer, (gsize)bytes);
+			continue;
+		}
+
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			/* all available data read */
+			return true;
+		}
+
+		/* EOF or error */
+		return false;
 	}
-	g_free(string);
+}
 
-	return true;
+/*!
+ * Handle output from a hook.
+ *
+ * \param fd File descriptor.
+ * \param cond \c GIOCondition.
+ * \param output \ref clr_oci_hook_output.
+ *
+ * \return \c true if the source should remain, else \c false.
+ */
+static gboolean
+clr_oci_hook_output_watcher (gint fd, GIOCondition cond,
+		struct clr_oci_hook_output *output)
+{
+	(void)fd;
+	(void)cond;
+
+	g_assert (output);
+
+	if (clr_oci_hook_output_read (output)) {
+		return true;
+	}
+
+	/* Stream closed, so stop watching it */
+	output->source = 0;
+	close (output->fd);
+	output->fd = -1;
+
+	return false;
+}
+
+/*!
+ * Stop capturing output from a hook stream and log everything
+ * captured as a single message.
+ *
+ * \param output \ref clr_oci_hook_output.
+ * \param run \ref clr_oci_hook_run that produced \p output.
+ * \param stream \c STDOUT_FILENO or \c STDERR_FILENO.
+ */
+static void
+clr_oci_hook_output_flush (struct clr_oci_hook_output *output,
+		const struct clr_oci_hook_run *run,
+		gint stream)
+{
+	const gchar *name = stream == STDOUT_FILENO ? "stdout" : "stderr";
+
+	g_assert (output);
+	g_assert (run);
+
+	/* Collect any remaining output, but don't wait for EOF: the
+	 * hook has exited so anything still holding the pipe open is
+	 * a background process that is not part of the hook.
+	 */
+	(void)clr_oci_hook_output_read (output);
+
+	if (output->source) {
+		g_source_remove (output->source);
+		output->source = 0;
+	}
+
+	if (output->fd >= 0) {
+		close (output->fd);
+		output->fd = -1;
+	}
+
+	if (output->data && output->data->len) {
+		if (! hook_log) {
+			hook_log = g_string_sized_new (CLR_OCI_HOOK_READ_SIZE);
+		}
+
+		g_string_printf (hook_log, "hook process %d ('%s') %s:\n",
+				(int)run->pid, run->hook->path, name);
+
+		clr_oci_hook_output_format (hook_log, "  ",
+				output->data->str, output->data->len);
+
+		if (output->dropped) {
+			g_string_append_printf (hook_log,
+					"  (%lu bytes of output discarded)\n",
+					(unsigned long int)output->dropped);
+		}
+
+		/* remove final newline */
+		g_string_truncate (hook_log, hook_log->len - 1);
+
+		if (stream == STDOUT_FILENO) {
+			g_message ("%s", hook_log->str);
+		} else {
+			g_warning ("%s", hook_log->str);
+		}
+	}
+
+	if (output->data) {
+		g_string_free (output->data, true);
+		output->data = NULL;
+	}
 }
 
 /*!
  * Start a hook
  *
- * \param hook \ref oci_cfg_hook.
- * \param state container state.
+ * The hook runs asynchronously: \ref clr_oci_hook_watcher() is called
+ * when it finishes (or is killed on timeout).
+ *
+ * \param run \ref clr_oci_hook_run.
+ * \param state Single-line container state.
  * \param state_length length of container state.
  *
  * \return \c true on success, else \c false.
  * */
 static gboolean
-clr_run_hook(struct oci_cfg_hook* hook, const gchar* state,
+clr_run_hook (struct clr_oci_hook_run *run, const gchar* state,
              gsize state_length) {
+	struct oci_cfg_hook* hook;
 	GError* error = NULL;
 	gboolean ret = false;
-	gboolean result = false;
 	gchar **args = NULL;
 	guint args_len = 0;
-	GPid pid = 0;
 	gint std_in = -1;
 	gint std_out = -1;
 	gint std_err = -1;
-	gint hook_exit_code = -1;
-	GIOChannel* out_ch = NULL;
-	GIOChannel* err_ch = NULL;
-	gchar* container_state = NULL;
+	struct iovec iov[2];
+	ssize_t written;
 	size_t i;
 	GSpawnFlags flags = 0x0;
 
-	if (! hook_loop) {
-		/* all the hooks share the same loop */
-		return false;
-	}
+	g_assert (run);
+	g_assert (run->hook);
+	g_assert (run->loop);
+	g_assert (run->pending);
+
+	hook = run->hook;
 
 	if (hook->args) {
 		/* command name + args */
@@ -369,13 +737,15 @@ clr_run_hook(struct oci_cfg_hook* hook, const gchar* state,
 		g_debug ("arg: '%s'", *p);
 	}
 
+	run->start_time = g_get_monotonic_time ();
+
 	ret = g_spawn_async_with_pipes(NULL,
 			args,
 			hook->env,
 			flags,
+			clr_oci_hook_setup_child,
 			NULL,
-			NULL,
-			&pid,
+			&run->pid,
 			&std_in,
 			&std_out,
 			&std_err,
@@ -392,76 +762,106 @@ clr_run_hook(struct oci_cfg_hook* hook, const gchar* state,
 	}
 
 	g_debug ("hook process ('%s') running with pid %d",
-			args[0], (int)pid);
+			args[0], (int)run->pid);
 
-	/* add watcher to hook */
-	g_child_watch_add(pid, clr_oci_hook_watcher, &hook_exit_code);
+	(*run->pending)++;
 
-	/* create output channels */
-	out_ch = g_io_channel_unix_new(std_out);
-	err_ch = g_io_channel_unix_new(std_err);
+	/* add watcher to hook */
+	g_child_watch_add(run->pid,
+			(GChildWatchFunc)clr_oci_hook_watcher, run);
 
-	/* add watchers to channels */
-	if (out_ch) {
-		g_io_add_watch(out_ch, G_IO_IN | G_IO_HUP,
-			(GIOFunc)clr_oci_output_watcher, (gint*)STDOUT_FILENO);
-	} else {
-		g_critical("failed to create out channel");
-	}
-	if (err_ch) {
-		g_io_add_watch(err_ch, G_IO_IN | G_IO_HUP,
-			(GIOFunc)clr_oci_output_watcher, (gint*)STDERR_FILENO);
-	} else {
-		g_critical("failed to create err channel");
+	if (hook->timeout > 0) {
+		run->timeout_source = g_timeout_add_seconds (
+				(guint)hook->timeout,
+				(GSourceFunc)clr_oci_hook_timeout, run);
 	}
 
-	/* write container state to hook's stdin */
-	container_state = g_strdup(state);
-	g_strdelimit(container_state, "\n", ' ');
-	if (write(std_in, container_state, state_length) < 0) {
+	/* capture output (logged once the hook finishes) */
+	clr_oci_hook_output_init (&run->out, std_out);
+	clr_oci_hook_output_init (&run->err, std_err);
+
+	/* The hook is now running so from here on, failures are
+	 * reported by clr_oci_hook_check().
+	 */
+	ret = true;
+
+	/* Write container state and the terminating newline to the
+	 * hooks stdin in a single call.
+	 */
+	iov[0].iov_base = (void *)state;
+	iov[0].iov_len = state_length;
+	iov[1].iov_base = (void *)"\n";
+	iov[1].iov_len = 1;
+
+	do {
+		written = writev (std_in, iov, 2);
+	} while (written < 0 && errno == EINTR);
+
+	if (written < 0) {
 		g_critical ("failed to send container state to hook: %s",
 				strerror (errno));
 		goto exit;
-	}
-
-	/* commit container state to stdin */
-	if (write(std_in, "\n", 1) < 0) {
-		g_critical ("failed to commit container state: %s",
-				strerror (errno));
+	} else if ((gsize)written != state_length + 1) {
+		g_critical ("failed to send container state to hook: "
+				"short write (%ld of %lu bytes)",
+				(long int)written,
+				(unsigned long int)state_length + 1);
 		goto exit;
 	}
 
+exit:
 	/* required to complete notification to hook */
-	close (std_in);
+	if (std_in != -1) close (std_in);
 
-	/* (re-)start the main loop and wait for the hook
-	 * to finish.
-	 */
-	g_main_loop_run(hook_loop);
-
-	/* check hook exit code */
-	if (hook_exit_code != 0) {
-		g_critical("hook process %d failed with exit code: %d",
-				(int)pid,
-				hook_exit_code);
-		goto exit;
+	g_free_if_set(args);
+	if (error) {
+		g_error_free(error);
 	}
 
-	g_debug ("hook process %d finished successfully", (int)pid);
+	return ret;
+}
 
-	result = true;
+/*!
+ * Check the result of a hook that has finished running.
+ *
+ * \param run \ref clr_oci_hook_run.
+ *
+ * \return \c true if the hook was successful, else \c false.
+ */
+static gboolean
+clr_oci_hook_check (const struct clr_oci_hook_run *run)
+{
+	g_assert (run);
 
-exit:
-	g_free_if_set(container_state);
-	g_free_if_set(args);
-	if (error) {
-		g_error_free(error);
+	if (! run->pid) {
+		/* failed to spawn */
+		return false;
 	}
 
-	if (std_out != -1) close (std_out);
-	if (std_err != -1) close (std_err);
+	if (run->timed_out) {
+		g_critical ("hook process %d killed after %.3fs "
+				"(timeout %ds)",
+				(int)run->pid,
+				(double)run->wall_time / G_USEC_PER_SEC,
+				run->hook->timeout);
+		return false;
+	}
 
-	return result;
+	if (run->exit_code != 0) {
+		g_critical("hook process %d failed after %.3fs "
+				"with exit code: %d",
+				(int)run->pid,
+				(double)run->wall_time / G_USEC_PER_SEC,
+				run->exit_code);
+		return false;
+	}
+
+	g_debug ("hook process %d ('%s') finished successfully in %.3fs",
+			(int)run->pid,
+			run->hook->path,
+			(double)run->wall_time / G_USEC_PER_SEC);
+
+	return true;
 }
 
 /*!
@@ -484,6 +884,7 @@ clr_oci_vm_launch (struct clr_oci_config *config)
 
 	ret = clr_oci_vm_args_get (config, &args);
 	if (! (ret && args)) {
+		clr_oci_vm_fds_close (config);
 		return ret;
 	}
 
@@ -548,6 +949,16 @@ clr_oci_vm_launch (struct clr_oci_config *config)
 		goto out;
 	}
 
+	/* The pid is stored in the state file, so record which
+	 * process it refers to in case it is later reused.
+	 */
+	if (! clr_oci_pid_start_time (pid,
+				&config->state.workload_start_time)) {
+		g_critical ("failed to determine start time of child %d",
+				(int)pid);
+		goto out;
+	}
+
 	g_debug ("child process ('%s') running in stopped state "
 			"with pid %u",
 		       	args[0],
@@ -561,6 +972,9 @@ clr_oci_vm_launch (struct clr_oci_config *config)
 	}
 
 out:
+	/* The hypervisor now owns the sockets */
+	clr_oci_vm_fds_close (config);
+
 	g_strfreev (args);
 
 	return ret;
@@ -569,27 +983,54 @@ out:
 /*!
  * Run hooks.
  *
+ * Hooks are run in order, each one being allowed to finish before the
+ * next is started, unless \p parallel is \c true in which case all the
+ * hooks are started immediately and run concurrently. Since the
+ * ordering of hooks matters when a failure must stop subsequent hooks
+ * from running, \p parallel is ignored if \p stop_on_failure is set.
+ *
+ * A hook that specifies a timeout is killed if it runs for longer than
+ * the timeout, which is considered a failure.
+ *
+ * The container state is passed to each hook on its standard input so
+ * that the hooks can get the information they need to do their work.
+ *
  * \param hooks \c GSList.
- * \param state_file_path Full path to state file.
+ * \param state Single-line container state
+ *   (see clr_oci_state_to_string()).
+ * \param state_length Length of \p state.
  * \param stop_on_failure Stop on error if \c true.
+ * \param parallel Run hooks concurrently if \c true.
  *
  * \return \c true on success, else \c false.
  */
 gboolean
-clr_run_hooks(GSList* hooks, const gchar* state_file_path,
-              gboolean stop_on_failure) {
+clr_run_hooks(GSList* hooks, const gchar* state, gsize state_length,
+              gboolean stop_on_failure, gboolean parallel) {
 	GSList* i = NULL;
-	struct oci_cfg_hook* hook = NULL;
-	gchar* container_state = NULL;
-	gsize length = 0;
-	GError* error = NULL;
+	struct clr_oci_hook_run* runs = NULL;
+	struct clr_oci_hook_run* run;
+	GMainLoop* hook_loop = NULL;
+	guint pending = 0;
+	guint count;
+	guint started = 0;
+	guint n;
 	gboolean result = false;
+	gint64 start_time;
 
 	/* no hooks */
 	if ((!hooks) || g_slist_length(hooks) == 0) {
 		return true;
 	}
 
+	if (! state) {
+		return false;
+	}
+
+	if (stop_on_failure) {
+		parallel = false;
+	}
+
 	/* create a new main loop */
 	hook_loop = g_main_loop_new(NULL, 0);
 	if (!hook_loop) {
@@ -597,191 +1038,133 @@ clr_run_hooks(GSList* hooks, const gchar* state_file_path,
 		return false;
 	}
 
-	/* The state of the container is passed to the hooks over stdin,
-	 * so the hooks could get the information they need to do their
-	 * work.
-	 */
-	if (! g_file_get_contents(state_file_path, &container_state,
-	        &length, &error)) {
-		g_critical ("failed to read state file: %s",
-		    error->message);
-		g_error_free(error);
-		goto exit;
+	count = g_slist_length (hooks);
+	runs = g_new0 (struct clr_oci_hook_run, count);
+
+	start_time = g_get_monotonic_time ();
+
+	result = true;
+
+	for (i = hooks, n = 0; i; i = g_slist_next (i), n++) {
+		run = &runs[n];
+
+		run->hook = (struct oci_cfg_hook*)i->data;
+		run->loop = hook_loop;
+		run->pending = &pending;
+
+		started++;
+
+		if (! clr_run_hook (run, state, state_length)) {
+			if (stop_on_failure) {
+				result = false;
+				break;
+			}
+		}
+
+		if (parallel) {
+			continue;
+		}
+
+		/* wait for the hook to finish */
+		if (pending) {
+			g_main_loop_run (hook_loop);
+		}
+
+		if (! clr_oci_hook_check (run)) {
+			result = false;
+			if (stop_on_failure) {
+				break;
+			}
+		}
 	}
 
-	for (i=g_slist_nth(hooks, 0); i; i=g_slist_next(i) ) {
-		hook = (struct oci_cfg_hook*)i->data;
-		if ((!clr_run_hook(hook, container_state, length)) && stop_on_failure) {
-			goto exit;
+	if (parallel) {
+		/* wait for all hooks to finish */
+		if (pending) {
+			g_main_loop_run (hook_loop);
+		}
+
+		for (n = 0; n < started; n++) {
+			if (! clr_oci_hook_check (&runs[n])) {
+				result = false;
+			}
 		}
 	}
 
-	result = true;
+	g_debug ("ran %u of %u hook%s in %.3fs (%s)",
+			started, count,
+			count == 1 ? "" : "s",
+			(double)(g_get_monotonic_time () - start_time)
+				/ G_USEC_PER_SEC,
+			parallel ? "concurrently" : "sequentially");
 
-exit:
-	g_free_if_set(container_state);
+	/* non-fatal hooks never cause a failure */
+	if (! stop_on_failure) {
+		result = true;
+	}
+
+	if (hook_log) {
+		g_string_free (hook_log, true);
+		hook_log = NULL;
+	}
+
+	g_free_if_set(runs);
 	g_main_loop_unref(hook_loop);
-	hook_loop = NULL;
 
 	return result;
 }
 
 /*!
- * Create a connection to the VM, run a command and disconnect.
+ * Run a command in the VM using its agent and wait for it to finish.
  *
  * \param config \ref clr_oci_config.
+ * \param cid vsock context ID of the VM.
  * \param argc Argument count.
  * \param argv Argument vector.
+ * \param[out] exit_code Exit status of the command (\c EXIT_FAILURE
+ *   if the agent reported one a process cannot exit with).
  *
- * \return \c true on success, else \c false.
+ * \return \c true if the command was run, else \c false.
  */
 gboolean
 clr_oci_vm_connect (struct clr_oci_config *config,
+		guint32 cid,
 		int argc,
-		char *const argv[]) {
-	gchar     **args = NULL;
-	GError     *err = NULL;
-	gboolean    ret = false;
-	GPid        pid;
-	guint       args_len = 0;
-	gint        exit_code = -1;
-	gboolean    cmd_is_just_shell = false;
-	GSpawnFlags flags = (G_SPAWN_CHILD_INHERITS_STDIN |
-			     /* XXX: required for g_child_watch_add! */
-			     G_SPAWN_DO_NOT_REAP_CHILD |
-			     G_SPAWN_SEARCH_PATH);
-	guint i;
+		char *const argv[],
+		gint *exit_code) {
+	gboolean    terminal = false;
 
 	g_assert (config);
 	g_assert (argc);
 	g_assert (argv);
+	g_assert (exit_code);
 
-	/* Check if the user has specified a shell to run.
+	/* An interactive shell needs a terminal.
 	 *
 	 * FIXME: This is a pragmatic (but potentially unreliable) solution
 	 * FIXME:   if the user wants to run an unknown shell.
 	 */
-	if (clr_oci_cmd_is_shell (argv[0])) {
-		cmd_is_just_shell = true;
-	}
-
-	/* The user wants to run an interactive shell.
-	 * However, this is the default with ssh if no command is
-	 * specified.
-	 *
-	 * If a shell is passed as the 1st arg, ssh gets
-	 * confused as it's expecting to run a non-interactive command,
-	 * so simply remove it to get the behaviour the user wants.
-	 *
-	 * An extra check is performed to ensure that the argument after
-	 * the shell is not an option to ensure that commands like:
-	 * "bash -c ..." still work as expected.
-	 */
-	if (argv[1] && argv[1][0] == '-') {
-		cmd_is_just_shell = false;
-	}
-
-	/* Just a shell, so remove the argument to get the expected
-	 * behavior of an interactive shell.
-	 */
-	if (cmd_is_just_shell) {
-		argc--;
-		argv++;
-	}
-
-	args_len = (guint)argc;
-
-	/* +2 for CLR_OCI_EXEC_CMD + hostname to connect to */
-	args_len += 2;
-
-	/* +1 for NULL terminator */
-	args = g_new0 (gchar *, args_len + 1);
-	if (! args) {
-		return false;
-	}
-
-	/* The command to use to connect to the VM */
-	args[0] = g_strdup (CLR_OCI_EXEC_CMD);
-	if (! args[0]) {
-		ret = false;
-		goto out;
-	}
-
-	/* connection string to connect to the VM */
-	// FIXME: replace with proper connection string once networking details available.
-#if 0
-	args[1] = g_strdup_printf (ip_address);
-#else
-	g_critical ("not implemented yet");
-	ret = false;
-	goto out;
-#endif
-
-	/* append argv to the end of args */
-	if (argc) {
-		for (i = 0; i < args_len; ++i) {
-			args[i+2] = g_strdup (argv[i]);
-		}
+	if (argc == 1 && clr_oci_cmd_is_shell (argv[0])
+			&& isatty (STDIN_FILENO)) {
+		terminal = true;
 	}
 
 	g_debug ("running command:");
-	for (gchar** p = args; p && *p; p++) {
-		g_debug ("arg: '%s'", *p);
-	}
-
-	/* create a new main loop */
-	main_loop = g_main_loop_new (NULL, 0);
-	if (! main_loop) {
-		g_critical ("cannot create main loop for client");
-		goto out;
-	}
-
-	ret = g_spawn_async_with_pipes (NULL, /* working directory */
-			args,
-			NULL, /* inherit parents environment */
-			flags,
-			(GSpawnChildSetupFunc)clr_oci_close_fds,
-			NULL, /* user_data */
-			&pid,
-			NULL, /* standard_input */
-			NULL, /* standard_output */
-			NULL, /* standard_error */
-			&err);
-
-	if (! ret) {
-		g_critical ("failed to spawn child process (%s): %s",
-				args[0], err->message);
-		g_error_free (err);
-		goto out;
+	for (int i = 0; i < argc; i++) {
+		g_debug ("arg: '%s'", argv[i]);
 	}
 
-	g_debug ("child process ('%s') running with pid %u",
-			args[0], (unsigned)pid);
-
-	g_child_watch_add (pid, clr_oci_child_watcher, &exit_code);
-
-	/* wait for child to finish */
-	g_main_loop_run (main_loop);
-
-	g_debug ("child pid %u exited with code %d",
-			(unsigned )pid, (int)exit_code);
-
-	if (exit_code) {
-		/* failed */
-		goto out;
+	if (! clr_oci_agent_exec (config, cid, argc, argv,
+				terminal, exit_code)) {
+		g_critical ("failed to connect to VM");
+		return false;
 	}
 
-	ret = true;
-
-out:
-	if (args) {
-		g_strfreev (args);
-	}
+	g_debug ("command exited with code %d", (int)*exit_code);
 
-	if (main_loop) {
-		g_main_loop_unref (main_loop);
-		main_loop = NULL;
+	if (*exit_code < 0 || *exit_code > 255) {
+		*exit_code = EXIT_FAILURE;
 	}
 
-	return ret;
+	return true;
 }
@@ -23,10 +23,11 @@
 
 gboolean clr_oci_vm_launch (struct clr_oci_config *config);
 
-gboolean clr_run_hooks(GSList* hooks, const gchar* state_file_path,
-                       gboolean stop_on_failure);
+gboolean clr_run_hooks(GSList* hooks, const gchar* state, gsize state_length,
+                       gboolean stop_on_failure, gboolean parallel);
 
 gboolean clr_oci_vm_connect (struct clr_oci_config *config,
-		int argc, char *const argv[]);
+		guint32 cid, int argc, char *const argv[],
+		gint *exit_code);
 
 #endif /* _CLR_OCI_PROCESS_H */
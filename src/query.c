@@ -0,0 +1,473 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Queries answered by the guest.
+ *
+ * Each VM has a virtio-serial port named \ref CLR_OCI_QUERY_PORT_NAME
+ * which is connected to \ref CLR_OCI_GUEST_QUERY_SOCKET on the host.
+ * Unlike \c exec (see agent.c), answering a query does not require a
+ * new process to be started in the VM.
+ *
+ * Messages are single lines of JSON. A request has the form:
+ *
+ *     {"execute": "ps", "arguments": {...}, "id": n}
+ *
+ * and the reply is either {"return": ..., "id": n} or
+ * {"error": {"desc": "..."}, "id": n}. Replies with a different id
+ * (to an earlier request that timed out) are ignored.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <json-glib/json-glib.h>
+
+#include "common.h"
+#include "util.h"
+#include "query.h"
+
+/** Size of the buffer used to receive replies. */
+#define CLR_OCI_QUERY_BUF_SIZE 4096
+
+/*!
+ * Create a request to send to the guest.
+ *
+ * \param command Name of query.
+ * \param arguments Arguments for \p command (may be \c NULL).
+ * \param id Identifier of the request.
+ *
+ * \return Newly-allocated single-line JSON string on success,
+ * else \c NULL.
+ */
+private gchar *
+clr_oci_query_request (const gchar *command, JsonObject *arguments,
+		guint32 id)
+{
+	JsonObject  *request;
+	gchar       *str;
+
+	if (! command) {
+		return NULL;
+	}
+
+	request = json_object_new ();
+
+	json_object_set_string_member (request, "execute", command);
+
+	if (arguments) {
+		json_object_set_object_member (request, "arguments",
+				json_object_ref (arguments));
+	}
+
+	json_object_set_int_member (request, "id", id);
+
+	str = clr_oci_json_obj_to_string (request, false, NULL);
+
+	json_object_unref (request);
+
+	return str;
+}
+
+/*!
+ * Parse a reply from the guest.
+ *
+ * \param line Single line of JSON.
+ * \param id Identifier of the request being waited for.
+ * \param[out] result Newly-allocated result of the query, or \c NULL
+ *   if \p line is a reply to a different request.
+ *
+ * \return \c true on success, or \c false if \p line is invalid or
+ * the query failed.
+ */
+private gboolean
+clr_oci_query_reply_parse (const gchar *line, guint32 id,
+		JsonNode **result)
+{
+	JsonParser  *parser;
+	JsonNode    *root;
+	JsonObject  *obj;
+	JsonObject  *error_obj;
+	GError      *error = NULL;
+	gboolean     ret = false;
+
+	if (! (line && result)) {
+		return false;
+	}
+
+	*result = NULL;
+
+	parser = json_parser_new ();
+
+	if (! json_parser_load_from_data (parser, line, -1, &error)) {
+		g_critical ("invalid reply from guest: %s", error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	root = json_parser_get_root (parser);
+	if (! (root && JSON_NODE_HOLDS_OBJECT (root))) {
+		g_critical ("invalid reply from guest");
+		goto out;
+	}
+
+	obj = json_node_get_object (root);
+
+	if (! json_object_has_member (obj, "id")
+			|| json_object_get_int_member (obj, "id") != id) {
+		g_debug ("ignoring reply to earlier query: %s", line);
+		ret = true;
+		goto out;
+	}
+
+	if (json_object_has_member (obj, "error")) {
+		error_obj = json_object_get_object_member (obj, "error");
+		g_critical ("guest query failed: %s",
+				error_obj && json_object_has_member (error_obj,
+					"desc")
+				? json_object_get_string_member (error_obj,
+					"desc")
+				: "unknown error");
+		goto out;
+	}
+
+	if (! json_object_has_member (obj, "return")) {
+		g_critical ("no result in reply from guest");
+		goto out;
+	}
+
+	*result = json_node_copy (json_object_get_member (obj, "return"));
+
+	ret = true;
+
+out:
+	g_object_unref (parser);
+
+	return ret;
+}
+
+/*!
+ * Send a query to the guest and wait for the reply.
+ *
+ * \param socket_path Path to \ref CLR_OCI_GUEST_QUERY_SOCKET.
+ * \param command Name of query.
+ * \param arguments Arguments for \p command (may be \c NULL).
+ * \param[out] result Newly-allocated result of the query.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_query (const gchar *socket_path, const gchar *command,
+		JsonObject *arguments, JsonNode **result)
+{
+	GSocketAddress    *addr = NULL;
+	GSocket           *socket = NULL;
+	GError            *error = NULL;
+	GString           *received = NULL;
+	g_autofree gchar  *request = NULL;
+	gchar              buffer[CLR_OCI_QUERY_BUF_SIZE];
+	gchar             *line;
+	gchar             *p;
+	gsize              len;
+	gsize              sent = 0;
+	gssize             bytes;
+	guint32            id;
+	gboolean           ret = false;
+
+	if (! (socket_path && command && result)) {
+		return false;
+	}
+
+	*result = NULL;
+
+	id = g_random_int ();
+
+	request = clr_oci_query_request (command, arguments, id);
+	if (! request) {
+		return false;
+	}
+
+	/* The guest reads a line at a time */
+	line = g_strconcat (request, "\n", NULL);
+	g_free (request);
+	request = line;
+	len = strlen (request);
+
+	addr = g_unix_socket_address_new (socket_path);
+
+	socket = g_socket_new (G_SOCKET_FAMILY_UNIX,
+			G_SOCKET_TYPE_STREAM,
+			G_SOCKET_PROTOCOL_DEFAULT, &error);
+	if (! socket) {
+		g_critical ("failed to create socket: %s", error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	/* The hypervisor accepts connections whether or not anything in
+	 * the guest has opened the port, so never wait indefinitely.
+	 */
+	g_socket_set_timeout (socket, CLR_OCI_QUERY_TIMEOUT);
+
+	if (! g_socket_connect (socket, addr, NULL, &error)) {
+		g_critical ("failed to connect to %s: %s",
+				socket_path, error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	while (sent < len) {
+		bytes = g_socket_send (socket, request + sent,
+				len - sent, NULL, &error);
+		if (bytes < 0) {
+			g_critical ("failed to send query: %s",
+					error->message);
+			g_error_free (error);
+			goto out;
+		}
+
+		sent += (gsize)bytes;
+	}
+
+	received = g_string_new ("");
+
+	while (! *result) {
+		p = strchr (received->str, '\n');
+		if (p) {
+			line = g_strndup (received->str,
+					(gsize)(p - received->str));
+			g_string_erase (received, 0,
+					(p - received->str) + 1);
+
+			ret = clr_oci_query_reply_parse (line, id, result);
+			g_free (line);
+			if (! ret) {
+				goto out;
+			}
+
+			continue;
+		}
+
+		if (received->len > CLR_OCI_QUERY_MAX_REPLY) {
+			g_critical ("reply from guest too large");
+			ret = false;
+			goto out;
+		}
+
+		bytes = g_socket_receive (socket, buffer, sizeof (buffer),
+				NULL, &error);
+		if (bytes <= 0) {
+			if (bytes < 0 && g_error_matches (error,
+						G_IO_ERROR,
+						G_IO_ERROR_TIMED_OUT)) {
+				g_critical ("no reply from guest "
+						"(is the query service "
+						"running in the VM?)");
+			} else {
+				g_critical ("failed to receive reply: %s",
+						error ? error->message
+						: "connection closed");
+			}
+			g_clear_error (&error);
+			ret = false;
+			goto out;
+		}
+
+		g_string_append_len (received, buffer, bytes);
+	}
+
+	ret = true;
+
+out:
+	if (received) {
+		g_string_free (received, true);
+	}
+	if (socket) {
+		g_object_unref (socket);
+	}
+	if (addr) {
+		g_object_unref (addr);
+	}
+
+	return ret;
+}
+
+/*!
+ * Format the process table returned by the guest for the \c ps query.
+ *
+ * The result must be an object of the form:
+ *
+ *     {"titles": ["UID", "PID", ...], "processes": [["root", "1", ...], ...]}
+ *
+ * \param result Result of the \c ps query.
+ * \param json If \c true, produce a JSON array of process IDs (as
+ *   runc does), else a table.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+gchar *
+clr_oci_ps_format (JsonNode *result, gboolean json)
+{
+	JsonObject  *obj;
+	JsonArray   *titles;
+	JsonArray   *processes;
+	JsonArray   *process;
+	JsonArray   *pids = NULL;
+	GString     *out = NULL;
+	gsize       *widths = NULL;
+	const gchar *field;
+	guint        columns;
+	guint        pid_column;
+	guint        i;
+	guint        j;
+	gint64       pid;
+	gchar       *end;
+	gchar       *str;
+
+	if (! (result && JSON_NODE_HOLDS_OBJECT (result))) {
+		goto err;
+	}
+
+	obj = json_node_get_object (result);
+
+	if (! (json_object_has_member (obj, "titles")
+				&& json_object_has_member (obj,
+					"processes"))) {
+		goto err;
+	}
+
+	titles = json_object_get_array_member (obj, "titles");
+	processes = json_object_get_array_member (obj, "processes");
+	if (! (titles && processes)) {
+		goto err;
+	}
+
+	columns = json_array_get_length (titles);
+	if (! columns) {
+		goto err;
+	}
+
+	pid_column = columns;
+	widths = g_new0 (gsize, columns);
+
+	for (i = 0; i < columns; i++) {
+		field = json_array_get_string_element (titles, i);
+		if (! field) {
+			goto err;
+		}
+
+		if (! g_strcmp0 (field, "PID")) {
+			pid_column = i;
+		}
+
+		widths[i] = strlen (field);
+	}
+
+	for (i = 0; i < json_array_get_length (processes); i++) {
+		process = json_array_get_array_element (processes, i);
+		if (! (process
+				&& json_array_get_length (process) == columns)) {
+			goto err;
+		}
+
+		for (j = 0; j < columns; j++) {
+			field = json_array_get_string_element (process, j);
+			if (! field) {
+				goto err;
+			}
+
+			widths[j] = MAX (widths[j], strlen (field));
+		}
+	}
+
+	if (json) {
+		if (pid_column == columns) {
+			g_critical ("no PID column in process table");
+			goto err_free;
+		}
+
+		pids = json_array_new ();
+
+		for (i = 0; i < json_array_get_length (processes); i++) {
+			process = json_array_get_array_element (processes, i);
+			field = json_array_get_string_element (process,
+					pid_column);
+
+			pid = g_ascii_strtoll (field, &end, 10);
+			if (*end || end == field) {
+				goto err;
+			}
+
+			json_array_add_int_element (pids, pid);
+		}
+
+		g_free (widths);
+
+		str = clr_oci_json_arr_to_string (pids, false);
+		json_array_unref (pids);
+
+		return str;
+	}
+
+	out = g_string_new ("");
+
+	for (i = 0; i <= json_array_get_length (processes); i++) {
+		/* the first line holds the titles */
+		process = i ? json_array_get_array_element (processes, i - 1)
+			: titles;
+
+		for (j = 0; j < columns; j++) {
+			field = json_array_get_string_element (process, j);
+
+			/* the last column (normally the command) is not
+			 * padded since it may contain spaces.
+			 */
+			if (j + 1 < columns) {
+				g_string_append_printf (out, "%-*s ",
+						(int)widths[j], field);
+			} else {
+				g_string_append_printf (out, "%s\n", field);
+			}
+		}
+	}
+
+	g_free (widths);
+
+	return g_string_free (out, false);
+
+err:
+	g_critical ("invalid process table from guest");
+
+err_free:
+	g_free_if_set (widths);
+	if (pids) {
+		json_array_unref (pids);
+	}
+	if (out) {
+		g_string_free (out, true);
+	}
+
+	return NULL;
+}
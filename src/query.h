@@ -0,0 +1,42 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_QUERY_H
+#define _CLR_OCI_QUERY_H
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+/** Name of the virtio-serial port the guest answers queries on
+ * (available as /dev/virtio-ports/<name> inside the VM).
+ */
+#define CLR_OCI_QUERY_PORT_NAME "org.clearlinux.clr-oci.query"
+
+/** Number of seconds to wait for the guest to answer a query. */
+#define CLR_OCI_QUERY_TIMEOUT 5
+
+/** Maximum size of a reply from the guest. */
+#define CLR_OCI_QUERY_MAX_REPLY (1024 * 1024)
+
+gboolean clr_oci_query (const gchar *socket_path, const gchar *command,
+		JsonObject *arguments, JsonNode **result);
+gchar *clr_oci_ps_format (JsonNode *result, gboolean json);
+
+#endif /* _CLR_OCI_QUERY_H */
@@ -0,0 +1,483 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Reclaiming memory from idle containers.
+ *
+ * A VM keeps all of its guest RAM resident, even while the container
+ * is idle. Two mechanisms give memory back to the host:
+ *
+ * - Identical pages of guest RAM (for example the guest OS of many
+ *   containers) can be merged by the kernel (KSM). This requires
+ *   guest RAM to be private anonymous memory.
+ * - While statistics of a container are being sampled (see
+ *   show_container_stats()), its balloon is inflated step by step
+ *   once the VM has been idle for a while, and deflated again as
+ *   soon as the VM is busy, the guest runs short of memory or
+ *   sampling stops.
+ *
+ * The memory reclaimed is recorded in \ref CLR_OCI_RECLAIM_FILE, so
+ * that it is known to every process sampling the statistics and can
+ * be given back by a later process if the one that reclaimed it
+ * died.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include "common.h"
+#include "oci.h"
+#include "annotation.h"
+#include "hypervisor.h"
+#include "network.h"
+#include "reclaim.h"
+
+/*!
+ * Determine if identical pages of guest RAM should be merged.
+ *
+ * The annotation \ref CLR_OCI_ANNOTATION_MEMORY_MERGE overrides the
+ * \c vm configuration.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true if pages should be merged, else \c false.
+ */
+gboolean
+clr_oci_memory_merge_get (const struct clr_oci_config *config)
+{
+	gboolean merge;
+
+	if (! config) {
+		return false;
+	}
+
+	if (clr_oci_annotation_bool_get (config->oci.annotations,
+				CLR_OCI_ANNOTATION_MEMORY_MERGE, &merge)) {
+		return merge;
+	}
+
+	return config->vm ? config->vm->memory_merge : false;
+}
+
+/*!
+ * Determine if memory should be reclaimed from the VM while its
+ * statistics are sampled.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true if memory should be reclaimed, else \c false.
+ */
+gboolean
+clr_oci_memory_reclaim_get (const struct clr_oci_config *config)
+{
+	gboolean reclaim;
+
+	if (! config) {
+		return false;
+	}
+
+	if (clr_oci_annotation_bool_get (config->oci.annotations,
+				CLR_OCI_ANNOTATION_MEMORY_RECLAIM, &reclaim)) {
+		return reclaim;
+	}
+
+	return false;
+}
+
+/*!
+ * Read the memory reclaimed from \ref CLR_OCI_RECLAIM_FILE.
+ *
+ * \param reclaim \ref clr_oci_reclaim.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_reclaim_load (struct clr_oci_reclaim *reclaim)
+{
+	gchar    buffer[32] = { 0 };
+	gchar   *end = NULL;
+	ssize_t  len;
+
+	if (reclaim->fd < 0) {
+		return true;
+	}
+
+	len = pread (reclaim->fd, buffer, sizeof (buffer) - 1, 0);
+	if (len < 0) {
+		return false;
+	}
+
+	if (! len) {
+		/* nothing reclaimed yet */
+		reclaim->reclaimed = 0;
+		return true;
+	}
+
+	reclaim->reclaimed = g_ascii_strtoull (g_strstrip (buffer),
+			&end, 10);
+
+	return ! *end;
+}
+
+/*!
+ * Record the memory reclaimed in \ref CLR_OCI_RECLAIM_FILE.
+ *
+ * \param reclaim \ref clr_oci_reclaim.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_reclaim_store (struct clr_oci_reclaim *reclaim)
+{
+	gchar  buffer[32];
+	int    len;
+
+	if (reclaim->fd < 0) {
+		return true;
+	}
+
+	/* Always the same length, so that the file never needs to
+	 * be truncated and is never seen partially written.
+	 */
+	len = g_snprintf (buffer, sizeof (buffer), "%020lu\n",
+			(unsigned long int)reclaim->reclaimed);
+
+	return pwrite (reclaim->fd, buffer, (size_t)len, 0) == len;
+}
+
+/*!
+ * Create a \ref clr_oci_reclaim for a container.
+ *
+ * Only the first process to call this for a container reclaims
+ * memory from its VM, until that process calls
+ * clr_oci_reclaim_free(). Memory left reclaimed by a process that
+ * died is given back once the VM is busy again.
+ *
+ * \param runtime_path Runtime directory of the container.
+ * \param interval Seconds between samples.
+ *
+ * \return Newly-allocated \ref clr_oci_reclaim on success, else
+ *   \c NULL.
+ */
+struct clr_oci_reclaim *
+clr_oci_reclaim_new (const gchar *runtime_path, gint interval)
+{
+	g_autofree gchar        *path = NULL;
+	struct clr_oci_reclaim  *reclaim;
+
+	if (! (runtime_path && interval > 0)) {
+		return NULL;
+	}
+
+	path = g_build_path ("/", runtime_path, CLR_OCI_RECLAIM_FILE,
+			NULL);
+
+	reclaim = g_new0 (struct clr_oci_reclaim, 1);
+	reclaim->interval = interval;
+
+	reclaim->fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (reclaim->fd < 0) {
+		g_critical ("failed to open %s: %s", path,
+				strerror (errno));
+		goto err;
+	}
+
+	if (flock (reclaim->fd, LOCK_EX | LOCK_NB) == 0) {
+		reclaim->owner = true;
+	} else if (errno != EWOULDBLOCK) {
+		g_critical ("failed to lock %s: %s", path,
+				strerror (errno));
+		goto err;
+	} else {
+		g_debug ("memory is already being reclaimed by "
+				"another process");
+	}
+
+	if (! clr_oci_reclaim_load (reclaim)) {
+		g_critical ("invalid %s", path);
+		goto err;
+	}
+
+	return reclaim;
+
+err:
+	clr_oci_reclaim_free (reclaim);
+
+	return NULL;
+}
+
+/*!
+ * Free the specified \ref clr_oci_reclaim, allowing another process
+ * to reclaim memory from the VM.
+ *
+ * \param reclaim \ref clr_oci_reclaim.
+ */
+void
+clr_oci_reclaim_free (struct clr_oci_reclaim *reclaim)
+{
+	if (! reclaim) {
+		return;
+	}
+
+	if (reclaim->fd >= 0) {
+		close (reclaim->fd);
+	}
+
+	g_free (reclaim);
+}
+
+/*!
+ * Decide how much memory the guest should be left with.
+ *
+ * Memory is reclaimed in steps of \ref CLR_OCI_RECLAIM_STEP once
+ * the VM has been idle for \ref CLR_OCI_RECLAIM_IDLE_SAMPLES samples,
+ * provided the guest is left with \ref CLR_OCI_RECLAIM_HEADROOM
+ * available. All of the reclaimed memory is given back as soon as
+ * the VM is busy or the guest is short of memory.
+ *
+ * \param reclaim \ref clr_oci_reclaim.
+ * \param vcpu_time Total time (in nanoseconds) spent running vCPUs.
+ * \param actual Memory (in bytes) currently available to the guest
+ *   (the size of the balloon).
+ * \param available Memory (in bytes) the guest reports as available,
+ *   or \c -1 if unknown.
+ *
+ * \return New balloon target (in bytes), or \c 0 to leave the balloon
+ *   unchanged.
+ */
+guint64
+clr_oci_reclaim_target (struct clr_oci_reclaim *reclaim,
+		guint64 vcpu_time, guint64 actual, gint64 available)
+{
+	guint64   busy_time;
+	guint64   step;
+	guint64   target;
+	gboolean  busy = true;
+
+	if (! (reclaim && actual)) {
+		return 0;
+	}
+
+	if (reclaim->sampled && vcpu_time >= reclaim->vcpu_time) {
+		busy_time = (guint64)reclaim->interval * 1000000000ULL
+			* CLR_OCI_RECLAIM_IDLE_USAGE / 100;
+		busy = vcpu_time - reclaim->vcpu_time > busy_time;
+	}
+
+	reclaim->vcpu_time = vcpu_time;
+	reclaim->sampled = true;
+
+	reclaim->idle_samples = busy ? 0 : reclaim->idle_samples + 1;
+
+	if (busy || (available >= 0
+				&& available < CLR_OCI_RECLAIM_PRESSURE)) {
+		if (! reclaim->reclaimed) {
+			return 0;
+		}
+
+		target = actual + reclaim->reclaimed;
+		reclaim->reclaimed = 0;
+
+		return target;
+	}
+
+	/* Without guest statistics, pressure cannot be detected */
+	if (available < 0
+			|| reclaim->idle_samples < CLR_OCI_RECLAIM_IDLE_SAMPLES
+			|| (guint64)available <= CLR_OCI_RECLAIM_HEADROOM) {
+		return 0;
+	}
+
+	step = MIN ((guint64)available - CLR_OCI_RECLAIM_HEADROOM,
+			CLR_OCI_RECLAIM_STEP);
+
+	if (actual < step + (CLR_OCI_VM_MEMORY_MIN * 1024 * 1024)) {
+		return 0;
+	}
+
+	reclaim->reclaimed += step;
+
+	return actual - step;
+}
+
+/*!
+ * Apply the memory reclamation policy to a sample of the resource
+ * usage of a VM.
+ *
+ * The memory currently reclaimed is added to the memory statistics
+ * of the sample as "reclaimed". If another process is reclaiming
+ * memory from the VM, this is all that is done.
+ *
+ * \param reclaim \ref clr_oci_reclaim.
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param resources Sample returned by clr_oci_stats_sample().
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_reclaim_sample (struct clr_oci_reclaim *reclaim,
+		const gchar *socket_path, GPid pid, JsonObject *resources)
+{
+	JsonObject  *cpu_usage = NULL;
+	JsonObject  *memory_stats;
+	JsonObject  *stats = NULL;
+	JsonArray   *percpu;
+	guint64      vcpu_time = 0;
+	guint64      actual;
+	guint64      target;
+	guint64      reclaimed;
+	gint64       available = -1;
+	guint        i;
+
+	if (! (reclaim && socket_path && pid && resources)) {
+		return false;
+	}
+
+	if (json_object_has_member (resources, "cpu_stats")) {
+		cpu_usage = json_object_get_object_member
+			(json_object_get_object_member (resources,
+				"cpu_stats"), "cpu_usage");
+	}
+
+	if (json_object_has_member (resources, "memory_stats")) {
+		memory_stats = json_object_get_object_member (resources,
+				"memory_stats");
+		stats = json_object_get_object_member (memory_stats,
+				"stats");
+	}
+
+	if (! (cpu_usage && stats)) {
+		return false;
+	}
+
+	/* The VM has no balloon device */
+	if (! json_object_has_member (stats, "balloon_actual")) {
+		return true;
+	}
+
+	actual = (guint64)json_object_get_int_member (stats,
+			"balloon_actual");
+
+	if (json_object_has_member (cpu_usage, "percpu_usage")) {
+		percpu = json_object_get_array_member (cpu_usage,
+				"percpu_usage");
+		for (i = 0; i < json_array_get_length (percpu); i++) {
+			vcpu_time += (guint64)json_array_get_int_element
+				(percpu, i);
+		}
+	}
+
+	/* another process decides how much to reclaim */
+	if (! reclaim->owner) {
+		if (! clr_oci_reclaim_load (reclaim)) {
+			return false;
+		}
+
+		json_object_set_int_member (stats, "reclaimed",
+				(gint64)reclaim->reclaimed);
+
+		return true;
+	}
+
+	if (json_object_has_member (stats, "guest_available_memory")) {
+		available = json_object_get_int_member (stats,
+				"guest_available_memory");
+	} else if (json_object_has_member (stats, "guest_free_memory")) {
+		available = json_object_get_int_member (stats,
+				"guest_free_memory");
+	}
+
+	reclaimed = reclaim->reclaimed;
+
+	target = clr_oci_reclaim_target (reclaim, vcpu_time, actual,
+			available);
+	if (target) {
+		g_debug ("setting balloon target to %lu bytes "
+				"(%lu bytes reclaimed)",
+				(unsigned long int)target,
+				(unsigned long int)reclaim->reclaimed);
+
+		if (! clr_oci_vm_balloon (socket_path, pid, target)) {
+			reclaim->reclaimed = reclaimed;
+			return false;
+		}
+
+		if (! clr_oci_reclaim_store (reclaim)) {
+			g_warning ("failed to record reclaimed memory: %s",
+					strerror (errno));
+		}
+	}
+
+	json_object_set_int_member (stats, "reclaimed",
+			(gint64)reclaim->reclaimed);
+
+	return true;
+}
+
+/*!
+ * Give back all of the memory reclaimed from the VM, once sampling
+ * stops.
+ *
+ * \param reclaim \ref clr_oci_reclaim.
+ * \param socket_path Path to \ref CLR_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_reclaim_stop (struct clr_oci_reclaim *reclaim,
+		const gchar *socket_path, GPid pid)
+{
+	guint64 actual;
+
+	if (! (reclaim && socket_path && pid)) {
+		return false;
+	}
+
+	if (! (reclaim->owner && reclaim->reclaimed)) {
+		return true;
+	}
+
+	if (! clr_oci_vm_balloon_get (socket_path, pid, &actual)) {
+		return false;
+	}
+
+	if (! clr_oci_vm_balloon (socket_path, pid,
+				actual + reclaim->reclaimed)) {
+		return false;
+	}
+
+	g_debug ("gave back %lu bytes of reclaimed memory",
+			(unsigned long int)reclaim->reclaimed);
+
+	reclaim->reclaimed = 0;
+
+	return clr_oci_reclaim_store (reclaim);
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_RECLAIM_H
+#define _CLR_OCI_RECLAIM_H
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include "oci.h"
+
+/** Annotation used to merge identical pages of guest RAM ("true" or
+ * "false"), overriding the \c vm configuration.
+ */
+#define CLR_OCI_ANNOTATION_MEMORY_MERGE "com.intel.clr.memory.merge"
+
+/** Annotation used to reclaim memory from the VM while it is idle
+ * ("true" or "false") whenever its statistics are sampled.
+ */
+#define CLR_OCI_ANNOTATION_MEMORY_RECLAIM "com.intel.clr.memory.reclaim"
+
+/** vCPU usage (as a percentage of one CPU) below which a VM is
+ * considered idle.
+ */
+#define CLR_OCI_RECLAIM_IDLE_USAGE 5
+
+/** Number of consecutive idle samples before memory is reclaimed. */
+#define CLR_OCI_RECLAIM_IDLE_SAMPLES 3
+
+/** Memory (in bytes) reclaimed from an idle VM per sample. */
+#define CLR_OCI_RECLAIM_STEP (128 * 1024 * 1024)
+
+/** Memory (in bytes) that is always left available to the guest. */
+#define CLR_OCI_RECLAIM_HEADROOM (256 * 1024 * 1024)
+
+/** If less memory (in bytes) than this is available to the guest,
+ * all reclaimed memory is given back.
+ */
+#define CLR_OCI_RECLAIM_PRESSURE (128 * 1024 * 1024)
+
+/** File below the runtime directory recording the memory (in bytes)
+ * currently reclaimed from the VM. The process reclaiming memory
+ * holds an exclusive lock on it, so that only one process at a time
+ * inflates the balloon.
+ */
+#define CLR_OCI_RECLAIM_FILE "reclaimed"
+
+/** State of the memory reclamation policy of a VM. */
+struct clr_oci_reclaim {
+	/** Seconds between samples. */
+	gint      interval;
+
+	/** Open \ref CLR_OCI_RECLAIM_FILE (or \c -1 if the memory
+	 * reclaimed is not recorded).
+	 */
+	int       fd;
+
+	/** \c false if another process is reclaiming memory from the
+	 * VM, in which case the memory it has reclaimed is only
+	 * reported.
+	 */
+	gboolean  owner;
+
+	/** vCPU time (in nanoseconds) at the previous sample. */
+	guint64   vcpu_time;
+
+	/** \c true once \ref vcpu_time has been set. */
+	gboolean  sampled;
+
+	/** Number of consecutive samples the VM has been idle for. */
+	guint     idle_samples;
+
+	/** Memory (in bytes) currently reclaimed by the balloon. */
+	guint64   reclaimed;
+};
+
+gboolean clr_oci_memory_merge_get (const struct clr_oci_config *config);
+gboolean clr_oci_memory_reclaim_get (const struct clr_oci_config *config);
+struct clr_oci_reclaim *clr_oci_reclaim_new (const gchar *runtime_path,
+		gint interval);
+void clr_oci_reclaim_free (struct clr_oci_reclaim *reclaim);
+guint64 clr_oci_reclaim_target (struct clr_oci_reclaim *reclaim,
+		guint64 vcpu_time, guint64 actual, gint64 available);
+gboolean clr_oci_reclaim_sample (struct clr_oci_reclaim *reclaim,
+		const gchar *socket_path, GPid pid, JsonObject *resources);
+gboolean clr_oci_reclaim_stop (struct clr_oci_reclaim *reclaim,
+		const gchar *socket_path, GPid pid);
+
+#endif /* _CLR_OCI_RECLAIM_H */
@@ -0,0 +1,451 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Resizing of running containers.
+ *
+ * The resources of a container are those of its VM, so they are
+ * changed by hotplugging vCPUs and memory (see network.c). Limits are
+ * accepted in the same forms as runc: as options, or as a
+ * "linux.resources" JSON object.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include "common.h"
+#include "oci.h"
+#include "util.h"
+#include "state.h"
+#include "network.h"
+#include "resources.h"
+#include "placement.h"
+#include "autopause.h"
+
+/*!
+ * Convert a CPU limit into a number of vCPUs.
+ *
+ * Fractional limits are rounded up, since a VM cannot have part of
+ * a vCPU.
+ *
+ * \param str Number of CPUs (for example "2" or "1.5").
+ * \param[out] vcpus Number of vCPUs.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_resources_parse_cpus (const gchar *str, guint *vcpus)
+{
+	gchar    *end = NULL;
+	gdouble   value;
+
+	if (! (str && *str && vcpus)) {
+		return false;
+	}
+
+	value = g_ascii_strtod (str, &end);
+	if (*end || value <= 0 || value > G_MAXUINT) {
+		g_critical ("invalid number of CPUs: %s", str);
+		return false;
+	}
+
+	*vcpus = (guint)value;
+	if ((gdouble)*vcpus < value) {
+		(*vcpus)++;
+	}
+
+	return true;
+}
+
+/*!
+ * Convert a memory limit into bytes.
+ *
+ * \param str Amount of memory, optionally followed by a unit of
+ *   "b", "k", "m", "g" or "t" (which may itself be followed by "b",
+ *   as in "512mb").
+ * \param[out] bytes Amount of memory in bytes.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_resources_parse_memory (const gchar *str, guint64 *bytes)
+{
+	const gchar  *units = "bkmgt";
+	const gchar  *unit;
+	gchar        *end = NULL;
+	guint64       value;
+	guint64       multiplier = 1;
+
+	if (! (str && *str && bytes)) {
+		return false;
+	}
+
+	if (! g_ascii_isdigit (*str)) {
+		goto err;
+	}
+
+	value = g_ascii_strtoull (str, &end, 10);
+
+	if (*end) {
+		unit = strchr (units, g_ascii_tolower (*end));
+		if (! unit) {
+			goto err;
+		}
+
+		multiplier <<= 10 * (unit - units);
+		end++;
+
+		if (unit != units && g_ascii_tolower (*end) == 'b') {
+			end++;
+		}
+
+		if (*end) {
+			goto err;
+		}
+	}
+
+	if (! value || value > G_MAXUINT64 / multiplier) {
+		goto err;
+	}
+
+	*bytes = value * multiplier;
+
+	return true;
+
+err:
+	g_critical ("invalid memory size: %s", str);
+	return false;
+}
+
+/*!
+ * Parse a cpuset list.
+ *
+ * \param cpuset List of CPUs or NUMA nodes (for example "0-3,6").
+ *
+ * \return Newly-allocated array of \c guint on success (in the order
+ * listed), else \c NULL.
+ */
+GArray *
+clr_oci_cpuset_parse (const gchar *cpuset)
+{
+	gchar   **ranges;
+	gchar   **range;
+	gchar    *end;
+	guint64   first;
+	guint64   last;
+	guint     cpu;
+	GArray   *cpus;
+
+	if (! (cpuset && *cpuset)) {
+		return NULL;
+	}
+
+	cpus = g_array_new (false, false, sizeof (guint));
+	ranges = g_strsplit (cpuset, ",", -1);
+
+	for (range = ranges; *range; range++) {
+		if (! g_ascii_isdigit (**range)) {
+			goto err;
+		}
+
+		first = last = g_ascii_strtoull (*range, &end, 10);
+
+		if (*end == '-') {
+			if (! g_ascii_isdigit (end[1])) {
+				goto err;
+			}
+			last = g_ascii_strtoull (end + 1, &end, 10);
+		}
+
+		if (*end || last < first || last > G_MAXUINT16) {
+			goto err;
+		}
+
+		for (cpu = (guint)first; cpu <= (guint)last; cpu++) {
+			g_array_append_val (cpus, cpu);
+		}
+	}
+
+	g_strfreev (ranges);
+
+	return cpus;
+
+err:
+	g_strfreev (ranges);
+	g_array_free (cpus, true);
+
+	return NULL;
+}
+
+/*!
+ * Count the CPUs in a cpuset list.
+ *
+ * \param cpuset List of CPUs (for example "0-3,6").
+ *
+ * \return Number of CPUs, or \c 0 if \p cpuset is invalid.
+ */
+private guint
+clr_oci_cpuset_count (const gchar *cpuset)
+{
+	GArray  *cpus;
+	guint    count;
+
+	cpus = clr_oci_cpuset_parse (cpuset);
+	if (! cpus) {
+		return 0;
+	}
+
+	count = cpus->len;
+	g_array_free (cpus, true);
+
+	return count;
+}
+
+/*!
+ * Determine the number of vCPUs from CPU limits.
+ *
+ * \param quota CPU time allowed per \p period (ignored if \c 0).
+ * \param period CPU scheduling period (ignored if \c 0).
+ * \param cpus List of CPUs (used if \p quota or \p period is not
+ *   set, ignored if \c NULL).
+ * \param[out] vcpus Number of vCPUs (unchanged if no limit is set).
+ *
+ * \return \c true on success, else \c false.
+ */
+private gboolean
+clr_oci_resources_vcpus (gint64 quota, gint64 period,
+		const gchar *cpus, guint *vcpus)
+{
+	guint count;
+
+	if (quota > 0 && period > 0) {
+		*vcpus = (guint)((quota + period - 1) / period);
+	} else if (cpus) {
+		count = clr_oci_cpuset_count (cpus);
+		if (! count) {
+			g_critical ("invalid cpuset: %s", cpus);
+			return false;
+		}
+
+		*vcpus = count;
+	}
+
+	return true;
+}
+
+/*!
+ * Parse a runc-style resources object.
+ *
+ * The "memory.limit" element determines the guest memory. The number
+ * of vCPUs is taken from "cpu.quota" and "cpu.period" if specified,
+ * else from the number of CPUs in "cpu.cpus".
+ *
+ * \param json "linux.resources" JSON object.
+ * \param len Length of \p json, or -1 if it is nul-terminated.
+ * \param[out] resources \ref clr_oci_vm_resources. Members are only
+ *   set for the limits specified in \p json.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_resources_parse_json (const gchar *json, gssize len,
+		struct clr_oci_vm_resources *resources)
+{
+	JsonParser  *parser = NULL;
+	JsonNode    *root;
+	JsonObject  *obj;
+	JsonObject  *memory;
+	JsonObject  *cpu;
+	GError      *error = NULL;
+	gint64       limit;
+	gint64       quota;
+	gint64       period;
+	const gchar *cpus;
+	gboolean     ret = false;
+
+	if (! (json && resources)) {
+		return false;
+	}
+
+	parser = json_parser_new ();
+
+	if (! json_parser_load_from_data (parser, json, len, &error)) {
+		g_critical ("failed to parse resources: %s", error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	root = json_parser_get_root (parser);
+	if (! (root && JSON_NODE_HOLDS_OBJECT (root))) {
+		g_critical ("resources must be a JSON object");
+		goto out;
+	}
+
+	obj = json_node_get_object (root);
+
+	if (json_object_has_member (obj, "memory")) {
+		memory = json_object_get_object_member (obj, "memory");
+
+		if (memory && json_object_has_member (memory, "limit")) {
+			limit = json_object_get_int_member (memory, "limit");
+			if (limit <= 0) {
+				g_critical ("invalid memory limit: %ld",
+						(long int)limit);
+				goto out;
+			}
+
+			resources->memory = (guint64)limit;
+		}
+	}
+
+	if (json_object_has_member (obj, "cpu")) {
+		cpu = json_object_get_object_member (obj, "cpu");
+
+		quota = cpu && json_object_has_member (cpu, "quota")
+			? json_object_get_int_member (cpu, "quota") : 0;
+		period = cpu && json_object_has_member (cpu, "period")
+			? json_object_get_int_member (cpu, "period") : 0;
+
+		cpus = cpu && json_object_has_member (cpu, "cpus")
+			? json_object_get_string_member (cpu, "cpus") : NULL;
+
+		if (! clr_oci_resources_vcpus (quota, period, cpus,
+					&resources->vcpus)) {
+			goto out;
+		}
+	}
+
+	ret = true;
+
+out:
+	g_object_unref (parser);
+
+	return ret;
+}
+
+/*!
+ * Determine the resources to create a VM with from the limits of
+ * its container.
+ *
+ * The guest memory is the memory limit, or the memory reservation if
+ * there is no limit. The number of vCPUs is determined as for
+ * clr_oci_resources_parse_json().
+ *
+ * \param limits \ref oci_cfg_resources.
+ * \param[out] resources \ref clr_oci_vm_resources. Members are only
+ *   set for the limits specified in \p limits.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_resources_from_limits (const struct oci_cfg_resources *limits,
+		struct clr_oci_vm_resources *resources)
+{
+	if (! (limits && resources)) {
+		return false;
+	}
+
+	if (limits->memory_limit > 0) {
+		resources->memory = (guint64)limits->memory_limit;
+	} else if (limits->memory_reservation > 0) {
+		resources->memory = (guint64)limits->memory_reservation;
+	}
+
+	return clr_oci_resources_vcpus (limits->cpu_quota,
+			limits->cpu_period, limits->cpu_cpus,
+			&resources->vcpus);
+}
+
+/*!
+ * Change the resources of a running container.
+ *
+ * The new limits are recorded in \ref CLR_OCI_STATE_FILE.
+ *
+ * \param config \ref clr_oci_config.
+ * \param state \ref oci_state.
+ * \param resources Resources to apply (members set to \c 0 are left
+ *   unchanged).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_resources_update (struct clr_oci_config *config,
+		struct oci_state *state,
+		const struct clr_oci_vm_resources *resources)
+{
+	gboolean ret = false;
+
+	if (! (config && state && resources)) {
+		return false;
+	}
+
+	/* a created container's hypervisor cannot answer QMP yet */
+	if (state->status == OCI_STATUS_CREATED
+			|| state->status == OCI_STATUS_STOPPED
+			|| state->status == OCI_STATUS_STOPPING) {
+		g_critical ("container %s is not running",
+				config->optarg_container_id);
+		return false;
+	}
+
+	/* new vCPUs must be onlined by the guest */
+	if (! clr_oci_autopause_wake (config, NULL)) {
+		return false;
+	}
+
+	if (resources->vcpus) {
+		if (! clr_oci_vm_set_vcpus (state->comms_path, state->pid,
+					resources->vcpus)) {
+			goto out;
+		}
+
+		config->state.resources.vcpus = resources->vcpus;
+
+		/* place any vCPUs that were added */
+		if (! clr_oci_vm_pin (config)) {
+			g_warning ("failed to pin vCPUs of container %s",
+					config->optarg_container_id);
+		}
+	}
+
+	if (resources->memory) {
+		if (! clr_oci_vm_set_memory (state->comms_path, state->pid,
+					resources->memory)) {
+			goto out;
+		}
+
+		config->state.resources.memory = resources->memory;
+	}
+
+	ret = true;
+
+out:
+	/* record whatever was applied, even on partial failure */
+	if (! clr_oci_state_file_create (config, state->create_time)) {
+		ret = false;
+	}
+
+	return ret;
+}
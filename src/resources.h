@@ -0,0 +1,41 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_RESOURCES_H
+#define _CLR_OCI_RESOURCES_H
+
+#include <glib.h>
+
+#include "oci.h"
+
+gboolean clr_oci_resources_parse_cpus (const gchar *str, guint *vcpus);
+gboolean clr_oci_resources_parse_memory (const gchar *str,
+		guint64 *bytes);
+GArray *clr_oci_cpuset_parse (const gchar *cpuset);
+gboolean clr_oci_resources_parse_json (const gchar *json, gssize len,
+		struct clr_oci_vm_resources *resources);
+gboolean clr_oci_resources_from_limits
+		(const struct oci_cfg_resources *limits,
+		struct clr_oci_vm_resources *resources);
+gboolean clr_oci_resources_update (struct clr_oci_config *config,
+		struct oci_state *state,
+		const struct clr_oci_vm_resources *resources);
+
+#endif /* _CLR_OCI_RESOURCES_H */
@@ -89,6 +89,12 @@ clr_oci_runtime_dir_setup (struct clr_oci_config *config)
 			config->state.runtime_path,
 			CLR_OCI_HYPERVISOR_SOCKET);
 
+	g_snprintf (config->state.events_path,
+			(gulong)sizeof (config->state.events_path),
+			"%s/%s",
+			config->state.runtime_path,
+			CLR_OCI_HYPERVISOR_EVENTS_SOCKET);
+
 	g_snprintf (config->state.procsock_path,
 			(gulong)sizeof (config->state.procsock_path),
 			"%s/%s",
@@ -32,6 +32,7 @@ extern struct spec_handler vm_spec_handler;
 extern struct spec_handler linux_spec_handler;
 
 static struct spec_handler* stop_spec_handlers[] = {
+	&annotations_spec_handler,
 	&hooks_spec_handler,
 
 	/* terminator */
@@ -91,6 +91,100 @@ err:
 	current_ns = NULL;
 }
 
+/*!
+ * Convert a resource limit to a number.
+ *
+ * \param root Node containing the name of the limit.
+ * \param[out] value Limit (unchanged if the limit has no value).
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+get_resource_limit (GNode *root, gint64 *value)
+{
+	const gchar *str = (const gchar *)root->children->data;
+	gchar       *end = NULL;
+
+	/* no value means "not limited" */
+	if (! str) {
+		return true;
+	}
+
+	if (! *str) {
+		goto err;
+	}
+
+	*value = g_ascii_strtoll (str, &end, 10);
+	if (*end) {
+		goto err;
+	}
+
+	return true;
+
+err:
+	g_critical ("invalid %s limit: %s", (gchar *)root->data, str);
+	error_detected = true;
+
+	return false;
+}
+
+static void
+handle_memory_section (GNode *root, struct clr_oci_config *config)
+{
+	struct oci_cfg_resources *resources = &config->oci.oci_linux.resources;
+
+	if ((! (root && root->children)) || error_detected) {
+		return;
+	}
+
+	if (! g_strcmp0 (root->data, "limit")) {
+		(void)get_resource_limit (root, &resources->memory_limit);
+	} else if (! g_strcmp0 (root->data, "reservation")) {
+		(void)get_resource_limit (root,
+				&resources->memory_reservation);
+	}
+}
+
+static void
+handle_cpu_section (GNode *root, struct clr_oci_config *config)
+{
+	struct oci_cfg_resources *resources = &config->oci.oci_linux.resources;
+
+	if ((! (root && root->children)) || error_detected) {
+		return;
+	}
+
+	if (! g_strcmp0 (root->data, "quota")) {
+		(void)get_resource_limit (root, &resources->cpu_quota);
+	} else if (! g_strcmp0 (root->data, "period")) {
+		(void)get_resource_limit (root, &resources->cpu_period);
+	} else if (! g_strcmp0 (root->data, "cpus")) {
+		g_free_if_set (resources->cpu_cpus);
+		resources->cpu_cpus = g_strdup (root->children->data);
+	} else if (! g_strcmp0 (root->data, "mems")) {
+		g_free_if_set (resources->cpu_mems);
+		resources->cpu_mems = g_strdup (root->children->data);
+	}
+}
+
+static void
+handle_resources_section (GNode *root, struct clr_oci_config *config)
+{
+	if (! (root && root->children)) {
+		return;
+	}
+
+	if (! g_strcmp0 (root->data, "memory")) {
+		g_node_children_foreach(root, G_TRAVERSE_ALL,
+			(GNodeForeachFunc)handle_memory_section,
+			config);
+	} else if (! g_strcmp0 (root->data, "cpu")) {
+		g_node_children_foreach(root, G_TRAVERSE_ALL,
+			(GNodeForeachFunc)handle_cpu_section,
+			config);
+	}
+}
+
 static void
 handle_linux_section (GNode *root, struct clr_oci_config *config)
 {
@@ -102,6 +196,10 @@ handle_linux_section (GNode *root, struct clr_oci_config *config)
 		g_node_children_foreach(root, G_TRAVERSE_ALL,
 			(GNodeForeachFunc)handle_namespaces_section,
 			config);
+	} else if (! g_strcmp0 (root->data, "resources")) {
+		g_node_children_foreach(root, G_TRAVERSE_ALL,
+			(GNodeForeachFunc)handle_resources_section,
+			config);
 	}
 }
 
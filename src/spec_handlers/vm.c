@@ -24,6 +24,7 @@
 #include "spec_handler.h"
 #include "oci.h"
 #include "util.h"
+#include "virtiofs.h"
 
 static void
 handle_kernel_section(GNode* root, struct clr_oci_config* config) {
@@ -41,6 +42,70 @@ handle_kernel_section(GNode* root, struct clr_oci_config* config) {
 		}
 	} else if (g_strcmp0(root->data, "parameters") == 0) {
 		config->vm->kernel_params = g_strdup(root->children->data);
+	} else if (g_strcmp0(root->data, "initrd") == 0) {
+		g_autofree gchar* path = clr_oci_resolve_path(root->children->data);
+		if (path) {
+			if (snprintf(config->vm->initrd_path,
+			    sizeof(config->vm->initrd_path),
+			    "%s", path) < 0) {
+				g_critical("failed to copy vm initrd path");
+			}
+		}
+	}
+}
+
+static void
+handle_rootfs_section(GNode* root, struct clr_oci_config* config) {
+	if (! (root && root->children)) {
+		return;
+	}
+	if (g_strcmp0(root->data, "transport") == 0) {
+		(void)clr_oci_rootfs_transport_from_name(root->children->data,
+			&config->vm->rootfs_transport);
+	} else if (g_strcmp0(root->data, "daemon") == 0) {
+		g_autofree gchar* path = clr_oci_resolve_path(root->children->data);
+		if (path) {
+			if (snprintf(config->vm->virtiofsd_path,
+			    sizeof(config->vm->virtiofsd_path),
+			    "%s", path) < 0) {
+				g_critical("failed to copy vm virtio-fs daemon path");
+			}
+		}
+	} else if (g_strcmp0(root->data, "dax_size") == 0) {
+		g_free_if_set(config->vm->dax_size);
+		config->vm->dax_size = g_strdup(root->children->data);
+	}
+}
+
+static void
+handle_memory_section(GNode* root, struct clr_oci_config* config) {
+	if (! (root && root->children)) {
+		return;
+	}
+	if (g_strcmp0(root->data, "hugepages") == 0) {
+		config->vm->hugepages =
+			! g_strcmp0(root->children->data, "true");
+	} else if (g_strcmp0(root->data, "path") == 0) {
+		g_autofree gchar* path = clr_oci_resolve_path(root->children->data);
+		if (path) {
+			if (snprintf(config->vm->hugepages_path,
+			    sizeof(config->vm->hugepages_path),
+			    "%s", path) < 0) {
+				g_critical("failed to copy vm hugepages path");
+			}
+		}
+	} else if (g_strcmp0(root->data, "prealloc") == 0) {
+		config->vm->hugepages_prealloc =
+			! g_strcmp0(root->children->data, "true");
+	} else if (g_strcmp0(root->data, "share") == 0) {
+		config->vm->hugepages_share =
+			! g_strcmp0(root->children->data, "true");
+	} else if (g_strcmp0(root->data, "merge") == 0) {
+		config->vm->memory_merge =
+			! g_strcmp0(root->children->data, "true");
+	} else if (g_strcmp0(root->data, "lazy_checkpoint") == 0) {
+		config->vm->lazy_checkpoint =
+			! g_strcmp0(root->children->data, "true");
 	}
 }
 
@@ -68,9 +133,18 @@ handle_vm_section(GNode* root, struct clr_oci_config* config) {
 				g_critical("failed to copy vm image path");
 			}
 		}
+	} else if (g_strcmp0(root->data, "image_shared") == 0) {
+		config->vm->image_shared =
+			! g_strcmp0(root->children->data, "true");
 	} else if (g_strcmp0(root->data, "kernel") == 0) {
 		g_node_children_foreach(root, G_TRAVERSE_ALL,
 			(GNodeForeachFunc)handle_kernel_section, config);
+	} else if (g_strcmp0(root->data, "rootfs") == 0) {
+		g_node_children_foreach(root, G_TRAVERSE_ALL,
+			(GNodeForeachFunc)handle_rootfs_section, config);
+	} else if (g_strcmp0(root->data, "memory") == 0) {
+		g_node_children_foreach(root, G_TRAVERSE_ALL,
+			(GNodeForeachFunc)handle_memory_section, config);
 	}
 }
 
@@ -91,6 +165,8 @@ vm_handle_section(GNode* root, struct clr_oci_config* config) {
 
 	if(! config->vm) {
 		config->vm = g_malloc0(sizeof(struct clr_oci_vm_cfg));
+		config->vm->hugepages_prealloc = true;
+		config->vm->hugepages_share = true;
 	}
 
 	g_node_children_foreach(root, G_TRAVERSE_ALL,
@@ -102,6 +178,11 @@ vm_handle_section(GNode* root, struct clr_oci_config* config) {
 	* - kernel_path
 	* Optional:
 	* - kernel_params
+	* - initrd_path
+	* - image_shared
+	* - rootfs (transport, daemon and dax_size)
+	* - memory (hugepages, path, prealloc, share, merge and
+	*   lazy_checkpoint)
 	*/
 
 	if (! config->vm->hypervisor_path[0]
@@ -122,11 +203,18 @@ vm_handle_section(GNode* root, struct clr_oci_config* config) {
 		goto out;
 	}
 
+	if (config->vm->initrd_path[0]
+	    && stat (config->vm->initrd_path, &st) < 0) {
+		g_critical("VM initrd path does not exist");
+		goto out;
+	}
+
 	ret = true;
 
 out:
 	if (! ret) {
 		g_free_if_set (config->vm->kernel_params);
+		g_free_if_set (config->vm->dax_size);
 		g_free (config->vm);
 		config->vm = NULL;
 	}
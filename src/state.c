@@ -36,9 +36,11 @@
 #include "state.h"
 #include "runtime.h"
 #include "mount.h"
+#include "hypervisor.h"
 #include "annotation.h"
 #include "json.h"
 #include "config.h"
+#include "checkpoint.h"
 
 #define update_subelements_and_strdup(node, data, member) \
 	if (node && node->data) { \
@@ -60,6 +62,12 @@ static void handle_state_mounts_section(GNode*, struct handler_data*);
 static void handle_state_console_section(GNode*, struct handler_data*);
 static void handle_state_vm_section(GNode*, struct handler_data*);
 static void handle_state_annotations_section(GNode*, struct handler_data*);
+static void handle_state_resources_section(GNode*, struct handler_data*);
+static void handle_state_vsockCid_section(GNode*, struct handler_data*);
+static void handle_state_pidStartTime_section(GNode*, struct handler_data*);
+static void handle_state_virtiofsdPid_section(GNode*, struct handler_data*);
+static void handle_state_virtiofsdStartTime_section(GNode*, struct handler_data*);
+static void handle_state_cpus_section(GNode*, struct handler_data*);
 
 /*! Used to handle each section in \ref CLR_OCI_STATE_FILE. */
 static struct state_handler {
@@ -77,18 +85,24 @@ static struct state_handler {
 	 */
 	size_t subelements_count;
 } state_handlers[] = {
-	{ "ociVersion"  , handle_state_ociVersion_section  , 1 , 0 },
-	{ "id"          , handle_state_id_section          , 1 , 0 },
-	{ "pid"         , handle_state_pid_section         , 1 , 0 },
-	{ "bundlePath"  , handle_state_bundlePath_section  , 1 , 0 },
-	{ "commsPath"   , handle_state_commsPath_section   , 1 , 0 },
-	{ "processPath" , handle_state_processPath_section , 1 , 0 },
-	{ "status"      , handle_state_status_section      , 1 , 0 },
-	{ "created"     , handle_state_created_section     , 1 , 0 },
-	{ "mounts"      , handle_state_mounts_section      , 0 , 0 },
-	{ "console"     , handle_state_console_section     , 2 , 0 },
-	{ "vm"          , handle_state_vm_section          , 5 , 0 },
-	{ "annotations" , handle_state_annotations_section , 0 , 0 },
+	{ "ociVersion"        , handle_state_ociVersion_section        , 1 , 0 },
+	{ "id"                , handle_state_id_section                , 1 , 0 },
+	{ "pid"               , handle_state_pid_section               , 1 , 0 },
+	{ "pidStartTime"      , handle_state_pidStartTime_section      , 0 , 0 },
+	{ "bundlePath"        , handle_state_bundlePath_section        , 1 , 0 },
+	{ "commsPath"         , handle_state_commsPath_section         , 1 , 0 },
+	{ "processPath"       , handle_state_processPath_section       , 1 , 0 },
+	{ "status"            , handle_state_status_section            , 1 , 0 },
+	{ "created"           , handle_state_created_section           , 1 , 0 },
+	{ "mounts"            , handle_state_mounts_section            , 0 , 0 },
+	{ "console"           , handle_state_console_section           , 2 , 0 },
+	{ "vm"                , handle_state_vm_section                , 5 , 0 },
+	{ "annotations"       , handle_state_annotations_section       , 0 , 0 },
+	{ "resources"         , handle_state_resources_section         , 0 , 0 },
+	{ "vsockCid"          , handle_state_vsockCid_section          , 0 , 0 },
+	{ "virtiofsdPid"      , handle_state_virtiofsdPid_section      , 0 , 0 },
+	{ "virtiofsdStartTime", handle_state_virtiofsdStartTime_section, 0 , 0 },
+	{ "cpus"              , handle_state_cpus_section              , 0 , 0 },
 
 	/* terminator */
 	{ NULL, NULL, 0, 0 }
@@ -186,6 +200,122 @@ handle_state_pid_section(GNode* node, struct handler_data* data) {
 	}
 }
 
+/*!
+ *  handler for vsockCid section
+ *
+ * \param node \c GNode.
+ * \param data \ref handler_data.
+ */
+static void
+handle_state_vsockCid_section(GNode* node, struct handler_data* data) {
+	gchar* endptr = NULL;
+	guint64 cid;
+
+	if (! (node && node->data)) {
+		return;
+	}
+
+	cid = g_ascii_strtoull((char*)node->data, &endptr, 10);
+	if (endptr == node->data || *endptr || cid > G_MAXUINT32) {
+		g_critical("invalid vsock context ID '%s'",
+		    (char*)node->data);
+		return;
+	}
+
+	data->state->vsock_cid = (guint32)cid;
+}
+
+/*!
+ * Parse the start time of a process.
+ *
+ * \param str String to parse.
+ * \param[out] start_time Start time.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_state_start_time_parse (const gchar *str, guint64 *start_time)
+{
+	gchar* endptr = NULL;
+
+	*start_time = g_ascii_strtoull(str, &endptr, 10);
+	if (endptr == str || *endptr) {
+		g_critical("invalid process start time '%s'", str);
+		*start_time = 0;
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ *  handler for pidStartTime section
+ *
+ * \param node \c GNode.
+ * \param data \ref handler_data.
+ */
+static void
+handle_state_pidStartTime_section(GNode* node, struct handler_data* data) {
+	if (! (node && node->data)) {
+		return;
+	}
+
+	(void)clr_oci_state_start_time_parse ((gchar*)node->data,
+			&data->state->start_time);
+}
+
+/*!
+ *  handler for virtiofsdStartTime section
+ *
+ * \param node \c GNode.
+ * \param data \ref handler_data.
+ */
+static void
+handle_state_virtiofsdStartTime_section(GNode* node, struct handler_data* data) {
+	if (! (node && node->data)) {
+		return;
+	}
+
+	(void)clr_oci_state_start_time_parse ((gchar*)node->data,
+			&data->state->virtiofsd_start_time);
+}
+
+/*!
+ *  handler for virtiofsdPid section
+ *
+ * \param node \c GNode.
+ * \param data \ref handler_data.
+ */
+static void
+handle_state_virtiofsdPid_section(GNode* node, struct handler_data* data) {
+	gchar* endptr = NULL;
+	gint64 pid;
+
+	if (! (node && node->data)) {
+		return;
+	}
+
+	pid = g_ascii_strtoll((char*)node->data, &endptr, 10);
+	if (endptr == node->data || *endptr || pid <= 0 || pid > G_MAXINT) {
+		g_critical("invalid virtio-fs daemon pid '%s'",
+		    (char*)node->data);
+		return;
+	}
+
+	data->state->virtiofsd_pid = (GPid)pid;
+}
+
+/*!
+ *  handler for cpus section
+ *
+ * \param node \c GNode.
+ * \param data \ref handler_data.
+ */
+static void
+handle_state_cpus_section(GNode* node, struct handler_data* data) {
+	update_subelements_and_strdup(node, data, cpus);
+}
+
 /*!
  *  handler for bundlePath section
  *
@@ -339,6 +469,17 @@ handle_state_vm_section(GNode* node, struct handler_data* data) {
 	} else if (g_strcmp0(node->data, "kernel_params") == 0) {
 		vm->kernel_params = g_strdup(node->children->data);
 		(*(data->subelements_count))++;
+	} else if (g_strcmp0(node->data, "initrd_path") == 0) {
+		/* optional */
+		g_strlcpy (vm->initrd_path,
+				node->children->data,
+				sizeof (vm->initrd_path));
+	} else if (g_strcmp0(node->data, "image_shared") == 0) {
+		/* optional */
+		vm->image_shared = ! g_strcmp0(node->children->data, "true");
+	} else if (g_strcmp0(node->data, "lazy_checkpoint") == 0) {
+		/* optional */
+		vm->lazy_checkpoint = ! g_strcmp0(node->children->data, "true");
 	} else {
 		g_critical("unknown console option: %s", (char*)node->data);
 	}
@@ -376,6 +517,50 @@ handle_state_annotations_section(GNode* node, struct handler_data* data)
                                                         ann);
 }
 
+/*!
+ * handler for resources section
+ *
+ * \param node \c GNode.
+ * \param data \ref handler_data.
+ */
+static void
+handle_state_resources_section(GNode* node, struct handler_data* data)
+{
+	struct clr_oci_vm_resources *resources;
+	gchar *endptr = NULL;
+	guint64 value;
+
+	if (! (node && node->data)) {
+		return;
+	}
+	if (! (node->children && node->children->data)) {
+		g_critical("%s missing value", (char*)node->data);
+		return;
+	}
+
+	g_assert (data->state);
+
+	resources = &data->state->resources;
+
+	value = g_ascii_strtoull ((char*)node->children->data, &endptr, 10);
+	if (endptr == node->children->data) {
+		g_critical("failed to convert '%s' to int",
+		    (char*)node->children->data);
+		return;
+	}
+
+	if (g_strcmp0(node->data, "vcpus") == 0) {
+		resources->vcpus = (guint)value;
+	} else if (g_strcmp0(node->data, "memory") == 0) {
+		resources->memory = value;
+	} else {
+		g_critical("unknown resources option: %s", (char*)node->data);
+		return;
+	}
+
+	(*(data->subelements_count))++;
+}
+
 /*!
  * process all sections in state.json using the right section handler
  *
@@ -532,6 +717,7 @@ clr_oci_state_free (struct oci_state *state)
 	g_free_if_set (state->procsock_path);
 	g_free_if_set (state->create_time);
 	g_free_if_set (state->console);
+	g_free_if_set (state->cpus);
 
 	if (state->mounts) {
 		clr_oci_mounts_free_all (state->mounts);
@@ -539,6 +725,7 @@ clr_oci_state_free (struct oci_state *state)
 
 	if (state->vm) {
 		g_free_if_set (state->vm->kernel_params);
+		g_free_if_set (state->vm->dax_size);
 		g_free (state->vm);
 	}
 
@@ -549,58 +736,50 @@ clr_oci_state_free (struct oci_state *state)
 }
 
 /*!
- * Create the state file for the specified \p config.
+ * Create a JSON representation of the state of the specified VM.
  *
  * \param config \ref clr_oci_config.
  * \param created_timestamp ISO 8601 timestamp for when VM Was created.
  *
  * \see https://github.com/opencontainers/specs/blob/master/runtime.md
  *
- * \return \c true on success, else \c false.
+ * \return \c JsonObject on success, else \c NULL.
  */
-gboolean
-clr_oci_state_file_create (struct clr_oci_config *config,
+static JsonObject *
+clr_oci_state_to_json (const struct clr_oci_config *config,
 		const char *created_timestamp)
 {
 	JsonObject  *obj = NULL;
 	JsonObject  *console = NULL;
 	JsonObject  *vm = NULL;
 	JsonObject  *annotation_obj = NULL;
+	JsonObject  *resources = NULL;
 	JsonArray   *mounts = NULL;
-	gchar       *str = NULL;
-	gsize        str_len = 0;
-	GError      *err = NULL;
 	const gchar *status;
-	gboolean     ret;
-	gboolean     result = false;
 
 	if (! (config && created_timestamp)) {
-		return false;
+		return NULL;
 	}
 	if ( ! config->optarg_container_id) {
-		return false;
+		return NULL;
 	}
 	if ( ! (*config->optarg_container_id)) {
-		return false;
+		return NULL;
 	}
 	if ( ! config->bundle_path) {
-		return false;
+		return NULL;
 	}
 	if ( ! config->state.runtime_path[0]) {
-		return false;
+		return NULL;
 	}
 	if ( ! config->state.comms_path[0]) {
-		return false;
+		return NULL;
 	}
 	if ( ! config->state.procsock_path[0]) {
-		return false;
+		return NULL;
 	}
 	if (! config->vm) {
-		return false;
-	}
-
-	if (! clr_oci_state_file_get (config)) {
-		return false;
+		return NULL;
 	}
 
 	obj = json_object_new ();
@@ -615,6 +794,11 @@ clr_oci_state_file_create (struct clr_oci_config *config,
 	json_object_set_int_member (obj, "pid",
 			(unsigned)config->state.workload_pid);
 
+	if (config->state.workload_start_time) {
+		json_object_set_int_member (obj, "pidStartTime",
+				(gint64)config->state.workload_start_time);
+	}
+
 	json_object_set_string_member (obj, "bundlePath",
 			config->bundle_path);
 
@@ -627,7 +811,7 @@ clr_oci_state_file_create (struct clr_oci_config *config,
 
 	status = clr_oci_status_get (config);
 	if (! status) {
-		goto out;
+		goto err;
 	}
 
 	json_object_set_string_member (obj, "status", status);
@@ -639,7 +823,7 @@ clr_oci_state_file_create (struct clr_oci_config *config,
 	 */
 	mounts = clr_oci_mounts_to_json (config);
 	if (! mounts) {
-		goto out;
+		goto err;
 	}
 
 	json_object_set_array_member (obj, "mounts", mounts);
@@ -670,6 +854,11 @@ clr_oci_state_file_create (struct clr_oci_config *config,
 	json_object_set_string_member (vm, "workload_path",
 			config->vm->workload_path);
 
+	if (config->vm->initrd_path[0]) {
+		json_object_set_string_member (vm, "initrd_path",
+				config->vm->initrd_path);
+	}
+
 	/* this element must be set, so specify a blank string if there
 	 * really are no parameters.
 	 */
@@ -677,8 +866,55 @@ clr_oci_state_file_create (struct clr_oci_config *config,
 			config->vm->kernel_params
 			? config->vm->kernel_params : "");
 
+	if (clr_oci_image_shared_get (config)) {
+		json_object_set_boolean_member (vm, "image_shared", true);
+	}
+
+	if (clr_oci_checkpoint_lazy_get (config)) {
+		json_object_set_boolean_member (vm, "lazy_checkpoint", true);
+	}
+
 	json_object_set_object_member (obj, "vm", vm);
 
+	if (config->state.vsock_cid) {
+		json_object_set_int_member (obj, "vsockCid",
+				config->state.vsock_cid);
+	}
+
+	if (config->state.virtiofsd_pid) {
+		json_object_set_int_member (obj, "virtiofsdPid",
+				config->state.virtiofsd_pid);
+
+		if (config->state.virtiofsd_start_time) {
+			json_object_set_int_member (obj, "virtiofsdStartTime",
+					(gint64)config->state.virtiofsd_start_time);
+		}
+	}
+
+	if (config->state.cpus[0]) {
+		json_object_set_string_member (obj, "cpus",
+				config->state.cpus);
+	}
+
+	if (config->state.resources.vcpus || config->state.resources.memory) {
+		/* Add an object containing the resources set by
+		 * "update", which override those the VM started with.
+		 */
+		resources = json_object_new ();
+
+		if (config->state.resources.vcpus) {
+			json_object_set_int_member (resources, "vcpus",
+					config->state.resources.vcpus);
+		}
+
+		if (config->state.resources.memory) {
+			json_object_set_int_member (resources, "memory",
+					(gint64)config->state.resources.memory);
+		}
+
+		json_object_set_object_member (obj, "resources", resources);
+	}
+
 	if (config->oci.annotations) {
 		/* Add an object containing annotations */
 		annotation_obj = clr_oci_annotations_to_json(config);
@@ -686,8 +922,83 @@ clr_oci_state_file_create (struct clr_oci_config *config,
 		json_object_set_object_member(obj, "annotations", annotation_obj);
 	}
 
+	return obj;
+
+err:
+	json_object_unref (obj);
+	return NULL;
+}
+
+/*!
+ * Render the state of the specified VM as a string.
+ *
+ * \param config \ref clr_oci_config.
+ * \param created_timestamp ISO 8601 timestamp for when VM Was created.
+ * \param pretty If \c true, format the output for humans, else
+ *   return a compact single-line representation.
+ * \param[out] length Length of the returned string.
+ *
+ * \note The compact form is suitable for passing to hooks, which
+ * expect the state as a single line on their standard input.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+gchar *
+clr_oci_state_to_string (const struct clr_oci_config *config,
+		const char *created_timestamp,
+		gboolean pretty,
+		gsize *length)
+{
+	JsonObject  *obj;
+	gchar       *str;
+
+	if (! length) {
+		return NULL;
+	}
+
+	obj = clr_oci_state_to_json (config, created_timestamp);
+	if (! obj) {
+		return NULL;
+	}
+
+	str = clr_oci_json_obj_to_string (obj, pretty, length);
+
+	json_object_unref (obj);
+
+	return str;
+}
+
+/*!
+ * Create the state file for the specified \p config.
+ *
+ * \param config \ref clr_oci_config.
+ * \param created_timestamp ISO 8601 timestamp for when VM Was created.
+ *
+ * \see https://github.com/opencontainers/specs/blob/master/runtime.md
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_state_file_create (struct clr_oci_config *config,
+		const char *created_timestamp)
+{
+	gchar       *str = NULL;
+	gsize        str_len = 0;
+	GError      *err = NULL;
+	gboolean     ret;
+	gboolean     result = false;
+
+	if (! (config && created_timestamp)) {
+		return false;
+	}
+
+	if (! clr_oci_state_file_get (config)) {
+		return false;
+	}
+
 	/* convert JSON to string */
-	str = clr_oci_json_obj_to_string (obj, true, &str_len);
+	str = clr_oci_state_to_string (config, created_timestamp,
+			true, &str_len);
 	if (! str) {
 		goto out;
 	}
@@ -706,9 +1017,6 @@ clr_oci_state_file_create (struct clr_oci_config *config,
 	g_debug ("created state file %s", config->state.state_file_path);
 
 out:
-	if (obj) {
-		json_object_unref (obj);
-	}
 	g_free_if_set (str);
 
 	return result;
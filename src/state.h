@@ -26,6 +26,9 @@ struct oci_state *clr_oci_state_file_read (const char *file);
 void clr_oci_state_free (struct oci_state *state);
 gboolean clr_oci_state_file_create (struct clr_oci_config *config,
 		const char *created_timestamp);
+gchar *clr_oci_state_to_string (const struct clr_oci_config *config,
+		const char *created_timestamp, gboolean pretty,
+		gsize *length);
 gboolean clr_oci_state_file_delete (const struct clr_oci_config *config);
 gboolean clr_oci_state_file_exists (struct clr_oci_config *config);
 const char *clr_oci_status_to_str (enum oci_status status);
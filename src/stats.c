@@ -0,0 +1,849 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Resource usage of a running container.
+ *
+ * Containers are not placed in cgroups by the runtime, so usage is
+ * measured from the host side by looking at the hypervisor process:
+ *
+ * - CPU time of the hypervisor and of each vCPU thread
+ *   (/proc/<pid>/stat and /proc/<pid>/task/<tid>/stat).
+ * - Memory usage of the hypervisor (/proc/<pid>/smaps_rollup).
+ * - Memory of the hypervisor merged with other pages by KSM
+ *   (/proc/<pid>/ksm_merging_pages).
+ * - Guest memory statistics reported by the virtio-balloon
+ *   device (via QMP), if the VM has one.
+ *
+ * The result is formatted like a libcontainer "CgroupStats" object
+ * so that docker can consume it.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include "common.h"
+#include "util.h"
+#include "network.h"
+#include "stats.h"
+
+/** Size of the chunks /proc files are read in. */
+#define CLR_OCI_STATS_READ_SIZE 4096
+
+/*!
+ * Parse the contents of a /proc "stat" file.
+ *
+ * \param buf Contents of the file.
+ * \param[out] comm Name of the process or thread (may be \c NULL).
+ * \param[out] utime Time spent in user mode (clock ticks).
+ * \param[out] stime Time spent in kernel mode (clock ticks).
+ *
+ * \return \c true on success, else \c false.
+ */
+private gboolean
+clr_oci_stats_parse_stat (const gchar *buf, gchar **comm,
+		guint64 *utime, guint64 *stime)
+{
+	const gchar  *start;
+	const gchar  *end;
+	gchar       **fields = NULL;
+	gboolean      ret = false;
+
+	if (! (buf && utime && stime)) {
+		return false;
+	}
+
+	/* The name may contain spaces and parentheses */
+	start = strchr (buf, '(');
+	end = strrchr (buf, ')');
+	if (! (start && end && end > start && end[1] == ' ')) {
+		return false;
+	}
+
+	/* fields[0] is field 3 ("state") of proc(5) */
+	fields = g_strsplit (end + 2, " ", 14);
+	if (g_strv_length (fields) < 14) {
+		goto out;
+	}
+
+	/* fields 14 and 15 */
+	*utime = g_ascii_strtoull (fields[11], NULL, 10);
+	*stime = g_ascii_strtoull (fields[12], NULL, 10);
+
+	if (comm) {
+		*comm = g_strndup (start + 1, (gsize)(end - start - 1));
+	}
+
+	ret = true;
+
+out:
+	g_strfreev (fields);
+
+	return ret;
+}
+
+/*!
+ * Determine the vCPU a hypervisor thread runs.
+ *
+ * \param comm Name of the thread.
+ *
+ * \return vCPU index, or -1 if the thread is not a vCPU thread.
+ */
+private gint
+clr_oci_stats_vcpu_index (const gchar *comm)
+{
+	const gchar  *p;
+	gchar        *end = NULL;
+	guint64       index;
+
+	if (! (comm && g_str_has_prefix (comm, CLR_OCI_STATS_VCPU_PREFIX))) {
+		return -1;
+	}
+
+	p = comm + sizeof (CLR_OCI_STATS_VCPU_PREFIX) - 1;
+	if (! g_ascii_isdigit (*p)) {
+		return -1;
+	}
+
+	/* "CPU <index>/<accelerator>" */
+	index = g_ascii_strtoull (p, &end, 10);
+	if (*end != '/' || index > G_MAXINT) {
+		return -1;
+	}
+
+	return (gint)index;
+}
+
+/*!
+ * Parse the contents of a /proc "smaps_rollup" or "status" file.
+ *
+ * \param buf Contents of the file.
+ * \param[out] mem \ref clr_oci_stats_memory.
+ *
+ * \return \c true if the resident set size was found, else \c false.
+ */
+private gboolean
+clr_oci_stats_parse_memory (const gchar *buf,
+		struct clr_oci_stats_memory *mem)
+{
+	gchar    **lines;
+	gchar    **line;
+	gchar     *value;
+	guint64   *field;
+	gboolean   ret = false;
+
+	if (! (buf && mem)) {
+		return false;
+	}
+
+	memset (mem, 0, sizeof (*mem));
+
+	lines = g_strsplit (buf, "\n", -1);
+
+	for (line = lines; *line; line++) {
+		value = strchr (*line, ':');
+		if (! value) {
+			continue;
+		}
+
+		*value++ = '\0';
+
+		if (! g_strcmp0 (*line, "Rss")
+				|| ! g_strcmp0 (*line, "VmRSS")) {
+			field = &mem->rss;
+			ret = true;
+		} else if (! g_strcmp0 (*line, "Pss")) {
+			field = &mem->pss;
+		} else if (! g_strcmp0 (*line, "Swap")
+				|| ! g_strcmp0 (*line, "VmSwap")) {
+			field = &mem->swap;
+		} else {
+			continue;
+		}
+
+		/* values are in kB */
+		*field = g_ascii_strtoull (value, NULL, 10) * 1024;
+	}
+
+	g_strfreev (lines);
+
+	return ret;
+}
+
+/*!
+ * Add the guest statistics reported by a virtio-balloon device.
+ *
+ * Statistics are named after their QMP name, so "stat-free-memory"
+ * becomes "guest_free_memory". Statistics the guest doesn't
+ * support (reported as -1) are skipped.
+ *
+ * \param stats Object to add the statistics to.
+ * \param guest_stats "stats" member of the "guest-stats" property.
+ */
+private void
+clr_oci_stats_balloon_add (JsonObject *stats, JsonObject *guest_stats)
+{
+	GList        *members;
+	GList        *l;
+	const gchar  *name;
+	gchar        *key;
+	gint64        value;
+
+	if (! (stats && guest_stats)) {
+		return;
+	}
+
+	members = json_object_get_members (guest_stats);
+
+	for (l = members; l; l = g_list_next (l)) {
+		name = l->data;
+
+		value = json_object_get_int_member (guest_stats, name);
+		if (value < 0) {
+			continue;
+		}
+
+		if (g_str_has_prefix (name, "stat-")) {
+			name += sizeof ("stat-") - 1;
+		}
+
+		key = g_strdup_printf ("guest_%s", name);
+		g_strdelimit (key, "-", '_');
+
+		json_object_set_int_member (stats, key, value);
+
+		g_free (key);
+	}
+
+	g_list_free (members);
+}
+
+/*!
+ * Read the whole of a /proc file.
+ *
+ * \param fd Open file.
+ * \param buf Buffer to read the file into.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+clr_oci_stats_read (int fd, GString *buf)
+{
+	gchar    chunk[CLR_OCI_STATS_READ_SIZE];
+	gssize   bytes;
+	off_t    offset = 0;
+
+	g_string_truncate (buf, 0);
+
+	do {
+		bytes = pread (fd, chunk, sizeof (chunk), offset);
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+
+		g_string_append_len (buf, chunk, bytes);
+		offset += bytes;
+	} while (bytes > 0);
+
+	return buf->len > 0;
+}
+
+/*!
+ * Free the specified \ref clr_oci_stats_task.
+ *
+ * \param task \ref clr_oci_stats_task.
+ */
+static void
+clr_oci_stats_task_free (struct clr_oci_stats_task *task)
+{
+	if (! task) {
+		return;
+	}
+
+	if (task->fd >= 0) {
+		close (task->fd);
+	}
+
+	g_free (task);
+}
+
+/*!
+ * Start tracking a hypervisor thread.
+ *
+ * \param sampler \ref clr_oci_stats_sampler.
+ * \param name Name of the thread's directory below
+ *   "/proc/<pid>/task".
+ *
+ * \return Newly-allocated \ref clr_oci_stats_task on success,
+ *   else \c NULL.
+ */
+static struct clr_oci_stats_task *
+clr_oci_stats_task_new (struct clr_oci_stats_sampler *sampler,
+		const gchar *name)
+{
+	struct clr_oci_stats_task  *task;
+	g_autofree gchar           *path = NULL;
+	g_autofree gchar           *comm = NULL;
+	guint64                     utime;
+	guint64                     stime;
+
+	task = g_new0 (struct clr_oci_stats_task, 1);
+	task->vcpu = -1;
+
+	path = g_strdup_printf ("%s/stat", name);
+
+	task->fd = openat (dirfd (sampler->task_dir), path,
+			O_RDONLY | O_CLOEXEC);
+	if (task->fd < 0) {
+		/* thread exited */
+		g_free (task);
+		return NULL;
+	}
+
+	if (clr_oci_stats_read (task->fd, sampler->buf)
+			&& clr_oci_stats_parse_stat (sampler->buf->str,
+				&comm, &utime, &stime)) {
+		task->vcpu = clr_oci_stats_vcpu_index (comm);
+	}
+
+	if (task->vcpu < 0) {
+		/* Only vCPU threads are sampled, but remember the
+		 * others to avoid looking at them again.
+		 */
+		close (task->fd);
+		task->fd = -1;
+	}
+
+	return task;
+}
+
+/*!
+ * Sample the CPU usage of the hypervisor.
+ *
+ * \param sampler \ref clr_oci_stats_sampler.
+ *
+ * \return "cpu_stats" object on success, else \c NULL.
+ */
+static JsonObject *
+clr_oci_stats_sample_cpu (struct clr_oci_stats_sampler *sampler)
+{
+	JsonObject                 *cpu_stats;
+	JsonObject                 *cpu_usage;
+	JsonObject                 *throttling;
+	JsonArray                  *percpu;
+	GArray                     *vcpus;
+	struct clr_oci_stats_task  *task;
+	struct dirent              *entry;
+	GHashTableIter              iter;
+	gpointer                    key;
+	gint                        tid;
+	guint64                     utime;
+	guint64                     stime;
+	guint64                     usage;
+	guint                       i;
+
+	if (! (clr_oci_stats_read (sampler->stat_fd, sampler->buf)
+			&& clr_oci_stats_parse_stat (sampler->buf->str,
+				NULL, &utime, &stime))) {
+		return NULL;
+	}
+
+	/* Look for new threads */
+	sampler->generation++;
+
+	rewinddir (sampler->task_dir);
+
+	while ((entry = readdir (sampler->task_dir))) {
+		tid = atoi (entry->d_name);
+		if (tid <= 0) {
+			continue;
+		}
+
+		task = g_hash_table_lookup (sampler->tasks,
+				GINT_TO_POINTER (tid));
+		if (! task) {
+			task = clr_oci_stats_task_new (sampler,
+					entry->d_name);
+			if (! task) {
+				continue;
+			}
+
+			g_hash_table_insert (sampler->tasks,
+					GINT_TO_POINTER (tid), task);
+		}
+
+		task->generation = sampler->generation;
+	}
+
+	/* Sample the vCPU threads and forget threads that exited */
+	vcpus = g_array_new (false, true, sizeof (guint64));
+
+	g_hash_table_iter_init (&iter, sampler->tasks);
+
+	while (g_hash_table_iter_next (&iter, &key, (gpointer *)&task)) {
+		if (task->generation != sampler->generation) {
+			g_hash_table_iter_remove (&iter);
+			continue;
+		}
+
+		if (task->vcpu < 0) {
+			continue;
+		}
+
+		if (! (clr_oci_stats_read (task->fd, sampler->buf)
+				&& clr_oci_stats_parse_stat (sampler->buf->str,
+					NULL, &usage, &stime))) {
+			g_hash_table_iter_remove (&iter);
+			continue;
+		}
+
+		usage = (usage + stime) * sampler->tick_ns;
+
+		if ((guint)task->vcpu >= vcpus->len) {
+			g_array_set_size (vcpus, (guint)task->vcpu + 1);
+		}
+
+		g_array_index (vcpus, guint64, task->vcpu) = usage;
+	}
+
+	percpu = json_array_new ();
+	for (i = 0; i < vcpus->len; i++) {
+		json_array_add_int_element (percpu,
+				(gint64)g_array_index (vcpus, guint64, i));
+	}
+	g_array_free (vcpus, true);
+
+	cpu_usage = json_object_new ();
+	json_object_set_int_member (cpu_usage, "total_usage",
+			(gint64)((utime + stime) * sampler->tick_ns));
+	json_object_set_array_member (cpu_usage, "percpu_usage", percpu);
+	json_object_set_int_member (cpu_usage, "usage_in_kernelmode",
+			(gint64)(stime * sampler->tick_ns));
+	json_object_set_int_member (cpu_usage, "usage_in_usermode",
+			(gint64)(utime * sampler->tick_ns));
+
+	/* No CPU quota is applied to the hypervisor */
+	throttling = json_object_new ();
+	json_object_set_int_member (throttling, "periods", 0);
+	json_object_set_int_member (throttling, "throttled_periods", 0);
+	json_object_set_int_member (throttling, "throttled_time", 0);
+
+	cpu_stats = json_object_new ();
+	json_object_set_object_member (cpu_stats, "cpu_usage", cpu_usage);
+	json_object_set_object_member (cpu_stats, "throttling_data",
+			throttling);
+
+	return cpu_stats;
+}
+
+/*!
+ * Add guest memory statistics from the virtio-balloon device.
+ *
+ * \param sampler \ref clr_oci_stats_sampler.
+ * \param usage "usage" member of "memory_stats".
+ * \param stats "stats" member of "memory_stats".
+ */
+static void
+clr_oci_stats_sample_balloon (struct clr_oci_stats_sampler *sampler,
+		JsonObject *usage, JsonObject *stats)
+{
+	struct clr_oci_vm_conn  *conn;
+	JsonObject              *args = NULL;
+	JsonObject              *obj;
+	JsonNode                *result = NULL;
+	gint64                   actual;
+
+	if (! sampler->balloon) {
+		return;
+	}
+
+	/* The QMP socket serves a single client at a time, so the
+	 * connection is not kept open between samples: that would
+	 * block commands such as "pause" and "stop" for as long as
+	 * stats are being displayed.
+	 */
+	conn = clr_oci_vm_conn_new (sampler->comms_path, sampler->pid);
+	if (! conn) {
+		return;
+	}
+
+	if (! clr_oci_qmp_execute (conn, "query-balloon", NULL, &result)) {
+		g_debug ("no balloon device, not collecting guest stats");
+		sampler->balloon = false;
+		goto out;
+	}
+
+	if (JSON_NODE_HOLDS_OBJECT (result)) {
+		obj = json_node_get_object (result);
+		if (json_object_has_member (obj, "actual")) {
+			actual = json_object_get_int_member (obj, "actual");
+
+			/* memory currently available to the guest */
+			json_object_set_int_member (usage, "limit", actual);
+			json_object_set_int_member (stats, "balloon_actual",
+					actual);
+		}
+	}
+
+	json_node_free (result);
+	result = NULL;
+
+	args = json_object_new ();
+	json_object_set_string_member (args, "path",
+			CLR_OCI_STATS_BALLOON_PATH);
+
+	if (sampler->poll_interval > 0) {
+		/* The guest only reports statistics once asked to */
+		json_object_set_string_member (args, "property",
+				"guest-stats-polling-interval");
+		json_object_set_int_member (args, "value",
+				sampler->poll_interval);
+
+		(void)clr_oci_qmp_execute (conn, "qom-set", args, NULL);
+
+		sampler->poll_interval = 0;
+		json_object_remove_member (args, "value");
+	}
+
+	json_object_set_string_member (args, "property", "guest-stats");
+
+	if (! clr_oci_qmp_execute (conn, "qom-get", args, &result)) {
+		goto out;
+	}
+
+	if (! JSON_NODE_HOLDS_OBJECT (result)) {
+		goto out;
+	}
+
+	obj = json_node_get_object (result);
+
+	/* "last-update" is zero until the guest has reported */
+	if (json_object_has_member (obj, "last-update")
+			&& json_object_get_int_member (obj, "last-update")
+			&& json_object_has_member (obj, "stats")) {
+		clr_oci_stats_balloon_add (stats,
+				json_object_get_object_member (obj, "stats"));
+	}
+
+out:
+	if (result) {
+		json_node_free (result);
+	}
+	if (args) {
+		json_object_unref (args);
+	}
+	clr_oci_vm_conn_free (conn);
+}
+
+/*!
+ * Sample the memory usage of the hypervisor.
+ *
+ * \param sampler \ref clr_oci_stats_sampler.
+ *
+ * \return "memory_stats" object on success, else \c NULL.
+ */
+static JsonObject *
+clr_oci_stats_sample_memory (struct clr_oci_stats_sampler *sampler)
+{
+	struct clr_oci_stats_memory   mem;
+	JsonObject                   *memory_stats;
+	JsonObject                   *usage;
+	JsonObject                   *swap_usage;
+	JsonObject                   *stats;
+
+	if (! (clr_oci_stats_read (sampler->mem_fd, sampler->buf)
+			&& clr_oci_stats_parse_memory (sampler->buf->str,
+				&mem))) {
+		return NULL;
+	}
+
+	sampler->max_usage = MAX (sampler->max_usage, mem.rss);
+
+	usage = json_object_new ();
+	json_object_set_int_member (usage, "usage", (gint64)mem.rss);
+	json_object_set_int_member (usage, "max_usage",
+			(gint64)sampler->max_usage);
+	json_object_set_int_member (usage, "failcnt", 0);
+
+	swap_usage = json_object_new ();
+	json_object_set_int_member (swap_usage, "usage",
+			(gint64)(mem.rss + mem.swap));
+	json_object_set_int_member (swap_usage, "failcnt", 0);
+
+	stats = json_object_new ();
+	json_object_set_int_member (stats, "rss", (gint64)mem.rss);
+	json_object_set_int_member (stats, "swap", (gint64)mem.swap);
+	if (mem.pss) {
+		json_object_set_int_member (stats, "pss", (gint64)mem.pss);
+	}
+
+	if (sampler->ksm_fd >= 0
+			&& clr_oci_stats_read (sampler->ksm_fd, sampler->buf)) {
+		json_object_set_int_member (stats, "ksm_merged",
+				(gint64)(g_ascii_strtoull (sampler->buf->str,
+						NULL, 10)
+					* sampler->page_size));
+	}
+
+	clr_oci_stats_sample_balloon (sampler, usage, stats);
+
+	memory_stats = json_object_new ();
+	json_object_set_object_member (memory_stats, "usage", usage);
+	json_object_set_object_member (memory_stats, "swap_usage",
+			swap_usage);
+	json_object_set_object_member (memory_stats, "stats", stats);
+
+	return memory_stats;
+}
+
+/*!
+ * Create a sampler for a running hypervisor.
+ *
+ * \param pid Process ID of the hypervisor.
+ * \param comms_path Path to the QMP socket of the hypervisor.
+ * \param interval Seconds between samples (\c 0 if only a single
+ *   sample will be taken).
+ *
+ * \return Newly-allocated \ref clr_oci_stats_sampler on success,
+ *   else \c NULL.
+ */
+struct clr_oci_stats_sampler *
+clr_oci_stats_sampler_new (GPid pid, const gchar *comms_path,
+		gint interval)
+{
+	struct clr_oci_stats_sampler  *sampler = NULL;
+	g_autofree gchar              *path = NULL;
+	int                            proc_fd = -1;
+	int                            fd;
+	long                           ticks;
+
+	if (pid <= 0 || ! comms_path) {
+		return NULL;
+	}
+
+	path = g_strdup_printf ("/proc/%d", (int)pid);
+
+	proc_fd = open (path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (proc_fd < 0) {
+		g_critical ("failed to open %s: %s",
+				path, strerror (errno));
+		return NULL;
+	}
+
+	sampler = g_new0 (struct clr_oci_stats_sampler, 1);
+
+	sampler->pid = pid;
+	sampler->comms_path = g_strdup (comms_path);
+	sampler->mem_fd = -1;
+	sampler->ksm_fd = -1;
+	sampler->balloon = true;
+	sampler->poll_interval = interval;
+	sampler->buf = g_string_sized_new (CLR_OCI_STATS_READ_SIZE);
+	sampler->tasks = g_hash_table_new_full (g_direct_hash,
+			g_direct_equal, NULL,
+			(GDestroyNotify)clr_oci_stats_task_free);
+
+	ticks = sysconf (_SC_CLK_TCK);
+	sampler->tick_ns = (guint64)(ticks > 0 ? 1000000000L / ticks : 0);
+	sampler->page_size = (guint64)sysconf (_SC_PAGESIZE);
+
+	sampler->stat_fd = openat (proc_fd, "stat", O_RDONLY | O_CLOEXEC);
+	if (sampler->stat_fd < 0) {
+		g_critical ("failed to open %s/stat: %s",
+				path, strerror (errno));
+		goto err;
+	}
+
+	sampler->mem_fd = openat (proc_fd, "smaps_rollup",
+			O_RDONLY | O_CLOEXEC);
+	if (sampler->mem_fd < 0) {
+		/* kernels older than 4.14: no PSS */
+		sampler->mem_fd = openat (proc_fd, "status",
+				O_RDONLY | O_CLOEXEC);
+	}
+
+	if (sampler->mem_fd < 0) {
+		g_critical ("failed to open %s/status: %s",
+				path, strerror (errno));
+		goto err;
+	}
+
+	/* kernels older than 6.1 don't report merged pages */
+	sampler->ksm_fd = openat (proc_fd, "ksm_merging_pages",
+			O_RDONLY | O_CLOEXEC);
+
+	fd = openat (proc_fd, "task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd >= 0) {
+		sampler->task_dir = fdopendir (fd);
+		if (! sampler->task_dir) {
+			close (fd);
+		}
+	}
+
+	if (! sampler->task_dir) {
+		g_critical ("failed to open %s/task: %s",
+				path, strerror (errno));
+		goto err;
+	}
+
+	close (proc_fd);
+
+	return sampler;
+
+err:
+	close (proc_fd);
+	clr_oci_stats_sampler_free (sampler);
+
+	return NULL;
+}
+
+/*!
+ * Free the specified \ref clr_oci_stats_sampler.
+ *
+ * \param sampler \ref clr_oci_stats_sampler.
+ */
+void
+clr_oci_stats_sampler_free (struct clr_oci_stats_sampler *sampler)
+{
+	if (! sampler) {
+		return;
+	}
+
+	if (sampler->stat_fd >= 0) {
+		close (sampler->stat_fd);
+	}
+
+	if (sampler->mem_fd >= 0) {
+		close (sampler->mem_fd);
+	}
+
+	if (sampler->ksm_fd >= 0) {
+		close (sampler->ksm_fd);
+	}
+
+	if (sampler->task_dir) {
+		closedir (sampler->task_dir);
+	}
+
+	if (sampler->tasks) {
+		g_hash_table_destroy (sampler->tasks);
+	}
+
+	if (sampler->buf) {
+		g_string_free (sampler->buf, true);
+	}
+
+	g_free_if_set (sampler->comms_path);
+	g_free (sampler);
+}
+
+/*!
+ * Determine the total time spent running the vCPUs of the hypervisor.
+ *
+ * This is much cheaper than clr_oci_stats_sample() since memory
+ * usage is not sampled.
+ *
+ * \param sampler \ref clr_oci_stats_sampler.
+ * \param[out] vcpu_time Time in nanoseconds.
+ *
+ * \return \c true on success, else \c false (the hypervisor has
+ *   exited).
+ */
+gboolean
+clr_oci_stats_vcpu_time (struct clr_oci_stats_sampler *sampler,
+		guint64 *vcpu_time)
+{
+	JsonObject  *cpu_stats;
+	JsonArray   *percpu;
+	guint        i;
+
+	if (! (sampler && vcpu_time)) {
+		return false;
+	}
+
+	cpu_stats = clr_oci_stats_sample_cpu (sampler);
+	if (! cpu_stats) {
+		return false;
+	}
+
+	percpu = json_object_get_array_member
+		(json_object_get_object_member (cpu_stats, "cpu_usage"),
+		 "percpu_usage");
+
+	*vcpu_time = 0;
+	for (i = 0; i < json_array_get_length (percpu); i++) {
+		*vcpu_time += (guint64)json_array_get_int_element (percpu, i);
+	}
+
+	json_object_unref (cpu_stats);
+
+	return true;
+}
+
+/*!
+ * Sample the resource usage of the hypervisor.
+ *
+ * \param sampler \ref clr_oci_stats_sampler.
+ *
+ * \return "CgroupStats" object on success, else \c NULL
+ *   (the hypervisor has exited).
+ */
+JsonObject *
+clr_oci_stats_sample (struct clr_oci_stats_sampler *sampler)
+{
+	JsonObject  *resources;
+	JsonObject  *cpu_stats;
+	JsonObject  *memory_stats;
+
+	if (! sampler) {
+		return NULL;
+	}
+
+	cpu_stats = clr_oci_stats_sample_cpu (sampler);
+	if (! cpu_stats) {
+		return NULL;
+	}
+
+	memory_stats = clr_oci_stats_sample_memory (sampler);
+	if (! memory_stats) {
+		json_object_unref (cpu_stats);
+		return NULL;
+	}
+
+	resources = json_object_new ();
+	json_object_set_object_member (resources, "cpu_stats", cpu_stats);
+	json_object_set_object_member (resources, "memory_stats",
+			memory_stats);
+
+	return resources;
+}
@@ -0,0 +1,126 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_STATS_H
+#define _CLR_OCI_STATS_H
+
+#include <dirent.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+/** Prefix of the name qemu gives vCPU threads (requires
+ * "-name debug-threads=on").
+ */
+#define CLR_OCI_STATS_VCPU_PREFIX "CPU "
+
+/** QOM path of the virtio-balloon device. */
+#define CLR_OCI_STATS_BALLOON_PATH "/machine/peripheral/balloon0"
+
+/** Memory usage of the hypervisor process (in bytes). */
+struct clr_oci_stats_memory {
+	/** Resident set size. */
+	guint64 rss;
+
+	/** Proportional set size (\c 0 if unavailable). */
+	guint64 pss;
+
+	/** Swapped out anonymous memory. */
+	guint64 swap;
+};
+
+/** Hypervisor thread tracked by \ref clr_oci_stats_sampler. */
+struct clr_oci_stats_task {
+	/** Open "stat" file of the thread, or -1 if it is not a vCPU. */
+	int     fd;
+
+	/** vCPU index, or -1 if the thread is not a vCPU. */
+	gint    vcpu;
+
+	/** Value of \ref clr_oci_stats_sampler.generation when the
+	 * thread was last seen.
+	 */
+	guint   generation;
+};
+
+/** Collects resource usage of a running hypervisor.
+ *
+ * The /proc files of the hypervisor are opened once and re-read
+ * on every sample, so periodic sampling only costs a few
+ * \c pread(2) calls.
+ */
+struct clr_oci_stats_sampler {
+	/** Process ID of the hypervisor. */
+	GPid         pid;
+
+	/** Path to the QMP socket of the hypervisor. */
+	gchar       *comms_path;
+
+	/** Open "/proc/<pid>/stat". */
+	int          stat_fd;
+
+	/** Open "/proc/<pid>/smaps_rollup" (or "status" for kernels
+	 * that don't provide it).
+	 */
+	int          mem_fd;
+
+	/** Open "/proc/<pid>/ksm_merging_pages", or -1 for kernels
+	 * that don't provide it.
+	 */
+	int          ksm_fd;
+
+	/** Open "/proc/<pid>/task". */
+	DIR         *task_dir;
+
+	/** Map of thread ID to \ref clr_oci_stats_task. */
+	GHashTable  *tasks;
+
+	/** Incremented on every sample to find exited threads. */
+	guint        generation;
+
+	/** Nanoseconds per clock tick. */
+	guint64      tick_ns;
+
+	/** Bytes per page. */
+	guint64      page_size;
+
+	/** Highest memory usage seen. */
+	guint64      max_usage;
+
+	/** \c false once the VM is known to have no balloon device. */
+	gboolean     balloon;
+
+	/** Guest stats polling interval to request from the balloon
+	 * device (\c 0 once requested, or to leave unchanged).
+	 */
+	gint         poll_interval;
+
+	/** Buffer that /proc files are read into. */
+	GString     *buf;
+};
+
+struct clr_oci_stats_sampler *clr_oci_stats_sampler_new (GPid pid,
+		const gchar *comms_path, gint interval);
+void clr_oci_stats_sampler_free (struct clr_oci_stats_sampler *sampler);
+JsonObject *clr_oci_stats_sample (struct clr_oci_stats_sampler *sampler);
+gboolean clr_oci_stats_vcpu_time (struct clr_oci_stats_sampler *sampler,
+		guint64 *vcpu_time);
+
+#endif /* _CLR_OCI_STATS_H */
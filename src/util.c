@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -508,6 +510,53 @@ clr_oci_resolve_path (const gchar *path)
 	return g_strdup (tmp);
 }
 
+/*!
+ * Create a listening Unix domain socket, replacing any existing
+ * socket at \p path.
+ *
+ * \param path Full path to socket.
+ * \param flags Additional socket type flags (such as
+ *   \c SOCK_NONBLOCK). The socket is always close-on-exec.
+ *
+ * \return Socket on success, else \c -1.
+ */
+int
+clr_oci_socket_listen (const gchar *path, int flags)
+{
+	struct sockaddr_un  addr = { 0 };
+	int                 fd;
+
+	if (! path) {
+		return -1;
+	}
+
+	if (strlen (path) >= sizeof (addr.sun_path)) {
+		g_critical ("socket path too long: %s", path);
+		return -1;
+	}
+
+	fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+	if (fd < 0) {
+		g_critical ("failed to create socket: %s", strerror (errno));
+		return -1;
+	}
+
+	addr.sun_family = AF_UNIX;
+	g_strlcpy (addr.sun_path, path, sizeof (addr.sun_path));
+
+	(void)unlink (path);
+
+	if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0
+			|| listen (fd, SOMAXCONN) < 0) {
+		g_critical ("failed to listen on %s: %s",
+				path, strerror (errno));
+		close (fd);
+		return -1;
+	}
+
+	return fd;
+}
+
 #ifdef DEBUG
 static gboolean
 clr_oci_node_dump_aux(GNode* node, gpointer data) {
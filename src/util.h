@@ -87,5 +87,6 @@ char** node_to_strv(GNode* root);
 gboolean gnode_free(GNode* node, gpointer data);
 int clr_oci_get_signum (const gchar *signame);
 gchar *clr_oci_resolve_path (const gchar *path);
+int clr_oci_socket_listen (const gchar *path, int flags);
 
 #endif /* _CLR_OCI_UTIL_H */
@@ -0,0 +1,269 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Sharing the container rootfs with the VM using virtio-fs.
+ *
+ * By default the rootfs is shared using 9p, which is slow for
+ * workloads that access many small files. With virtio-fs, a daemon
+ * (virtiofsd) serves the rootfs to the hypervisor over a vhost-user
+ * socket and the guest can map file contents directly through a DAX
+ * window, avoiding copies through the guest page cache.
+ *
+ * The runtime creates the listening socket and passes it to the
+ * daemon, so the hypervisor can connect as soon as it is launched.
+ * The daemon exits once the hypervisor disconnects from it.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "common.h"
+#include "oci.h"
+#include "util.h"
+#include "annotation.h"
+#include "pidfd.h"
+#include "virtiofs.h"
+
+/** Map of rootfs transport to name. */
+static struct clr_oci_map clr_oci_rootfs_transport_map[] =
+{
+	{ CLR_OCI_ROOTFS_9P        , "9p"        },
+	{ CLR_OCI_ROOTFS_VIRTIO_FS , "virtio-fs" },
+
+	{ 0, NULL }
+};
+
+/*!
+ * Convert a rootfs transport name to its value.
+ *
+ * \param name Name of transport ("9p" or "virtio-fs").
+ * \param[out] transport \ref clr_oci_rootfs_transport.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_rootfs_transport_from_name (const gchar *name,
+		enum clr_oci_rootfs_transport *transport)
+{
+	struct clr_oci_map *p;
+
+	if (! (name && transport)) {
+		return false;
+	}
+
+	for (p = clr_oci_rootfs_transport_map; p && p->name; p++) {
+		if (! g_strcmp0 (p->name, name)) {
+			*transport = (enum clr_oci_rootfs_transport)p->num;
+			return true;
+		}
+	}
+
+	g_critical ("invalid rootfs transport: %s", name);
+
+	return false;
+}
+
+/*!
+ * Determine the transport used to share the rootfs with the VM.
+ *
+ * The \ref CLR_OCI_ANNOTATION_ROOTFS_TRANSPORT annotation overrides
+ * the \c vm configuration.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \ref clr_oci_rootfs_transport.
+ */
+enum clr_oci_rootfs_transport
+clr_oci_rootfs_transport_get (const struct clr_oci_config *config)
+{
+	enum clr_oci_rootfs_transport  transport;
+	const gchar                   *name;
+
+	if (! config) {
+		return CLR_OCI_ROOTFS_9P;
+	}
+
+	name = clr_oci_annotation_get (config->oci.annotations,
+			CLR_OCI_ANNOTATION_ROOTFS_TRANSPORT);
+	if (name && clr_oci_rootfs_transport_from_name (name,
+				&transport)) {
+		return transport;
+	}
+
+	return config->vm ? config->vm->rootfs_transport
+		: CLR_OCI_ROOTFS_9P;
+}
+
+/*!
+ * Perform setup on the spawned virtio-fs daemon.
+ *
+ * \param fd Listening socket to be inherited by the daemon.
+ */
+static void
+clr_oci_virtiofsd_setup_child (gpointer fd)
+{
+	int sock = GPOINTER_TO_INT (fd);
+
+	/* become session leader so the daemon outlives the runtime */
+	setsid ();
+
+	(void)fcntl (sock, F_SETFD, fcntl (sock, F_GETFD) & ~FD_CLOEXEC);
+}
+
+/*!
+ * Start the virtio-fs daemon serving the rootfs of the container.
+ *
+ * The daemon is only started if the rootfs transport is virtio-fs
+ * (see clr_oci_rootfs_transport_get()). Its process ID is saved in
+ * the state of the container so that it can be stopped on deletion.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_virtiofsd_start (struct clr_oci_config *config)
+{
+	g_autofree gchar  *socket_path = NULL;
+	g_autofree gchar  *fd_arg = NULL;
+	g_autofree gchar  *dir_arg = NULL;
+	const gchar       *daemon = CLR_OCI_VIRTIOFSD_PATH;
+	gchar             *args[5] = { NULL };
+	GError            *err = NULL;
+	gboolean           ret = false;
+	GPid               pid;
+	int                fd;
+
+	if (! (config && config->vm)) {
+		return false;
+	}
+
+	if (clr_oci_rootfs_transport_get (config)
+			!= CLR_OCI_ROOTFS_VIRTIO_FS) {
+		return true;
+	}
+
+	if (config->vm->virtiofsd_path[0]) {
+		daemon = config->vm->virtiofsd_path;
+	}
+
+	socket_path = g_build_path ("/", config->state.runtime_path,
+			CLR_OCI_VIRTIOFS_SOCKET, NULL);
+
+	fd = clr_oci_socket_listen (socket_path, 0);
+	if (fd < 0) {
+		return false;
+	}
+
+	fd_arg = g_strdup_printf ("--fd=%d", fd);
+	dir_arg = g_strdup_printf ("--shared-dir=%s",
+			config->oci.root.path);
+
+	args[0] = (gchar *)daemon;
+	args[1] = fd_arg;
+	args[2] = dir_arg;
+
+	/* The rootfs is only used by this VM, so the guest can cache
+	 * it for as long as it likes.
+	 */
+	args[3] = "--cache=always";
+
+	ret = g_spawn_async (NULL, args, NULL,
+			G_SPAWN_DO_NOT_REAP_CHILD
+			| G_SPAWN_STDOUT_TO_DEV_NULL
+			| G_SPAWN_STDERR_TO_DEV_NULL,
+			clr_oci_virtiofsd_setup_child,
+			GINT_TO_POINTER (fd),
+			&pid, &err);
+	if (! ret) {
+		g_critical ("failed to spawn %s: %s",
+				daemon, err->message);
+		g_error_free (err);
+		(void)unlink (socket_path);
+		goto out;
+	}
+
+	config->state.virtiofsd_pid = pid;
+
+	/* the daemon is still running, so it cannot have been reaped */
+	(void)clr_oci_pid_start_time (pid,
+			&config->state.virtiofsd_start_time);
+
+	g_debug ("virtio-fs daemon %s running with pid %d",
+			daemon, (int)pid);
+
+out:
+	/* The daemon now owns the socket */
+	close (fd);
+
+	return ret;
+}
+
+/*!
+ * Stop the virtio-fs daemon of the container (if it has one).
+ *
+ * The daemon normally exits with the hypervisor, so it not running
+ * is not an error.
+ *
+ * \param config \ref clr_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+clr_oci_virtiofsd_stop (struct clr_oci_config *config)
+{
+	GPid pid;
+	guint64 start_time;
+
+	if (! config) {
+		return false;
+	}
+
+	pid = config->state.virtiofsd_pid;
+	if (! pid) {
+		return true;
+	}
+
+	start_time = config->state.virtiofsd_start_time;
+
+	config->state.virtiofsd_pid = 0;
+	config->state.virtiofsd_start_time = 0;
+
+	if (! clr_oci_pid_signal (pid, start_time, SIGTERM)
+			&& errno != ESRCH) {
+		g_critical ("failed to stop virtio-fs daemon %d: %s",
+				(int)pid, strerror (errno));
+		return false;
+	}
+
+	g_debug ("stopped virtio-fs daemon %d", (int)pid);
+
+	return true;
+}
@@ -0,0 +1,46 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CLR_OCI_VIRTIOFS_H
+#define _CLR_OCI_VIRTIOFS_H
+
+#include <glib.h>
+
+#include "oci.h"
+
+/** Annotation used to select the rootfs transport of a container
+ * ("9p" or "virtio-fs"), overriding the \c vm configuration.
+ */
+#define CLR_OCI_ANNOTATION_ROOTFS_TRANSPORT "com.intel.clr.rootfs.transport"
+
+/** Default virtio-fs daemon. */
+#define CLR_OCI_VIRTIOFSD_PATH "/usr/libexec/virtiofsd"
+
+/** Default size of the virtio-fs DAX window. */
+#define CLR_OCI_VIRTIOFS_DAX_SIZE "2G"
+
+gboolean clr_oci_rootfs_transport_from_name (const gchar *name,
+		enum clr_oci_rootfs_transport *transport);
+enum clr_oci_rootfs_transport clr_oci_rootfs_transport_get
+		(const struct clr_oci_config *config);
+gboolean clr_oci_virtiofsd_start (struct clr_oci_config *config);
+gboolean clr_oci_virtiofsd_stop (struct clr_oci_config *config);
+
+#endif /* _CLR_OCI_VIRTIOFS_H */
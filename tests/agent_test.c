@@ -0,0 +1,198 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <check.h>
+#include <glib.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/agent.h"
+
+void clr_oci_agent_frame_append (GByteArray *buf, guint8 stream,
+		const guint8 *data, guint32 len);
+gboolean clr_oci_agent_frame_parse (GByteArray *buf, guint8 *stream,
+		GBytes **payload);
+gchar *clr_oci_agent_request (const struct clr_oci_config *config,
+		int argc, char *const argv[], gboolean terminal);
+
+START_TEST(test_clr_oci_vsock_cid_new) {
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		ck_assert (clr_oci_vsock_cid_new () >= CLR_OCI_VSOCK_CID_MIN);
+	}
+} END_TEST
+
+START_TEST(test_clr_oci_vsock_open) {
+	ck_assert (clr_oci_vsock_open (NULL) < 0);
+} END_TEST
+
+START_TEST(test_clr_oci_agent_frame) {
+	GByteArray *buf;
+	GBytes *payload = NULL;
+	const guint8 *data;
+	guint8 stream = 0;
+	gsize len;
+
+	ck_assert (! clr_oci_agent_frame_parse (NULL, NULL, NULL));
+
+	buf = g_byte_array_new ();
+
+	ck_assert (! clr_oci_agent_frame_parse (buf, NULL, NULL));
+	ck_assert (! clr_oci_agent_frame_parse (buf, &stream, NULL));
+
+	/* empty buffer */
+	ck_assert (clr_oci_agent_frame_parse (buf, &stream, &payload));
+	ck_assert (! payload);
+
+	clr_oci_agent_frame_append (buf, CLR_OCI_AGENT_STREAM_STDOUT,
+			(const guint8 *)"hello", 5);
+	clr_oci_agent_frame_append (buf, CLR_OCI_AGENT_STREAM_STDIN,
+			NULL, 0);
+	ck_assert (buf->len == (CLR_OCI_AGENT_HEADER_SIZE * 2) + 5);
+
+	/* header is stream then big-endian length */
+	ck_assert (buf->data[0] == CLR_OCI_AGENT_STREAM_STDOUT);
+	ck_assert (buf->data[1] == 0);
+	ck_assert (buf->data[2] == 0);
+	ck_assert (buf->data[3] == 0);
+	ck_assert (buf->data[4] == 5);
+
+	ck_assert (clr_oci_agent_frame_parse (buf, &stream, &payload));
+	ck_assert (payload);
+	ck_assert (stream == CLR_OCI_AGENT_STREAM_STDOUT);
+	data = g_bytes_get_data (payload, &len);
+	ck_assert (len == 5);
+	ck_assert (! memcmp (data, "hello", 5));
+	g_bytes_unref (payload);
+
+	/* empty frame */
+	ck_assert (clr_oci_agent_frame_parse (buf, &stream, &payload));
+	ck_assert (payload);
+	ck_assert (stream == CLR_OCI_AGENT_STREAM_STDIN);
+	ck_assert (g_bytes_get_size (payload) == 0);
+	g_bytes_unref (payload);
+	ck_assert (buf->len == 0);
+
+	/* incomplete frame is left in the buffer */
+	clr_oci_agent_frame_append (buf, CLR_OCI_AGENT_STREAM_STDERR,
+			(const guint8 *)"error", 5);
+	g_byte_array_set_size (buf, buf->len - 1);
+	ck_assert (clr_oci_agent_frame_parse (buf, &stream, &payload));
+	ck_assert (! payload);
+	ck_assert (buf->len == CLR_OCI_AGENT_HEADER_SIZE + 4);
+	g_byte_array_set_size (buf, 0);
+
+	/* oversized frame */
+	clr_oci_agent_frame_append (buf, CLR_OCI_AGENT_STREAM_STDOUT,
+			NULL, 0);
+	buf->data[1] = 0xff;
+	ck_assert (! clr_oci_agent_frame_parse (buf, &stream, &payload));
+	ck_assert (! payload);
+
+	g_byte_array_free (buf, true);
+} END_TEST
+
+START_TEST(test_clr_oci_agent_request) {
+	struct clr_oci_config config = { { 0 } };
+	char *argv[] = { "ls", "-l", NULL };
+	gchar *env[] = { "PATH=/bin", NULL };
+	gchar *str;
+
+	ck_assert (! clr_oci_agent_request (NULL, 0, NULL, false));
+	ck_assert (! clr_oci_agent_request (&config, 0, argv, false));
+	ck_assert (! clr_oci_agent_request (&config, 2, NULL, false));
+
+	str = clr_oci_agent_request (&config, 2, argv, false);
+	ck_assert (str);
+	ck_assert (strstr (str, "\"args\":[\"ls\",\"-l\"]"));
+	ck_assert (strstr (str, "\"env\":[]"));
+	ck_assert (strstr (str, "\"cwd\":\"/\""));
+	ck_assert (strstr (str, "\"terminal\":false"));
+	g_free (str);
+
+	config.oci.process.env = env;
+	g_strlcpy (config.oci.process.cwd, "/tmp",
+			sizeof (config.oci.process.cwd));
+
+	str = clr_oci_agent_request (&config, 1, argv, true);
+	ck_assert (str);
+	ck_assert (strstr (str, "\"args\":[\"ls\"]"));
+	ck_assert (strstr (str, "\"env\":[\"PATH=/bin\"]"));
+	ck_assert (strstr (str, "\"cwd\":\"/tmp\""));
+	ck_assert (strstr (str, "\"terminal\":true"));
+	g_free (str);
+} END_TEST
+
+START_TEST(test_clr_oci_agent_exec) {
+	struct clr_oci_config config = { { 0 } };
+	char *argv[] = { "true", NULL };
+	gint exit_code = 0;
+
+	ck_assert (! clr_oci_agent_exec (NULL, 0, 0, NULL, false, NULL));
+	ck_assert (! clr_oci_agent_exec (&config, 0, 1, argv,
+				false, &exit_code));
+	ck_assert (! clr_oci_agent_exec (&config, CLR_OCI_VSOCK_CID_MIN,
+				0, argv, false, &exit_code));
+	ck_assert (! clr_oci_agent_exec (&config, CLR_OCI_VSOCK_CID_MIN,
+				1, NULL, false, &exit_code));
+	ck_assert (! clr_oci_agent_exec (&config, CLR_OCI_VSOCK_CID_MIN,
+				1, argv, false, NULL));
+} END_TEST
+
+Suite* make_agent_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_vsock_cid_new, s);
+	ADD_TEST(test_clr_oci_vsock_open, s);
+	ADD_TEST(test_clr_oci_agent_frame, s);
+	ADD_TEST(test_clr_oci_agent_request, s);
+	ADD_TEST(test_clr_oci_agent_exec, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("agent_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_agent_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -30,6 +30,10 @@
 
 void clr_oci_annotation_free (struct oci_cfg_annotation *a);
 void clr_oci_annotations_free_all (GSList *annotations);
+const gchar *clr_oci_annotation_get (GSList *annotations, const gchar *key);
+gboolean clr_oci_annotation_is_true (GSList *annotations, const gchar *key);
+gboolean clr_oci_annotation_bool_get (GSList *annotations, const gchar *key,
+		gboolean *value);
 
 START_TEST(test_clr_oci_annotation_free) {
 	struct oci_cfg_annotation* a;
@@ -71,11 +75,116 @@ START_TEST(test_clr_oci_annotations_free_all) {
 
 } END_TEST
 
+START_TEST(test_clr_oci_annotation_get) {
+	GSList* list = NULL;
+	struct oci_cfg_annotation* a;
+
+	ck_assert (! clr_oci_annotation_get (NULL, NULL));
+	ck_assert (! clr_oci_annotation_get (NULL, "foo"));
+
+	a = g_new0(struct oci_cfg_annotation, 1);
+	a->key = g_strdup("foo");
+	a->value = g_strdup("bar");
+	list = g_slist_append(list, a);
+
+	a = g_new0(struct oci_cfg_annotation, 1);
+	a->key = g_strdup("novalue");
+	list = g_slist_append(list, a);
+
+	ck_assert (! clr_oci_annotation_get (list, NULL));
+	ck_assert (! clr_oci_annotation_get (list, "baz"));
+	ck_assert (! clr_oci_annotation_get (list, "novalue"));
+	ck_assert (! g_strcmp0 (clr_oci_annotation_get (list, "foo"), "bar"));
+
+	clr_oci_annotations_free_all(list);
+} END_TEST
+
+START_TEST(test_clr_oci_annotation_is_true) {
+	GSList* list = NULL;
+	struct oci_cfg_annotation* a;
+	const gchar *true_values[] = { "true", "TRUE", "yes", "on", "1", NULL };
+	const gchar *false_values[] = { "false", "no", "0", "", "truthy", NULL };
+	const gchar **v;
+
+	ck_assert (! clr_oci_annotation_is_true (NULL, "foo"));
+
+	a = g_new0(struct oci_cfg_annotation, 1);
+	a->key = g_strdup("foo");
+	list = g_slist_append(list, a);
+
+	ck_assert (! clr_oci_annotation_is_true (list, "foo"));
+
+	for (v = true_values; *v; v++) {
+		g_free (a->value);
+		a->value = g_strdup (*v);
+		ck_assert_msg (clr_oci_annotation_is_true (list, "foo"),
+				"value '%s'", *v);
+	}
+
+	for (v = false_values; *v; v++) {
+		g_free (a->value);
+		a->value = g_strdup (*v);
+		ck_assert_msg (! clr_oci_annotation_is_true (list, "foo"),
+				"value '%s'", *v);
+	}
+
+	clr_oci_annotations_free_all(list);
+} END_TEST
+
+START_TEST(test_clr_oci_annotation_bool_get) {
+	GSList* list = NULL;
+	struct oci_cfg_annotation* a;
+	const gchar *true_values[] = { "true", "TRUE", "yes", "On", "1", NULL };
+	const gchar *false_values[] = { "false", "False", "NO", "off", "0", NULL };
+	const gchar *invalid_values[] = { "", "truthy", "2", "y", NULL };
+	const gchar **v;
+	gboolean value;
+
+	ck_assert (! clr_oci_annotation_bool_get (NULL, "foo", &value));
+
+	a = g_new0(struct oci_cfg_annotation, 1);
+	a->key = g_strdup("foo");
+	a->value = g_strdup("true");
+	list = g_slist_append(list, a);
+
+	ck_assert (! clr_oci_annotation_bool_get (list, "foo", NULL));
+	ck_assert (! clr_oci_annotation_bool_get (list, "bar", &value));
+
+	for (v = true_values; *v; v++) {
+		g_free (a->value);
+		a->value = g_strdup (*v);
+		value = false;
+		ck_assert_msg (clr_oci_annotation_bool_get (list, "foo",
+					&value) && value, "value '%s'", *v);
+	}
+
+	for (v = false_values; *v; v++) {
+		g_free (a->value);
+		a->value = g_strdup (*v);
+		value = true;
+		ck_assert_msg (clr_oci_annotation_bool_get (list, "foo",
+					&value) && ! value, "value '%s'", *v);
+	}
+
+	for (v = invalid_values; *v; v++) {
+		g_free (a->value);
+		a->value = g_strdup (*v);
+		value = true;
+		ck_assert_msg (! clr_oci_annotation_bool_get (list, "foo",
+					&value) && value, "value '%s'", *v);
+	}
+
+	clr_oci_annotations_free_all(list);
+} END_TEST
+
 Suite* make_annotation_suite(void) {
 	Suite* s = suite_create(__FILE__);
 
 	ADD_TEST(test_clr_oci_annotation_free, s);
 	ADD_TEST(test_clr_oci_annotations_free_all, s);
+	ADD_TEST(test_clr_oci_annotation_get, s);
+	ADD_TEST(test_clr_oci_annotation_is_true, s);
+	ADD_TEST(test_clr_oci_annotation_bool_get, s);
 
 	return s;
 }
@@ -0,0 +1,240 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/oci.h"
+#include "../src/autopause.h"
+
+#define SEC (G_USEC_PER_SEC)
+
+gboolean clr_oci_autopause_idle (struct clr_oci_autopause *autopause,
+		guint64 vcpu_time, gint64 now);
+
+/*!
+ * Set \ref CLR_OCI_ANNOTATION_AUTOPAUSE_IDLE for \p config.
+ *
+ * \param config \ref clr_oci_config.
+ * \param value Value of annotation.
+ */
+static void
+test_annotation_set (struct clr_oci_config *config, const gchar *value)
+{
+	struct oci_cfg_annotation *a;
+
+	a = g_new0 (struct oci_cfg_annotation, 1);
+	a->key = g_strdup (CLR_OCI_ANNOTATION_AUTOPAUSE_IDLE);
+	a->value = g_strdup (value);
+	config->oci.annotations = g_slist_prepend (NULL, a);
+}
+
+/*!
+ * Free the annotation set by test_annotation_set().
+ *
+ * \param config \ref clr_oci_config.
+ */
+static void
+test_annotation_free (struct clr_oci_config *config)
+{
+	struct oci_cfg_annotation *a = config->oci.annotations->data;
+
+	g_free (a->key);
+	g_free (a->value);
+	g_free (a);
+	g_slist_free (config->oci.annotations);
+	config->oci.annotations = NULL;
+}
+
+START_TEST(test_clr_oci_autopause_get) {
+	struct clr_oci_config config = { { 0 } };
+
+	ck_assert (clr_oci_autopause_get (NULL) == 0);
+	ck_assert (clr_oci_autopause_get (&config) == 0);
+
+	test_annotation_set (&config, "30");
+	ck_assert (clr_oci_autopause_get (&config) == 30);
+	test_annotation_free (&config);
+
+	test_annotation_set (&config, "0");
+	ck_assert (clr_oci_autopause_get (&config) == 0);
+	test_annotation_free (&config);
+
+	test_annotation_set (&config, "");
+	ck_assert (clr_oci_autopause_get (&config) == 0);
+	test_annotation_free (&config);
+
+	test_annotation_set (&config, "30s");
+	ck_assert (clr_oci_autopause_get (&config) == 0);
+	test_annotation_free (&config);
+
+	test_annotation_set (&config, "-1");
+	ck_assert (clr_oci_autopause_get (&config) == 0);
+	test_annotation_free (&config);
+} END_TEST
+
+START_TEST(test_clr_oci_autopause_idle) {
+	struct clr_oci_autopause autopause = { 0 };
+	guint64 vcpu_time = 0;
+	gint64 now = 100 * SEC;
+
+	autopause.idle = 10;
+	autopause.last_activity = now;
+
+	/* first sample only records the vCPU time */
+	ck_assert (! clr_oci_autopause_idle (&autopause, vcpu_time, now));
+	ck_assert (autopause.sample_time == now);
+
+	/* 1% of the elapsed time is idle */
+	now += 5 * SEC;
+	vcpu_time += 50000000ULL;
+	ck_assert (! clr_oci_autopause_idle (&autopause, vcpu_time, now));
+	ck_assert (autopause.last_activity == 100 * SEC);
+
+	now += 5 * SEC;
+	vcpu_time += 50000000ULL;
+	ck_assert (clr_oci_autopause_idle (&autopause, vcpu_time, now));
+
+	/* 10% of the elapsed time is busy */
+	now += 5 * SEC;
+	vcpu_time += 500000000ULL;
+	ck_assert (! clr_oci_autopause_idle (&autopause, vcpu_time, now));
+	ck_assert (autopause.last_activity == now);
+
+	/* idle for the full period again */
+	now += 5 * SEC;
+	ck_assert (! clr_oci_autopause_idle (&autopause, vcpu_time, now));
+	now += 5 * SEC;
+	ck_assert (clr_oci_autopause_idle (&autopause, vcpu_time, now));
+
+	/* vCPU time going backwards (the hypervisor thread exited)
+	 * is ignored
+	 */
+	now += 5 * SEC;
+	ck_assert (clr_oci_autopause_idle (&autopause, 0, now));
+} END_TEST
+
+START_TEST(test_clr_oci_autopause_wake) {
+	struct clr_oci_config config = { { 0 } };
+	struct clr_oci_autopause *autopause;
+	g_autofree gchar *tmpdir = g_dir_make_tmp (NULL, NULL);
+	g_autofree gchar *path = NULL;
+	struct stat st;
+	int hold = 0;
+
+	ck_assert (tmpdir);
+	g_strlcpy (config.state.runtime_path, tmpdir,
+			sizeof (config.state.runtime_path));
+	path = g_build_path ("/", tmpdir, CLR_OCI_AUTOPAUSE_FILE, NULL);
+
+	ck_assert (! clr_oci_autopause_wake (NULL, NULL));
+
+	/* VM is never paused automatically */
+	ck_assert (! clr_oci_autopause_new (tmpdir, "qmp.sock", 1, 0));
+	ck_assert (clr_oci_autopause_wake (&config, &hold));
+	ck_assert (hold == -1);
+
+	ck_assert (! clr_oci_autopause_new (NULL, "qmp.sock", 1, 10));
+	ck_assert (! clr_oci_autopause_new (tmpdir, NULL, 1, 10));
+
+	autopause = clr_oci_autopause_new (tmpdir, "qmp.sock", 1, 10);
+	ck_assert (autopause);
+	ck_assert (autopause->idle == 10);
+	ck_assert (! autopause->paused);
+	ck_assert (g_stat (path, &st) == 0);
+	ck_assert (st.st_size == 0);
+
+	/* nothing is counted until the container has been started */
+	autopause->last_activity = 0;
+	ck_assert (clr_oci_autopause_check (autopause));
+	ck_assert (! autopause->started);
+	ck_assert (! autopause->sampler);
+	ck_assert (autopause->last_activity == 0);
+
+	/* activity is recorded even when the VM is not paused */
+	autopause->last_activity = 0;
+	clr_oci_autopause_activity (autopause);
+	ck_assert (autopause->last_activity > 0);
+
+	/* waking a running VM only records that it is in use */
+	ck_assert (clr_oci_autopause_wake (&config, NULL));
+	ck_assert (g_stat (path, &st) == 0);
+	ck_assert (st.st_size == 0);
+	ck_assert (! autopause->paused);
+
+	/* the VM cannot be paused while a command holds the file */
+	ck_assert (clr_oci_autopause_wake (&config, &hold));
+	ck_assert (hold >= 0);
+	ck_assert (flock (autopause->fd, LOCK_EX | LOCK_NB) < 0);
+	ck_assert (errno == EWOULDBLOCK);
+
+	close (hold);
+	ck_assert (flock (autopause->fd, LOCK_EX | LOCK_NB) == 0);
+	ck_assert (flock (autopause->fd, LOCK_UN) == 0);
+
+	clr_oci_autopause_free (autopause);
+
+	ck_assert (g_remove (path) == 0);
+	ck_assert (g_remove (tmpdir) == 0);
+} END_TEST
+
+Suite* make_autopause_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_autopause_get, s);
+	ADD_TEST(test_clr_oci_autopause_idle, s);
+	ADD_TEST(test_clr_oci_autopause_wake, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("autopause_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_autopause_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
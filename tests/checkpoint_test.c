@@ -0,0 +1,283 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/checkpoint.h"
+
+int clr_oci_checkpoint_ram_open (GPid pid);
+
+START_TEST(test_clr_oci_checkpoint_lazy_get) {
+	struct clr_oci_config      config = { { 0 } };
+	struct clr_oci_vm_cfg      vm = { { 0 } };
+	struct oci_cfg_annotation *a;
+
+	ck_assert (! clr_oci_checkpoint_lazy_get (NULL));
+	ck_assert (! clr_oci_checkpoint_lazy_get (&config));
+
+	config.vm = &vm;
+	ck_assert (! clr_oci_checkpoint_lazy_get (&config));
+
+	vm.lazy_checkpoint = true;
+	ck_assert (clr_oci_checkpoint_lazy_get (&config));
+
+	/* the annotation overrides the vm configuration */
+	a = g_new0 (struct oci_cfg_annotation, 1);
+	a->key = g_strdup (CLR_OCI_ANNOTATION_CHECKPOINT_LAZY);
+	a->value = g_strdup ("false");
+	config.oci.annotations = g_slist_prepend (NULL, a);
+
+	ck_assert (! clr_oci_checkpoint_lazy_get (&config));
+
+	vm.lazy_checkpoint = false;
+	g_free (a->value);
+	a->value = g_strdup ("true");
+	ck_assert (clr_oci_checkpoint_lazy_get (&config));
+
+	g_free (a->key);
+	g_free (a->value);
+	g_free (a);
+	g_slist_free (config.oci.annotations);
+} END_TEST
+
+START_TEST(test_clr_oci_checkpoint_path) {
+	struct clr_oci_checkpoint cp = { 0 };
+	gchar *path;
+
+	ck_assert (! clr_oci_checkpoint_path (NULL));
+	ck_assert (! clr_oci_checkpoint_path (&cp));
+
+	cp.image_path = "/tmp/cp";
+
+	path = clr_oci_checkpoint_path (&cp);
+	ck_assert_str_eq (path, "/tmp/cp/" CLR_OCI_CHECKPOINT_FILE);
+	g_free (path);
+
+	cp.compress = true;
+
+	path = clr_oci_checkpoint_path (&cp);
+	ck_assert_str_eq (path, "/tmp/cp/"
+			CLR_OCI_CHECKPOINT_COMPRESSED_FILE);
+	g_free (path);
+} END_TEST
+
+START_TEST(test_clr_oci_checkpoint_uri) {
+	struct clr_oci_checkpoint cp = { 0 };
+	gchar *uri;
+
+	ck_assert (! clr_oci_checkpoint_uri (NULL, true));
+	ck_assert (! clr_oci_checkpoint_uri (&cp, true));
+
+	cp.image_path = "/tmp/cp";
+
+	uri = clr_oci_checkpoint_uri (&cp, true);
+	ck_assert_str_eq (uri, "file:/tmp/cp/" CLR_OCI_CHECKPOINT_FILE);
+	g_free (uri);
+
+	uri = clr_oci_checkpoint_uri (&cp, false);
+	ck_assert_str_eq (uri, "file:/tmp/cp/" CLR_OCI_CHECKPOINT_FILE);
+	g_free (uri);
+
+	cp.compress = true;
+	cp.image_path = "/tmp/a dir";
+
+	uri = clr_oci_checkpoint_uri (&cp, true);
+	ck_assert_str_eq (uri, "exec:gzip -c > '/tmp/a dir/"
+			CLR_OCI_CHECKPOINT_COMPRESSED_FILE "'");
+	g_free (uri);
+
+	uri = clr_oci_checkpoint_uri (&cp, false);
+	ck_assert_str_eq (uri, "exec:gzip -dc < '/tmp/a dir/"
+			CLR_OCI_CHECKPOINT_COMPRESSED_FILE "'");
+	g_free (uri);
+} END_TEST
+
+START_TEST(test_clr_oci_checkpoint_info) {
+	struct clr_oci_checkpoint cp = { 0 };
+	struct clr_oci_checkpoint loaded = { 0 };
+	gchar *tmpdir;
+	gchar *path;
+
+	ck_assert (! clr_oci_checkpoint_info_write (NULL));
+	ck_assert (! clr_oci_checkpoint_info_write (&cp));
+	ck_assert (! clr_oci_checkpoint_info_read (NULL));
+	ck_assert (! clr_oci_checkpoint_info_read (&loaded));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	path = g_build_path ("/", tmpdir,
+			CLR_OCI_CHECKPOINT_INFO_FILE, NULL);
+
+	/* no info file */
+	loaded.image_path = tmpdir;
+	ck_assert (! clr_oci_checkpoint_info_read (&loaded));
+
+	/* invalid info file */
+	ck_assert (g_file_set_contents (path, "[]", -1, NULL));
+	ck_assert (! clr_oci_checkpoint_info_read (&loaded));
+
+	cp.image_path = tmpdir;
+	cp.compress = true;
+	cp.size = 123456789;
+	cp.duration = 1.5;
+
+	ck_assert (clr_oci_checkpoint_info_write (&cp));
+	ck_assert (clr_oci_checkpoint_info_read (&loaded));
+
+	ck_assert (loaded.compress);
+	ck_assert (loaded.channels == 0);
+	ck_assert (loaded.size == 123456789);
+	ck_assert (loaded.duration == 1.5);
+
+	cp.compress = false;
+	cp.channels = 4;
+
+	ck_assert (clr_oci_checkpoint_info_write (&cp));
+	ck_assert (clr_oci_checkpoint_info_read (&loaded));
+
+	ck_assert (! loaded.compress);
+	ck_assert (loaded.channels == 4);
+	ck_assert (! loaded.lazy);
+
+	cp.channels = 0;
+	cp.lazy = true;
+
+	ck_assert (clr_oci_checkpoint_info_write (&cp));
+	ck_assert (clr_oci_checkpoint_info_read (&loaded));
+	ck_assert (loaded.lazy);
+	ck_assert (! loaded.paused);
+
+	cp.paused = true;
+
+	ck_assert (clr_oci_checkpoint_info_write (&cp));
+	ck_assert (clr_oci_checkpoint_info_read (&loaded));
+	ck_assert (loaded.paused);
+
+	ck_assert (! g_remove (path));
+	ck_assert (! g_remove (tmpdir));
+
+	g_free (path);
+	g_free (tmpdir);
+} END_TEST
+
+START_TEST(test_clr_oci_checkpoint_ram_save) {
+	struct stat st;
+	gchar *tmpdir;
+	gchar *path;
+	gchar *contents = NULL;
+	gsize len = 0;
+	guint64 size = 0;
+	gsize ram_size = 4 * 1024 * 1024;
+	gsize offset = 1024 * 1024;
+	int fd;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	path = g_build_path ("/", tmpdir,
+			CLR_OCI_CHECKPOINT_RAM_FILE, NULL);
+
+	ck_assert (! clr_oci_checkpoint_ram_save (0, path, &size));
+	ck_assert (! clr_oci_checkpoint_ram_save (getpid (), NULL, &size));
+	ck_assert (! clr_oci_checkpoint_ram_save (getpid (), path, NULL));
+
+	/* no guest RAM */
+	ck_assert (clr_oci_checkpoint_ram_open (getpid ()) < 0);
+	ck_assert (! clr_oci_checkpoint_ram_save (getpid (), path, &size));
+
+	/* pretend to be a hypervisor */
+	fd = memfd_create (CLR_OCI_RAM_MEMFD_NAME, MFD_CLOEXEC);
+	ck_assert (fd >= 0);
+	ck_assert (! ftruncate (fd, (off_t)ram_size));
+	ck_assert (pwrite (fd, "hello", 5, (off_t)offset) == 5);
+
+	ck_assert (clr_oci_checkpoint_ram_save (getpid (), path, &size));
+
+	/* only the touched page is copied */
+	ck_assert (size > 0);
+	ck_assert (size < ram_size);
+
+	ck_assert (! stat (path, &st));
+	ck_assert ((gsize)st.st_size == ram_size);
+
+	ck_assert (g_file_get_contents (path, &contents, &len, NULL));
+	ck_assert (len == ram_size);
+	ck_assert (! memcmp (contents + offset, "hello", 5));
+	ck_assert (! contents[0]);
+	ck_assert (! contents[ram_size - 1]);
+
+	close (fd);
+
+	ck_assert (! g_remove (path));
+	ck_assert (! g_remove (tmpdir));
+
+	g_free (contents);
+	g_free (path);
+	g_free (tmpdir);
+} END_TEST
+
+Suite* make_checkpoint_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_checkpoint_lazy_get, s);
+	ADD_TEST(test_clr_oci_checkpoint_path, s);
+	ADD_TEST(test_clr_oci_checkpoint_uri, s);
+	ADD_TEST(test_clr_oci_checkpoint_info, s);
+	ADD_TEST(test_clr_oci_checkpoint_ram_save, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("checkpoint_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_checkpoint_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,164 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/console-log.h"
+
+/*!
+ * Read everything available from \p log starting at \p pos.
+ *
+ * \param log \ref clr_oci_console_log.
+ * \param pos Position to start reading from.
+ *
+ * \return Newly-allocated string.
+ */
+static gchar *
+test_log_read (const struct clr_oci_console_log *log, guint64 pos)
+{
+	gchar buf[64] = { 0 };
+
+	(void)clr_oci_console_log_read (log, &pos, buf, sizeof (buf) - 1);
+
+	return g_strdup (buf);
+}
+
+START_TEST(test_clr_oci_console_log) {
+	struct clr_oci_console_log log = { 0 };
+	struct clr_oci_console_log reader = { 0 };
+	g_autofree gchar *tmpdir = g_dir_make_tmp (NULL, NULL);
+	g_autofree gchar *path = NULL;
+	gchar buf[64];
+	gchar *str;
+	guint64 pos = 0;
+
+	ck_assert (tmpdir);
+	path = g_build_path ("/", tmpdir, "console.log", NULL);
+
+	ck_assert (! clr_oci_console_log_create (NULL, path, 16));
+	ck_assert (! clr_oci_console_log_create (&log, NULL, 16));
+	ck_assert (! clr_oci_console_log_create (&log, path, 0));
+
+	ck_assert (! clr_oci_console_log_open (&reader, path));
+
+	/* 16 byte ring, of which the most recent 12 bytes are readable */
+	ck_assert (clr_oci_console_log_create (&log, path, 16));
+	ck_assert (clr_oci_console_log_head (&log) == 0);
+	ck_assert (clr_oci_console_log_read (&log, &pos,
+				buf, sizeof (buf)) == 0);
+	ck_assert (clr_oci_console_log_tail (&log, 10) == 0);
+
+	clr_oci_console_log_write (&log, "hello\nworld\n", 12);
+	ck_assert (clr_oci_console_log_head (&log) == 12);
+
+	str = test_log_read (&log, 0);
+	ck_assert_str_eq (str, "hello\nworld\n");
+	g_free (str);
+
+	/* reading advances the position */
+	pos = 0;
+	ck_assert (clr_oci_console_log_read (&log, &pos, buf, 6) == 6);
+	ck_assert (pos == 6);
+	ck_assert (! memcmp (buf, "hello\n", 6));
+
+	ck_assert (clr_oci_console_log_tail (&log, 0) == 12);
+	ck_assert (clr_oci_console_log_tail (&log, 1) == 6);
+	ck_assert (clr_oci_console_log_tail (&log, 2) == 0);
+	ck_assert (clr_oci_console_log_tail (&log, 10) == 0);
+
+	/* a second process sees the same data */
+	ck_assert (clr_oci_console_log_open (&reader, path));
+	ck_assert (clr_oci_console_log_head (&reader) == 12);
+
+	/* wrap, losing the oldest data */
+	clr_oci_console_log_write (&log, "abcdef", 6);
+	ck_assert (clr_oci_console_log_head (&reader) == 18);
+
+	str = test_log_read (&reader, 0);
+	ck_assert_str_eq (str, "world\nabcdef");
+	g_free (str);
+
+	str = test_log_read (&reader, 14);
+	ck_assert_str_eq (str, "cdef");
+	g_free (str);
+
+	/* a partial final line counts as a line */
+	ck_assert (clr_oci_console_log_tail (&reader, 1) == 12);
+
+	/* writes larger than the ring only retain the end */
+	clr_oci_console_log_write (&log,
+			"0123456789abcdefghijklmnopqrstuvwxyz", 36);
+	ck_assert (clr_oci_console_log_head (&reader) == 54);
+
+	str = test_log_read (&reader, 0);
+	ck_assert_str_eq (str, "opqrstuvwxyz");
+	g_free (str);
+
+	clr_oci_console_log_close (&reader);
+	clr_oci_console_log_close (&log);
+
+	/* only console logs can be opened */
+	ck_assert (g_file_set_contents (path, "not a log", -1, NULL));
+	ck_assert (! clr_oci_console_log_open (&reader, path));
+
+	ck_assert (! g_remove (path));
+	ck_assert (! g_rmdir (tmpdir));
+} END_TEST
+
+Suite* make_console_log_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_console_log, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("console_log_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_console_log_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,179 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <check.h>
+#include <glib.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/console.h"
+
+/*!
+ * Read exactly \p len bytes from \p fd, running the default main
+ * context to allow the relay to make progress.
+ *
+ * \param fd Non-blocking file descriptor to read from.
+ * \param buf Buffer to read into.
+ * \param len Number of bytes to read.
+ *
+ * \return \c true if all bytes were read, else \c false.
+ */
+static gboolean
+test_relay_read (int fd, gchar *buf, gsize len)
+{
+	gint64 end = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+	gsize total = 0;
+	ssize_t bytes;
+
+	while (total < len && g_get_monotonic_time () < end) {
+		g_main_context_iteration (NULL, false);
+
+		bytes = read (fd, buf + total, len - total);
+		if (bytes > 0) {
+			total += (gsize)bytes;
+		} else {
+			g_usleep (1000);
+		}
+	}
+
+	return total == len;
+}
+
+/*!
+ * Quit the specified main loop.
+ *
+ * \param loop \c GMainLoop.
+ *
+ * \return \c false.
+ */
+static gboolean
+test_loop_timeout (GMainLoop *loop)
+{
+	g_main_loop_quit (loop);
+
+	return false;
+}
+
+START_TEST(test_clr_oci_console_relay) {
+	struct clr_oci_console_relay relay;
+	GMainLoop *loop;
+	int sv[2];
+	int in[2];
+	int out[2];
+	gchar data[4096];
+	gchar buf[sizeof (data)];
+	gsize i;
+	guint timeout;
+
+	loop = g_main_loop_new (NULL, false);
+	ck_assert (loop);
+
+	ck_assert (! socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv));
+	ck_assert (! pipe2 (in, O_CLOEXEC));
+	ck_assert (! pipe2 (out, O_CLOEXEC | O_NONBLOCK));
+
+	ck_assert (! clr_oci_console_relay_init (NULL,
+				sv[0], in[0], out[1], loop));
+	ck_assert (! clr_oci_console_relay_init (&relay,
+				-1, in[0], out[1], loop));
+
+	ck_assert (clr_oci_console_relay_init (&relay,
+				sv[0], in[0], out[1], loop));
+
+	/* binary data (including NULs and no newline) */
+	for (i = 0; i < sizeof (data); i++) {
+		data[i] = (gchar)(i % 251);
+	}
+
+	/* input to console */
+	ck_assert (write (in[1], data, sizeof (data)) == sizeof (data));
+	ck_assert (! fcntl (sv[1], F_SETFL, O_NONBLOCK));
+	ck_assert (test_relay_read (sv[1], buf, sizeof (buf)));
+	ck_assert (! memcmp (data, buf, sizeof (data)));
+
+	/* console to output */
+	memset (buf, 0, sizeof (buf));
+	ck_assert (write (sv[1], data, sizeof (data)) == sizeof (data));
+	ck_assert (test_relay_read (out[0], buf, sizeof (buf)));
+	ck_assert (! memcmp (data, buf, sizeof (data)));
+
+	/* input finishing does not stop the relay */
+	close (in[1]);
+	while (g_main_context_iteration (NULL, false))
+		;
+	ck_assert (relay.input.done);
+	ck_assert (! relay.output.done);
+
+	/* console closing stops the relay */
+	close (sv[1]);
+	timeout = g_timeout_add_seconds (5,
+			(GSourceFunc)test_loop_timeout, loop);
+	g_main_loop_run (loop);
+	ck_assert (relay.output.done);
+	g_source_remove (timeout);
+
+	clr_oci_console_relay_free (&relay);
+
+	close (sv[0]);
+	close (in[0]);
+	close (out[0]);
+	close (out[1]);
+	g_main_loop_unref (loop);
+} END_TEST
+
+Suite* make_console_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_console_relay, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("console_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_console_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
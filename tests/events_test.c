@@ -0,0 +1,136 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/oci.h"
+#include "../src/events.h"
+
+gchar *clr_oci_vm_event_to_json (const gchar *id, JsonObject *event);
+
+/*!
+ * Parse a QMP event.
+ *
+ * \param str JSON string.
+ *
+ * \return \c JsonObject.
+ */
+static JsonObject *
+test_event_new (const gchar *str)
+{
+	JsonParser *parser = json_parser_new ();
+	JsonObject *obj;
+
+	ck_assert (json_parser_load_from_data (parser, str, -1, NULL));
+	obj = json_object_ref (json_node_get_object
+			(json_parser_get_root (parser)));
+	g_object_unref (parser);
+
+	return obj;
+}
+
+START_TEST(test_clr_oci_vm_event_to_json) {
+	JsonObject *event;
+	gchar *str;
+
+	event = test_event_new ("{\"event\": \"STOP\"}");
+	ck_assert (! clr_oci_vm_event_to_json (NULL, event));
+	ck_assert (! clr_oci_vm_event_to_json ("foo", NULL));
+	json_object_unref (event);
+
+	/* not an event */
+	event = test_event_new ("{\"return\": {}}");
+	ck_assert (! clr_oci_vm_event_to_json ("foo", event));
+	json_object_unref (event);
+
+	/* not a lifecycle event */
+	event = test_event_new ("{\"event\": \"NIC_RX_FILTER_CHANGED\"}");
+	ck_assert (! clr_oci_vm_event_to_json ("foo", event));
+	json_object_unref (event);
+
+	event = test_event_new ("{\"event\": \"STOP\"}");
+	str = clr_oci_vm_event_to_json ("foo", event);
+	ck_assert_str_eq (str, "{\"type\":\"stop\",\"id\":\"foo\"}");
+	g_free (str);
+	json_object_unref (event);
+
+	event = test_event_new ("{\"timestamp\": {\"seconds\": 1470000000, "
+			"\"microseconds\": 500}, "
+			"\"event\": \"GUEST_PANICKED\", "
+			"\"data\": {\"action\": \"pause\"}}");
+	str = clr_oci_vm_event_to_json ("bar", event);
+	ck_assert_str_eq (str, "{\"type\":\"guest_panicked\","
+			"\"id\":\"bar\","
+			"\"timestamp\":\"2016-07-31T21:20:00.000500Z\","
+			"\"data\":{\"action\":\"pause\"}}");
+	g_free (str);
+	json_object_unref (event);
+} END_TEST
+
+START_TEST(test_show_container_events) {
+	g_autofree gchar *tmpdir = g_dir_make_tmp (NULL, NULL);
+
+	/* no such container */
+	ck_assert (! show_container_events (tmpdir, "foo"));
+
+	ck_assert (! g_rmdir (tmpdir));
+} END_TEST
+
+Suite* make_events_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_vm_event_to_json, s);
+	ADD_TEST(test_show_container_events, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("events_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_events_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
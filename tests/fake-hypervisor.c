@@ -0,0 +1,1236 @@
+/*
+ * This file is part of clr-oci-runtime.
+ *
+ * Copyright (C) 2016 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Stand-in hypervisor used to exercise the runtime without qemu.
+ *
+ * Accepts the command-line generated from hypervisor.args, creates the
+ * QMP, console and process sockets specified on it and implements
+ * enough of the QMP protocol (capabilities negotiation, stop, cont,
+ * system_powerdown, quit and a handful of queries, plus the
+ * corresponding asynchronous events) for the runtime to drive the full
+ * container lifecycle.
+ *
+ * Console input is echoed back to the console. A line containing only
+ * "exit" behaves like the workload exiting: the "guest" shuts down.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <json-glib/json-glib.h>
+
+/** String that terminates every message sent to a QMP client. */
+#define FAKE_QMP_SEPARATOR "\r\n"
+
+/** Size of buffer used to read from clients. */
+#define FAKE_BUF_SIZE 4096
+
+/** Value of "id=" that denotes the console chardev. */
+#define FAKE_CONSOLE_ID "charconsole0"
+
+/** Type of socket created by the hypervisor. */
+enum fake_server_type {
+	FAKE_SERVER_QMP = 0,
+	FAKE_SERVER_CONSOLE,
+	FAKE_SERVER_OTHER,
+};
+
+/** A listening socket created from the command-line. */
+struct fake_server {
+	enum fake_server_type  type;
+
+	/** Chardev id (or \c NULL for "-qmp"). */
+	gchar                 *id;
+
+	/** Path to socket (or \c NULL if it was inherited). */
+	gchar                 *path;
+	int                    fd;
+	guint                  source;
+};
+
+/** A connection accepted on a \ref fake_server. */
+struct fake_client {
+	struct fake_server  *server;
+	int                  fd;
+	guint                source;
+
+	/** Data received but not yet handled. */
+	GString             *buf;
+
+	/** \c true once "qmp_capabilities" has been received. */
+	gboolean             negotiated;
+};
+
+/** Handler for a single QMP command. */
+struct fake_qmp_cmd {
+	const gchar  *name;
+	void        (*handler) (struct fake_client *client,
+				JsonObject *arguments,
+				const gchar *id);
+};
+
+static GMainLoop  *loop;
+static GSList     *servers;
+static GSList     *clients;
+static gchar      *vm_name;
+static gchar      *vm_uuid;
+static gint        vm_cpus = 1;
+static gboolean    vm_running = true;
+static gboolean    console_stdio;
+
+static void fake_client_free (struct fake_client *client);
+
+/*!
+ * Write all of \p len bytes of \p data to \p fd.
+ *
+ * \param fd File descriptor.
+ * \param data Data to write.
+ * \param len Size of \p data.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+fake_write_all (int fd, const gchar *data, gsize len)
+{
+	while (len) {
+		ssize_t bytes = write (fd, data, len);
+
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+
+		data += bytes;
+		len -= (gsize)bytes;
+	}
+
+	return true;
+}
+
+/*!
+ * Send a single QMP message to \p client.
+ *
+ * \param client \ref fake_client.
+ * \param msg Single-line JSON message (without separator).
+ */
+static void
+fake_qmp_send (struct fake_client *client, const gchar *msg)
+{
+	g_autofree gchar *line = NULL;
+
+	line = g_strdup_printf ("%s%s", msg, FAKE_QMP_SEPARATOR);
+
+	(void)fake_write_all (client->fd, line, strlen (line));
+}
+
+/*!
+ * Send a QMP "return" message, echoing the command id if one was
+ * specified.
+ *
+ * \param client \ref fake_client.
+ * \param value JSON value to return.
+ * \param id Serialised command id, or \c NULL.
+ */
+static void
+fake_qmp_return (struct fake_client *client, const gchar *value,
+		const gchar *id)
+{
+	g_autofree gchar *msg = NULL;
+
+	if (id) {
+		msg = g_strdup_printf ("{\"return\": %s, \"id\": %s}",
+				value, id);
+	} else {
+		msg = g_strdup_printf ("{\"return\": %s}", value);
+	}
+
+	fake_qmp_send (client, msg);
+}
+
+/*!
+ * Send a QMP "error" message.
+ *
+ * \param client \ref fake_client.
+ * \param class QMP error class.
+ * \param desc Human-readable description.
+ * \param id Serialised command id, or \c NULL.
+ */
+static void
+fake_qmp_error (struct fake_client *client, const gchar *class,
+		const gchar *desc, const gchar *id)
+{
+	g_autofree gchar *msg = NULL;
+
+	msg = g_strdup_printf ("{\"error\": {\"class\": \"%s\", "
+			"\"desc\": \"%s\"}%s%s}",
+			class, desc,
+			id ? ", \"id\": " : "",
+			id ? id : "");
+
+	fake_qmp_send (client, msg);
+}
+
+/*!
+ * Send a QMP event to all clients that have completed capabilities
+ * negotiation.
+ *
+ * \param event Name of event.
+ * \param data JSON object to use as event data, or \c NULL.
+ */
+static void
+fake_qmp_event (const gchar *event, const gchar *data)
+{
+	g_autofree gchar  *msg = NULL;
+	gint64             now;
+	GSList            *l;
+
+	now = g_get_real_time ();
+
+	msg = g_strdup_printf ("{\"timestamp\": {\"seconds\": %ld, "
+			"\"microseconds\": %ld}, "
+			"\"event\": \"%s\"%s%s}",
+			(long int)(now / G_USEC_PER_SEC),
+			(long int)(now % G_USEC_PER_SEC),
+			event,
+			data ? ", \"data\": " : "",
+			data ? data : "");
+
+	for (l = clients; l; l = g_slist_next (l)) {
+		struct fake_client *client = l->data;
+
+		if (client->server->type == FAKE_SERVER_QMP
+				&& client->negotiated) {
+			fake_qmp_send (client, msg);
+		}
+	}
+}
+
+/*!
+ * Arrange for the hypervisor to exit once the current event has been
+ * handled.
+ */
+static void
+fake_vm_exit (void)
+{
+	g_main_loop_quit (loop);
+}
+
+/*!
+ * Simulate the guest powering itself off.
+ *
+ * \param reason QMP shutdown reason.
+ * \param guest \c true if the shutdown was initiated by the guest.
+ */
+static void
+fake_vm_shutdown (const gchar *reason, gboolean guest)
+{
+	g_autofree gchar *data = NULL;
+
+	data = g_strdup_printf ("{\"guest\": %s, \"reason\": \"%s\"}",
+			guest ? "true" : "false", reason);
+
+	fake_qmp_event ("SHUTDOWN", data);
+
+	fake_vm_exit ();
+}
+
+static void
+fake_cmd_capabilities (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	(void)arguments;
+
+	client->negotiated = true;
+	fake_qmp_return (client, "{}", id);
+}
+
+static void
+fake_cmd_stop (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	(void)arguments;
+
+	/* qemu emits the event before replying */
+	if (vm_running) {
+		vm_running = false;
+		fake_qmp_event ("STOP", NULL);
+	}
+
+	fake_qmp_return (client, "{}", id);
+}
+
+static void
+fake_cmd_cont (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	(void)arguments;
+
+	if (! vm_running) {
+		vm_running = true;
+		fake_qmp_event ("RESUME", NULL);
+	}
+
+	fake_qmp_return (client, "{}", id);
+}
+
+static void
+fake_cmd_system_powerdown (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	(void)arguments;
+
+	fake_qmp_return (client, "{}", id);
+
+	/* The ACPI request is honoured immediately by the "guest" */
+	fake_qmp_event ("POWERDOWN", NULL);
+	fake_vm_shutdown ("guest-shutdown", true);
+}
+
+static void
+fake_cmd_system_reset (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	(void)arguments;
+
+	fake_qmp_return (client, "{}", id);
+	fake_qmp_event ("RESET",
+			"{\"guest\": false, \"reason\": \"host-qmp-system-reset\"}");
+}
+
+static void
+fake_cmd_quit (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	(void)arguments;
+
+	fake_qmp_return (client, "{}", id);
+	fake_vm_shutdown ("host-qmp-quit", false);
+}
+
+static void
+fake_cmd_query_status (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	g_autofree gchar *value = NULL;
+
+	(void)arguments;
+
+	value = g_strdup_printf ("{\"status\": \"%s\", "
+			"\"singlestep\": false, \"running\": %s}",
+			vm_running ? "running" : "paused",
+			vm_running ? "true" : "false");
+
+	fake_qmp_return (client, value, id);
+}
+
+static void
+fake_cmd_query_version (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	(void)arguments;
+
+	fake_qmp_return (client,
+			"{\"qemu\": {\"major\": 2, \"minor\": 7, \"micro\": 0}, "
+			"\"package\": \" (clr-oci-runtime fake hypervisor)\"}",
+			id);
+}
+
+static void
+fake_cmd_query_name (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	g_autofree gchar *value = NULL;
+
+	(void)arguments;
+
+	value = g_strdup_printf ("{\"name\": \"%s\"}",
+			vm_name ? vm_name : "");
+
+	fake_qmp_return (client, value, id);
+}
+
+static void
+fake_cmd_query_uuid (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	g_autofree gchar *value = NULL;
+
+	(void)arguments;
+
+	value = g_strdup_printf ("{\"UUID\": \"%s\"}",
+			vm_uuid ? vm_uuid :
+			"00000000-0000-0000-0000-000000000000");
+
+	fake_qmp_return (client, value, id);
+}
+
+static void
+fake_cmd_query_kvm (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	(void)arguments;
+
+	fake_qmp_return (client, "{\"enabled\": true, \"present\": true}",
+			id);
+}
+
+static void
+fake_cmd_query_cpus_fast (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	GString  *value;
+	gint      i;
+
+	(void)arguments;
+
+	value = g_string_new ("[");
+
+	/* There are no vCPU threads, so report the main thread for
+	 * each vCPU.
+	 */
+	for (i = 0; i < vm_cpus; i++) {
+		g_string_append_printf (value,
+				"%s{\"cpu-index\": %d, "
+				"\"qom-path\": \"/machine/unattached/device[%d]\", "
+				"\"thread-id\": %d, "
+				"\"props\": {\"socket-id\": %d, \"core-id\": 0, "
+				"\"thread-id\": 0}, \"arch\": \"x86\"}",
+				i ? ", " : "", i, i, (int)getpid (), i);
+	}
+
+	g_string_append (value, "]");
+
+	fake_qmp_return (client, value->str, id);
+
+	g_string_free (value, true);
+}
+
+static void fake_cmd_query_commands (struct fake_client *client,
+		JsonObject *arguments, const gchar *id);
+
+/** Supported QMP commands. */
+static struct fake_qmp_cmd fake_qmp_cmds[] = {
+	{ "qmp_capabilities" , fake_cmd_capabilities },
+	{ "stop"             , fake_cmd_stop },
+	{ "cont"             , fake_cmd_cont },
+	{ "system_powerdown" , fake_cmd_system_powerdown },
+	{ "system_reset"     , fake_cmd_system_reset },
+	{ "quit"             , fake_cmd_quit },
+	{ "query-status"     , fake_cmd_query_status },
+	{ "query-version"    , fake_cmd_query_version },
+	{ "query-name"       , fake_cmd_query_name },
+	{ "query-uuid"       , fake_cmd_query_uuid },
+	{ "query-kvm"        , fake_cmd_query_kvm },
+	{ "query-cpus-fast"  , fake_cmd_query_cpus_fast },
+	{ "query-commands"   , fake_cmd_query_commands },
+
+	/* terminator */
+	{ NULL, NULL }
+};
+
+static void
+fake_cmd_query_commands (struct fake_client *client,
+		JsonObject *arguments, const gchar *id)
+{
+	struct fake_qmp_cmd  *cmd;
+	GString              *value;
+
+	(void)arguments;
+
+	value = g_string_new ("[");
+
+	for (cmd = fake_qmp_cmds; cmd->name; cmd++) {
+		g_string_append_printf (value, "%s{\"name\": \"%s\"}",
+				cmd == fake_qmp_cmds ? "" : ", ",
+				cmd->name);
+	}
+
+	g_string_append (value, "]");
+
+	fake_qmp_return (client, value->str, id);
+
+	g_string_free (value, true);
+}
+
+/*!
+ * Dispatch a single complete QMP request.
+ *
+ * \param client \ref fake_client.
+ * \param request JSON request.
+ * \param len Length of \p request.
+ */
+static void
+fake_qmp_dispatch (struct fake_client *client, const gchar *request,
+		gsize len)
+{
+	JsonParser           *parser = NULL;
+	JsonNode             *root;
+	JsonObject           *obj;
+	JsonObject           *arguments = NULL;
+	const gchar          *execute;
+	struct fake_qmp_cmd  *cmd;
+	g_autofree gchar     *id = NULL;
+	g_autofree gchar     *desc = NULL;
+
+	parser = json_parser_new ();
+
+	if (! json_parser_load_from_data (parser, request,
+				(gssize)len, NULL)) {
+		fake_qmp_error (client, "GenericError",
+				"JSON parse error", NULL);
+		goto out;
+	}
+
+	root = json_parser_get_root (parser);
+	if (! root || JSON_NODE_TYPE (root) != JSON_NODE_OBJECT) {
+		fake_qmp_error (client, "GenericError",
+				"QMP input must be a JSON object", NULL);
+		goto out;
+	}
+
+	obj = json_node_get_object (root);
+
+	if (json_object_has_member (obj, "id")) {
+		JsonGenerator *generator = json_generator_new ();
+
+		json_generator_set_root (generator,
+				json_object_get_member (obj, "id"));
+		id = json_generator_to_data (generator, NULL);
+		g_object_unref (generator);
+	}
+
+	if (! json_object_has_member (obj, "execute")) {
+		fake_qmp_error (client, "GenericError",
+				"QMP input lacks member 'execute'", id);
+		goto out;
+	}
+
+	execute = json_object_get_string_member (obj, "execute");
+
+	if (json_object_has_member (obj, "arguments")) {
+		arguments = json_object_get_object_member (obj,
+				"arguments");
+	}
+
+	if (! client->negotiated
+			&& g_strcmp0 (execute, "qmp_capabilities")) {
+		fake_qmp_error (client, "CommandNotFound",
+				"Expecting capabilities negotiation "
+				"with 'qmp_capabilities'", id);
+		goto out;
+	}
+
+	for (cmd = fake_qmp_cmds; cmd->name; cmd++) {
+		if (! g_strcmp0 (cmd->name, execute)) {
+			cmd->handler (client, arguments, id);
+			goto out;
+		}
+	}
+
+	desc = g_strdup_printf ("The command %s has not been found",
+			execute);
+	fake_qmp_error (client, "CommandNotFound", desc, id);
+
+out:
+	g_object_unref (parser);
+}
+
+/*!
+ * Handle all complete QMP requests in the client buffer.
+ *
+ * Like qemu, requests are delimited by brace-matching rather than by
+ * newlines (the runtime does not terminate its requests).
+ *
+ * \param client \ref fake_client.
+ */
+static void
+fake_qmp_handle_input (struct fake_client *client)
+{
+	gsize     i;
+	gsize     start = 0;
+	gint      depth = 0;
+	gboolean  in_string = false;
+	gboolean  escaped = false;
+
+	for (i = 0; i < client->buf->len; i++) {
+		gchar c = client->buf->str[i];
+
+		if (in_string) {
+			if (escaped) {
+				escaped = false;
+			} else if (c == '\\') {
+				escaped = true;
+			} else if (c == '"') {
+				in_string = false;
+			}
+			continue;
+		}
+
+		if (c == '"') {
+			in_string = true;
+		} else if (c == '{') {
+			if (! depth) {
+				start = i;
+			}
+			depth++;
+		} else if (c == '}' && depth) {
+			depth--;
+			if (! depth) {
+				fake_qmp_dispatch (client,
+						client->buf->str + start,
+						i - start + 1);
+
+				/* Handler may have scheduled an exit but the
+				 * client is still valid until the loop ends.
+				 */
+				g_string_erase (client->buf, 0,
+						(gssize)(i + 1));
+				i = (gsize)-1;
+				start = 0;
+			}
+		}
+	}
+}
+
+/*!
+ * Handle console input: echo it back and shut down on "exit".
+ *
+ * \param out_fd File descriptor to echo data to.
+ * \param buf \c GString containing input not yet handled.
+ */
+static void
+fake_console_handle_input (int out_fd, GString *buf)
+{
+	gchar *nl;
+
+	(void)fake_write_all (out_fd, buf->str, buf->len);
+
+	while ((nl = memchr (buf->str, '\n', buf->len))) {
+		gsize              len = (gsize)(nl - buf->str);
+		g_autofree gchar  *line = g_strndup (buf->str, len);
+
+		if (! g_strcmp0 (g_strstrip (line), "exit")) {
+			fake_vm_shutdown ("guest-shutdown", true);
+		}
+
+		g_string_erase (buf, 0, (gssize)(len + 1));
+	}
+
+	/* data already echoed; only partial lines need to be kept */
+	if (buf->len > FAKE_BUF_SIZE) {
+		g_string_truncate (buf, 0);
+	}
+}
+
+static gboolean
+fake_client_read (gint fd, GIOCondition condition,
+		struct fake_client *client)
+{
+	gchar    buffer[FAKE_BUF_SIZE];
+	ssize_t  bytes;
+
+	(void)condition;
+
+	bytes = read (fd, buffer, sizeof (buffer));
+	if (bytes <= 0) {
+		if (bytes < 0 && errno == EINTR) {
+			return true;
+		}
+
+		clients = g_slist_remove (clients, client);
+		client->source = 0;
+		fake_client_free (client);
+		return false;
+	}
+
+	g_string_append_len (client->buf, buffer, bytes);
+
+	switch (client->server->type) {
+	case FAKE_SERVER_QMP:
+		fake_qmp_handle_input (client);
+		break;
+
+	case FAKE_SERVER_CONSOLE:
+		fake_console_handle_input (client->fd, client->buf);
+		break;
+
+	default:
+		/* nothing is expected on the other sockets */
+		g_string_truncate (client->buf, 0);
+		break;
+	}
+
+	return true;
+}
+
+static gboolean
+fake_stdio_read (gint fd, GIOCondition condition, GString *buf)
+{
+	gchar    buffer[FAKE_BUF_SIZE];
+	ssize_t  bytes;
+
+	(void)condition;
+
+	bytes = read (fd, buffer, sizeof (buffer));
+	if (bytes <= 0) {
+		return bytes < 0 && errno == EINTR;
+	}
+
+	g_string_append_len (buf, buffer, bytes);
+
+	fake_console_handle_input (STDOUT_FILENO, buf);
+
+	return true;
+}
+
+static void
+fake_client_free (struct fake_client *client)
+{
+	if (! client) {
+		return;
+	}
+
+	if (client->source) {
+		g_source_remove (client->source);
+	}
+
+	if (client->fd >= 0) {
+		close (client->fd);
+	}
+
+	g_string_free (client->buf, true);
+	g_free (client);
+}
+
+static gboolean
+fake_server_accept (gint fd, GIOCondition condition,
+		struct fake_server *server)
+{
+	struct fake_client  *client;
+	int                  client_fd;
+
+	(void)condition;
+
+	client_fd = accept4 (fd, NULL, NULL, SOCK_CLOEXEC);
+	if (client_fd < 0) {
+		return true;
+	}
+
+	client = g_new0 (struct fake_client, 1);
+	client->server = server;
+	client->fd = client_fd;
+	client->buf = g_string_new ("");
+
+	clients = g_slist_append (clients, client);
+
+	client->source = g_unix_fd_add (client_fd, G_IO_IN | G_IO_HUP,
+			(GUnixFDSourceFunc)fake_client_read, client);
+
+	if (server->type == FAKE_SERVER_QMP) {
+		fake_qmp_send (client,
+				"{\"QMP\": {\"version\": {\"qemu\": "
+				"{\"micro\": 0, \"minor\": 7, \"major\": 2}, "
+				"\"package\": \"\"}, \"capabilities\": []}}");
+	}
+
+	return true;
+}
+
+/*!
+ * Start accepting connections on a listening socket.
+ *
+ * \param type \ref fake_server_type.
+ * \param id Chardev id (may be \c NULL).
+ * \param path Full path to socket (may be \c NULL).
+ * \param fd Listening socket.
+ */
+static void
+fake_server_add (enum fake_server_type type, const gchar *id,
+		const gchar *path, int fd)
+{
+	struct fake_server  *server;
+
+	server = g_new0 (struct fake_server, 1);
+	server->type = type;
+	server->id = g_strdup (id);
+	server->path = g_strdup (path);
+	server->fd = fd;
+	server->source = g_unix_fd_add (fd, G_IO_IN,
+			(GUnixFDSourceFunc)fake_server_accept, server);
+
+	servers = g_slist_append (servers, server);
+}
+
+/*!
+ * Create a listening socket.
+ *
+ * \param type \ref fake_server_type.
+ * \param id Chardev id (may be \c NULL).
+ * \param path Full path to socket to create.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+fake_server_new (enum fake_server_type type, const gchar *id,
+		const gchar *path)
+{
+	struct sockaddr_un   addr = { 0 };
+	int                  fd;
+
+	if (! path || strlen (path) >= sizeof (addr.sun_path)) {
+		fprintf (stderr, "invalid socket path: %s\n",
+				path ? path : "(null)");
+		return false;
+	}
+
+	fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror ("socket");
+		return false;
+	}
+
+	addr.sun_family = AF_UNIX;
+	g_strlcpy (addr.sun_path, path, sizeof (addr.sun_path));
+
+	(void)unlink (path);
+
+	if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+		fprintf (stderr, "Failed to bind socket to %s: %s\n",
+				path, strerror (errno));
+		close (fd);
+		return false;
+	}
+
+	if (listen (fd, SOMAXCONN) < 0) {
+		perror ("listen");
+		close (fd);
+		return false;
+	}
+
+	fake_server_add (type, id, path, fd);
+
+	return true;
+}
+
+/*!
+ * Use a listening socket inherited from the runtime ("fd=").
+ *
+ * \param type \ref fake_server_type.
+ * \param id Chardev id.
+ * \param fd_str Socket number.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+fake_server_inherit (enum fake_server_type type, const gchar *id,
+		const gchar *fd_str)
+{
+	gchar  *end = NULL;
+	long    fd;
+
+	fd = strtol (fd_str, &end, 10);
+	if (*end || end == fd_str || fd < 0
+			|| fcntl ((int)fd, F_GETFD) < 0) {
+		fprintf (stderr, "invalid socket fd: %s\n", fd_str);
+		return false;
+	}
+
+	/* Like the real hypervisor, do not leak it to children */
+	(void)fcntl ((int)fd, F_SETFD, FD_CLOEXEC);
+
+	fake_server_add (type, id, NULL, (int)fd);
+
+	return true;
+}
+
+static void
+fake_server_free (struct fake_server *server)
+{
+	if (! server) {
+		return;
+	}
+
+	if (server->fd >= 0) {
+		g_source_remove (server->source);
+		close (server->fd);
+
+		/* Like qemu, remove the socket on exit (unless it
+		 * was created by the runtime).
+		 */
+		if (server->path) {
+			(void)unlink (server->path);
+		}
+	}
+
+	g_free (server->id);
+	g_free (server->path);
+	g_free (server);
+}
+
+/*!
+ * Find the value of \p key in a qemu-style comma-separated option list.
+ *
+ * \param opts Option list (for example "socket,id=x,path=/a/b").
+ * \param key Name of option to look up.
+ *
+ * \return Newly-allocated value, or \c NULL if not found.
+ */
+static gchar *
+fake_opt_get (const gchar *opts, const gchar *key)
+{
+	gchar   **fields;
+	gchar   **field;
+	gchar    *value = NULL;
+	gsize     len = strlen (key);
+
+	fields = g_strsplit (opts, ",", -1);
+
+	for (field = fields; field && *field; field++) {
+		if (! strncmp (*field, key, len) && (*field)[len] == '=') {
+			value = g_strdup (*field + len + 1);
+			break;
+		}
+	}
+
+	g_strfreev (fields);
+
+	return value;
+}
+
+/*!
+ * Determine if the flag \p key is present in a qemu-style
+ * comma-separated option list.
+ *
+ * \param opts Option list (for example "socket,server,nowait").
+ * \param key Name of flag.
+ *
+ * \return \c true if \p key is set, else \c false.
+ */
+static gboolean
+fake_opt_is_set (const gchar *opts, const gchar *key)
+{
+	gchar   **fields;
+	gchar   **field;
+	gboolean  found = false;
+
+	fields = g_strsplit (opts, ",", -1);
+
+	for (field = fields; field && *field; field++) {
+		if (! g_strcmp0 (*field, key)
+				|| (g_str_has_prefix (*field, key)
+					&& (*field)[strlen (key)] == '=')) {
+			found = true;
+			break;
+		}
+	}
+
+	g_strfreev (fields);
+
+	return found;
+}
+
+/*!
+ * Connect to a listening socket (for a chardev in client mode).
+ *
+ * \param type \ref fake_server_type.
+ * \param path Full path to socket to connect to.
+ *
+ * \note Like qemu with "reconnect" set, failure to connect is not
+ * fatal.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+fake_client_connect (enum fake_server_type type, const gchar *path)
+{
+	struct fake_server  *server;
+	struct fake_client  *client;
+	struct sockaddr_un   addr = { 0 };
+	int                  fd;
+
+	if (! path || strlen (path) >= sizeof (addr.sun_path)) {
+		fprintf (stderr, "invalid socket path: %s\n",
+				path ? path : "(null)");
+		return false;
+	}
+
+	fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror ("socket");
+		return false;
+	}
+
+	addr.sun_family = AF_UNIX;
+	g_strlcpy (addr.sun_path, path, sizeof (addr.sun_path));
+
+	if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+		fprintf (stderr, "Failed to connect socket %s: %s\n",
+				path, strerror (errno));
+		close (fd);
+		return true;
+	}
+
+	/* A non-listening "server" simply records the socket type */
+	server = g_new0 (struct fake_server, 1);
+	server->type = type;
+	server->fd = -1;
+	servers = g_slist_append (servers, server);
+
+	client = g_new0 (struct fake_client, 1);
+	client->server = server;
+	client->fd = fd;
+	client->buf = g_string_new ("");
+
+	clients = g_slist_append (clients, client);
+
+	client->source = g_unix_fd_add (fd, G_IO_IN | G_IO_HUP,
+			(GUnixFDSourceFunc)fake_client_read, client);
+
+	return true;
+}
+
+/*!
+ * Handle a "-chardev" option.
+ *
+ * \param opts Option value.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+fake_handle_chardev (const gchar *opts)
+{
+	g_autofree gchar      *id = NULL;
+	g_autofree gchar      *path = NULL;
+	g_autofree gchar      *fd = NULL;
+	enum fake_server_type  type = FAKE_SERVER_OTHER;
+
+	id = fake_opt_get (opts, "id");
+
+	if (g_str_has_prefix (opts, "stdio")) {
+		if (! g_strcmp0 (id, FAKE_CONSOLE_ID)) {
+			console_stdio = true;
+		}
+		return true;
+	}
+
+	if (! g_str_has_prefix (opts, "socket")) {
+		/* other backends are accepted but not emulated */
+		return true;
+	}
+
+	path = fake_opt_get (opts, "path");
+	fd = fake_opt_get (opts, "fd");
+
+	if (! g_strcmp0 (id, FAKE_CONSOLE_ID)) {
+		type = FAKE_SERVER_CONSOLE;
+	}
+
+	if (fd) {
+		return fake_server_inherit (type, id, fd);
+	}
+
+	if (! fake_opt_is_set (opts, "server")) {
+		return fake_client_connect (type, path);
+	}
+
+	return fake_server_new (type, id, path);
+}
+
+/*!
+ * Handle a "-mon" option.
+ *
+ * \param opts Option value (for example "chardev=x,mode=control").
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+fake_handle_mon (const gchar *opts)
+{
+	g_autofree gchar    *id = NULL;
+	g_autofree gchar    *mode = NULL;
+	struct fake_server  *server;
+	GSList              *l;
+
+	id = fake_opt_get (opts, "chardev");
+	mode = fake_opt_get (opts, "mode");
+
+	if (g_strcmp0 (mode, "control")) {
+		fprintf (stderr, "unsupported monitor option: %s\n", opts);
+		return false;
+	}
+
+	for (l = servers; l; l = g_slist_next (l)) {
+		server = (struct fake_server *)l->data;
+
+		if (server->id && ! g_strcmp0 (server->id, id)) {
+			server->type = FAKE_SERVER_QMP;
+			return true;
+		}
+	}
+
+	fprintf (stderr, "no such chardev: %s\n", id ? id : "(null)");
+
+	return false;
+}
+
+/*!
+ * Handle a "-qmp" option.
+ *
+ * \param opts Option value (for example "unix:/a/b,server,nowait").
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+fake_handle_qmp (const gchar *opts)
+{
+	g_autofree gchar  *path = NULL;
+	gchar             *p;
+
+	if (! g_str_has_prefix (opts, "unix:")) {
+		fprintf (stderr, "unsupported qmp option: %s\n", opts);
+		return false;
+	}
+
+	path = g_strdup (opts + strlen ("unix:"));
+
+	p = strchr (path, ',');
+	if (p) {
+		*p = '\0';
+	}
+
+	return fake_server_new (FAKE_SERVER_QMP, NULL, path);
+}
+
+static gboolean
+fake_handle_signal (gpointer user_data)
+{
+	(void)user_data;
+
+	fake_vm_exit ();
+
+	return false;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GString  *stdio_buf = NULL;
+	int       i;
+	int       ret = EXIT_FAILURE;
+
+	for (i = 1; i < argc; i++) {
+		const gchar *opt = argv[i];
+		const gchar *value = (i + 1 < argc) ? argv[i+1] : NULL;
+
+		if (! g_strcmp0 (opt, "-version")) {
+			printf ("QEMU emulator version 2.7.0 "
+					"(clr-oci-runtime fake hypervisor)\n");
+			return EXIT_SUCCESS;
+		}
+
+		if (! value) {
+			continue;
+		}
+
+		if (! g_strcmp0 (opt, "-machine")
+				&& ! g_strcmp0 (value, "help")) {
+			printf ("Supported machines are:\n");
+			printf ("pc-lite              Light weight PC\n");
+			return EXIT_SUCCESS;
+		} else if (! g_strcmp0 (opt, "-name")) {
+			vm_name = g_strdup (value);
+		} else if (! g_strcmp0 (opt, "-uuid")) {
+			vm_uuid = g_strdup (value);
+		} else if (! g_strcmp0 (opt, "-smp")) {
+			vm_cpus = atoi (value);
+			if (vm_cpus <= 0) {
+				vm_cpus = 1;
+			}
+		} else if (! g_strcmp0 (opt, "-qmp")) {
+			if (! fake_handle_qmp (value)) {
+				goto out;
+			}
+		} else if (! g_strcmp0 (opt, "-chardev")) {
+			if (! fake_handle_chardev (value)) {
+				goto out;
+			}
+		} else if (! g_strcmp0 (opt, "-mon")) {
+			if (! fake_handle_mon (value)) {
+				goto out;
+			}
+		} else {
+			/* not an option with a value we care about */
+			continue;
+		}
+
+		i++;
+	}
+
+	loop = g_main_loop_new (NULL, false);
+
+	g_unix_signal_add (SIGTERM, fake_handle_signal, NULL);
+	g_unix_signal_add (SIGINT, fake_handle_signal, NULL);
+	g_unix_signal_add (SIGHUP, fake_handle_signal, NULL);
+
+	if (console_stdio) {
+		stdio_buf = g_string_new ("");
+		g_unix_fd_add (STDIN_FILENO, G_IO_IN | G_IO_HUP,
+				(GUnixFDSourceFunc)fake_stdio_read, stdio_buf);
+	}
+
+	g_main_loop_run (loop);
+
+	ret = EXIT_SUCCESS;
+
+out:
+	g_slist_free_full (clients, (GDestroyNotify)fake_client_free);
+	g_slist_free_full (servers, (GDestroyNotify)fake_server_free);
+
+	if (stdio_buf) {
+		g_string_free (stdio_buf, true);
+	}
+
+	if (loop) {
+		g_main_loop_unref (loop);
+	}
+
+	g_free (vm_name);
+	g_free (vm_uuid);
+
+	return ret;
+}
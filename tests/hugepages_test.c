@@ -0,0 +1,220 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/oci.h"
+#include "../src/hugepages.h"
+
+extern gchar *sysfs_hugepages_dir;
+
+START_TEST(test_clr_oci_hugepages_get) {
+	struct clr_oci_config      config = { { 0 } };
+	struct clr_oci_vm_cfg      vm = { { 0 } };
+	struct oci_cfg_annotation *a;
+
+	ck_assert (! clr_oci_hugepages_get (NULL));
+
+	/* no vm configuration */
+	ck_assert (! clr_oci_hugepages_get (&config));
+
+	config.vm = &vm;
+	ck_assert (! clr_oci_hugepages_get (&config));
+
+	vm.hugepages = true;
+	ck_assert (clr_oci_hugepages_get (&config));
+
+	/* the annotation overrides the vm configuration */
+	a = g_new0 (struct oci_cfg_annotation, 1);
+	a->key = g_strdup (CLR_OCI_ANNOTATION_HUGEPAGES);
+	a->value = g_strdup ("false");
+	config.oci.annotations = g_slist_prepend (NULL, a);
+
+	ck_assert (! clr_oci_hugepages_get (&config));
+
+	vm.hugepages = false;
+	g_free (a->value);
+	a->value = g_strdup ("true");
+	ck_assert (clr_oci_hugepages_get (&config));
+
+	/* any boolean spelling is accepted */
+	g_free (a->value);
+	a->value = g_strdup ("Yes");
+	ck_assert (clr_oci_hugepages_get (&config));
+
+	vm.hugepages = true;
+	g_free (a->value);
+	a->value = g_strdup ("OFF");
+	ck_assert (! clr_oci_hugepages_get (&config));
+
+	/* invalid values are ignored */
+	g_free (a->value);
+	a->value = g_strdup ("maybe");
+	ck_assert (clr_oci_hugepages_get (&config));
+
+	g_free (a->key);
+	g_free (a->value);
+	g_free (a);
+	g_slist_free (config.oci.annotations);
+} END_TEST
+
+START_TEST(test_clr_oci_hugepages_page_size) {
+	guint64  page_size = 0;
+	gchar   *tmpdir;
+
+	ck_assert (! clr_oci_hugepages_page_size (NULL, &page_size));
+	ck_assert (! clr_oci_hugepages_page_size ("/", NULL));
+	ck_assert (! clr_oci_hugepages_page_size
+			("/this/directory/must/not/exist", &page_size));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	/* not hugetlbfs */
+	ck_assert (! clr_oci_hugepages_page_size (tmpdir, &page_size));
+	ck_assert (page_size == 0);
+
+	ck_assert (! g_remove (tmpdir));
+	g_free (tmpdir);
+} END_TEST
+
+START_TEST(test_clr_oci_hugepages_available) {
+	guint64  pages = 0;
+	gchar   *tmpdir;
+	gchar   *dir;
+	gchar   *free_path;
+	gchar   *resv_path;
+
+	ck_assert (! clr_oci_hugepages_available (0, &pages));
+	ck_assert (! clr_oci_hugepages_available (2 * 1024 * 1024, NULL));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	sysfs_hugepages_dir = tmpdir;
+
+	/* no pool of this size */
+	ck_assert (! clr_oci_hugepages_available (2 * 1024 * 1024,
+				&pages));
+
+	dir = g_build_path ("/", tmpdir, "hugepages-2048kB", NULL);
+	ck_assert (! g_mkdir (dir, 0750));
+
+	free_path = g_build_path ("/", dir, "free_hugepages", NULL);
+	resv_path = g_build_path ("/", dir, "resv_hugepages", NULL);
+
+	ck_assert (g_file_set_contents (free_path, "10\n", -1, NULL));
+
+	/* no reservation count */
+	ck_assert (! clr_oci_hugepages_available (2 * 1024 * 1024,
+				&pages));
+
+	ck_assert (g_file_set_contents (resv_path, "x\n", -1, NULL));
+	ck_assert (! clr_oci_hugepages_available (2 * 1024 * 1024,
+				&pages));
+
+	ck_assert (g_file_set_contents (resv_path, "4\n", -1, NULL));
+	ck_assert (clr_oci_hugepages_available (2 * 1024 * 1024, &pages));
+	ck_assert (pages == 6);
+
+	ck_assert (g_file_set_contents (free_path, "0\n", -1, NULL));
+	ck_assert (clr_oci_hugepages_available (2 * 1024 * 1024, &pages));
+	ck_assert (pages == 0);
+
+	/* a different page size */
+	ck_assert (! clr_oci_hugepages_available (1024 * 1024 * 1024,
+				&pages));
+
+	ck_assert (! g_remove (free_path));
+	ck_assert (! g_remove (resv_path));
+	ck_assert (! g_remove (dir));
+	ck_assert (! g_remove (tmpdir));
+
+	g_free (free_path);
+	g_free (resv_path);
+	g_free (dir);
+	g_free (tmpdir);
+} END_TEST
+
+START_TEST(test_clr_oci_hugepages_backend) {
+	struct clr_oci_config config = { { 0 } };
+	struct clr_oci_vm_cfg vm = { { 0 } };
+	guint64               memory = 2048;
+	gchar                *tmpdir;
+
+	ck_assert (! clr_oci_hugepages_backend (NULL, &memory));
+	ck_assert (! clr_oci_hugepages_backend (&config, &memory));
+
+	config.vm = &vm;
+	ck_assert (! clr_oci_hugepages_backend (&config, NULL));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	/* not hugetlbfs */
+	g_strlcpy (vm.hugepages_path, tmpdir, sizeof (vm.hugepages_path));
+	ck_assert (! clr_oci_hugepages_backend (&config, &memory));
+	ck_assert (memory == 2048);
+
+	ck_assert (! g_remove (tmpdir));
+	g_free (tmpdir);
+} END_TEST
+
+Suite* make_hugepages_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_hugepages_get, s);
+	ADD_TEST(test_clr_oci_hugepages_page_size, s);
+	ADD_TEST(test_clr_oci_hugepages_available, s);
+	ADD_TEST(test_clr_oci_hugepages_backend, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("hugepages_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_hugepages_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
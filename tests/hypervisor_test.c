@@ -20,6 +20,8 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
 
 #include <check.h>
 #include <glib.h>
@@ -29,6 +31,7 @@
 #include "../src/logging.h"
 #include "../src/hypervisor.h"
 #include "../src/oci.h"
+#include "../src/virtiofs.h"
 
 gchar *
 clr_oci_vm_args_file_path (const struct clr_oci_config *config);
@@ -342,6 +345,355 @@ START_TEST(test_clr_oci_expand_cmdline) {
 				(const gchar **)args, image_size));
 	g_strfreev (args);
 
+	/* check expansion of the image, which is private by default */
+	args = g_new0 (gchar *, 4);
+	ck_assert (args);
+	args[0] = g_strdup ("@IMAGE_DEVICE@");
+	args[1] = g_strdup ("@IMAGE_BACKEND@");
+	args[2] = g_strdup ("@KERNEL_PARAMS@");
+	args[3] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (args[0], "nvdimm,memdev=mem0,id=nv0");
+	path = g_strdup_printf ("memory-backend-file,id=mem0,"
+			"mem-path=%s,size=%s",
+			config.vm->image_path, image_size);
+	ck_assert_str_eq (args[1], path);
+	g_free (path);
+	ck_assert_str_eq (args[2], "param1=foo param2=bar");
+	g_strfreev (args);
+
+	/* a shared image is read-only and overlaid in the guest */
+	config.vm->image_shared = true;
+
+	args = g_new0 (gchar *, 2);
+	ck_assert (args);
+	args[0] = g_strdup ("@KERNEL_PARAMS@");
+	args[1] = NULL;
+
+	/* which requires an initrd */
+	ck_assert (! clr_oci_expand_cmdline (&config, args));
+
+	path = g_build_path ("/", tmpdir, "initrd", NULL);
+	ck_assert (path);
+	g_strlcpy (config.vm->initrd_path, path,
+			sizeof (config.vm->initrd_path));
+	g_free (path);
+
+	/* initrd_path is ENOENT */
+	ck_assert (! clr_oci_expand_cmdline (&config, args));
+	g_strfreev (args);
+
+	ck_assert (g_file_set_contents (config.vm->initrd_path, "", -1,
+				NULL));
+
+	args = g_new0 (gchar *, 4);
+	ck_assert (args);
+	args[0] = g_strdup ("@IMAGE_DEVICE@");
+	args[1] = g_strdup ("@IMAGE_BACKEND@");
+	args[2] = g_strdup ("@KERNEL_PARAMS@");
+	args[3] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (args[0], "nvdimm,memdev=mem0,id=nv0,unarmed=on");
+	path = g_strdup_printf ("memory-backend-file,id=mem0,"
+			"mem-path=%s,size=%s,share=on,readonly=on",
+			config.vm->image_path, image_size);
+	ck_assert_str_eq (args[1], path);
+	g_free (path);
+	ck_assert_str_eq (args[2], "param1=foo param2=bar "
+			CLR_OCI_IMAGE_SHARED_KERNEL_PARAMS);
+	g_strfreev (args);
+
+	config.vm->image_shared = false;
+
+	ck_assert (! g_remove (config.vm->initrd_path));
+	config.vm->initrd_path[0] = '\0';
+
+	/* check expansion of the events socket */
+	g_strlcpy (config.state.events_path, "events-path",
+			sizeof (config.state.events_path));
+
+	args = g_new0 (gchar *, 2);
+	ck_assert (args);
+	args[0] = g_strdup ("unix:@EVENTS_SOCKET@,server,nowait");
+	args[1] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert (! g_strcmp0 (args[0], "unix:events-path,server,nowait"));
+	ck_assert (! args[1]);
+	g_strfreev (args);
+
+	/* check expansion of the guest query socket */
+	g_strlcpy (config.state.runtime_path, "/run/foo",
+			sizeof (config.state.runtime_path));
+
+	args = g_new0 (gchar *, 2);
+	ck_assert (args);
+	args[0] = g_strdup ("socket,path=@QUERY_SOCKET@");
+	args[1] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert (! g_strcmp0 (args[0], "socket,path=/run/foo/"
+				CLR_OCI_GUEST_QUERY_SOCKET));
+	ck_assert (! args[1]);
+	g_strfreev (args);
+
+	/* guest RAM has no backend by default */
+	args = g_new0 (gchar *, 2);
+	ck_assert (args);
+	args[0] = g_strdup ("@MEMORY@");
+	args[1] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert (! config.ram_backend);
+
+	/* guest RAM is shared if it may be checkpointed lazily */
+	config.vm->lazy_checkpoint = true;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (config.ram_backend,
+			"memory-backend-memfd,share=on,id=ram0,size=2048M");
+
+	/* and so cannot use huge pages */
+	config.vm->hugepages = true;
+	ck_assert (! clr_oci_expand_cmdline (&config, args));
+	config.vm->hugepages = false;
+	config.vm->lazy_checkpoint = false;
+
+	/* RAM is mapped from the checkpoint for a lazy restore */
+	config.incoming_ram = g_strdup ("/tmp/vm.ram");
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (config.ram_backend, "memory-backend-file,"
+			"mem-path=/tmp/vm.ram,share=off,id=ram0,size=2048M");
+
+	/* huge pages cannot be mapped from the checkpoint */
+	config.vm->hugepages = true;
+	ck_assert (! clr_oci_expand_cmdline (&config, args));
+
+	g_free (config.incoming_ram);
+	config.incoming_ram = NULL;
+
+	/* huge pages require a hugetlbfs mount */
+	g_strlcpy (config.vm->hugepages_path, tmpdir,
+			sizeof (config.vm->hugepages_path));
+
+	ck_assert (! clr_oci_expand_cmdline (&config, args));
+
+	config.vm->hugepages = false;
+	config.vm->hugepages_path[0] = '\0';
+
+	/* merged guest RAM is private anonymous memory */
+	config.vm->memory_merge = true;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (config.ram_backend,
+			"memory-backend-ram,merge=on,id=ram0,size=2048M");
+
+	/* and cannot be mapped from a checkpoint */
+	config.incoming_ram = g_strdup ("/tmp/vm.ram");
+	ck_assert (! clr_oci_expand_cmdline (&config, args));
+	g_free (config.incoming_ram);
+	config.incoming_ram = NULL;
+	g_strfreev (args);
+
+	config.vm->memory_merge = false;
+
+	g_free (config.ram_backend);
+	config.ram_backend = NULL;
+
+	/* check sockets are created for the hypervisor to inherit */
+	g_snprintf (config.state.comms_path, sizeof (config.state.comms_path),
+			"%s/comms.sock", tmpdir);
+	g_snprintf (config.state.procsock_path,
+			sizeof (config.state.procsock_path),
+			"%s/process.sock", tmpdir);
+
+	args = g_new0 (gchar *, 4);
+	ck_assert (args);
+	args[0] = g_strdup ("fd=@COMMS_FD@");
+	args[1] = g_strdup ("@PROCESS_SOCKET@");
+	args[2] = g_strdup ("id=@COMMS_FD@");
+	args[3] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert (config.hypervisor_fds);
+	ck_assert (config.hypervisor_fds->len == 2);
+
+	path = g_strdup_printf ("fd=%d",
+			g_array_index (config.hypervisor_fds, int, 0));
+	ck_assert_str_eq (args[0], path);
+	g_free (path);
+
+	path = g_strdup_printf ("socket,id=procsock,fd=%d,"
+			"server=on,wait=off",
+			g_array_index (config.hypervisor_fds, int, 1));
+	ck_assert_str_eq (args[1], path);
+	g_free (path);
+
+	/* the same socket is used for each occurrence */
+	ck_assert (! g_strcmp0 (args[2] + strlen ("id="),
+				args[0] + strlen ("fd=")));
+
+	ck_assert (g_file_test (config.state.comms_path,
+				G_FILE_TEST_EXISTS));
+	ck_assert (g_file_test (config.state.procsock_path,
+				G_FILE_TEST_EXISTS));
+	g_strfreev (args);
+
+	clr_oci_vm_fds_close (&config);
+	ck_assert (! config.hypervisor_fds);
+
+	ck_assert (! g_remove (config.state.comms_path));
+	ck_assert (! g_remove (config.state.procsock_path));
+	config.state.procsock_path[0] = '\0';
+	g_strlcpy (config.state.comms_path, "comms-path",
+			sizeof (config.state.comms_path));
+
+	/* VMs have a default size if the container is not limited */
+	args = g_new0 (gchar *, 4);
+	ck_assert (args);
+	args[0] = g_strdup ("@MEMORY@");
+	args[1] = g_strdup ("@MAXMEM@");
+	args[2] = g_strdup ("@SMP@");
+	args[3] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (args[0], "2048M");
+	ck_assert_str_eq (args[1], "3072M");
+	path = g_strdup_printf ("%u,maxcpus=4,sockets=4,cores=1,threads=1",
+			MIN (CLR_OCI_VM_VCPUS_DEFAULT, g_get_num_processors ()));
+	ck_assert_str_eq (args[2], path);
+	g_free (path);
+	g_strfreev (args);
+
+	/* VMs are sized to the limits of the container */
+	config.oci.oci_linux.resources.memory_limit = 512 * 1024 * 1024 + 1;
+	config.oci.oci_linux.resources.cpu_quota = 100000;
+	config.oci.oci_linux.resources.cpu_period = 100000;
+
+	args = g_new0 (gchar *, 4);
+	ck_assert (args);
+	args[0] = g_strdup ("-m @MEMORY@,maxmem=@MAXMEM@");
+	args[1] = g_strdup ("size=@MEMORY@");
+	args[2] = g_strdup ("@SMP@");
+	args[3] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (args[0], "-m 513M,maxmem=1537M");
+	ck_assert_str_eq (args[1], "size=513M");
+	ck_assert_str_eq (args[2], "1,maxcpus=4,sockets=4,cores=1,threads=1");
+	g_strfreev (args);
+
+	/* but are always large enough to boot */
+	config.oci.oci_linux.resources.memory_limit = 4096;
+
+	args = g_new0 (gchar *, 2);
+	ck_assert (args);
+	args[0] = g_strdup ("@MEMORY@");
+	args[1] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (args[0], "256M");
+	g_strfreev (args);
+
+	/* a CPU is left for the other threads of a placed VM */
+	config.oci.oci_linux.resources.cpu_quota = 0;
+	config.oci.oci_linux.resources.cpu_cpus = g_strdup ("0-1");
+
+	args = g_new0 (gchar *, 2);
+	ck_assert (args);
+	args[0] = g_strdup ("@SMP@");
+	args[1] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (args[0], "1,maxcpus=4,sockets=4,cores=1,threads=1");
+	ck_assert_str_eq (config.state.cpus, "0-1");
+	g_strfreev (args);
+
+	g_free (config.oci.oci_linux.resources.cpu_cpus);
+	g_free (config.ram_backend);
+	config.ram_backend = NULL;
+	config.state.cpus[0] = '\0';
+
+	/* invalid limits */
+	config.oci.oci_linux.resources.cpu_cpus = g_strdup ("x");
+
+	args = g_new0 (gchar *, 2);
+	ck_assert (args);
+	args[0] = g_strdup ("@SMP@");
+	args[1] = NULL;
+
+	ck_assert (! clr_oci_expand_cmdline (&config, args));
+	g_strfreev (args);
+
+	g_free (config.oci.oci_linux.resources.cpu_cpus);
+	memset (&config.oci.oci_linux.resources, 0,
+			sizeof (config.oci.oci_linux.resources));
+
+	/* the rootfs is shared using 9p by default */
+	args = g_new0 (gchar *, 4);
+	ck_assert (args);
+	args[0] = g_strdup ("@ROOTFS_DEVICE@");
+	args[1] = g_strdup ("@ROOTFS_BACKEND_TYPE@");
+	args[2] = g_strdup ("@ROOTFS_BACKEND@");
+	args[3] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (args[0], "virtio-9p-pci,fsdev=workload9p,"
+			"mount_tag=rootfs");
+	ck_assert_str_eq (args[1], "-fsdev");
+	path = g_strdup_printf ("local,id=workload9p,path=%s,"
+			"security_model=none", config.oci.root.path);
+	ck_assert_str_eq (args[2], path);
+	g_free (path);
+	g_strfreev (args);
+
+	/* virtio-fs with the default DAX window */
+	config.vm->rootfs_transport = CLR_OCI_ROOTFS_VIRTIO_FS;
+
+	args = g_new0 (gchar *, 4);
+	ck_assert (args);
+	args[0] = g_strdup ("@ROOTFS_DEVICE@");
+	args[1] = g_strdup ("@ROOTFS_BACKEND_TYPE@");
+	args[2] = g_strdup ("@ROOTFS_BACKEND@");
+	args[3] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (args[0], "vhost-user-fs-pci,chardev=charfs0,"
+			"tag=rootfs,cache-size=" CLR_OCI_VIRTIOFS_DAX_SIZE);
+	ck_assert_str_eq (args[1], "-chardev");
+	/* vhost-user requires guest RAM to be shared */
+	ck_assert (g_str_has_prefix (config.ram_backend,
+				"memory-backend-memfd,share=on,"));
+	path = g_strdup_printf ("socket,id=charfs0,path=%s/%s",
+			config.state.runtime_path, CLR_OCI_VIRTIOFS_SOCKET);
+	ck_assert_str_eq (args[2], path);
+	g_free (path);
+	g_strfreev (args);
+
+	/* virtio-fs without a DAX window */
+	config.vm->dax_size = g_strdup ("0");
+
+	args = g_new0 (gchar *, 2);
+	ck_assert (args);
+	args[0] = g_strdup ("@ROOTFS_DEVICE@");
+	args[1] = NULL;
+
+	ck_assert (clr_oci_expand_cmdline (&config, args));
+	ck_assert_str_eq (args[0], "vhost-user-fs-pci,chardev=charfs0,"
+			"tag=rootfs");
+
+	/* guest RAM is not shared when restoring a lazy checkpoint */
+	config.incoming_ram = g_strdup ("/tmp/vm.ram");
+	ck_assert (! clr_oci_expand_cmdline (&config, args));
+	g_free (config.incoming_ram);
+	config.incoming_ram = NULL;
+	g_strfreev (args);
+
+	config.vm->rootfs_transport = CLR_OCI_ROOTFS_9P;
+
 	/* check expansion of first param if relative */
 	shell = g_find_program_in_path ("sh");
 	ck_assert (shell);
@@ -376,6 +728,39 @@ START_TEST(test_clr_oci_expand_cmdline) {
 	clr_oci_config_free (&config);
 } END_TEST
 
+START_TEST(test_clr_oci_image_shared_get) {
+	struct clr_oci_config      config = { { 0 } };
+	struct clr_oci_vm_cfg      vm = { { 0 } };
+	struct oci_cfg_annotation *a;
+
+	ck_assert (! clr_oci_image_shared_get (NULL));
+	ck_assert (! clr_oci_image_shared_get (&config));
+
+	config.vm = &vm;
+	ck_assert (! clr_oci_image_shared_get (&config));
+
+	vm.image_shared = true;
+	ck_assert (clr_oci_image_shared_get (&config));
+
+	/* the annotation overrides the vm configuration */
+	a = g_new0 (struct oci_cfg_annotation, 1);
+	a->key = g_strdup (CLR_OCI_ANNOTATION_IMAGE_SHARED);
+	a->value = g_strdup ("false");
+	config.oci.annotations = g_slist_prepend (NULL, a);
+
+	ck_assert (! clr_oci_image_shared_get (&config));
+
+	vm.image_shared = false;
+	g_free (a->value);
+	a->value = g_strdup ("true");
+	ck_assert (clr_oci_image_shared_get (&config));
+
+	g_free (a->key);
+	g_free (a->value);
+	g_free (a);
+	g_slist_free (config.oci.annotations);
+} END_TEST
+
 START_TEST(test_clr_oci_vm_args_get) {
 	gboolean ret;
 	gchar *path;
@@ -507,6 +892,118 @@ START_TEST(test_clr_oci_vm_args_get) {
 	ck_assert (! args[4]);
 	g_strfreev (args);
 
+	/* restoring appends the migration source */
+	config.incoming = g_strdup ("file:/tmp/vm.state");
+
+	ck_assert (clr_oci_vm_args_get (&config, &args));
+
+	ck_assert (! g_strcmp0 (args[0], "hello"));
+	ck_assert (! g_strcmp0 (args[3], "bar"));
+	ck_assert (! g_strcmp0 (args[4], "-incoming"));
+	ck_assert (! g_strcmp0 (args[5], "file:/tmp/vm.state"));
+	ck_assert (! args[6]);
+	g_strfreev (args);
+
+	/* guest RAM is not part of the state of a lazy checkpoint */
+	config.incoming_ram = g_strdup ("/tmp/vm.ram");
+
+	ck_assert (clr_oci_vm_args_get (&config, &args));
+
+	ck_assert (! g_strcmp0 (args[4], "-object"));
+	ck_assert (g_str_has_prefix (args[5], "memory-backend-file,"
+				"mem-path=/tmp/vm.ram,share=off,id=ram0,"));
+	ck_assert (! g_strcmp0 (args[6], "-machine"));
+	ck_assert (! g_strcmp0 (args[7], "memory-backend=ram0"));
+	ck_assert (! g_strcmp0 (args[8], "-incoming"));
+	ck_assert (! g_strcmp0 (args[9], "file:/tmp/vm.state"));
+	ck_assert (! g_strcmp0 (args[10], "-global"));
+	ck_assert (! g_strcmp0 (args[11], "migration.x-ignore-shared=on"));
+	ck_assert (! args[12]);
+	g_strfreev (args);
+
+	g_free (config.incoming);
+	config.incoming = NULL;
+	g_free (config.incoming_ram);
+	config.incoming_ram = NULL;
+
+	/* the VM inherits the device reserving its vsock context ID */
+	config.state.vsock_cid = 1234;
+	config.vsock_fd = open ("/dev/null", O_RDWR | O_CLOEXEC);
+	ck_assert (config.vsock_fd >= 0);
+
+	ck_assert (clr_oci_vm_args_get (&config, &args));
+
+	ck_assert (! g_strcmp0 (args[3], "bar"));
+	ck_assert (! g_strcmp0 (args[4], "-device"));
+	path = g_strdup_printf ("vhost-vsock-pci,id=vsock0,"
+			"guest-cid=1234,vhostfd=%d",
+			g_array_index (config.hypervisor_fds, int, 0));
+	ck_assert_str_eq (args[5], path);
+	g_free (path);
+	ck_assert (! args[6]);
+	ck_assert (config.vsock_fd == -1);
+	g_strfreev (args);
+
+	clr_oci_vm_fds_close (&config);
+	config.state.vsock_cid = 0;
+
+	/* the kernel is booted with the initrd, if there is one */
+	path = g_build_path ("/", tmpdir, "initrd", NULL);
+	ck_assert (path);
+	g_strlcpy (config.vm->initrd_path, path,
+			sizeof (config.vm->initrd_path));
+	g_free (path);
+
+	ck_assert (g_file_set_contents (config.vm->initrd_path, "", -1,
+				NULL));
+
+	ck_assert (clr_oci_vm_args_get (&config, &args));
+
+	ck_assert (! g_strcmp0 (args[3], "bar"));
+	ck_assert (! g_strcmp0 (args[4], "-initrd"));
+	ck_assert_str_eq (args[5], config.vm->initrd_path);
+	ck_assert (! args[6]);
+	g_strfreev (args);
+
+	ck_assert (! g_remove (config.vm->initrd_path));
+	config.vm->initrd_path[0] = '\0';
+
+	/* the workload is written to the rootfs by default */
+	ck_assert (! clr_oci_vm_args_use_workload_spec (NULL));
+	ck_assert (! clr_oci_vm_args_use_workload_spec (&config));
+
+	/* pass the workload to the VM instead */
+	ret = g_file_set_contents (args_file,
+			"-fw_cfg\n"
+			"name=" CLR_OCI_WORKLOAD_SPEC_NAME
+			",string=@WORKLOAD_SPEC@\n",
+			-1, NULL);
+	ck_assert (ret);
+
+	ck_assert (clr_oci_vm_args_use_workload_spec (&config));
+
+	/* no workload */
+	ck_assert (! clr_oci_vm_args_get (&config, &args));
+	g_strfreev (args);
+	args = NULL;
+
+	config.oci.process.args = g_strsplit ("sh|-c|echo a,b", "|", -1);
+	config.oci.process.env = g_strsplit ("PATH=/bin", "|", -1);
+	g_strlcpy (config.oci.process.cwd, "/",
+			sizeof (config.oci.process.cwd));
+
+	ck_assert (clr_oci_vm_args_get (&config, &args));
+
+	ck_assert_str_eq (args[0], "-fw_cfg");
+
+	/* commas are escaped for the hypervisor */
+	ck_assert_str_eq (args[1], "name=" CLR_OCI_WORKLOAD_SPEC_NAME
+			",string={\"args\":[\"sh\",,\"-c\",,\"echo a,,b\"],,"
+			"\"env\":[\"PATH=/bin\"],,"
+			"\"cwd\":\"/\"}");
+	ck_assert (! args[2]);
+	g_strfreev (args);
+
 	/* recreate the args file with expandable lines */
 	ret = g_file_set_contents (args_file,
 			"@WORKLOAD_DIR@\n"
@@ -544,6 +1041,7 @@ Suite* make_hypervisor_suite(void) {
 
 	ADD_TEST(test_clr_oci_vm_args_file_path, s);
 	ADD_TEST(test_clr_oci_expand_cmdline, s);
+	ADD_TEST(test_clr_oci_image_shared_get, s);
 	ADD_TEST(test_clr_oci_vm_args_get, s);
 
 	return s;
@@ -0,0 +1,577 @@
+/*
+ * This file is part of clr-oci-runtime.
+ *
+ * Copyright (C) 2016 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Container lifecycle load driver.
+ *
+ * Generates a bundle whose hypervisor is the fake hypervisor, then runs
+ * the requested number of create/start/pause/resume/delete cycles
+ * through the runtime command-line, with the requested number of cycles
+ * in flight concurrently. Once all cycles complete, throughput and
+ * per-operation latency percentiles are displayed.
+ *
+ * Since no real hypervisor is involved, this measures the overhead of
+ * the runtime itself and can be run on any Linux system as a normal
+ * user.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+/** Lifecycle operations performed for each cycle (in order). */
+enum load_op {
+	LOAD_OP_CREATE = 0,
+	LOAD_OP_START,
+	LOAD_OP_PAUSE,
+	LOAD_OP_RESUME,
+	LOAD_OP_DELETE,
+
+	LOAD_OP_COUNT
+};
+
+static const gchar *load_op_names[LOAD_OP_COUNT] = {
+	"create",
+	"start",
+	"pause",
+	"resume",
+	"delete",
+};
+
+/** Results for a single operation type. */
+struct load_stats {
+	/** Latency of each successful operation (in microseconds). */
+	GArray  *latencies;
+	guint    failures;
+};
+
+static gchar     *runtime_path;
+static gchar     *hypervisor_path;
+static gchar     *work_dir;
+static gint       cycles = 100;
+static gint       parallel = 8;
+static gboolean   keep;
+static gboolean   verbose;
+
+static gchar     *bundle_dir;
+static gchar     *root_dir;
+
+static GMutex             stats_lock;
+static struct load_stats  stats[LOAD_OP_COUNT];
+static guint              failed_cycles;
+
+static GOptionEntry options[] =
+{
+	{
+		"runtime", 'r', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_FILENAME, &runtime_path,
+		"path to the runtime to test (default: ./clr-oci-runtime)",
+		"PATH"
+	},
+	{
+		"hypervisor", 'H', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_FILENAME, &hypervisor_path,
+		"path to the fake hypervisor (default: ./fake-hypervisor)",
+		"PATH"
+	},
+	{
+		"cycles", 'n', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &cycles,
+		"number of lifecycles to run (default: 100)",
+		"COUNT"
+	},
+	{
+		"parallel", 'p', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &parallel,
+		"number of lifecycles to run concurrently (default: 8)",
+		"COUNT"
+	},
+	{
+		"dir", 'd', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_FILENAME, &work_dir,
+		"directory to create bundle and runtime root below "
+		"(default: temporary directory)",
+		"DIR"
+	},
+	{
+		"keep", 'k', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &keep,
+		"do not remove the work directory on exit",
+		NULL
+	},
+	{
+		"verbose", 'v', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &verbose,
+		"display failing commands and their output",
+		NULL
+	},
+
+	{NULL}
+};
+
+/** Hypervisor arguments used for the generated bundle. */
+static const gchar *hypervisor_args[] = {
+	"-name",
+	"@NAME@",
+	"-smp",
+	"1",
+	"-chardev",
+	"@CONSOLE_DEVICE@",
+	"-chardev",
+	"@PROCESS_SOCKET@",
+	"-uuid",
+	"@UUID@",
+	"-chardev",
+	"socket,id=charqmp0,fd=@COMMS_FD@,server=on,wait=off",
+	"-mon",
+	"chardev=charqmp0,mode=control",
+	"-chardev",
+	"socket,id=charqmp1,fd=@EVENTS_FD@,server=on,wait=off",
+	"-mon",
+	"chardev=charqmp1,mode=control",
+
+	/* terminator */
+	NULL
+};
+
+/*!
+ * Create a minimal bundle below \ref work_dir.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+load_bundle_create (void)
+{
+	g_autofree gchar  *rootfs = NULL;
+	g_autofree gchar  *image = NULL;
+	g_autofree gchar  *kernel = NULL;
+	g_autofree gchar  *config = NULL;
+	g_autofree gchar  *config_file = NULL;
+	g_autofree gchar  *args_file = NULL;
+	GString           *args;
+	const gchar      **arg;
+	GError            *error = NULL;
+	gboolean           ret = false;
+
+	bundle_dir = g_build_path ("/", work_dir, "bundle", NULL);
+	root_dir = g_build_path ("/", work_dir, "root", NULL);
+	rootfs = g_build_path ("/", bundle_dir, "rootfs", NULL);
+	image = g_build_path ("/", bundle_dir, "clear-containers.img", NULL);
+	kernel = g_build_path ("/", bundle_dir, "vmlinux.container", NULL);
+	config_file = g_build_path ("/", bundle_dir, "config.json", NULL);
+	args_file = g_build_path ("/", bundle_dir, "hypervisor.args", NULL);
+
+	if (g_mkdir_with_parents (rootfs, 0750) < 0
+			|| g_mkdir_with_parents (root_dir, 0750) < 0) {
+		fprintf (stderr, "failed to create bundle directories\n");
+		return false;
+	}
+
+	if (! (g_file_set_contents (image, "", 0, &error)
+			&& g_file_set_contents (kernel, "", 0, &error))) {
+		goto out;
+	}
+
+	config = g_strdup_printf (
+		"{\n"
+		"  \"ociVersion\": \"0.6.0\",\n"
+		"  \"platform\": { \"os\": \"linux\", \"arch\": \"amd64\" },\n"
+		"  \"process\": {\n"
+		"    \"terminal\": false,\n"
+		"    \"user\": { \"uid\": 0, \"gid\": 0 },\n"
+		"    \"args\": [ \"true\" ],\n"
+		"    \"env\": [ \"PATH=/usr/bin:/bin\" ],\n"
+		"    \"cwd\": \"/\"\n"
+		"  },\n"
+		"  \"root\": { \"path\": \"rootfs\", \"readonly\": false },\n"
+		"  \"hostname\": \"load\",\n"
+		"  \"mounts\": [],\n"
+		"  \"hooks\": {},\n"
+		"  \"vm\": {\n"
+		"    \"path\": \"%s\",\n"
+		"    \"image\": \"%s\",\n"
+		"    \"kernel\": { \"path\": \"%s\", \"parameters\": \"\" }\n"
+		"  }\n"
+		"}\n",
+		hypervisor_path, image, kernel);
+
+	if (! g_file_set_contents (config_file, config, -1, &error)) {
+		goto out;
+	}
+
+	/* first line is the command to run */
+	args = g_string_new (hypervisor_path);
+	g_string_append_c (args, '\n');
+
+	for (arg = hypervisor_args; *arg; arg++) {
+		g_string_append_printf (args, "%s\n", *arg);
+	}
+
+	ret = g_file_set_contents (args_file, args->str,
+			(gssize)args->len, &error);
+
+	g_string_free (args, true);
+
+out:
+	if (error) {
+		fprintf (stderr, "failed to create bundle: %s\n",
+				error->message);
+		g_error_free (error);
+	}
+
+	return ret;
+}
+
+/*!
+ * Run a single runtime command.
+ *
+ * \param op \ref load_op.
+ * \param id Container id.
+ * \param[out] elapsed Time taken to run the command (in microseconds).
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+load_run_op (enum load_op op, const gchar *id, gint64 *elapsed)
+{
+	g_autofree gchar  *out = NULL;
+	g_autofree gchar  *err = NULL;
+	const gchar       *argv[8];
+	GError            *error = NULL;
+	gint               status = -1;
+	gint64             start;
+	gboolean           ret;
+	guint              i = 0;
+
+	argv[i++] = runtime_path;
+	argv[i++] = "--root";
+	argv[i++] = root_dir;
+	argv[i++] = load_op_names[op];
+
+	if (op == LOAD_OP_CREATE) {
+		argv[i++] = "--bundle";
+		argv[i++] = bundle_dir;
+	}
+
+	argv[i++] = id;
+	argv[i] = NULL;
+
+	start = g_get_monotonic_time ();
+
+	ret = g_spawn_sync (NULL, (gchar **)argv, NULL,
+			(GSpawnFlags)0,
+			NULL, NULL, &out, &err, &status, &error);
+
+	*elapsed = g_get_monotonic_time () - start;
+
+	if (! ret) {
+		fprintf (stderr, "failed to run %s: %s\n",
+				runtime_path, error->message);
+		g_error_free (error);
+		return false;
+	}
+
+	if (! (WIFEXITED (status) && WEXITSTATUS (status) == 0)) {
+		if (verbose) {
+			fprintf (stderr, "%s %s failed (status %d):\n%s%s",
+					load_op_names[op], id, status,
+					out ? out : "", err ? err : "");
+		}
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * Run a single lifecycle.
+ *
+ * \param data Cycle number (offset by one).
+ * \param user_data Unused.
+ */
+static void
+load_cycle (gpointer data, gpointer user_data)
+{
+	g_autofree gchar  *id = NULL;
+	gint64             elapsed[LOAD_OP_COUNT] = { 0 };
+	gboolean           ok[LOAD_OP_COUNT] = { false };
+	gboolean           failed = false;
+	guint              op;
+
+	(void)user_data;
+
+	id = g_strdup_printf ("load-%d-%u", (int)getpid (),
+			GPOINTER_TO_UINT (data));
+
+	for (op = 0; op < LOAD_OP_COUNT; op++) {
+		ok[op] = load_run_op (op, id, &elapsed[op]);
+		if (! ok[op]) {
+			failed = true;
+
+			if (op != LOAD_OP_DELETE) {
+				/* always attempt to clean up */
+				gint64 ignored;
+
+				(void)load_run_op (LOAD_OP_DELETE, id,
+						&ignored);
+			}
+			break;
+		}
+	}
+
+	g_mutex_lock (&stats_lock);
+
+	for (op = 0; op < LOAD_OP_COUNT; op++) {
+		if (ok[op]) {
+			g_array_append_val (stats[op].latencies,
+					elapsed[op]);
+		} else if (elapsed[op]) {
+			stats[op].failures++;
+		}
+	}
+
+	if (failed) {
+		failed_cycles++;
+	}
+
+	g_mutex_unlock (&stats_lock);
+}
+
+static gint
+load_compare_latency (gconstpointer a, gconstpointer b)
+{
+	gint64 x = *(const gint64 *)a;
+	gint64 y = *(const gint64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*!
+ * Determine the specified percentile of a sorted array of latencies.
+ *
+ * \param latencies Sorted \c GArray of \c gint64 values.
+ * \param percentile Percentile to calculate (0-100).
+ *
+ * \return Latency in milliseconds.
+ */
+static double
+load_percentile (GArray *latencies, double percentile)
+{
+	guint index;
+
+	if (! latencies->len) {
+		return 0.0;
+	}
+
+	index = (guint)((percentile / 100.0) * (latencies->len - 1) + 0.5);
+
+	return (double)g_array_index (latencies, gint64, index) / 1000.0;
+}
+
+static void
+load_show_results (gint64 wall_time)
+{
+	double  seconds = (double)wall_time / G_USEC_PER_SEC;
+	guint   op;
+
+	printf ("cycles: %d (%u failed), parallel: %d\n",
+			cycles, failed_cycles, parallel);
+	printf ("wall time: %.3fs, throughput: %.2f cycles/s\n",
+			seconds,
+			seconds > 0 ? (cycles - failed_cycles) / seconds : 0.0);
+
+	printf ("\n%-8s %8s %8s %10s %10s %10s %10s %10s\n",
+			"op", "count", "failed",
+			"min(ms)", "p50(ms)", "p90(ms)", "p99(ms)", "max(ms)");
+
+	for (op = 0; op < LOAD_OP_COUNT; op++) {
+		GArray *l = stats[op].latencies;
+
+		g_array_sort (l, load_compare_latency);
+
+		printf ("%-8s %8u %8u %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+				load_op_names[op],
+				l->len,
+				stats[op].failures,
+				load_percentile (l, 0),
+				load_percentile (l, 50),
+				load_percentile (l, 90),
+				load_percentile (l, 99),
+				load_percentile (l, 100));
+	}
+}
+
+/*!
+ * Convert \p path into an absolute path.
+ *
+ * \param path Path to resolve (freed by this function).
+ * \param fallback Path to use if \p path is \c NULL.
+ *
+ * \return Newly-allocated absolute path.
+ */
+static gchar *
+load_absolute_path (gchar *path, const gchar *fallback)
+{
+	g_autofree gchar  *cwd = NULL;
+	gchar             *resolved;
+
+	if (! path) {
+		path = g_strdup (fallback);
+	}
+
+	if (g_path_is_absolute (path)) {
+		return path;
+	}
+
+	if (! strchr (path, '/')) {
+		/* bare command name */
+		resolved = g_find_program_in_path (path);
+		if (resolved) {
+			g_free (path);
+			return resolved;
+		}
+	}
+
+	cwd = g_get_current_dir ();
+	resolved = g_build_path ("/", cwd, path, NULL);
+
+	g_free (path);
+
+	return resolved;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext  *context;
+	GThreadPool     *pool;
+	GError          *error = NULL;
+	gint64           start;
+	gboolean         created_work_dir = false;
+	gint             i;
+	guint            op;
+	int              ret = EXIT_FAILURE;
+
+	context = g_option_context_new ("- container lifecycle load driver");
+	g_option_context_add_main_entries (context, options, NULL);
+
+	if (! g_option_context_parse (context, &argc, &argv, &error)) {
+		fprintf (stderr, "%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free (context);
+
+	if (cycles <= 0 || parallel <= 0) {
+		fprintf (stderr, "cycles and parallel must be positive\n");
+		return EXIT_FAILURE;
+	}
+
+	runtime_path = load_absolute_path (runtime_path,
+			"./clr-oci-runtime");
+	hypervisor_path = load_absolute_path (hypervisor_path,
+			"./fake-hypervisor");
+
+	if (! g_file_test (runtime_path, G_FILE_TEST_IS_EXECUTABLE)) {
+		fprintf (stderr, "runtime not found: %s\n", runtime_path);
+		return EXIT_FAILURE;
+	}
+
+	if (! g_file_test (hypervisor_path, G_FILE_TEST_IS_EXECUTABLE)) {
+		fprintf (stderr, "fake hypervisor not found: %s\n",
+				hypervisor_path);
+		return EXIT_FAILURE;
+	}
+
+	if (! work_dir) {
+		work_dir = g_dir_make_tmp ("clr-oci-load-XXXXXX", &error);
+		if (! work_dir) {
+			fprintf (stderr, "%s\n", error->message);
+			g_error_free (error);
+			return EXIT_FAILURE;
+		}
+		created_work_dir = true;
+	}
+
+	if (! load_bundle_create ()) {
+		goto out;
+	}
+
+	for (op = 0; op < LOAD_OP_COUNT; op++) {
+		stats[op].latencies = g_array_sized_new (false, false,
+				sizeof (gint64), (guint)cycles);
+	}
+
+	pool = g_thread_pool_new (load_cycle, NULL, parallel, true,
+			&error);
+	if (! pool) {
+		fprintf (stderr, "%s\n", error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	start = g_get_monotonic_time ();
+
+	for (i = 0; i < cycles; i++) {
+		g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+	}
+
+	/* wait for all cycles to complete */
+	g_thread_pool_free (pool, false, true);
+
+	load_show_results (g_get_monotonic_time () - start);
+
+	ret = failed_cycles ? EXIT_FAILURE : EXIT_SUCCESS;
+
+	for (op = 0; op < LOAD_OP_COUNT; op++) {
+		g_array_free (stats[op].latencies, true);
+	}
+
+out:
+	if (created_work_dir && ! keep) {
+		gchar *cmd[] = { "/bin/rm", "-rf", work_dir, NULL };
+
+		(void)g_spawn_sync (NULL, cmd, NULL,
+				G_SPAWN_STDOUT_TO_DEV_NULL
+				| G_SPAWN_STDERR_TO_DEV_NULL,
+				NULL, NULL, NULL, NULL, NULL, NULL);
+	} else {
+		printf ("work directory: %s\n", work_dir);
+	}
+
+	g_free (bundle_dir);
+	g_free (root_dir);
+	g_free (runtime_path);
+	g_free (hypervisor_path);
+	g_free (work_dir);
+
+	return ret;
+}
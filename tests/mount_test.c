@@ -22,6 +22,7 @@
 
 #include <check.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #include "../src/mount.h"
 #include "../src/logging.h"
@@ -32,6 +33,10 @@
 gboolean clr_oci_mount_ignore (struct clr_oci_mount *m);
 gboolean clr_oci_perform_mount (const struct clr_oci_mount *m, gboolean dry_run);
 gboolean clr_oci_perform_unmount (const struct clr_oci_mount *m);
+gchar **clr_oci_mount_dirs_get (GSList *mounts);
+guint64 clr_oci_mount_flags_to_attr (unsigned long flags,
+		guint64 *attr_clr);
+GPtrArray *clr_oci_unmount_groups_get (GSList *mounts);
 
 extern struct spec_handler mounts_spec_handler;
 
@@ -66,6 +71,81 @@ START_TEST(test_clr_oci_perform_mount) {
 	ck_assert(clr_oci_perform_mount(&m, true));
 } END_TEST
 
+START_TEST(test_clr_oci_mount_dirs_get) {
+	struct clr_oci_mount m1 = { 0 };
+	struct clr_oci_mount m2 = { 0 };
+	struct clr_oci_mount m3 = { 0 };
+	struct clr_oci_mount m4 = { 0 };
+	GSList *mounts = NULL;
+	gchar **dirs;
+
+	dirs = clr_oci_mount_dirs_get (NULL);
+	ck_assert (dirs);
+	ck_assert (! dirs[0]);
+	g_strfreev (dirs);
+
+	m1.mnt.mnt_dir = "/a/b/c";
+	m2.mnt.mnt_dir = "/a//b/./d";
+
+	/* only the parent directory is required for a file */
+	m3.mnt.mnt_dir = "/etc/resolv.conf";
+	m3.dest_is_file = true;
+
+	m4.mnt.mnt_dir = "/ignored";
+	m4.ignore_mount = true;
+
+	mounts = g_slist_append (mounts, &m1);
+	mounts = g_slist_append (mounts, &m2);
+	mounts = g_slist_append (mounts, &m3);
+	mounts = g_slist_append (mounts, &m4);
+
+	dirs = clr_oci_mount_dirs_get (mounts);
+	ck_assert (dirs);
+
+	/* deduplicated, with parents before children */
+	ck_assert (g_strv_length (dirs) == 5);
+	ck_assert_str_eq (dirs[0], "a");
+	ck_assert_str_eq (dirs[1], "a/b");
+	ck_assert_str_eq (dirs[2], "a/b/c");
+	ck_assert_str_eq (dirs[3], "a/b/d");
+	ck_assert_str_eq (dirs[4], "etc");
+
+	g_strfreev (dirs);
+	g_slist_free (mounts);
+} END_TEST
+
+START_TEST(test_clr_oci_mount_flags_to_attr) {
+	guint64 attr;
+	guint64 attr_clr;
+
+	ck_assert (! clr_oci_mount_flags_to_attr (0, &attr_clr));
+	ck_assert (! attr_clr);
+	ck_assert (! clr_oci_mount_flags_to_attr (MS_BIND | MS_REC,
+				&attr_clr));
+	ck_assert (! attr_clr);
+
+	attr = clr_oci_mount_flags_to_attr (MS_BIND | MS_RDONLY |
+			MS_NOSUID | MS_NODEV | MS_NOEXEC, &attr_clr);
+	ck_assert (attr == 0xf);
+	ck_assert (! attr_clr);
+
+	/* setting an atime mode requires clearing the old one */
+	attr = clr_oci_mount_flags_to_attr (MS_BIND | MS_NOATIME,
+			&attr_clr);
+	ck_assert (attr == 0x10);
+	ck_assert (attr_clr == 0x70);
+
+	attr = clr_oci_mount_flags_to_attr (MS_BIND | MS_STRICTATIME,
+			&attr_clr);
+	ck_assert (attr == 0x20);
+	ck_assert (attr_clr == 0x70);
+
+	attr = clr_oci_mount_flags_to_attr (MS_BIND | MS_RELATIME,
+			&attr_clr);
+	ck_assert (attr == 0);
+	ck_assert (attr_clr == 0x70);
+} END_TEST
+
 START_TEST(test_clr_oci_handle_mounts) {
 	struct clr_oci_config config = { { 0 } };
 	GNode* node = NULL;
@@ -85,11 +165,112 @@ START_TEST(test_clr_oci_handle_mounts) {
 	g_free_node(node);
 } END_TEST
 
+START_TEST(test_clr_oci_handle_mounts_dirs) {
+	struct clr_oci_config config = { { 0 } };
+	struct clr_oci_mount *m;
+	g_autofree gchar *tmpdir = g_dir_make_tmp (NULL, NULL);
+	g_autofree gchar *dir = NULL;
+
+	ck_assert (tmpdir);
+
+	g_strlcpy (config.oci.root.path, tmpdir,
+			sizeof (config.oci.root.path));
+
+	m = g_new0 (struct clr_oci_mount, 1);
+	m->mnt.mnt_fsname = g_strdup ("/");
+	m->mnt.mnt_dir = g_strdup ("/a/b");
+	m->mnt.mnt_type = g_strdup ("bind");
+	m->flags = MS_BIND;
+	config.oci.mounts = g_slist_append (NULL, m);
+
+	/* source does not exist */
+	m = g_new0 (struct clr_oci_mount, 1);
+	m->mnt.mnt_fsname = g_strdup ("/does/not/exist");
+	m->mnt.mnt_dir = g_strdup ("/c");
+	m->mnt.mnt_type = g_strdup ("bind");
+	m->flags = MS_BIND;
+	config.oci.mounts = g_slist_append (config.oci.mounts, m);
+
+	config.dry_run_mode = true;
+	ck_assert (clr_oci_handle_mounts (&config));
+
+	dir = g_build_path ("/", tmpdir, "a", "b", NULL);
+	ck_assert (g_file_test (dir, G_FILE_TEST_IS_DIR));
+	ck_assert (! g_rmdir (dir));
+	g_free (dir);
+
+	dir = g_build_path ("/", tmpdir, "a", NULL);
+	ck_assert (! g_rmdir (dir));
+	g_free (dir);
+
+	/* ignored mounts are not recorded */
+	ck_assert (m->ignore_mount);
+	dir = g_build_path ("/", tmpdir, "c", NULL);
+	ck_assert (! g_file_test (dir, G_FILE_TEST_EXISTS));
+
+	ck_assert (! g_rmdir (tmpdir));
+
+	clr_oci_config_free(&config);
+} END_TEST
+
 START_TEST(test_clr_oci_perform_unmount) {
 	struct clr_oci_mount m = { 0 };
 	ck_assert(! clr_oci_perform_unmount(NULL));
 
 	ck_assert(! clr_oci_perform_unmount(&m));
+
+	g_snprintf(m.dest, PATH_MAX, "/does/not/exist");
+	ck_assert(! clr_oci_perform_unmount(&m));
+} END_TEST
+
+START_TEST(test_clr_oci_unmount_groups_get) {
+	struct clr_oci_mount m[7] = { { 0 } };
+	const gchar *dests[] = {
+		"/r/a/b", "/r/a", "/r/a-b", "/r/c", "/r/a", "/r/ignored",
+		"/r/c/d"
+	};
+	GSList *mounts = NULL;
+	GPtrArray *groups;
+	GPtrArray *group;
+	guint i;
+
+	groups = clr_oci_unmount_groups_get (NULL);
+	ck_assert (groups);
+	ck_assert (groups->len == 0);
+	g_ptr_array_free (groups, true);
+
+	for (i = 0; i < CLR_OCI_ARRAY_SIZE (m); i++) {
+		g_strlcpy (m[i].dest, dests[i], sizeof (m[i].dest));
+		mounts = g_slist_append (mounts, &m[i]);
+	}
+
+	m[5].ignore_mount = true;
+
+	groups = clr_oci_unmount_groups_get (mounts);
+	ck_assert (groups);
+	ck_assert (groups->len == 3);
+
+	/* "/r/a" subtree, with the stacked mounts in mount order
+	 * and the mount below them last (so unmounted first).
+	 */
+	group = g_ptr_array_index (groups, 0);
+	ck_assert (group->len == 3);
+	ck_assert (g_ptr_array_index (group, 0) == &m[1]);
+	ck_assert (g_ptr_array_index (group, 1) == &m[4]);
+	ck_assert (g_ptr_array_index (group, 2) == &m[0]);
+
+	/* not below "/r/a" */
+	group = g_ptr_array_index (groups, 1);
+	ck_assert (group->len == 1);
+	ck_assert (g_ptr_array_index (group, 0) == &m[2]);
+
+	group = g_ptr_array_index (groups, 2);
+	ck_assert (group->len == 2);
+	ck_assert (g_ptr_array_index (group, 0) == &m[3]);
+	ck_assert (g_ptr_array_index (group, 1) == &m[6]);
+
+	g_ptr_array_free (groups, true);
+	g_slist_free (mounts);
 } END_TEST
 
 START_TEST(test_clr_oci_handle_umounts) {
@@ -104,6 +285,12 @@ START_TEST(test_clr_oci_handle_umounts) {
 
 	ck_assert(! clr_oci_handle_unmounts(&config));
 
+	/* nothing to unmount */
+	for (GSList *l = config.oci.mounts; l; l = g_slist_next (l)) {
+		((struct clr_oci_mount *)l->data)->ignore_mount = true;
+	}
+	ck_assert(clr_oci_handle_unmounts(&config));
+
 	clr_oci_config_free(&config);
 	g_free_node(node);
 } END_TEST
@@ -113,8 +300,12 @@ Suite* make_mount_suite(void) {
 
 	ADD_TEST(test_clr_oci_mount_ignore, s);
 	ADD_TEST(test_clr_oci_perform_mount, s);
+	ADD_TEST(test_clr_oci_mount_dirs_get, s);
+	ADD_TEST(test_clr_oci_mount_flags_to_attr, s);
 	ADD_TEST(test_clr_oci_handle_mounts, s);
+	ADD_TEST(test_clr_oci_handle_mounts_dirs, s);
 	ADD_TEST(test_clr_oci_perform_unmount, s);
+	ADD_TEST(test_clr_oci_unmount_groups_get, s);
 	ADD_TEST(test_clr_oci_handle_umounts, s);
 
 	return s;
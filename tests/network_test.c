@@ -0,0 +1,125 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <check.h>
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/network.h"
+
+void clr_oci_qmp_events_parse (GString *pending, GSList **events);
+
+START_TEST(test_clr_oci_qmp_events_parse) {
+	GString *pending = g_string_new ("");
+	GSList *events = NULL;
+	JsonObject *event;
+
+	/* nothing to parse */
+	clr_oci_qmp_events_parse (pending, &events);
+	ck_assert (! events);
+
+	/* partial message */
+	g_string_assign (pending, "{\"event\": \"STOP\"");
+	clr_oci_qmp_events_parse (pending, &events);
+	ck_assert (! events);
+	ck_assert_str_eq (pending->str, "{\"event\": \"STOP\"");
+
+	/* message completed, and the next one started */
+	g_string_append (pending, "}\r\n{\"timestamp\": ");
+	clr_oci_qmp_events_parse (pending, &events);
+	ck_assert (g_slist_length (events) == 1);
+	event = events->data;
+	ck_assert_str_eq (json_object_get_string_member (event, "event"),
+			"STOP");
+	ck_assert_str_eq (pending->str, "{\"timestamp\": ");
+	g_slist_free_full (events, (GDestroyNotify)json_object_unref);
+	events = NULL;
+
+	/* responses, invalid and empty messages are skipped */
+	g_string_assign (pending,
+			"{\"return\": {}}\r\n"
+			"not json\r\n"
+			"\r\n"
+			"[1, 2]\r\n"
+			"{\"event\": \"RESUME\"}\r\n"
+			"{\"event\": \"RESET\", \"data\": {\"guest\": true}}\r\n");
+	clr_oci_qmp_events_parse (pending, &events);
+	ck_assert (g_slist_length (events) == 2);
+	ck_assert_str_eq (json_object_get_string_member (events->data,
+				"event"), "RESUME");
+	event = events->next->data;
+	ck_assert_str_eq (json_object_get_string_member (event, "event"),
+			"RESET");
+	ck_assert (json_object_get_boolean_member
+			(json_object_get_object_member (event, "data"),
+			 "guest"));
+	ck_assert (! pending->len);
+	g_slist_free_full (events, (GDestroyNotify)json_object_unref);
+
+	g_string_free (pending, true);
+} END_TEST
+
+START_TEST(test_clr_oci_qmp_events_connect) {
+	GSList *events = NULL;
+
+	ck_assert (! clr_oci_qmp_events_connect (NULL, 1));
+	ck_assert (! clr_oci_qmp_events_connect ("/foo", 0));
+	ck_assert (! clr_oci_qmp_events_read (NULL, &events));
+	ck_assert (clr_oci_vm_conn_fd (NULL) == -1);
+} END_TEST
+
+Suite* make_network_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_qmp_events_parse, s);
+	ADD_TEST(test_clr_oci_qmp_events_connect, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("network_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_network_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
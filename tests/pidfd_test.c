@@ -0,0 +1,210 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <check.h>
+#include <glib.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/pidfd.h"
+
+/* Create a child process which waits to be killed. */
+static GPid
+child_new (void)
+{
+	GPid pid = fork ();
+
+	ck_assert (pid >= 0);
+
+	if (! pid) {
+		pause ();
+		_exit (EXIT_SUCCESS);
+	}
+
+	return pid;
+}
+
+static gboolean
+quit_loop (GMainLoop *loop)
+{
+	g_main_loop_quit (loop);
+
+	return false;
+}
+
+START_TEST(test_clr_oci_pidfd_open) {
+	int fd;
+
+	ck_assert (clr_oci_pidfd_open (0, 0) < 0);
+	ck_assert (errno == EINVAL);
+
+	fd = clr_oci_pidfd_open (getpid (), 0);
+	if (fd < 0) {
+		/* kernel without pidfd support */
+		ck_assert (errno == ENOSYS);
+		return;
+	}
+
+	close (fd);
+
+	ck_assert (clr_oci_pidfd_open ((GPid)INT_MAX, 0) < 0);
+} END_TEST
+
+START_TEST(test_clr_oci_pid_start_time) {
+	guint64 start_time = 0;
+
+	ck_assert (! clr_oci_pid_start_time (0, &start_time));
+	ck_assert (! clr_oci_pid_start_time (getpid (), NULL));
+	ck_assert (! clr_oci_pid_start_time ((GPid)INT_MAX, &start_time));
+
+	ck_assert (clr_oci_pid_start_time (getpid (), &start_time));
+	ck_assert (start_time);
+} END_TEST
+
+START_TEST(test_clr_oci_pid_running) {
+	GPid pid;
+	int fd;
+	guint64 start_time = 0;
+
+	ck_assert (! clr_oci_pid_running (0, 0));
+	ck_assert (! clr_oci_pid_running (-1, 0));
+	ck_assert (clr_oci_pid_running (getpid (), 0));
+
+	/* a different process that has been given the same pid */
+	ck_assert (clr_oci_pid_start_time (getpid (), &start_time));
+	ck_assert (clr_oci_pid_running (getpid (), start_time));
+	ck_assert (! clr_oci_pid_running (getpid (), start_time + 1));
+	ck_assert (! clr_oci_pid_signal (getpid (), start_time + 1, 0));
+	ck_assert (errno == ESRCH);
+
+	/* invalid pid (we hope) */
+	ck_assert (! clr_oci_pid_running ((GPid)INT_MAX, 0));
+
+	pid = child_new ();
+	ck_assert (clr_oci_pid_running (pid, 0));
+
+	ck_assert (clr_oci_pid_signal (pid, 0, SIGKILL));
+
+	fd = clr_oci_pidfd_open (pid, 0);
+	if (fd >= 0) {
+		close (fd);
+
+		/* An unreaped child is not running */
+		while (clr_oci_pid_running (pid, 0)) {
+			g_usleep (1000);
+		}
+	}
+
+	ck_assert (waitpid (pid, NULL, 0) == pid);
+	ck_assert (! clr_oci_pid_running (pid, 0));
+} END_TEST
+
+START_TEST(test_clr_oci_pid_signal) {
+	GPid pid;
+	int status;
+
+	ck_assert (! clr_oci_pid_signal (0, 0, SIGTERM));
+	ck_assert (errno == EINVAL);
+
+	ck_assert (! clr_oci_pid_signal ((GPid)INT_MAX, 0, 0));
+
+	pid = child_new ();
+
+	ck_assert (clr_oci_pid_signal (pid, 0, 0));
+	ck_assert (clr_oci_pid_signal (pid, 0, SIGTERM));
+
+	ck_assert (waitpid (pid, &status, 0) == pid);
+	ck_assert (WIFSIGNALED (status));
+	ck_assert (WTERMSIG (status) == SIGTERM);
+} END_TEST
+
+START_TEST(test_clr_oci_pid_watch) {
+	GMainLoop *loop;
+	GPid pid;
+	guint source;
+
+	loop = g_main_loop_new (NULL, false);
+
+	ck_assert (! clr_oci_pid_watch (0, 0, (GSourceFunc)quit_loop, loop));
+	ck_assert (! clr_oci_pid_watch (getpid (), 0, NULL, NULL));
+
+	/* watch can be removed before the process exits */
+	source = clr_oci_pid_watch (getpid (), 0,
+			(GSourceFunc)quit_loop, loop);
+	ck_assert (source);
+	g_source_remove (source);
+
+	pid = child_new ();
+
+	ck_assert (clr_oci_pid_watch (pid, 0, (GSourceFunc)quit_loop, loop));
+	ck_assert (clr_oci_pid_signal (pid, 0, SIGKILL));
+
+	/* returns once the child has exited */
+	g_main_loop_run (loop);
+
+	(void)waitpid (pid, NULL, WNOHANG);
+
+	g_main_loop_unref (loop);
+} END_TEST
+
+Suite* make_pidfd_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_pidfd_open, s);
+	ADD_TEST(test_clr_oci_pid_start_time, s);
+	ADD_TEST(test_clr_oci_pid_running, s);
+	ADD_TEST(test_clr_oci_pid_signal, s);
+	ADD_TEST(test_clr_oci_pid_watch, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("pidfd_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_pidfd_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,290 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/oci.h"
+#include "../src/oci-config.h"
+#include "../src/placement.h"
+
+extern gchar *sysfs_node_dir;
+
+/* Create a fake NUMA node below \p dir. */
+static void
+node_new (const gchar *dir, const gchar *name, const gchar *cpulist)
+{
+	g_autofree gchar *node_dir = g_build_path ("/", dir, name, NULL);
+	g_autofree gchar *path = g_build_path ("/", node_dir, "cpulist",
+			NULL);
+
+	ck_assert (! g_mkdir (node_dir, 0750));
+	ck_assert (g_file_set_contents (path, cpulist, -1, NULL));
+}
+
+/* Remove a fake NUMA node created by node_new(). */
+static void
+node_free (const gchar *dir, const gchar *name)
+{
+	g_autofree gchar *node_dir = g_build_path ("/", dir, name, NULL);
+	g_autofree gchar *path = g_build_path ("/", node_dir, "cpulist",
+			NULL);
+
+	ck_assert (! g_remove (path));
+	ck_assert (! g_remove (node_dir));
+}
+
+START_TEST(test_clr_oci_placement_nodes) {
+	gchar *tmpdir;
+	gchar *nodes;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	sysfs_node_dir = "/this/directory/must/not/exist";
+
+	ck_assert (! clr_oci_placement_nodes (NULL));
+	ck_assert (! clr_oci_placement_nodes ("x"));
+
+	/* not a NUMA system */
+	ck_assert (! clr_oci_placement_nodes ("0"));
+
+	sysfs_node_dir = tmpdir;
+
+	node_new (tmpdir, "node0", "0-1,4-5\n");
+	node_new (tmpdir, "node1", "2-3,6-7\n");
+	node_new (tmpdir, "node10", "8\n");
+	node_new (tmpdir, "online", "0-1\n");
+
+	nodes = clr_oci_placement_nodes ("1");
+	ck_assert_str_eq (nodes, "0");
+	g_free (nodes);
+
+	nodes = clr_oci_placement_nodes ("6,7");
+	ck_assert_str_eq (nodes, "1");
+	g_free (nodes);
+
+	nodes = clr_oci_placement_nodes ("8,5-6");
+	ck_assert_str_eq (nodes, "0,1,10");
+	g_free (nodes);
+
+	/* no such CPU */
+	ck_assert (! clr_oci_placement_nodes ("9"));
+
+	node_free (tmpdir, "node0");
+	node_free (tmpdir, "node1");
+	node_free (tmpdir, "node10");
+	node_free (tmpdir, "online");
+
+	ck_assert (! g_remove (tmpdir));
+	g_free (tmpdir);
+} END_TEST
+
+START_TEST(test_clr_oci_placement_get) {
+	struct clr_oci_config      config = { { 0 } };
+	struct oci_cfg_annotation *a;
+	gchar                     *cpus = NULL;
+	gchar                     *mems = NULL;
+
+	sysfs_node_dir = "/this/directory/must/not/exist";
+
+	ck_assert (! clr_oci_placement_get (NULL, NULL, NULL));
+	ck_assert (! clr_oci_placement_get (&config, NULL, &mems));
+	ck_assert (! clr_oci_placement_get (&config, &cpus, NULL));
+
+	/* no placement */
+	ck_assert (clr_oci_placement_get (&config, &cpus, &mems));
+	ck_assert (! cpus);
+	ck_assert (! mems);
+
+	/* the nodes of the CPUs cannot be determined */
+	config.oci.oci_linux.resources.cpu_cpus = g_strdup ("0-3");
+	ck_assert (clr_oci_placement_get (&config, &cpus, &mems));
+	ck_assert_str_eq (cpus, "0-3");
+	ck_assert (! mems);
+	g_free (cpus);
+
+	config.oci.oci_linux.resources.cpu_mems = g_strdup ("1");
+	ck_assert (clr_oci_placement_get (&config, &cpus, &mems));
+	ck_assert_str_eq (cpus, "0-3");
+	ck_assert_str_eq (mems, "1");
+	g_free (cpus);
+	g_free (mems);
+
+	/* annotations override the resources */
+	a = g_new0 (struct oci_cfg_annotation, 1);
+	a->key = g_strdup (CLR_OCI_ANNOTATION_CPUS);
+	a->value = g_strdup ("4,6");
+	config.oci.annotations = g_slist_prepend (config.oci.annotations, a);
+
+	a = g_new0 (struct oci_cfg_annotation, 1);
+	a->key = g_strdup (CLR_OCI_ANNOTATION_MEMS);
+	a->value = g_strdup ("0");
+	config.oci.annotations = g_slist_prepend (config.oci.annotations, a);
+
+	ck_assert (clr_oci_placement_get (&config, &cpus, &mems));
+	ck_assert_str_eq (cpus, "4,6");
+	ck_assert_str_eq (mems, "0");
+	g_free (cpus);
+	g_free (mems);
+
+	/* invalid placement */
+	g_free (a->value);
+	a->value = g_strdup ("0-");
+
+	ck_assert (! clr_oci_placement_get (&config, &cpus, &mems));
+	ck_assert (! cpus);
+	ck_assert (! mems);
+
+	clr_oci_config_free (&config);
+} END_TEST
+
+START_TEST(test_clr_oci_placement_memory_policy) {
+	gchar *policy;
+
+	ck_assert (! clr_oci_placement_memory_policy (NULL));
+	ck_assert (! clr_oci_placement_memory_policy (""));
+
+	policy = clr_oci_placement_memory_policy ("1");
+	ck_assert_str_eq (policy, "host-nodes=1,policy=bind");
+	g_free (policy);
+
+	policy = clr_oci_placement_memory_policy ("0-1,3");
+	ck_assert_str_eq (policy, "host-nodes=0-1,host-nodes=3,policy=bind");
+	g_free (policy);
+} END_TEST
+
+START_TEST(test_clr_oci_placement_vcpus) {
+	ck_assert (clr_oci_placement_vcpus (NULL, 4) == 4);
+	ck_assert (clr_oci_placement_vcpus ("x", 4) == 4);
+
+	/* a single CPU is shared */
+	ck_assert (clr_oci_placement_vcpus ("2", 1) == 1);
+	ck_assert (clr_oci_placement_vcpus ("2", 4) == 4);
+
+	/* else one is left for the other threads */
+	ck_assert (clr_oci_placement_vcpus ("0-3", 4) == 3);
+	ck_assert (clr_oci_placement_vcpus ("0-3", 8) == 3);
+	ck_assert (clr_oci_placement_vcpus ("0-3", 2) == 2);
+	ck_assert (clr_oci_placement_vcpus ("1,3", 2) == 1);
+} END_TEST
+
+START_TEST(test_clr_oci_placement_pin) {
+	cpu_set_t  saved;
+	cpu_set_t  set;
+	GArray    *threads;
+	GPid       tid;
+	gchar     *cpus;
+	int        cpu;
+
+	ck_assert (! sched_getaffinity (0, sizeof (saved), &saved));
+
+	/* find a CPU this process may use */
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET (cpu, &saved)) {
+			break;
+		}
+	}
+	ck_assert (cpu < CPU_SETSIZE);
+
+	cpus = g_strdup_printf ("%d", cpu);
+
+	threads = g_array_new (false, true, sizeof (GPid));
+
+	ck_assert (! clr_oci_placement_pin (0, threads, cpus));
+	ck_assert (! clr_oci_placement_pin (getpid (), NULL, cpus));
+	ck_assert (! clr_oci_placement_pin (getpid (), threads, NULL));
+	ck_assert (! clr_oci_placement_pin (getpid (), threads, "x"));
+
+	/* treat this thread as a vCPU */
+	tid = (GPid)syscall (SYS_gettid);
+	g_array_append_val (threads, tid);
+
+	ck_assert (clr_oci_placement_pin (getpid (), threads, cpus));
+
+	ck_assert (! sched_getaffinity (0, sizeof (set), &set));
+	ck_assert (CPU_COUNT (&set) == 1);
+	ck_assert (CPU_ISSET (cpu, &set));
+
+	ck_assert (! sched_setaffinity (0, sizeof (saved), &saved));
+
+	g_array_free (threads, true);
+	g_free (cpus);
+} END_TEST
+
+START_TEST(test_clr_oci_vm_pin) {
+	struct clr_oci_config config = { { 0 } };
+
+	ck_assert (! clr_oci_vm_pin (NULL));
+
+	/* not placed */
+	ck_assert (clr_oci_vm_pin (&config));
+
+	/* no hypervisor */
+	g_strlcpy (config.state.cpus, "0", sizeof (config.state.cpus));
+	ck_assert (! clr_oci_vm_pin (&config));
+} END_TEST
+
+Suite* make_placement_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_placement_nodes, s);
+	ADD_TEST(test_clr_oci_placement_get, s);
+	ADD_TEST(test_clr_oci_placement_memory_policy, s);
+	ADD_TEST(test_clr_oci_placement_vcpus, s);
+	ADD_TEST(test_clr_oci_placement_pin, s);
+	ADD_TEST(test_clr_oci_vm_pin, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("placement_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_placement_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -20,15 +20,22 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include <check.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #include "test_common.h"
 #include "../src/logging.h"
+#include "../src/oci.h"
 #include "../src/process.h"
 
 gboolean clr_oci_cmd_is_shell (const char *cmd);
+gsize clr_oci_hook_output_append (GString *buf, gsize max,
+		const gchar *data, gsize len);
+void clr_oci_hook_output_format (GString *log, const gchar *prefix,
+		const gchar *data, gsize len);
 
 START_TEST(test_clr_oci_cmd_is_shell) {
 
@@ -73,10 +80,217 @@ START_TEST(test_clr_oci_cmd_is_shell) {
 
 } END_TEST
 
+/*!
+ * Create a hook that runs the specified shell command.
+ *
+ * \param cmd Shell command.
+ * \param timeout Hook timeout in seconds.
+ *
+ * \return Newly-allocated \ref oci_cfg_hook.
+ */
+static struct oci_cfg_hook *
+test_hook_new (const gchar *cmd, gint timeout)
+{
+	struct oci_cfg_hook *hook = g_new0 (struct oci_cfg_hook, 1);
+
+	g_strlcpy (hook->path, "/bin/sh", sizeof (hook->path));
+	hook->args = g_new0 (gchar *, 4);
+	hook->args[0] = g_strdup ("sh");
+	hook->args[1] = g_strdup ("-c");
+	hook->args[2] = g_strdup (cmd);
+	hook->timeout = timeout;
+
+	return hook;
+}
+
+static void
+test_hook_free (struct oci_cfg_hook *hook)
+{
+	g_strfreev (hook->args);
+	g_free (hook);
+}
+
+/** Single-line state passed to hooks. */
+static const gchar test_state[] = "{\"id\":\"foo\"}";
+
+START_TEST(test_clr_run_hooks) {
+	GSList *hooks = NULL;
+	gchar *tmpdir;
+	gchar *marker;
+	gchar *cmd;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	/* no hooks */
+	ck_assert (clr_run_hooks (NULL, test_state, sizeof (test_state) - 1,
+			true, false));
+
+	/* no state */
+	hooks = g_slist_append (hooks, test_hook_new ("true", 0));
+	ck_assert (! clr_run_hooks (hooks, NULL, 0, true, false));
+
+	/* successful hook */
+	ck_assert (clr_run_hooks (hooks, test_state, sizeof (test_state) - 1,
+			true, false));
+	g_slist_free_full (hooks, (GDestroyNotify)test_hook_free);
+
+	/* hook receives the state as a single line on stdin */
+	marker = g_build_path ("/", tmpdir, "state", NULL);
+	cmd = g_strdup_printf ("[ \"$(cat)\" = '%s' ] && touch %s",
+			test_state, marker);
+	hooks = g_slist_append (NULL, test_hook_new (cmd, 0));
+	ck_assert (clr_run_hooks (hooks, test_state, sizeof (test_state) - 1,
+			true, false));
+	ck_assert (g_file_test (marker, G_FILE_TEST_EXISTS));
+	g_remove (marker);
+	g_free (marker);
+	g_free (cmd);
+	g_slist_free_full (hooks, (GDestroyNotify)test_hook_free);
+
+	/* a failing hook stops subsequent hooks from running */
+	marker = g_build_path ("/", tmpdir, "marker", NULL);
+	cmd = g_strdup_printf ("touch %s", marker);
+	hooks = g_slist_append (NULL, test_hook_new ("false", 0));
+	hooks = g_slist_append (hooks, test_hook_new (cmd, 0));
+	ck_assert (! clr_run_hooks (hooks, test_state, sizeof (test_state) - 1,
+			true, false));
+	ck_assert (! g_file_test (marker, G_FILE_TEST_EXISTS));
+
+	/* ... unless failures are non-fatal */
+	ck_assert (clr_run_hooks (hooks, test_state, sizeof (test_state) - 1,
+			false, false));
+	ck_assert (g_file_test (marker, G_FILE_TEST_EXISTS));
+	g_remove (marker);
+	g_slist_free_full (hooks, (GDestroyNotify)test_hook_free);
+
+	g_free (marker);
+	g_free (cmd);
+	g_rmdir (tmpdir);
+	g_free (tmpdir);
+} END_TEST
+
+START_TEST(test_clr_run_hooks_timeout) {
+	GSList *hooks = NULL;
+	gint64 start;
+	gint64 elapsed;
+
+	/* hooks exceeding their timeout are killed (along with any
+	 * children they have created).
+	 */
+	hooks = g_slist_append (NULL, test_hook_new ("sleep 30; true", 1));
+	start = g_get_monotonic_time ();
+	ck_assert (! clr_run_hooks (hooks, test_state, sizeof (test_state) - 1,
+			true, false));
+	elapsed = g_get_monotonic_time () - start;
+	ck_assert (elapsed >= 1 * G_USEC_PER_SEC);
+	ck_assert (elapsed < 3 * G_USEC_PER_SEC);
+
+	/* a timeout is not fatal for non-fatal hooks */
+	ck_assert (clr_run_hooks (hooks, test_state, sizeof (test_state) - 1,
+			false, false));
+	g_slist_free_full (hooks, (GDestroyNotify)test_hook_free);
+
+	/* a hook finishing before its timeout succeeds */
+	hooks = g_slist_append (NULL, test_hook_new ("true", 2));
+	ck_assert (clr_run_hooks (hooks, test_state, sizeof (test_state) - 1,
+			true, false));
+	g_slist_free_full (hooks, (GDestroyNotify)test_hook_free);
+} END_TEST
+
+START_TEST(test_clr_run_hooks_parallel) {
+	GSList *hooks = NULL;
+	gint64 start;
+	gint64 elapsed;
+
+	hooks = g_slist_append (NULL, test_hook_new ("false", 0));
+	hooks = g_slist_append (hooks, test_hook_new ("sleep 1", 0));
+	hooks = g_slist_append (hooks, test_hook_new ("sleep 1", 0));
+	hooks = g_slist_append (hooks, test_hook_new ("sleep 1", 0));
+
+	/* hooks run concurrently, so take as long as the slowest */
+	start = g_get_monotonic_time ();
+	ck_assert (clr_run_hooks (hooks, test_state, sizeof (test_state) - 1,
+			false, true));
+	elapsed = g_get_monotonic_time () - start;
+	ck_assert (elapsed < 3 * G_USEC_PER_SEC);
+
+	/* parallel is ignored when hooks are fatal (so the first
+	 * failure stops the remaining hooks from running).
+	 */
+	ck_assert (! clr_run_hooks (hooks, test_state, sizeof (test_state) - 1,
+			true, true));
+
+	g_slist_free_full (hooks, (GDestroyNotify)test_hook_free);
+} END_TEST
+
+START_TEST(test_clr_oci_hook_output_append) {
+	GString *buf = g_string_new ("");
+
+	ck_assert (! clr_oci_hook_output_append (buf, 8, NULL, 0));
+	ck_assert (! clr_oci_hook_output_append (buf, 8, "", 0));
+	ck_assert (buf->len == 0);
+
+	ck_assert (! clr_oci_hook_output_append (buf, 8, "hello", 5));
+	ck_assert_str_eq (buf->str, "hello");
+
+	/* fills buffer exactly */
+	ck_assert (! clr_oci_hook_output_append (buf, 8, "abc", 3));
+	ck_assert_str_eq (buf->str, "helloabc");
+
+	/* buffer full */
+	ck_assert (clr_oci_hook_output_append (buf, 8, "x", 1) == 1);
+	ck_assert_str_eq (buf->str, "helloabc");
+
+	g_string_truncate (buf, 6);
+
+	/* partially saved */
+	ck_assert (clr_oci_hook_output_append (buf, 8, "wxyz", 4) == 2);
+	ck_assert_str_eq (buf->str, "hellowx");
+
+	g_string_free (buf, true);
+} END_TEST
+
+START_TEST(test_clr_oci_hook_output_format) {
+	GString *log = g_string_new ("");
+	const gchar *data;
+
+	clr_oci_hook_output_format (log, "> ", NULL, 0);
+	ck_assert (log->len == 0);
+
+	data = "\n\r\n\n";
+	clr_oci_hook_output_format (log, "> ", data, strlen (data));
+	ck_assert (log->len == 0);
+
+	data = "one";
+	clr_oci_hook_output_format (log, "> ", data, strlen (data));
+	ck_assert_str_eq (log->str, "> one\n");
+
+	g_string_truncate (log, 0);
+
+	data = "one\ntwo\r\n\nthree";
+	clr_oci_hook_output_format (log, "> ", data, strlen (data));
+	ck_assert_str_eq (log->str, "> one\n> two\n> three\n");
+
+	g_string_truncate (log, 0);
+
+	/* only the specified length is considered */
+	data = "one\ntwo\n";
+	clr_oci_hook_output_format (log, "", data, 4);
+	ck_assert_str_eq (log->str, "one\n");
+
+	g_string_free (log, true);
+} END_TEST
+
 Suite* make_process_suite(void) {
 	Suite* s = suite_create(__FILE__);
 
 	ADD_TEST(test_clr_oci_cmd_is_shell, s);
+	ADD_TEST(test_clr_run_hooks, s);
+	ADD_TEST(test_clr_run_hooks_timeout, s);
+	ADD_TEST(test_clr_run_hooks_parallel, s);
+	ADD_TEST(test_clr_oci_hook_output_append, s);
+	ADD_TEST(test_clr_oci_hook_output_format, s);
 
 	return s;
 }
@@ -0,0 +1,284 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/query.h"
+
+gchar *clr_oci_query_request (const gchar *command,
+		JsonObject *arguments, guint32 id);
+gboolean clr_oci_query_reply_parse (const gchar *line, guint32 id,
+		JsonNode **result);
+
+static JsonNode *
+parse (const gchar *str)
+{
+	JsonParser *parser = json_parser_new ();
+	JsonNode *node;
+
+	ck_assert (json_parser_load_from_data (parser, str, -1, NULL));
+	node = json_node_copy (json_parser_get_root (parser));
+	g_object_unref (parser);
+
+	return node;
+}
+
+/* Answer a single query like the service in the guest, replying to a
+ * stale request first.
+ */
+static gpointer
+fake_guest (gpointer data)
+{
+	int listener = GPOINTER_TO_INT (data);
+	char buffer[1024] = { 0 };
+	gchar *reply;
+	gchar *id;
+	ssize_t bytes;
+	int fd;
+
+	fd = accept (listener, NULL, NULL);
+	ck_assert (fd >= 0);
+
+	bytes = read (fd, buffer, sizeof (buffer) - 1);
+	ck_assert (bytes > 0);
+	ck_assert (buffer[bytes - 1] == '\n');
+	ck_assert (strstr (buffer, "\"execute\":\"ps\""));
+
+	id = strstr (buffer, "\"id\":");
+	ck_assert (id);
+	id += strlen ("\"id\":");
+	*strchr (id, '}') = '\0';
+
+	reply = g_strdup_printf ("{\"return\":{},\"id\":%u}\n"
+			"{\"return\":{\"titles\":[\"PID\"],"
+			"\"processes\":[[\"1\"]]},\"id\":%s}\n",
+			(guint)strtoul (id, NULL, 10) + 1, id);
+	ck_assert (write (fd, reply, strlen (reply))
+			== (ssize_t)strlen (reply));
+	g_free (reply);
+
+	close (fd);
+
+	return NULL;
+}
+
+START_TEST(test_clr_oci_query_request) {
+	JsonObject *arguments;
+	gchar *str;
+
+	ck_assert (! clr_oci_query_request (NULL, NULL, 0));
+
+	str = clr_oci_query_request ("ps", NULL, 7);
+	ck_assert (str);
+	ck_assert (! strchr (str, '\n'));
+	ck_assert (strstr (str, "\"execute\":\"ps\""));
+	ck_assert (strstr (str, "\"id\":7"));
+	ck_assert (! strstr (str, "\"arguments\""));
+	g_free (str);
+
+	arguments = json_object_new ();
+	json_object_set_string_member (arguments, "foo", "bar");
+
+	str = clr_oci_query_request ("ps", arguments, 7);
+	ck_assert (str);
+	ck_assert (strstr (str, "\"arguments\":{\"foo\":\"bar\"}"));
+	g_free (str);
+
+	json_object_unref (arguments);
+} END_TEST
+
+START_TEST(test_clr_oci_query_reply_parse) {
+	JsonNode *result = NULL;
+
+	ck_assert (! clr_oci_query_reply_parse (NULL, 0, NULL));
+	ck_assert (! clr_oci_query_reply_parse ("{}", 0, NULL));
+	ck_assert (! clr_oci_query_reply_parse ("", 0, &result));
+	ck_assert (! clr_oci_query_reply_parse ("[]", 0, &result));
+
+	/* reply to another request */
+	ck_assert (clr_oci_query_reply_parse ("{\"return\":{},\"id\":1}",
+				2, &result));
+	ck_assert (! result);
+
+	ck_assert (! clr_oci_query_reply_parse ("{\"id\":2}", 2, &result));
+	ck_assert (! result);
+
+	ck_assert (! clr_oci_query_reply_parse (
+				"{\"error\":{\"desc\":\"oops\"},\"id\":2}",
+				2, &result));
+	ck_assert (! result);
+
+	ck_assert (clr_oci_query_reply_parse (
+				"{\"return\":[1,2],\"id\":2}", 2, &result));
+	ck_assert (result);
+	ck_assert (JSON_NODE_HOLDS_ARRAY (result));
+	json_node_free (result);
+} END_TEST
+
+START_TEST(test_clr_oci_query) {
+	g_autofree gchar *tmpdir = g_dir_make_tmp (NULL, NULL);
+	g_autofree gchar *path = NULL;
+	struct sockaddr_un addr = { 0 };
+	JsonNode *result = NULL;
+	GThread *thread;
+	int listener;
+
+	ck_assert (tmpdir);
+
+	ck_assert (! clr_oci_query (NULL, NULL, NULL, NULL));
+	ck_assert (! clr_oci_query ("/tmp", "ps", NULL, NULL));
+
+	path = g_build_path ("/", tmpdir, "query.sock", NULL);
+
+	/* nothing listening */
+	ck_assert (! clr_oci_query (path, "ps", NULL, &result));
+	ck_assert (! result);
+
+	listener = socket (AF_UNIX, SOCK_STREAM, 0);
+	ck_assert (listener >= 0);
+
+	addr.sun_family = AF_UNIX;
+	g_strlcpy (addr.sun_path, path, sizeof (addr.sun_path));
+
+	ck_assert (! bind (listener, (struct sockaddr *)&addr,
+				sizeof (addr)));
+	ck_assert (! listen (listener, 1));
+
+	thread = g_thread_new ("fake-guest", fake_guest,
+			GINT_TO_POINTER (listener));
+
+	ck_assert (clr_oci_query (path, "ps", NULL, &result));
+	ck_assert (result);
+	ck_assert (JSON_NODE_HOLDS_OBJECT (result));
+	ck_assert (json_object_has_member (json_node_get_object (result),
+				"titles"));
+	json_node_free (result);
+
+	g_thread_join (thread);
+
+	close (listener);
+	ck_assert (! g_remove (path));
+	ck_assert (! g_remove (tmpdir));
+} END_TEST
+
+START_TEST(test_clr_oci_ps_format) {
+	JsonNode *result;
+	gchar *str;
+
+	ck_assert (! clr_oci_ps_format (NULL, false));
+
+	result = parse ("[]");
+	ck_assert (! clr_oci_ps_format (result, false));
+	json_node_free (result);
+
+	result = parse ("{\"titles\":[],\"processes\":[]}");
+	ck_assert (! clr_oci_ps_format (result, false));
+	json_node_free (result);
+
+	/* wrong number of columns */
+	result = parse ("{\"titles\":[\"PID\",\"CMD\"],"
+			"\"processes\":[[\"1\"]]}");
+	ck_assert (! clr_oci_ps_format (result, false));
+	json_node_free (result);
+
+	result = parse ("{\"titles\":[\"UID\",\"PID\",\"CMD\"],"
+			"\"processes\":["
+			"[\"root\",\"1\",\"/sbin/init\"],"
+			"[\"daemon\",\"123\",\"sleep 60\"]]}");
+
+	str = clr_oci_ps_format (result, false);
+	ck_assert (str);
+	ck_assert_str_eq (str,
+			"UID    PID CMD\n"
+			"root   1   /sbin/init\n"
+			"daemon 123 sleep 60\n");
+	g_free (str);
+
+	str = clr_oci_ps_format (result, true);
+	ck_assert (str);
+	ck_assert_str_eq (str, "[1,123]");
+	g_free (str);
+
+	json_node_free (result);
+
+	/* JSON output requires a PID column */
+	result = parse ("{\"titles\":[\"CMD\"],"
+			"\"processes\":[[\"init\"]]}");
+	ck_assert (! clr_oci_ps_format (result, true));
+
+	str = clr_oci_ps_format (result, false);
+	ck_assert (str);
+	ck_assert_str_eq (str, "CMD\ninit\n");
+	g_free (str);
+
+	json_node_free (result);
+
+	result = parse ("{\"titles\":[\"PID\"],"
+			"\"processes\":[[\"abc\"]]}");
+	ck_assert (! clr_oci_ps_format (result, true));
+	json_node_free (result);
+} END_TEST
+
+Suite* make_query_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_query_request, s);
+	ADD_TEST(test_clr_oci_query_reply_parse, s);
+	ADD_TEST(test_clr_oci_query, s);
+	ADD_TEST(test_clr_oci_ps_format, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("query_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_query_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,382 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/oci.h"
+#include "../src/hypervisor.h"
+#include "../src/reclaim.h"
+
+#define MiB (1024ULL * 1024)
+
+/** vCPU time (in nanoseconds) of a busy VM over a 1 second interval. */
+#define BUSY_TIME 1000000000ULL
+
+START_TEST(test_clr_oci_memory_merge_get) {
+	struct clr_oci_config      config = { { 0 } };
+	struct clr_oci_vm_cfg      vm = { { 0 } };
+	struct oci_cfg_annotation *a;
+
+	ck_assert (! clr_oci_memory_merge_get (NULL));
+	ck_assert (! clr_oci_memory_merge_get (&config));
+
+	config.vm = &vm;
+	ck_assert (! clr_oci_memory_merge_get (&config));
+
+	vm.memory_merge = true;
+	ck_assert (clr_oci_memory_merge_get (&config));
+
+	/* the annotation overrides the vm configuration */
+	a = g_new0 (struct oci_cfg_annotation, 1);
+	a->key = g_strdup (CLR_OCI_ANNOTATION_MEMORY_MERGE);
+	a->value = g_strdup ("false");
+	config.oci.annotations = g_slist_prepend (NULL, a);
+
+	ck_assert (! clr_oci_memory_merge_get (&config));
+
+	vm.memory_merge = false;
+	g_free (a->value);
+	a->value = g_strdup ("true");
+	ck_assert (clr_oci_memory_merge_get (&config));
+
+	g_free (a->key);
+	g_free (a->value);
+	g_free (a);
+	g_slist_free (config.oci.annotations);
+} END_TEST
+
+START_TEST(test_clr_oci_memory_reclaim_get) {
+	struct clr_oci_config      config = { { 0 } };
+	struct oci_cfg_annotation *a;
+
+	ck_assert (! clr_oci_memory_reclaim_get (NULL));
+	ck_assert (! clr_oci_memory_reclaim_get (&config));
+
+	a = g_new0 (struct oci_cfg_annotation, 1);
+	a->key = g_strdup (CLR_OCI_ANNOTATION_MEMORY_RECLAIM);
+	a->value = g_strdup ("true");
+	config.oci.annotations = g_slist_prepend (NULL, a);
+
+	ck_assert (clr_oci_memory_reclaim_get (&config));
+
+	g_free (a->value);
+	a->value = g_strdup ("false");
+	ck_assert (! clr_oci_memory_reclaim_get (&config));
+
+	g_free (a->key);
+	g_free (a->value);
+	g_free (a);
+	g_slist_free (config.oci.annotations);
+} END_TEST
+
+START_TEST(test_clr_oci_reclaim_new) {
+	struct clr_oci_reclaim *reclaim;
+	struct clr_oci_reclaim *other;
+	gchar                  *tmpdir;
+	gchar                  *path;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	path = g_build_path ("/", tmpdir, CLR_OCI_RECLAIM_FILE, NULL);
+	ck_assert (path);
+
+	ck_assert (! clr_oci_reclaim_new (NULL, 1));
+	ck_assert (! clr_oci_reclaim_new (tmpdir, 0));
+
+	reclaim = clr_oci_reclaim_new (tmpdir, 1);
+	ck_assert (reclaim);
+	ck_assert (reclaim->owner);
+	ck_assert (reclaim->interval == 1);
+	ck_assert (reclaim->reclaimed == 0);
+	ck_assert (g_file_test (path, G_FILE_TEST_EXISTS));
+
+	/* only one process reclaims memory at a time */
+	other = clr_oci_reclaim_new (tmpdir, 1);
+	ck_assert (other);
+	ck_assert (! other->owner);
+	clr_oci_reclaim_free (other);
+
+	/* nothing to give back */
+	ck_assert (! clr_oci_reclaim_stop (NULL, "socket", 1));
+	ck_assert (! clr_oci_reclaim_stop (reclaim, NULL, 1));
+	ck_assert (clr_oci_reclaim_stop (reclaim, "socket", 1));
+
+	clr_oci_reclaim_free (reclaim);
+	ck_assert (! g_remove (path));
+
+	/* memory left reclaimed by a process that died */
+	ck_assert (g_file_set_contents (path, "00000000000134217728\n",
+				-1, NULL));
+
+	reclaim = clr_oci_reclaim_new (tmpdir, 1);
+	ck_assert (reclaim);
+	ck_assert (reclaim->owner);
+	ck_assert (reclaim->reclaimed == 134217728);
+
+	other = clr_oci_reclaim_new (tmpdir, 1);
+	ck_assert (other);
+	ck_assert (other->reclaimed == 134217728);
+	clr_oci_reclaim_free (other);
+
+	clr_oci_reclaim_free (reclaim);
+	ck_assert (! g_remove (path));
+
+	ck_assert (g_file_set_contents (path, "x", -1, NULL));
+	ck_assert (! clr_oci_reclaim_new (tmpdir, 1));
+
+	ck_assert (! g_remove (path));
+	ck_assert (! g_remove (tmpdir));
+
+	g_free (path);
+	g_free (tmpdir);
+} END_TEST
+
+START_TEST(test_clr_oci_reclaim_target) {
+	struct clr_oci_reclaim reclaim = { 0 };
+	guint64                time = 0;
+	guint64                actual = 2048 * MiB;
+	guint                  i;
+
+	reclaim.interval = 1;
+
+	ck_assert (! clr_oci_reclaim_target (NULL, 0, actual, -1));
+	ck_assert (! clr_oci_reclaim_target (&reclaim, 0, 0, -1));
+
+	/* the first sample cannot tell if the VM is idle */
+	ck_assert (! clr_oci_reclaim_target (&reclaim, time, actual,
+				1024 * MiB));
+	ck_assert (reclaim.sampled);
+	ck_assert (reclaim.idle_samples == 0);
+
+	/* not idle for long enough */
+	for (i = 1; i < CLR_OCI_RECLAIM_IDLE_SAMPLES; i++) {
+		ck_assert (! clr_oci_reclaim_target (&reclaim, time, actual,
+					1024 * MiB));
+		ck_assert (reclaim.idle_samples == i);
+	}
+
+	/* idle: reclaim a step */
+	ck_assert (clr_oci_reclaim_target (&reclaim, time, actual,
+				1024 * MiB)
+			== actual - CLR_OCI_RECLAIM_STEP);
+	ck_assert (reclaim.reclaimed == CLR_OCI_RECLAIM_STEP);
+	actual -= CLR_OCI_RECLAIM_STEP;
+
+	/* never leave the guest with less than the headroom */
+	ck_assert (clr_oci_reclaim_target (&reclaim, time, actual,
+				CLR_OCI_RECLAIM_HEADROOM + MiB)
+			== actual - MiB);
+	ck_assert (reclaim.reclaimed == CLR_OCI_RECLAIM_STEP + MiB);
+	actual -= MiB;
+
+	ck_assert (! clr_oci_reclaim_target (&reclaim, time, actual,
+				CLR_OCI_RECLAIM_HEADROOM));
+
+	/* without guest statistics, nothing is reclaimed */
+	ck_assert (! clr_oci_reclaim_target (&reclaim, time, actual, -1));
+	ck_assert (reclaim.reclaimed == CLR_OCI_RECLAIM_STEP + MiB);
+
+	/* never leave the guest with less than the minimum memory */
+	ck_assert (! clr_oci_reclaim_target (&reclaim, time,
+				CLR_OCI_VM_MEMORY_MIN * MiB, 1024 * MiB));
+
+	/* give everything back when the guest is short of memory */
+	ck_assert (clr_oci_reclaim_target (&reclaim, time, actual,
+				CLR_OCI_RECLAIM_PRESSURE - 1)
+			== actual + CLR_OCI_RECLAIM_STEP + MiB);
+	ck_assert (reclaim.reclaimed == 0);
+	actual += CLR_OCI_RECLAIM_STEP + MiB;
+
+	/* nothing to give back */
+	ck_assert (! clr_oci_reclaim_target (&reclaim, time, actual,
+				CLR_OCI_RECLAIM_PRESSURE - 1));
+
+	/* reclaim again, then give everything back when busy */
+	ck_assert (clr_oci_reclaim_target (&reclaim, time, actual,
+				1024 * MiB)
+			== actual - CLR_OCI_RECLAIM_STEP);
+	actual -= CLR_OCI_RECLAIM_STEP;
+
+	time += BUSY_TIME;
+	ck_assert (clr_oci_reclaim_target (&reclaim, time, actual,
+				1024 * MiB)
+			== actual + CLR_OCI_RECLAIM_STEP);
+	ck_assert (reclaim.reclaimed == 0);
+	ck_assert (reclaim.idle_samples == 0);
+} END_TEST
+
+/* Create a sample as returned by clr_oci_stats_sample(). */
+static JsonObject *
+resources_new (gboolean balloon)
+{
+	JsonObject *resources = json_object_new ();
+	JsonObject *cpu_stats = json_object_new ();
+	JsonObject *cpu_usage = json_object_new ();
+	JsonObject *memory_stats = json_object_new ();
+	JsonObject *stats = json_object_new ();
+	JsonArray  *percpu = json_array_new ();
+
+	json_array_add_int_element (percpu, 1000);
+	json_array_add_int_element (percpu, 2000);
+	json_object_set_array_member (cpu_usage, "percpu_usage", percpu);
+	json_object_set_object_member (cpu_stats, "cpu_usage", cpu_usage);
+
+	if (balloon) {
+		json_object_set_int_member (stats, "balloon_actual",
+				2048 * MiB);
+		json_object_set_int_member (stats, "guest_available_memory",
+				1024 * MiB);
+	}
+
+	json_object_set_object_member (memory_stats, "stats", stats);
+
+	json_object_set_object_member (resources, "cpu_stats", cpu_stats);
+	json_object_set_object_member (resources, "memory_stats",
+			memory_stats);
+
+	return resources;
+}
+
+START_TEST(test_clr_oci_reclaim_sample) {
+	struct clr_oci_reclaim  reclaim = { 0 };
+	struct clr_oci_reclaim *other;
+	JsonObject             *resources;
+	JsonObject             *stats;
+	gchar                  *tmpdir;
+	gchar                  *path;
+
+	reclaim.interval = 1;
+	reclaim.fd = -1;
+	reclaim.owner = true;
+
+	resources = json_object_new ();
+
+	ck_assert (! clr_oci_reclaim_sample (NULL, "socket", 1, resources));
+	ck_assert (! clr_oci_reclaim_sample (&reclaim, NULL, 1, resources));
+	ck_assert (! clr_oci_reclaim_sample (&reclaim, "socket", 0,
+				resources));
+	ck_assert (! clr_oci_reclaim_sample (&reclaim, "socket", 1, NULL));
+
+	/* no statistics */
+	ck_assert (! clr_oci_reclaim_sample (&reclaim, "socket", 1,
+				resources));
+	json_object_unref (resources);
+
+	/* no balloon device */
+	resources = resources_new (false);
+	ck_assert (clr_oci_reclaim_sample (&reclaim, "socket", 1,
+				resources));
+	ck_assert (! reclaim.sampled);
+	json_object_unref (resources);
+
+	/* first sample: nothing to do, but report what was reclaimed */
+	resources = resources_new (true);
+	ck_assert (clr_oci_reclaim_sample (&reclaim, "socket", 1,
+				resources));
+	ck_assert (reclaim.sampled);
+	ck_assert (reclaim.vcpu_time == 3000);
+
+	stats = json_object_get_object_member
+		(json_object_get_object_member (resources, "memory_stats"),
+		 "stats");
+	ck_assert (json_object_has_member (stats, "reclaimed"));
+	ck_assert (json_object_get_int_member (stats, "reclaimed") == 0);
+	json_object_unref (resources);
+
+	/* another process only reports what has been reclaimed */
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	path = g_build_path ("/", tmpdir, CLR_OCI_RECLAIM_FILE, NULL);
+	ck_assert (path);
+
+	ck_assert (g_file_set_contents (path, "00000000000134217728\n",
+				-1, NULL));
+
+	other = clr_oci_reclaim_new (tmpdir, 1);
+	ck_assert (other);
+	ck_assert (other->owner);
+	other->owner = false;
+
+	resources = resources_new (true);
+	ck_assert (clr_oci_reclaim_sample (other, "socket", 1,
+				resources));
+	ck_assert (! other->sampled);
+
+	stats = json_object_get_object_member
+		(json_object_get_object_member (resources, "memory_stats"),
+		 "stats");
+	ck_assert (json_object_get_int_member (stats, "reclaimed")
+			== 134217728);
+	json_object_unref (resources);
+
+	clr_oci_reclaim_free (other);
+
+	ck_assert (! g_remove (path));
+	ck_assert (! g_remove (tmpdir));
+
+	g_free (path);
+	g_free (tmpdir);
+} END_TEST
+
+Suite* make_reclaim_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_memory_merge_get, s);
+	ADD_TEST(test_clr_oci_memory_reclaim_get, s);
+	ADD_TEST(test_clr_oci_reclaim_new, s);
+	ADD_TEST(test_clr_oci_reclaim_target, s);
+	ADD_TEST(test_clr_oci_reclaim_sample, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("reclaim_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_reclaim_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
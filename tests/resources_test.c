@@ -0,0 +1,257 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <check.h>
+#include <glib.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/resources.h"
+
+guint clr_oci_cpuset_count (const gchar *cpuset);
+
+START_TEST(test_clr_oci_resources_parse_cpus) {
+	guint vcpus = 0;
+
+	ck_assert (! clr_oci_resources_parse_cpus (NULL, &vcpus));
+	ck_assert (! clr_oci_resources_parse_cpus ("", &vcpus));
+	ck_assert (! clr_oci_resources_parse_cpus ("1", NULL));
+	ck_assert (! clr_oci_resources_parse_cpus ("0", &vcpus));
+	ck_assert (! clr_oci_resources_parse_cpus ("-2", &vcpus));
+	ck_assert (! clr_oci_resources_parse_cpus ("two", &vcpus));
+	ck_assert (! clr_oci_resources_parse_cpus ("2x", &vcpus));
+
+	ck_assert (clr_oci_resources_parse_cpus ("2", &vcpus));
+	ck_assert (vcpus == 2);
+
+	ck_assert (clr_oci_resources_parse_cpus ("0.5", &vcpus));
+	ck_assert (vcpus == 1);
+
+	ck_assert (clr_oci_resources_parse_cpus ("2.25", &vcpus));
+	ck_assert (vcpus == 3);
+} END_TEST
+
+START_TEST(test_clr_oci_resources_parse_memory) {
+	guint64 bytes = 0;
+
+	ck_assert (! clr_oci_resources_parse_memory (NULL, &bytes));
+	ck_assert (! clr_oci_resources_parse_memory ("", &bytes));
+	ck_assert (! clr_oci_resources_parse_memory ("1", NULL));
+	ck_assert (! clr_oci_resources_parse_memory ("0", &bytes));
+	ck_assert (! clr_oci_resources_parse_memory ("-1", &bytes));
+	ck_assert (! clr_oci_resources_parse_memory ("m", &bytes));
+	ck_assert (! clr_oci_resources_parse_memory ("1x", &bytes));
+	ck_assert (! clr_oci_resources_parse_memory ("1mm", &bytes));
+	ck_assert (! clr_oci_resources_parse_memory ("1bb", &bytes));
+	ck_assert (! clr_oci_resources_parse_memory ("99999999999t",
+				&bytes));
+
+	ck_assert (clr_oci_resources_parse_memory ("4096", &bytes));
+	ck_assert (bytes == 4096);
+
+	ck_assert (clr_oci_resources_parse_memory ("10b", &bytes));
+	ck_assert (bytes == 10);
+
+	ck_assert (clr_oci_resources_parse_memory ("2k", &bytes));
+	ck_assert (bytes == 2048);
+
+	ck_assert (clr_oci_resources_parse_memory ("512m", &bytes));
+	ck_assert (bytes == 512 * 1024 * 1024ULL);
+
+	ck_assert (clr_oci_resources_parse_memory ("512MB", &bytes));
+	ck_assert (bytes == 512 * 1024 * 1024ULL);
+
+	ck_assert (clr_oci_resources_parse_memory ("3g", &bytes));
+	ck_assert (bytes == 3 * 1024 * 1024 * 1024ULL);
+
+	ck_assert (clr_oci_resources_parse_memory ("1T", &bytes));
+	ck_assert (bytes == 1024 * 1024 * 1024 * 1024ULL);
+} END_TEST
+
+START_TEST(test_clr_oci_cpuset_count) {
+	ck_assert (clr_oci_cpuset_count (NULL) == 0);
+	ck_assert (clr_oci_cpuset_count ("") == 0);
+	ck_assert (clr_oci_cpuset_count ("a") == 0);
+	ck_assert (clr_oci_cpuset_count ("1,") == 0);
+	ck_assert (clr_oci_cpuset_count ("3-1") == 0);
+	ck_assert (clr_oci_cpuset_count ("1-") == 0);
+
+	ck_assert (clr_oci_cpuset_count ("0") == 1);
+	ck_assert (clr_oci_cpuset_count ("0-3") == 4);
+	ck_assert (clr_oci_cpuset_count ("0-3,6") == 5);
+	ck_assert (clr_oci_cpuset_count ("1,3,5-6") == 4);
+} END_TEST
+
+START_TEST(test_clr_oci_cpuset_parse) {
+	GArray *cpus;
+
+	ck_assert (! clr_oci_cpuset_parse (NULL));
+	ck_assert (! clr_oci_cpuset_parse ("1,,2"));
+	ck_assert (! clr_oci_cpuset_parse ("65536"));
+
+	cpus = clr_oci_cpuset_parse ("4,0-1");
+	ck_assert (cpus);
+	ck_assert (cpus->len == 3);
+	ck_assert (g_array_index (cpus, guint, 0) == 4);
+	ck_assert (g_array_index (cpus, guint, 1) == 0);
+	ck_assert (g_array_index (cpus, guint, 2) == 1);
+	g_array_free (cpus, true);
+} END_TEST
+
+START_TEST(test_clr_oci_resources_parse_json) {
+	struct clr_oci_vm_resources resources = { 0 };
+
+	ck_assert (! clr_oci_resources_parse_json (NULL, -1, &resources));
+	ck_assert (! clr_oci_resources_parse_json ("{}", -1, NULL));
+	ck_assert (! clr_oci_resources_parse_json ("", -1, &resources));
+	ck_assert (! clr_oci_resources_parse_json ("[]", -1, &resources));
+	ck_assert (! clr_oci_resources_parse_json
+			("{\"memory\": {\"limit\": 0}}", -1, &resources));
+	ck_assert (! clr_oci_resources_parse_json
+			("{\"cpu\": {\"cpus\": \"x\"}}", -1, &resources));
+
+	ck_assert (clr_oci_resources_parse_json ("{}", -1, &resources));
+	ck_assert (resources.vcpus == 0);
+	ck_assert (resources.memory == 0);
+
+	ck_assert (clr_oci_resources_parse_json
+			("{\"memory\": {\"limit\": 1073741824}}",
+			 -1, &resources));
+	ck_assert (resources.vcpus == 0);
+	ck_assert (resources.memory == 1073741824);
+
+	resources.memory = 0;
+	ck_assert (clr_oci_resources_parse_json
+			("{\"cpu\": {\"quota\": 150000, \"period\": 100000,"
+			 " \"cpus\": \"0-7\"}}", -1, &resources));
+	ck_assert (resources.vcpus == 2);
+	ck_assert (resources.memory == 0);
+
+	ck_assert (clr_oci_resources_parse_json
+			("{\"cpu\": {\"cpus\": \"0-2\"}}", -1, &resources));
+	ck_assert (resources.vcpus == 3);
+
+	/* a quota without a period is ignored */
+	ck_assert (clr_oci_resources_parse_json
+			("{\"cpu\": {\"quota\": 150000}}", -1, &resources));
+	ck_assert (resources.vcpus == 3);
+} END_TEST
+
+START_TEST(test_clr_oci_resources_from_limits) {
+	struct clr_oci_vm_resources resources = { 0 };
+	struct oci_cfg_resources    limits = { 0 };
+
+	ck_assert (! clr_oci_resources_from_limits (NULL, NULL));
+	ck_assert (! clr_oci_resources_from_limits (&limits, NULL));
+	ck_assert (! clr_oci_resources_from_limits (NULL, &resources));
+
+	/* no limits */
+	ck_assert (clr_oci_resources_from_limits (&limits, &resources));
+	ck_assert (resources.vcpus == 0);
+	ck_assert (resources.memory == 0);
+
+	/* the reservation is used if there is no limit */
+	limits.memory_reservation = 536870912;
+	ck_assert (clr_oci_resources_from_limits (&limits, &resources));
+	ck_assert (resources.memory == 536870912);
+
+	limits.memory_limit = 1073741824;
+	ck_assert (clr_oci_resources_from_limits (&limits, &resources));
+	ck_assert (resources.memory == 1073741824);
+	ck_assert (resources.vcpus == 0);
+
+	/* unlimited */
+	resources.memory = 0;
+	limits.memory_limit = -1;
+	limits.memory_reservation = 0;
+	ck_assert (clr_oci_resources_from_limits (&limits, &resources));
+	ck_assert (resources.memory == 0);
+
+	limits.cpu_cpus = "0-2";
+	ck_assert (clr_oci_resources_from_limits (&limits, &resources));
+	ck_assert (resources.vcpus == 3);
+
+	/* the quota takes priority over the cpuset */
+	limits.cpu_quota = 250000;
+	limits.cpu_period = 100000;
+	ck_assert (clr_oci_resources_from_limits (&limits, &resources));
+	ck_assert (resources.vcpus == 3);
+
+	limits.cpu_cpus = "0-7";
+	ck_assert (clr_oci_resources_from_limits (&limits, &resources));
+	ck_assert (resources.vcpus == 3);
+
+	limits.cpu_quota = 50000;
+	ck_assert (clr_oci_resources_from_limits (&limits, &resources));
+	ck_assert (resources.vcpus == 1);
+
+	/* invalid cpuset */
+	limits.cpu_quota = 0;
+	limits.cpu_cpus = "x";
+	ck_assert (! clr_oci_resources_from_limits (&limits, &resources));
+} END_TEST
+
+START_TEST(test_clr_oci_resources_update) {
+	struct clr_oci_vm_resources resources = { 0 };
+
+	ck_assert (! clr_oci_resources_update (NULL, NULL, NULL));
+	ck_assert (! clr_oci_resources_update (NULL, NULL, &resources));
+} END_TEST
+
+Suite* make_resources_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_resources_parse_cpus, s);
+	ADD_TEST(test_clr_oci_resources_parse_memory, s);
+	ADD_TEST(test_clr_oci_cpuset_count, s);
+	ADD_TEST(test_clr_oci_cpuset_parse, s);
+	ADD_TEST(test_clr_oci_resources_parse_json, s);
+	ADD_TEST(test_clr_oci_resources_from_limits, s);
+	ADD_TEST(test_clr_oci_resources_update, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("resources_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_resources_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -36,6 +36,9 @@ extern struct spec_handler vm_spec_handler;
 * - kernel path
 * vm json optional:
 * - kernel parameters
+* - image_shared
+* - rootfs
+* - memory
 */
 static struct spec_handler_test tests[] = {
 	{ TEST_DATA_DIR "/vm-no-path.json",              false },
@@ -43,6 +46,10 @@ static struct spec_handler_test tests[] = {
 	{ TEST_DATA_DIR "/vm-no-kernel-path.json",       false },
 	{ TEST_DATA_DIR "/vm-no-kernel-parameters.json", true  },
 	{ TEST_DATA_DIR "/vm.json",                      true  },
+	{ TEST_DATA_DIR "/vm-rootfs.json",               true  },
+	{ TEST_DATA_DIR "/vm-memory.json",               true  },
+	{ TEST_DATA_DIR "/vm-image-shared.json",         true  },
+	{ TEST_DATA_DIR "/vm-invalid-initrd.json",       false },
 	{ NULL, false },
 };
 
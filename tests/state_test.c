@@ -20,6 +20,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -133,6 +134,8 @@ START_TEST(test_clr_oci_state_file_create) {
         struct oci_cfg_annotation* a = NULL;
 	g_autofree gchar *tmpdir = g_dir_make_tmp (NULL, NULL);
 	gboolean ret;
+	gchar *str;
+	gsize len = 0;
 
 	ck_assert(! clr_oci_state_file_create (NULL, NULL));
 
@@ -203,6 +206,59 @@ START_TEST(test_clr_oci_state_file_create) {
 	config.vm->kernel_params = g_strdup ("kernel params");
 
 	/* All required elements now set */
+	ck_assert (! clr_oci_state_to_string (&config, timestamp,
+				false, NULL));
+	str = clr_oci_state_to_string (&config, timestamp, false, &len);
+	ck_assert (str);
+	ck_assert (len == strlen (str));
+	ck_assert (! strchr (str, '\n'));
+	ck_assert (strstr (str, "\"id\":\"foo\""));
+	ck_assert (! strstr (str, "\"vsockCid\""));
+	g_free (str);
+
+	config.state.vsock_cid = 1234;
+	str = clr_oci_state_to_string (&config, timestamp, false, &len);
+	ck_assert (str);
+	ck_assert (strstr (str, "\"vsockCid\":1234"));
+	ck_assert (! strstr (str, "\"virtiofsdPid\""));
+	g_free (str);
+
+	config.state.virtiofsd_pid = 4321;
+	str = clr_oci_state_to_string (&config, timestamp, false, &len);
+	ck_assert (str);
+	ck_assert (strstr (str, "\"virtiofsdPid\":4321"));
+	g_free (str);
+	config.state.virtiofsd_pid = 0;
+
+	g_strlcpy (config.state.cpus, "2-3",
+			sizeof (config.state.cpus));
+	str = clr_oci_state_to_string (&config, timestamp, false, &len);
+	ck_assert (str);
+	ck_assert (strstr (str, "\"cpus\":\"2-3\""));
+	g_free (str);
+	config.state.cpus[0] = '\0';
+
+	str = clr_oci_state_to_string (&config, timestamp, false, &len);
+	ck_assert (str);
+	ck_assert (! strstr (str, "\"image_shared\""));
+	g_free (str);
+
+	config.vm->image_shared = true;
+	str = clr_oci_state_to_string (&config, timestamp, false, &len);
+	ck_assert (str);
+	ck_assert (strstr (str, "\"image_shared\":true"));
+	ck_assert (! strstr (str, "\"initrd_path\""));
+	g_free (str);
+
+	g_strlcpy (config.vm->initrd_path, "/path/to/initrd",
+			sizeof (config.vm->initrd_path));
+	str = clr_oci_state_to_string (&config, timestamp, false, &len);
+	ck_assert (str);
+	ck_assert (strstr (str, "\"initrd_path\":\"/path/to/initrd\""));
+	g_free (str);
+	config.vm->initrd_path[0] = '\0';
+	config.vm->image_shared = false;
+
 	ck_assert (clr_oci_state_file_create (&config, timestamp));
 
 	ret = g_file_test (config.state.state_file_path,
@@ -0,0 +1,243 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+#include <glib.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/stats.h"
+
+gboolean clr_oci_stats_parse_stat (const gchar *buf, gchar **comm,
+		guint64 *utime, guint64 *stime);
+gint clr_oci_stats_vcpu_index (const gchar *comm);
+gboolean clr_oci_stats_parse_memory (const gchar *buf,
+		struct clr_oci_stats_memory *mem);
+void clr_oci_stats_balloon_add (JsonObject *stats,
+		JsonObject *guest_stats);
+
+START_TEST(test_clr_oci_stats_parse_stat) {
+	gchar *comm = NULL;
+	guint64 utime = 0;
+	guint64 stime = 0;
+
+	ck_assert (! clr_oci_stats_parse_stat (NULL, NULL, &utime, &stime));
+	ck_assert (! clr_oci_stats_parse_stat ("", NULL, &utime, &stime));
+	ck_assert (! clr_oci_stats_parse_stat ("1 (qemu) S 1 2",
+				NULL, &utime, &stime));
+
+	ck_assert (clr_oci_stats_parse_stat ("1234 (qemu-system-x86) S "
+				"1 1234 1234 0 -1 4194624 100 0 0 0 "
+				"250 75 0 0 20 0 4 0 100",
+				&comm, &utime, &stime));
+	ck_assert_str_eq (comm, "qemu-system-x86");
+	ck_assert (utime == 250);
+	ck_assert (stime == 75);
+	g_free (comm);
+
+	/* names may contain spaces and parentheses */
+	ck_assert (clr_oci_stats_parse_stat ("1240 (CPU 1/KVM) R "
+				"1 1234 1234 0 -1 4194624 0 0 0 0 "
+				"9 3 0 0 20 0 4 0 100",
+				&comm, &utime, &stime));
+	ck_assert_str_eq (comm, "CPU 1/KVM");
+	ck_assert (utime == 9);
+	ck_assert (stime == 3);
+	g_free (comm);
+
+	ck_assert (clr_oci_stats_parse_stat ("7 (a) b)) S "
+				"1 1 1 0 -1 0 0 0 0 0 "
+				"1 2 0 0 20 0 1 0 100",
+				&comm, &utime, &stime));
+	ck_assert_str_eq (comm, "a) b)");
+	ck_assert (utime == 1);
+	ck_assert (stime == 2);
+	g_free (comm);
+} END_TEST
+
+START_TEST(test_clr_oci_stats_vcpu_index) {
+	ck_assert (clr_oci_stats_vcpu_index (NULL) == -1);
+	ck_assert (clr_oci_stats_vcpu_index ("") == -1);
+	ck_assert (clr_oci_stats_vcpu_index ("qemu-system-x86") == -1);
+	ck_assert (clr_oci_stats_vcpu_index ("CPU ") == -1);
+	ck_assert (clr_oci_stats_vcpu_index ("CPU x/KVM") == -1);
+	ck_assert (clr_oci_stats_vcpu_index ("CPU 1") == -1);
+
+	ck_assert (clr_oci_stats_vcpu_index ("CPU 0/KVM") == 0);
+	ck_assert (clr_oci_stats_vcpu_index ("CPU 17/KVM") == 17);
+	ck_assert (clr_oci_stats_vcpu_index ("CPU 3/TCG") == 3);
+} END_TEST
+
+START_TEST(test_clr_oci_stats_parse_memory) {
+	struct clr_oci_stats_memory mem;
+
+	ck_assert (! clr_oci_stats_parse_memory (NULL, &mem));
+	ck_assert (! clr_oci_stats_parse_memory ("", &mem));
+	ck_assert (! clr_oci_stats_parse_memory ("Pss: 10 kB\n", &mem));
+
+	/* smaps_rollup */
+	ck_assert (clr_oci_stats_parse_memory (
+				"00400000-7ffd1234f000 ---p 00000000 00:00 0 "
+				"[rollup]\n"
+				"Rss:              204800 kB\n"
+				"Pss:              102400 kB\n"
+				"Pss_Anon:          51200 kB\n"
+				"Swap:                 16 kB\n"
+				"SwapPss:               8 kB\n",
+				&mem));
+	ck_assert (mem.rss == 204800 * 1024);
+	ck_assert (mem.pss == 102400 * 1024);
+	ck_assert (mem.swap == 16 * 1024);
+
+	/* status */
+	ck_assert (clr_oci_stats_parse_memory (
+				"Name:\tqemu-system-x86\n"
+				"VmHWM:\t  300000 kB\n"
+				"VmRSS:\t  204800 kB\n"
+				"VmSwap:\t       0 kB\n",
+				&mem));
+	ck_assert (mem.rss == 204800 * 1024);
+	ck_assert (mem.pss == 0);
+	ck_assert (mem.swap == 0);
+} END_TEST
+
+START_TEST(test_clr_oci_stats_balloon_add) {
+	JsonObject *stats = json_object_new ();
+	JsonObject *guest_stats = json_object_new ();
+
+	json_object_set_int_member (guest_stats, "stat-free-memory", 1024);
+	json_object_set_int_member (guest_stats, "stat-total-memory", 4096);
+	json_object_set_int_member (guest_stats, "stat-swap-in", -1);
+
+	clr_oci_stats_balloon_add (NULL, guest_stats);
+	clr_oci_stats_balloon_add (stats, NULL);
+	ck_assert (json_object_get_size (stats) == 0);
+
+	clr_oci_stats_balloon_add (stats, guest_stats);
+	ck_assert (json_object_get_size (stats) == 2);
+	ck_assert (json_object_get_int_member (stats,
+				"guest_free_memory") == 1024);
+	ck_assert (json_object_get_int_member (stats,
+				"guest_total_memory") == 4096);
+
+	/* unsupported by the guest */
+	ck_assert (! json_object_has_member (stats, "guest_swap_in"));
+
+	json_object_unref (stats);
+	json_object_unref (guest_stats);
+} END_TEST
+
+START_TEST(test_clr_oci_stats_sample) {
+	struct clr_oci_stats_sampler *sampler;
+	JsonObject *resources;
+	JsonObject *cpu_stats;
+	JsonObject *cpu_usage;
+	JsonObject *memory_stats;
+	JsonObject *usage;
+	gint i;
+
+	ck_assert (! clr_oci_stats_sampler_new (0, "/foo", 0));
+	ck_assert (! clr_oci_stats_sampler_new (getpid (), NULL, 0));
+	ck_assert (! clr_oci_stats_sample (NULL));
+	clr_oci_stats_sampler_free (NULL);
+
+	sampler = clr_oci_stats_sampler_new (getpid (), "/foo", 1);
+	ck_assert (sampler);
+
+	/* no hypervisor to query */
+	sampler->balloon = false;
+
+	/* the same files are re-read each time */
+	for (i = 0; i < 3; i++) {
+		resources = clr_oci_stats_sample (sampler);
+		ck_assert (resources);
+
+		cpu_stats = json_object_get_object_member (resources,
+				"cpu_stats");
+		ck_assert (cpu_stats);
+		cpu_usage = json_object_get_object_member (cpu_stats,
+				"cpu_usage");
+		ck_assert (cpu_usage);
+		ck_assert (json_object_get_int_member (cpu_usage,
+					"total_usage") >= 0);
+
+		/* this process has no vCPU threads */
+		ck_assert (json_array_get_length (
+					json_object_get_array_member (cpu_usage,
+						"percpu_usage")) == 0);
+
+		memory_stats = json_object_get_object_member (resources,
+				"memory_stats");
+		ck_assert (memory_stats);
+		usage = json_object_get_object_member (memory_stats, "usage");
+		ck_assert (usage);
+		ck_assert (json_object_get_int_member (usage, "usage") > 0);
+		ck_assert (json_object_get_int_member (usage, "max_usage")
+				>= json_object_get_int_member (usage, "usage"));
+
+		json_object_unref (resources);
+	}
+
+	/* the main thread is being tracked */
+	ck_assert (g_hash_table_size (sampler->tasks) >= 1);
+
+	clr_oci_stats_sampler_free (sampler);
+} END_TEST
+
+Suite* make_stats_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_stats_parse_stat, s);
+	ADD_TEST(test_clr_oci_stats_vcpu_index, s);
+	ADD_TEST(test_clr_oci_stats_parse_memory, s);
+	ADD_TEST(test_clr_oci_stats_balloon_add, s);
+	ADD_TEST(test_clr_oci_stats_sample, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("stats_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_stats_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -134,6 +134,13 @@ void test_spec_handler(struct spec_handler* handler, struct spec_handler_test* t
 		close(fd);
 	}
 
+	fd = g_creat("CONTAINER-INITRD",0755);
+	if (fd < 0) {
+		g_critical ("failed to create file CONTAINER-INITRD");
+	} else {
+		close(fd);
+	}
+
 	fd = g_creat("CLEAR-CONTAINERS.img",0755);
 	if (fd < 0) {
 		g_critical ("failed to create file CLEAR-CONTAINERS.img");
@@ -162,6 +169,10 @@ void test_spec_handler(struct spec_handler* handler, struct spec_handler_test* t
 		g_critical ("failed to remove file CONTAINER-KERNEL");
 	}
 
+	if (g_remove("CONTAINER-INITRD") < 0) {
+		g_critical ("failed to remove file CONTAINER-INITRD");
+	}
+
 	if (g_remove ("CLEAR-CONTAINERS.img") < 0) {
 		g_critical ("failed to remove file CLEAR-CONTAINERS.img");
 	}
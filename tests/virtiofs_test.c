@@ -0,0 +1,231 @@
+/*
+ * This file is part of clr-oci-runtime.
+ * 
+ * Copyright (C) 2016 Intel Corporation
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "../src/logging.h"
+#include "../src/oci.h"
+#include "../src/oci-config.h"
+#include "../src/annotation.h"
+#include "../src/virtiofs.h"
+
+START_TEST(test_clr_oci_rootfs_transport_from_name) {
+	enum clr_oci_rootfs_transport transport = CLR_OCI_ROOTFS_9P;
+
+	ck_assert (! clr_oci_rootfs_transport_from_name (NULL, NULL));
+	ck_assert (! clr_oci_rootfs_transport_from_name ("9p", NULL));
+	ck_assert (! clr_oci_rootfs_transport_from_name (NULL,
+				&transport));
+
+	ck_assert (! clr_oci_rootfs_transport_from_name ("", &transport));
+	ck_assert (! clr_oci_rootfs_transport_from_name ("virtiofs",
+				&transport));
+	ck_assert (transport == CLR_OCI_ROOTFS_9P);
+
+	ck_assert (clr_oci_rootfs_transport_from_name ("virtio-fs",
+				&transport));
+	ck_assert (transport == CLR_OCI_ROOTFS_VIRTIO_FS);
+
+	ck_assert (clr_oci_rootfs_transport_from_name ("9p", &transport));
+	ck_assert (transport == CLR_OCI_ROOTFS_9P);
+} END_TEST
+
+START_TEST(test_clr_oci_rootfs_transport_get) {
+	struct clr_oci_config      config = { { 0 } };
+	struct oci_cfg_annotation *a;
+
+	ck_assert (clr_oci_rootfs_transport_get (NULL)
+			== CLR_OCI_ROOTFS_9P);
+
+	/* no vm configuration */
+	ck_assert (clr_oci_rootfs_transport_get (&config)
+			== CLR_OCI_ROOTFS_9P);
+
+	config.vm = g_new0 (struct clr_oci_vm_cfg, 1);
+	ck_assert (config.vm);
+
+	ck_assert (clr_oci_rootfs_transport_get (&config)
+			== CLR_OCI_ROOTFS_9P);
+
+	config.vm->rootfs_transport = CLR_OCI_ROOTFS_VIRTIO_FS;
+	ck_assert (clr_oci_rootfs_transport_get (&config)
+			== CLR_OCI_ROOTFS_VIRTIO_FS);
+
+	/* the annotation overrides the vm configuration */
+	a = g_new0 (struct oci_cfg_annotation, 1);
+	a->key = g_strdup (CLR_OCI_ANNOTATION_ROOTFS_TRANSPORT);
+	a->value = g_strdup ("9p");
+	config.oci.annotations = g_slist_prepend (config.oci.annotations, a);
+
+	ck_assert (clr_oci_rootfs_transport_get (&config)
+			== CLR_OCI_ROOTFS_9P);
+
+	/* an invalid annotation is ignored */
+	g_free (a->value);
+	a->value = g_strdup ("nfs");
+
+	ck_assert (clr_oci_rootfs_transport_get (&config)
+			== CLR_OCI_ROOTFS_VIRTIO_FS);
+
+	clr_oci_config_free (&config);
+} END_TEST
+
+START_TEST(test_clr_oci_virtiofsd_start) {
+	struct clr_oci_config  config = { { 0 } };
+	g_autofree gchar      *tmpdir = NULL;
+	g_autofree gchar      *socket_path = NULL;
+	g_autofree gchar      *daemon = NULL;
+	int                    status = 0;
+
+	ck_assert (! clr_oci_virtiofsd_start (NULL));
+
+	/* no vm configuration */
+	ck_assert (! clr_oci_virtiofsd_start (&config));
+
+	config.vm = g_new0 (struct clr_oci_vm_cfg, 1);
+	ck_assert (config.vm);
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	g_strlcpy (config.state.runtime_path, tmpdir,
+			sizeof (config.state.runtime_path));
+	g_strlcpy (config.oci.root.path, tmpdir,
+			sizeof (config.oci.root.path));
+
+	socket_path = g_build_path ("/", tmpdir,
+			CLR_OCI_VIRTIOFS_SOCKET, NULL);
+
+	/* nothing to do for 9p */
+	ck_assert (clr_oci_virtiofsd_start (&config));
+	ck_assert (! config.state.virtiofsd_pid);
+	ck_assert (! g_file_test (socket_path, G_FILE_TEST_EXISTS));
+
+	config.vm->rootfs_transport = CLR_OCI_ROOTFS_VIRTIO_FS;
+
+	/* daemon does not exist */
+	g_strlcpy (config.vm->virtiofsd_path,
+			"/this/daemon/must/not/exist",
+			sizeof (config.vm->virtiofsd_path));
+
+	ck_assert (! clr_oci_virtiofsd_start (&config));
+	ck_assert (! config.state.virtiofsd_pid);
+	ck_assert (! g_file_test (socket_path, G_FILE_TEST_EXISTS));
+
+	/* use a daemon which ignores its arguments */
+	daemon = g_find_program_in_path ("true");
+	ck_assert (daemon);
+	g_strlcpy (config.vm->virtiofsd_path, daemon,
+			sizeof (config.vm->virtiofsd_path));
+
+	ck_assert (clr_oci_virtiofsd_start (&config));
+	ck_assert (config.state.virtiofsd_pid > 0);
+	ck_assert (g_file_test (socket_path, G_FILE_TEST_EXISTS));
+
+	ck_assert (waitpid (config.state.virtiofsd_pid, &status, 0)
+			== config.state.virtiofsd_pid);
+	ck_assert (WIFEXITED (status));
+	ck_assert (! WEXITSTATUS (status));
+
+	ck_assert (! g_remove (socket_path));
+	ck_assert (! g_remove (tmpdir));
+
+	config.state.virtiofsd_pid = 0;
+	clr_oci_config_free (&config);
+} END_TEST
+
+START_TEST(test_clr_oci_virtiofsd_stop) {
+	struct clr_oci_config  config = { { 0 } };
+	GPid                   pid;
+	int                    status = 0;
+
+	ck_assert (! clr_oci_virtiofsd_stop (NULL));
+
+	/* no daemon */
+	ck_assert (clr_oci_virtiofsd_stop (&config));
+
+	pid = fork ();
+	ck_assert (pid >= 0);
+
+	if (! pid) {
+		pause ();
+		_exit (EXIT_SUCCESS);
+	}
+
+	config.state.virtiofsd_pid = pid;
+
+	ck_assert (clr_oci_virtiofsd_stop (&config));
+	ck_assert (! config.state.virtiofsd_pid);
+
+	ck_assert (waitpid (pid, &status, 0) == pid);
+	ck_assert (WIFSIGNALED (status));
+	ck_assert (WTERMSIG (status) == SIGTERM);
+
+	/* the daemon has already exited */
+	config.state.virtiofsd_pid = pid;
+
+	ck_assert (clr_oci_virtiofsd_stop (&config));
+	ck_assert (! config.state.virtiofsd_pid);
+} END_TEST
+
+Suite* make_virtiofs_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_clr_oci_rootfs_transport_from_name, s);
+	ADD_TEST(test_clr_oci_rootfs_transport_get, s);
+	ADD_TEST(test_clr_oci_virtiofsd_start, s);
+	ADD_TEST(test_clr_oci_virtiofsd_stop, s);
+
+	return s;
+}
+
+gboolean enable_debug = true;
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct clr_log_options options = { 0 };
+
+	options.use_json = false;
+	options.filename = g_strdup ("virtiofs_test_debug.log");
+	(void)clr_oci_log_init(&options);
+
+	s = make_virtiofs_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	clr_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}